@@ -5,6 +5,8 @@ REM ============================================
 
 set CXX=g++
 set CXXFLAGS=-std=c++11 -Wall -Wextra -O2
+REM runtime.cpp usa std::thread: necesita -pthread y un MinGW con hilos posix
+set RUNTIME_LIBS=-pthread -lgdi32 -luser32
 
 REM Directorios
 set SRCDIR=src
@@ -68,6 +70,7 @@ echo ============================================
 echo   MOTOR DE LADRILLOS - INFORMACION
 echo ============================================
 echo Compilador: %CXX% %CXXFLAGS%
+echo Runtime: %RUNTIME_LIBS% (MinGW con modelo de hilos posix)
 echo Directorios:
 echo   - Fuentes: %SRCDIR%\
 echo   - Build: %BUILDDIR%\
@@ -110,8 +113,14 @@ echo Compilador .brik listo: %COMPILADOR_EXE%
 goto :eof
 
 :runtime
+REM Los MinGW con modelo de hilos win32 anteriores a GCC 13 no traen std::thread
+%CXX% -v 2>&1 | findstr /C:"Thread model: win32" >nul
+if not errorlevel 1 (
+    echo AVISO: %CXX% usa el modelo de hilos win32; si falta std::thread instala
+    echo        un MinGW-w64 con hilos posix ^(p. ej. el de MSYS2^)
+)
 echo [CC] Compilando runtime.cpp (con GDI - Win32)...
-%CXX% %CXXFLAGS% -DUSE_GDI -o %RUNTIME_EXE% %RUNTIME_SRC% -lgdi32 -luser32
+%CXX% %CXXFLAGS% -DUSE_GDI -o %RUNTIME_EXE% %RUNTIME_SRC% %RUNTIME_LIBS%
 if errorlevel 1 (
     echo ERROR: Fallo al compilar runtime.cpp
     goto end
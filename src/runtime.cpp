@@ -10,28 +10,162 @@
 //   - Motor de Snake con crecimiento y colisiones
 //   - Renderizado optimizado sin parpadeo
 //   - Soporte para modo consola (texto) y modo gráfico (ventana GDI)
-//   - Compatible con Windows XP (usa GetTickCount en lugar de <chrono>)
+//   - Reloj de juego en ms con GetTickCount; lotes, arena y lectura de
+//     teclado usan los hilos de C++11 (<thread>, <mutex>, <chrono>)
+//   - Modo headless (--headless) para simular sin render a máxima velocidad
+//   - Entorno vectorial (--entorno) que avanza miles de tableros por paso
 //
-// Compilación:
-//   Modo consola:     g++ -o runtime runtime.cpp
-//   Modo gráfico GDI: g++ -DUSE_GDI -o runtime runtime.cpp -lgdi32 -luser32
+// Compilación (C++11 con hilos; en MinGW hace falta el modelo de hilos
+// posix, el modelo win32 no trae std::thread):
+//   Modo consola:     g++ -std=c++11 -pthread -o runtime runtime.cpp
+//   Modo gráfico GDI: g++ -std=c++11 -pthread -DUSE_GDI -o runtime runtime.cpp -lgdi32 -luser32
+//   Linux/POSIX:      g++ -std=c++11 -pthread -o runtime runtime.cpp   (consola y headless)
 //
 // ============================================================================
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
 #include <ctime>
-#include <conio.h>
 #include <cstdlib>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <sstream>
+#include <stdint.h>
 #include <string>
+#include <thread>
 #include <vector>
+
+#ifdef _WIN32
+#include <conio.h>
 #include <windows.h>
+#else
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+// SSE2 es la base de x86-64; en otras arquitecturas se usa el camino escalar
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RUNTIME_SSE2 1
+#endif
 
 using namespace std;
 
+// ============================================================================
+// PORTABILIDAD POSIX
+// ============================================================================
+// Fuera de Windows se proveen equivalentes de las pocas funciones Win32 que
+// usan los motores de consola (reloj, espera y teclado sin bloqueo). El modo
+// gráfico GDI sigue siendo exclusivo de Windows.
+// ============================================================================
+#ifndef _WIN32
+#ifdef USE_GDI
+#error "USE_GDI requiere Windows (gdi32/user32)"
+#endif
+
+typedef unsigned long  DWORD;
+typedef unsigned short WORD;
+
+// Milisegundos de un reloj monótono, como GetTickCount
+static DWORD GetTickCount() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<DWORD>(ts.tv_sec * 1000UL + ts.tv_nsec / 1000000UL);
+}
+
+// Pone la terminal en modo sin eco ni búfer de línea mientras dura el objeto
+class TerminalCruda {
+private:
+    struct termios original;
+    bool activa;
+public:
+    TerminalCruda() : activa(false) {
+        if (isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &original) == 0) {
+            struct termios cruda = original;
+            cruda.c_lflag &= ~(ICANON | ECHO);
+            cruda.c_cc[VMIN]  = 1;
+            cruda.c_cc[VTIME] = 0;
+            activa = (tcsetattr(STDIN_FILENO, TCSANOW, &cruda) == 0);
+        }
+    }
+    ~TerminalCruda() {
+        if (activa) tcsetattr(STDIN_FILENO, TCSANOW, &original);
+    }
+};
+
+// _kbhit, _getch y esperarTecla no tocan el modo de la terminal: cada tecla
+// llega sola y sin eco mientras haya una TerminalCruda (la de EntradaConsola)
+static int _kbhit() {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    struct timeval tv = { 0, 0 };
+    return select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0;
+}
+
+static int _getch() {
+    unsigned char c = 0;
+    return (read(STDIN_FILENO, &c, 1) == 1) ? c : -1;
+}
+
+// Duerme hasta 'ms' milisegundos o hasta que llegue una tecla
+static bool esperarTecla(DWORD ms) {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    struct timeval tv = { static_cast<long>(ms / 1000), static_cast<long>(ms % 1000) * 1000 };
+    return select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0;
+}
+#else
+// Duerme hasta 'ms' milisegundos o hasta que llegue una tecla. Los registros
+// que _kbhit no cuenta (soltar teclas, foco, ratón) se descartan para que el
+// manejador de entrada no quede señalado y la espera no se vuelva activa.
+static bool esperarTecla(DWORD ms) {
+    HANDLE entrada = GetStdHandle(STD_INPUT_HANDLE);
+    DWORD  limite  = GetTickCount() + ms;
+    for (;;) {
+        INPUT_RECORD registro;
+        DWORD        leidos = 0;
+        while (PeekConsoleInput(entrada, &registro, 1, &leidos) && leidos == 1 && !_kbhit()) {
+            ReadConsoleInput(entrada, &registro, 1, &leidos);
+        }
+        if (_kbhit()) return true;
+        DWORD ahora = GetTickCount();
+        if (static_cast<long>(limite - ahora) <= 0) return false;
+        if (WaitForSingleObject(entrada, limite - ahora) == WAIT_TIMEOUT) return false;
+    }
+}
+#endif
+
+// Columnas y filas visibles de la terminal (80x25 si no se pueden saber)
+static void tamanioTerminal(int& columnas, int& filas) {
+    columnas = 80;
+    filas    = 25;
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+        columnas = info.srWindow.Right - info.srWindow.Left + 1;
+        filas    = info.srWindow.Bottom - info.srWindow.Top + 1;
+    }
+#else
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0 && ws.ws_row > 0) {
+        columnas = ws.ws_col;
+        filas    = ws.ws_row;
+    }
+#endif
+}
+
 // ============================================================================
 // CONFIGURACIÓN Y CONSTANTES GLOBALES
 // ============================================================================
@@ -45,6 +179,9 @@ enum ModoRenderizado {
 // Variable global que almacena el modo de renderizado seleccionado
 ModoRenderizado modoActual = MODO_CONSOLA;
 
+// Semilla recibida por línea de comandos (--semilla N); 0 = no indicada
+unsigned int semillaLineaComandos = 0;
+
 
 // ============================================================================
 // CLASE: ColorConsola
@@ -54,18 +191,22 @@ ModoRenderizado modoActual = MODO_CONSOLA;
 // ============================================================================
 class ColorConsola {
 private:
+#ifdef _WIN32
     HANDLE hConsole;      // Handle de la consola de Windows
+#endif
     WORD   color_original; // Color original que se restaurará al destruirse
 
 public:
     /**
      * Constructor: obtiene el handle de la consola y guarda el color actual.
      */
-    ColorConsola() {
+    ColorConsola() : color_original(0) {
+#ifdef _WIN32
         hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
         CONSOLE_SCREEN_BUFFER_INFO info;
         GetConsoleScreenBufferInfo(hConsole, &info);
         color_original = info.wAttributes;
+#endif
     }
     
     /**
@@ -80,14 +221,20 @@ public:
      * @param codigo_color Código de color de Windows (WORD)
      */
     void establecerColor(int codigo_color) {
+#ifdef _WIN32
         SetConsoleTextAttribute(hConsole, codigo_color);
+#else
+        (void)codigo_color;  // En POSIX los renderizadores ya emiten ANSI
+#endif
     }
 
     /**
      * Restaura el color original de la consola.
      */
     void restaurarColor() {
+#ifdef _WIN32
         SetConsoleTextAttribute(hConsole, color_original);
+#endif
     }
 
    
@@ -120,6 +267,101 @@ public:
     }
 };
 
+// ============================================================================
+// CLASE: LienzoConsola
+// ============================================================================
+// Pantalla de consola que solo reescribe lo que cambió desde el cuadro
+// anterior. El área de celdas guarda por casilla un carácter y un índice de
+// la paleta de colores ANSI; al presentar se recorre comparando con lo ya
+// mostrado y solo se emite (con su posición y, si cambia, su color) lo que
+// es distinto. Las líneas de texto se comparan enteras por fila.
+// Cambiar el tamaño o invalidar() fuerza a redibujar la pantalla entera.
+// ============================================================================
+class LienzoConsola {
+private:
+    int              fila_celdas;     // Fila de pantalla (desde 0) de la primera celda
+    int              columna_celdas;  // Columna de pantalla (desde 0) de la primera celda
+    int              ancho;
+    int              alto;
+    vector<uint32_t> celdas;          // (color << 8) | carácter del cuadro en preparación
+    vector<uint32_t> mostradas;       // Lo que hay ahora en pantalla
+    vector<string>   lineas;          // Texto por fila de pantalla
+    vector<string>   lineas_mostradas;
+    bool             completo;        // Hay que redibujar todo
+
+    static void irA(string& out, int fila, int columna) {
+        char pos[32];
+        sprintf(pos, "\033[%d;%dH", fila + 1, columna + 1);
+        out += pos;
+    }
+public:
+    LienzoConsola() : fila_celdas(0), columna_celdas(0), ancho(0), alto(0), completo(true) {}
+
+    // Sitúa el área de celdas; si cambia algo, el próximo cuadro es completo
+    void preparar(int fila, int columna, int ancho_, int alto_) {
+        if (fila == fila_celdas && columna == columna_celdas && ancho_ == ancho && alto_ == alto) return;
+        fila_celdas    = fila;
+        columna_celdas = columna;
+        ancho          = ancho_;
+        alto           = alto_;
+        celdas.assign(static_cast<size_t>(ancho) * alto, 0);
+        mostradas.assign(celdas.size(), 0);
+        completo = true;
+    }
+
+    void invalidar() { completo = true; }
+
+    void celda(int x, int y, char ch, int color) {
+        celdas[static_cast<size_t>(y) * ancho + x] = (static_cast<uint32_t>(color) << 8) | static_cast<unsigned char>(ch);
+    }
+
+    // Texto de una fila de pantalla (puede llevar secuencias de color)
+    void linea(int fila, const string& texto) {
+        if (fila >= static_cast<int>(lineas.size())) {
+            lineas.resize(fila + 1);
+            lineas_mostradas.resize(fila + 1);
+        }
+        lineas[fila] = texto;
+    }
+
+    // Escribe en 'salida' solo las diferencias con lo que ya está en pantalla
+    void presentar(ostream& salida, const vector<string>& paleta) {
+        string out;
+        if (completo) out += "\033[2J";
+        for (size_t f = 0; f < lineas.size(); ++f) {
+            if (!completo && lineas[f] == lineas_mostradas[f]) continue;
+            irA(out, static_cast<int>(f), 0);
+            out += lineas[f];
+            out += "\033[0m\033[K";
+            lineas_mostradas[f] = lineas[f];
+        }
+        int color_actual = -1;
+        for (int y = 0; y < alto; ++y) {
+            int siguiente_x = -1;  // Columna donde quedó el cursor en esta fila
+            for (int x = 0; x < ancho; ++x) {
+                size_t   i = static_cast<size_t>(y) * ancho + x;
+                uint32_t c = celdas[i];
+                if (!completo && c == mostradas[i]) continue;
+                mostradas[i] = c;
+                if (x != siguiente_x) irA(out, fila_celdas + y, columna_celdas + x);
+                int color = static_cast<int>(c >> 8);
+                if (color != color_actual) {
+                    out += paleta[color];
+                    color_actual = color;
+                }
+                out += static_cast<char>(c & 0xFF);
+                siguiente_x = x + 1;
+            }
+        }
+        out += "\033[0m";
+        // El cursor queda debajo de todo
+        irA(out, max(fila_celdas + alto, static_cast<int>(lineas.size())), 0);
+        completo = false;
+        salida << out;
+        salida.flush();
+    }
+};
+
 // ============================================================================
 // SINGLETON PARA GESTIÓN DE COLORES EN CONSOLA
 // ============================================================================
@@ -177,6 +419,10 @@ private:
             integers["tiempo_fijacion_pieza"] = extraerInt(linea);
         } else if (linea.find("\"tiempo_antes_de_bloquear\":") != string::npos) {
             integers["tiempo_antes_de_bloquear"] = extraerInt(linea);
+        } else if (linea.find("\"retardo_repeticion\":") != string::npos) {
+            integers["retardo_repeticion"] = extraerInt(linea);
+        } else if (linea.find("\"intervalo_repeticion\":") != string::npos) {
+            integers["intervalo_repeticion"] = extraerInt(linea);
         } else if (linea.find("\"aceleracion_por_nivel\":") != string::npos) {
             integers["aceleracion_por_nivel"] = extraerInt(linea);
         } else if (linea.find("\"velocidad_maxima\":") != string::npos) {
@@ -190,6 +436,12 @@ private:
             integers["tamanio_celda"] = extraerInt(linea);
         } else if (linea.find("\"nivel_inicial\":") != string::npos) {
             integers["nivel_inicial"] = extraerInt(linea);
+        } else if (linea.find("\"semilla\":") != string::npos) {
+            integers["semilla"] = extraerInt(linea);
+        } else if (linea.find("\"vista_previa\":") != string::npos) {
+            integers["vista_previa"] = extraerInt(linea);
+        } else if (linea.find("\"generador_piezas\":") != string::npos) {
+            strings["generador_piezas"] = extraerString(linea);
         } else if (linea.find("\"puntos_linea_simple\":") != string::npos) {
             integers["puntos_linea_simple"] = extraerInt(linea);
         } else if (linea.find("\"puntos_linea_doble\":") != string::npos) {
@@ -249,6 +501,9 @@ public:
     map<string, int>            integers;
     map<string, bool>           booleans;
     map<string, vector<string> > arrays;
+    bool                        cargado;  // true si ya se leyó un archivo AST
+
+    SnakeAST() : cargado(false) {}
 
     bool cargarDesdeAST(const string& archivo) {
         ifstream file(archivo.c_str());
@@ -259,6 +514,7 @@ public:
         while (getline(file, linea)) {
             procesarLinea(linea);
         }
+        cargado = true;
         return true;
     }
 private:
@@ -277,6 +533,10 @@ private:
             integers["puntos_por_fruta"] = extraerInt(linea);
         } else if (linea.find("\"longitud_inicial\":") != string::npos) {
             integers["longitud_inicial"] = extraerInt(linea);
+        } else if (linea.find("\"semilla\":") != string::npos) {
+            integers["semilla"] = extraerInt(linea);
+        } else if (linea.find("\"respawn_fruta_ms\":") != string::npos) {
+            integers["respawn_fruta_ms"] = extraerInt(linea);
         } else if (linea.find("\"terminar_al_chocar_borde\":") != string::npos) {
             booleans["terminar_al_chocar_borde"] = (linea.find("true") != string::npos);
         } else if (linea.find("\"terminar_al_chocar_cuerpo\":") != string::npos) {
@@ -287,6 +547,15 @@ private:
             strings["color_fruta"] = extraerString(linea);
         } else if (linea.find("\"frutas_disponibles\":") != string::npos) {
             arrays["frutas_disponibles"] = extraerArray(linea);
+        } else if (linea.find("\"frutas_simultaneas\":") != string::npos) {
+            integers["frutas_simultaneas"] = extraerInt(linea);
+        } else if (linea.find("\"obstaculos_aleatorios\":") != string::npos) {
+            integers["obstaculos_aleatorios"] = extraerInt(linea);
+        } else if (linea.find("\"obstaculos_fijos\":") != string::npos) {
+            // [[x, y], ...] se guarda aplanado: x0, y0, x1, y1, ...
+            arrays["obstaculos_fijos"] = extraerEnteros(linea);
+        } else if (linea.find("\"bordes_solidos\":") != string::npos) {
+            booleans["bordes_solidos"] = (linea.find("true") != string::npos);
         } else if (linea.find("\"puntos_") != string::npos && linea.find(":") != string::npos) {
             // Capturar dinámicamente puntos_manzana, puntos_cereza, etc.
             size_t inicio_clave = linea.find("\"puntos_") + 1;
@@ -295,6 +564,15 @@ private:
                 string clave = linea.substr(inicio_clave, fin_clave - inicio_clave);
                 integers[clave] = extraerInt(linea);
             }
+        } else if ((linea.find("\"crecimiento_") != string::npos || linea.find("\"velocidad_") != string::npos)
+                   && linea.find(":") != string::npos) {
+            // Efectos por fruta (crecimiento_uva, velocidad_banana) y límites de velocidad
+            size_t inicio_clave = linea.find("\"") + 1;
+            size_t fin_clave = linea.find("\"", inicio_clave);
+            if (fin_clave != string::npos) {
+                string clave = linea.substr(inicio_clave, fin_clave - inicio_clave);
+                integers[clave] = extraerInt(linea);
+            }
         } else if (linea.find("\"color_") != string::npos && linea.find(":") != string::npos && linea.find("color_fruta") == string::npos) {
             // Capturar dinámicamente color_manzana, color_cereza, etc. (excluyendo color_fruta)
             size_t inicio_clave = linea.find("\"color_") + 1;
@@ -327,6 +605,22 @@ private:
         num_str.erase(num_str.find_last_not_of(" \t,") + 1);
         return atoi(num_str.c_str());
     }
+    // Todos los enteros que aparecen tras ':' (listas anidadas incluidas)
+    vector<string> extraerEnteros(const string& linea) {
+        vector<string> resultado;
+        size_t i = linea.find(":");
+        if (i == string::npos) return resultado;
+        while (i < linea.size()) {
+            size_t a = linea.find_first_of("-0123456789", i);
+            if (a == string::npos) break;
+            size_t b = linea.find_first_not_of("0123456789", a + 1);
+            if (b == string::npos) b = linea.size();
+            if (linea[a] != '-' || b > a + 1) resultado.push_back(linea.substr(a, b - a));
+            i = b;
+        }
+        return resultado;
+    }
+
     vector<string> extraerArray(const string& linea) {
         vector<string> resultado;
         size_t inicio = linea.find("[");
@@ -347,138 +641,1132 @@ private:
     }
 };
 
-// ================================================================
-// Tetris
-// ================================================================
-class ConfigTetris {
+// ============================================================================
+// CLASE: GeneradorAleatorio
+// ============================================================================
+// Generador pseudoaleatorio xoshiro128** con estado propio por motor.
+// Sustituye a srand()/rand(): cada instancia tiene su propio estado, de modo
+// que la misma semilla con las mismas entradas reproduce la misma partida y
+// varios motores pueden ejecutarse a la vez sin compartir estado oculto.
+// ============================================================================
+class GeneradorAleatorio {
+private:
+    uint32_t estado[4];
+
+    static uint32_t rotl(uint32_t x, int k) {
+        return (x << k) | (x >> (32 - k));
+    }
 public:
-    map<string, int> colores;  // Colores para consola (códigos)
-    map<string, vector<int> > colores_rgb;  // Colores RGB para renderizado gráfico [R, G, B]
-    map<string, string> pieza_a_color;  // Mapeo de tipo de pieza a nombre de color (ej: "I" -> "cian")
-    map<string, vector<vector<vector<int> > > > rotaciones_piezas;
-    vector<string> tipos_piezas;
-    string nombre_juego;
-    int ancho_tablero;
-    int alto_tablero;
-    int velocidad_inicial;
-    // Physics and gameplay params read from AST
-    int velocidad_caida_rapida;
-    int tiempo_fijacion_pieza;
-    int tiempo_antes_de_bloquear;
-    int aceleracion_por_nivel;
-    int velocidad_maxima;
-    bool gravedad_automatica;
-    int lineas_para_nivel;
-    int tamanio_celda;
-    int nivel_inicial;
-    int puntos_linea_simple;
-    int puntos_linea_doble;
-    int puntos_linea_triple;
-    int puntos_linea_tetris;
+    explicit GeneradorAleatorio(uint32_t semilla = 1) {
+        sembrar(semilla);
+    }
 
-    ConfigTetris() {
-        cargarDesdeAST();
-        configurarRotacionesHardcoded();
+    // Expande la semilla a los 128 bits de estado con splitmix32
+    void sembrar(uint32_t semilla) {
+        uint32_t z = semilla;
+        for (int i = 0; i < 4; ++i) {
+            z += 0x9E3779B9u;
+            uint32_t t = z;
+            t = (t ^ (t >> 16)) * 0x85EBCA6Bu;
+            t = (t ^ (t >> 13)) * 0xC2B2AE35u;
+            estado[i] = t ^ (t >> 16);
+        }
+    }
+
+    uint32_t siguiente() {
+        uint32_t resultado = rotl(estado[1] * 5, 7) * 9;
+        uint32_t t = estado[1] << 9;
+        estado[2] ^= estado[0];
+        estado[3] ^= estado[1];
+        estado[1] ^= estado[2];
+        estado[0] ^= estado[3];
+        estado[2] ^= t;
+        estado[3] = rotl(estado[3], 11);
+        return resultado;
     }
+
+    // Entero uniforme en [0, n) (reducción por multiplicación, sin módulo)
+    int rango(int n) {
+        if (n <= 0) return 0;
+        return static_cast<int>((static_cast<uint64_t>(siguiente()) * static_cast<uint32_t>(n)) >> 32);
+    }
+};
+
+// Elige la semilla de una partida: línea de comandos, luego .brik, luego reloj.
+static uint32_t resolverSemilla(int semilla_config) {
+    if (semillaLineaComandos != 0) return semillaLineaComandos;
+    if (semilla_config != 0) return static_cast<uint32_t>(semilla_config);
+    uint32_t s = static_cast<uint32_t>(time(NULL)) ^ (static_cast<uint32_t>(GetTickCount()) << 16);
+    return (s != 0) ? s : 1;
+}
+
+// ============================================================================
+// MODO HEADLESS: entrada guionada y resultados de simulación
+// ============================================================================
+// En modo headless los motores de consola no dibujan ni leen el teclado: un
+// reloj virtual avanza un número fijo de milisegundos por tick y las teclas
+// salen de un guion. Sirve para pruebas largas y mediciones de rendimiento.
+// ============================================================================
+
+// Guion de entrada: una tecla por tick, '.' = ninguna; se repite en bucle
+class GuionEntrada {
+private:
+    string teclas;
 public:
-    void printConfig() const {
-        std::cout << "[ConfigTetris] nombre_juego=" << nombre_juego
-                  << " ancho_tablero=" << ancho_tablero
-                  << " alto_tablero=" << alto_tablero
-                  << " tamanio_celda=" << tamanio_celda
-                  << " velocidad_inicial=" << velocidad_inicial
-                  << " aceleracion_por_nivel=" << aceleracion_por_nivel
-                  << " lineas_para_nivel=" << lineas_para_nivel
-                  << " nivel_inicial=" << nivel_inicial
-                  << " puntos_linea_simple=" << puntos_linea_simple
-                  << " puntos_linea_tetris=" << puntos_linea_tetris
-                  << std::endl;
+    explicit GuionEntrada(const string& t = "") : teclas(t) {}
+
+    char tecla(long tick) const {
+        if (teclas.empty()) return 0;
+        char c = teclas[static_cast<size_t>(tick % static_cast<long>(teclas.size()))];
+        return (c == '.') ? 0 : static_cast<char>(tolower(c));
     }
-    
-    // Obtener color RGB de una pieza por su tipo
-    vector<int> obtenerColorRGB(const string& tipo_pieza) const {
-        if (pieza_a_color.count(tipo_pieza)) {
-            string color_nombre = pieza_a_color.find(tipo_pieza)->second;
-            return obtenerColorRGBPorNombre(color_nombre);
+};
+
+struct ResultadoSimulacion {
+    long      ticks;           // Ticks simulados
+    long      partidas;        // Partidas terminadas (cada game over reinicia)
+    long long puntos_totales;  // Suma de puntos de todas las partidas
+    int       mejor_puntaje;   // Mejor puntaje de una partida
+    long long eventos;         // Líneas (Tetris) o frutas (Snake) acumuladas
+    int       puntos_en_curso; // Puntos de la partida sin terminar al final
+
+    ResultadoSimulacion()
+        : ticks(0), partidas(0), puntos_totales(0), mejor_puntaje(0), eventos(0), puntos_en_curso(0) {}
+
+    void cerrarPartida(int puntos, int eventos_partida) {
+        partidas++;
+        puntos_totales += puntos;
+        eventos        += eventos_partida;
+        if (puntos > mejor_puntaje) mejor_puntaje = puntos;
+    }
+};
+
+// Resultado de una sola partida simulada (modo lote)
+static const int NUM_DETALLES_PARTIDA = 8;
+
+struct ResumenPartida {
+    int  puntos;
+    long ticks;      // Duración de la partida en ticks (supervivencia)
+    int  eventos;    // Líneas (Tetris) o frutas (Snake)
+    int  detalle[NUM_DETALLES_PARTIDA];  // contador_linea_* (Tetris) o frutas por tipo de la TablaFrutas (Snake)
+    bool terminada;  // false si se cortó por alcanzar el máximo de ticks
+
+    ResumenPartida() : puntos(0), ticks(0), eventos(0), terminada(false) {
+        for (int i = 0; i < NUM_DETALLES_PARTIDA; ++i) detalle[i] = 0;
+    }
+};
+
+// Opciones de --headless / --lote leídas de la línea de comandos
+struct OpcionesHeadless {
+    string juego;    // "tetris" o "snake"; vacío = modo interactivo
+    long   ticks;    // Ticks totales (headless) o máximo por partida (lote)
+    int    tick_ms;
+    string guion;
+    string bot;      // Política que juega: guion, aleatorio, ...
+    int    profundidad;  // Piezas que mira por delante el bot "haz" de Tetris
+    string grabar;   // Ruta de la repetición a grabar (--grabar); vacía = no grabar
+
+    OpcionesHeadless() : ticks(1000000), tick_ms(16), bot("guion"), profundidad(1) {}
+};
+
+// ============================================================================
+// CLASE: PoolTrabajo
+// ============================================================================
+// Reparte un rango de índices entre varios hilos con robo de trabajo: cada
+// hilo tiene su propia cola de bloques, toma de su extremo y, al vaciarla,
+// roba bloques del extremo opuesto de las colas ajenas. Los hilos se crean
+// una vez, en el constructor, y entre lotes duermen en una variable de
+// condición: paraCada solo los despierta (el bot haz lo llama por cada pieza
+// colocada) y no retorna hasta terminar todo el rango.
+// ============================================================================
+class PoolTrabajo {
+private:
+    struct Bloque {
+        long desde;
+        long hasta;  // exclusivo
+        Bloque(long d = 0, long h = 0) : desde(d), hasta(h) {}
+    };
+
+    struct ColaBloques {
+        std::mutex    cerrojo;
+        deque<Bloque> bloques;
+    };
+
+    int                  hilos;
+    vector<ColaBloques*> colas;
+    vector<std::thread>  trabajadores;  // Hilos 1..hilos-1; el 0 es quien llama a paraCada
+
+    // Reparto de cada lote a los trabajadores
+    std::mutex                               cerrojo;
+    std::condition_variable                  aviso_lote;  // Hay lote nuevo o hay que cerrar
+    std::condition_variable                  aviso_fin;   // Terminó el último trabajador
+    const std::function<void(long, int)>*    tarea;
+    unsigned long                            lote;        // Crece con cada paraCada
+    int                                      pendientes;  // Trabajadores aún en el lote
+    bool                                     cerrando;
+
+    bool tomarPropio(int h, Bloque& b) {
+        std::lock_guard<std::mutex> g(colas[h]->cerrojo);
+        if (colas[h]->bloques.empty()) return false;
+        b = colas[h]->bloques.back();
+        colas[h]->bloques.pop_back();
+        return true;
+    }
+
+    bool robar(int h, Bloque& b) {
+        for (int k = 1; k < hilos; ++k) {
+            int victima = (h + k) % hilos;
+            std::lock_guard<std::mutex> g(colas[victima]->cerrojo);
+            if (!colas[victima]->bloques.empty()) {
+                b = colas[victima]->bloques.front();
+                colas[victima]->bloques.pop_front();
+                return true;
+            }
         }
-        // Valores por defecto basados en el tipo de pieza
-        vector<int> rgb;
-        if (tipo_pieza == "I") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(255); } // cian
-        else if (tipo_pieza == "J") { rgb.push_back(0); rgb.push_back(100); rgb.push_back(255); } // azul
-        else if (tipo_pieza == "L") { rgb.push_back(255); rgb.push_back(165); rgb.push_back(0); } // naranja
-        else if (tipo_pieza == "O") { rgb.push_back(255); rgb.push_back(255); rgb.push_back(0); } // amarillo
-        else if (tipo_pieza == "S") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(0); } // verde
-        else if (tipo_pieza == "Z") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(0); } // rojo
-        else if (tipo_pieza == "T") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(255); } // magenta
-        else { rgb.push_back(128); rgb.push_back(128); rgb.push_back(128); } // gris
-        return rgb;
+        return false;
     }
-    
-    // Obtener color RGB por nombre de color
-    vector<int> obtenerColorRGBPorNombre(const string& nombre_color) const {
-        if (colores_rgb.count(nombre_color)) {
-            return colores_rgb.find(nombre_color)->second;
+
+    void trabajar(int h, const std::function<void(long, int)>& funcion) {
+        Bloque b;
+        while (tomarPropio(h, b) || robar(h, b)) {
+            for (long i = b.desde; i < b.hasta; ++i) {
+                funcion(i, h);
+            }
         }
-        // Valores por defecto
-        vector<int> rgb;
-        if (nombre_color == "cian") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(255); }
-        else if (nombre_color == "azul") { rgb.push_back(0); rgb.push_back(100); rgb.push_back(255); }
-        else if (nombre_color == "naranja") { rgb.push_back(255); rgb.push_back(165); rgb.push_back(0); }
-        else if (nombre_color == "amarillo") { rgb.push_back(255); rgb.push_back(255); rgb.push_back(0); }
-        else if (nombre_color == "verde") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(0); }
-        else if (nombre_color == "rojo") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(0); }
-        else if (nombre_color == "magenta") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(255); }
-        else if (nombre_color == "blanco") { rgb.push_back(255); rgb.push_back(255); rgb.push_back(255); }
-        else { rgb.push_back(128); rgb.push_back(128); rgb.push_back(128); }
-        return rgb;
     }
-private:
-    void cargarDesdeAST() {
-        ASTParser parser;
-        if (!parser.cargarDesdeAST("build/arbol.ast")) {
-            nombre_juego = "Tetris Clásico";
-            ancho_tablero = 10;
-            alto_tablero = 20;
-            velocidad_inicial = 800;
-            // defaults
-            velocidad_caida_rapida = 50;
-            tiempo_fijacion_pieza = 1000;
-            tiempo_antes_de_bloquear = 1000;
-            aceleracion_por_nivel = 50;
-            velocidad_maxima = 1000;
-            gravedad_automatica = true;
-            lineas_para_nivel = 10;
-            tamanio_celda = 30;
-            nivel_inicial = 1;
-            puntos_linea_simple = 100;
-            puntos_linea_doble = 300;
-            puntos_linea_triple = 500;
-            puntos_linea_tetris = 800;
-            return;
+
+    // Vida de un trabajador: esperar lote, vaciar colas, avisar y volver a dormir
+    void bucle(int h) {
+        unsigned long visto = 0;
+        for (;;) {
+            const std::function<void(long, int)>* funcion;
+            {
+                std::unique_lock<std::mutex> g(cerrojo);
+                aviso_lote.wait(g, [&] { return cerrando || lote != visto; });
+                if (cerrando) return;
+                visto   = lote;
+                funcion = tarea;
+            }
+            trabajar(h, *funcion);
+            std::lock_guard<std::mutex> g(cerrojo);
+            if (--pendientes == 0) aviso_fin.notify_one();
         }
-        nombre_juego = parser.obtenerString("nombre_juego", "Tetris Clásico");
-        ancho_tablero = parser.obtenerInt("ancho_tablero", 10);
-        alto_tablero = parser.obtenerInt("alto_tablero", 20);
-        velocidad_inicial = parser.obtenerInt("velocidad_inicial", 800);
-        // Read additional physics/gameplay params
-        velocidad_caida_rapida = parser.obtenerInt("velocidad_caida_rapida", 50);
-        tiempo_fijacion_pieza = parser.obtenerInt("tiempo_fijacion_pieza", 1000);
-        tiempo_antes_de_bloquear = parser.obtenerInt("tiempo_antes_de_bloquear", 1000);
-        aceleracion_por_nivel = parser.obtenerInt("aceleracion_por_nivel", 50);
-        velocidad_maxima = parser.obtenerInt("velocidad_maxima", 1000);
-        gravedad_automatica = (parser.obtenerInt("gravedad_automatica", 1) != 0);
-        lineas_para_nivel = parser.obtenerInt("lineas_para_nivel", 10);
-        tamanio_celda = parser.obtenerInt("tamanio_celda", 30);
-        nivel_inicial = parser.obtenerInt("nivel_inicial", 1);
-        puntos_linea_simple = parser.obtenerInt("puntos_linea_simple", 100);
-        puntos_linea_doble = parser.obtenerInt("puntos_linea_doble", 300);
-        puntos_linea_triple = parser.obtenerInt("puntos_linea_triple", 500);
-        puntos_linea_tetris = parser.obtenerInt("puntos_linea_tetris", 800);
+    }
+public:
+    /**
+     * @param n_hilos Hilos a usar (0 = los núcleos disponibles)
+     */
+    explicit PoolTrabajo(int n_hilos = 0) : tarea(NULL), lote(0), pendientes(0), cerrando(false) {
+        if (n_hilos <= 0) n_hilos = static_cast<int>(std::thread::hardware_concurrency());
+        hilos = max(1, n_hilos);
+        for (int h = 0; h < hilos; ++h) colas.push_back(new ColaBloques());
+        for (int h = 1; h < hilos; ++h) trabajadores.push_back(std::thread(&PoolTrabajo::bucle, this, h));
+    }
+
+    ~PoolTrabajo() {
         {
-            vector<string> tmp_tipos;
-            tmp_tipos.push_back("I"); tmp_tipos.push_back("J"); tmp_tipos.push_back("L");
-            tmp_tipos.push_back("O"); tmp_tipos.push_back("S"); tmp_tipos.push_back("Z"); tmp_tipos.push_back("T");
-            tipos_piezas = tmp_tipos;
+            std::lock_guard<std::mutex> g(cerrojo);
+            cerrando = true;
+        }
+        aviso_lote.notify_all();
+        for (size_t t = 0; t < trabajadores.size(); ++t) trabajadores[t].join();
+        for (size_t h = 0; h < colas.size(); ++h) delete colas[h];
+    }
+
+    int tamanio() const { return hilos; }
+
+    /**
+     * Ejecuta funcion(i, hilo) para cada i en [0, n). El índice de hilo
+     * (0..tamanio()-1) permite mantener estado por hilo sin cerrojos. No se
+     * puede llamar desde dentro de 'funcion' sobre el mismo pool.
+     */
+    void paraCada(long n, const std::function<void(long, int)>& funcion) {
+        if (n <= 0) return;
+        // Bloques pequeños para que el robo pueda equilibrar la carga
+        long tam_bloque = max(1L, n / (static_cast<long>(hilos) * 8));
+        int  h = 0;
+        for (long i = 0; i < n; i += tam_bloque) {
+            colas[h]->bloques.push_back(Bloque(i, min(n, i + tam_bloque)));
+            h = (h + 1) % hilos;
+        }
+        if (hilos == 1) {
+            trabajar(0, funcion);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> g(cerrojo);
+            tarea      = &funcion;
+            pendientes = hilos - 1;
+            lote++;
+        }
+        aviso_lote.notify_all();
+        trabajar(0, funcion);
+        std::unique_lock<std::mutex> g(cerrojo);
+        aviso_fin.wait(g, [this] { return pendientes == 0; });
+    }
+};
+
+// ============================================================================
+// CLASE: BarreraHilos
+// ============================================================================
+// Punto de encuentro de un número fijo de hilos que avanzan por fases: nadie
+// sigue hasta que han llegado todos. El último en llegar ejecuta una acción
+// antes de soltar a los demás (la parte secuencial entre dos fases
+// paralelas), así que no hace falta una segunda espera.
+// ============================================================================
+class BarreraHilos {
+private:
+    std::mutex              cerrojo;
+    std::condition_variable aviso;
+    int                     hilos;
+    int                     esperando;
+    unsigned long           generacion;
+public:
+    explicit BarreraHilos(int n) : hilos(max(1, n)), esperando(0), generacion(0) {}
+
+    template <class Accion>
+    void esperar(Accion al_completar) {
+        std::unique_lock<std::mutex> g(cerrojo);
+        unsigned long mia = generacion;
+        if (++esperando == hilos) {
+            al_completar();
+            esperando = 0;
+            ++generacion;
+            aviso.notify_all();
+            return;
+        }
+        aviso.wait(g, [&] { return generacion != mia; });
+    }
+};
+
+// ============================================================================
+// CLASE: ColaSPSC
+// ============================================================================
+// Cola circular de capacidad fija para un productor y un consumidor, sin
+// cerrojos: cada lado solo avanza su propio contador (el productor
+// 'escritos', el consumidor 'leidos') y publica con release lo que el otro
+// lee con acquire. Los contadores crecen sin envolverse a mano; la
+// diferencia entre ambos es lo ocupado aunque den la vuelta. Si está llena,
+// meter() falla en lugar de pisar un elemento que el consumidor no ha visto.
+// ============================================================================
+template <class T, unsigned CAPACIDAD>
+class ColaSPSC {
+private:
+    static_assert((CAPACIDAD & (CAPACIDAD - 1)) == 0, "CAPACIDAD debe ser potencia de dos");
+
+    T                     datos[CAPACIDAD];
+    std::atomic<unsigned> escritos;
+    std::atomic<unsigned> leidos;
+public:
+    ColaSPSC() : escritos(0), leidos(0) {}
+
+    // Productor. false si la cola está llena
+    bool meter(const T& v) {
+        unsigned e = escritos.load(std::memory_order_relaxed);
+        if (e - leidos.load(std::memory_order_acquire) == CAPACIDAD) return false;
+        datos[e & (CAPACIDAD - 1)] = v;
+        escritos.store(e + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumidor. El elemento más antiguo sin sacarlo (NULL si está vacía)
+    const T* frente() const {
+        unsigned l = leidos.load(std::memory_order_relaxed);
+        if (escritos.load(std::memory_order_acquire) == l) return NULL;
+        return &datos[l & (CAPACIDAD - 1)];
+    }
+
+    // Consumidor. Quita el elemento de frente() (debe haberlo)
+    void descartar() {
+        leidos.store(leidos.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumidor
+    bool sacar(T& v) {
+        const T* f = frente();
+        if (!f) return false;
+        v = *f;
+        descartar();
+        return true;
+    }
+
+    // Consumidor. Descarta todo lo publicado hasta ahora
+    void vaciar() {
+        leidos.store(escritos.load(std::memory_order_acquire), std::memory_order_release);
+    }
+};
+
+// ============================================================================
+// CLASE: HiloEntrada
+// ============================================================================
+// Lee el teclado en un hilo propio y deja cada tecla, con el instante
+// (GetTickCount) en que llegó, en una ColaSPSC que el bucle del juego vacía
+// en cada vuelta. Una tecla ya no espera a que termine de dibujarse el
+// cuadro ni se pierde si se pulsa y suelta durante uno, y el motor la aplica
+// en su instante de llegada. El bucle duerme con esperar(), que despierta
+// también al entrar una tecla.
+//
+// Las subclases dicen cómo se lee (EntradaConsola lee la consola). Arrancan
+// el hilo al final de su constructor y lo detienen al principio de su
+// destructor, mientras su leer() todavía existe. La ventana GDI no necesita
+// hilo: sus teclas llegan como mensajes (EntradaGDI).
+// ============================================================================
+struct EventoTecla {
+    DWORD ms;       // GetTickCount al llegar
+    int   tecla;    // Carácter (consola) o código de tecla virtual (GDI)
+    bool  pulsada;  // false al soltarla (solo GDI: la consola no lo sabe)
+};
+
+static const unsigned CAPACIDAD_TECLAS       = 64;
+static const DWORD    ESPERA_HILO_ENTRADA_MS = 50;  // Cada cuánto mira el hilo si debe terminar
+
+class HiloEntrada {
+private:
+    ColaSPSC<EventoTecla, CAPACIDAD_TECLAS> cola;
+    std::mutex              cerrojo;  // Solo para dormir y despertar; la cola no lo usa
+    std::condition_variable aviso;
+    std::atomic<bool>       activo;
+    std::thread             hilo;
+
+    void bucle() {
+        while (activo.load()) leer();
+    }
+protected:
+    // Espera como mucho ESPERA_HILO_ENTRADA_MS y publica lo que llegue
+    virtual void leer() = 0;
+
+    void publicar(int tecla, bool pulsada) {
+        EventoTecla e = { GetTickCount(), tecla, pulsada };
+        if (!cola.meter(e)) return;  // Llena: el juego lleva CAPACIDAD_TECLAS teclas sin mirar
+        // Tomar el cerrojo evita avisar entre la comprobación de esperar() y su espera
+        { std::lock_guard<std::mutex> g(cerrojo); }
+        aviso.notify_one();
+    }
+
+    void arrancar() {
+        activo = true;
+        hilo   = std::thread(&HiloEntrada::bucle, this);
+    }
+
+    void detener() {
+        activo = false;
+        if (hilo.joinable()) hilo.join();
+    }
+public:
+    HiloEntrada() : activo(false) {}
+    virtual ~HiloEntrada() {}
+
+    bool sacar(EventoTecla& e) { return cola.sacar(e); }
+
+    // Duerme hasta 'ms' milisegundos o hasta que haya teclas sin sacar
+    void esperar(DWORD ms) {
+        std::unique_lock<std::mutex> g(cerrojo);
+        aviso.wait_for(g, std::chrono::milliseconds(ms), [this] { return cola.frente() != NULL; });
+    }
+};
+
+// Teclas de la consola (motores de consola). Mientras existe, la terminal
+// POSIX queda sin eco ni búfer de línea.
+class EntradaConsola : public HiloEntrada {
+private:
+#ifndef _WIN32
+    TerminalCruda cruda;
+#endif
+protected:
+    void leer() {
+        if (!esperarTecla(ESPERA_HILO_ENTRADA_MS)) return;
+        while (_kbhit()) {
+            int c = _getch();
+            if (c < 0) {
+                // Entrada cerrada (p. ej. redirigida): no queda nada que leer
+                std::this_thread::sleep_for(std::chrono::milliseconds(ESPERA_HILO_ENTRADA_MS));
+                return;
+            }
+            publicar(c, true);
+        }
+    }
+public:
+    EntradaConsola()  { arrancar(); }
+    ~EntradaConsola() { detener(); }
+};
+
+// ============================================================================
+// CLASE: PlanificadorEventos
+// ============================================================================
+// Temporizadores de un motor en un montículo mínimo ordenado por vencimiento
+// (ms del reloj monótono del motor, real o virtual). Cada evento es un índice
+// pequeño con a lo sumo un vencimiento vigente: reprogramarlo o cancelarlo
+// sube su generación y las entradas viejas se descartan al llegar a la cima.
+// El bucle principal duerme justo hasta el próximo vencimiento. El montículo
+// es un arreglo de tamaño fijo, así que copiar el planificador (p. ej. en una
+// instantánea) no reserva memoria.
+// ============================================================================
+static const int MAX_EVENTOS_PLANIFICADOR = 8;
+static const int CAPACIDAD_MONTICULO      = 4 * MAX_EVENTOS_PLANIFICADOR;
+
+class PlanificadorEventos {
+private:
+    struct Entrada {
+        DWORD    vence;
+        uint32_t generacion;
+        int      evento;
+    };
+
+    // Orden del montículo: en la cima queda el vencimiento más próximo
+    struct VenceDespues {
+        bool operator()(const Entrada& a, const Entrada& b) const {
+            return PlanificadorEventos::antes(b.vence, a.vence);
+        }
+    };
+
+    Entrada  monticulo[CAPACIDAD_MONTICULO];
+    int      tamanio;
+    uint32_t generacion[MAX_EVENTOS_PLANIFICADOR];
+    bool     activo[MAX_EVENTOS_PLANIFICADOR];
+
+    bool vigente(const Entrada& e) const {
+        return activo[e.evento] && e.generacion == generacion[e.evento];
+    }
+
+    // Quita de la cima las entradas reprogramadas o canceladas
+    void purgar() {
+        while (tamanio > 0 && !vigente(monticulo[0])) {
+            pop_heap(monticulo, monticulo + tamanio, VenceDespues());
+            tamanio--;
+        }
+    }
+
+    // Reconstruye el montículo solo con las entradas vigentes
+    void compactar() {
+        int n = 0;
+        for (int i = 0; i < tamanio; ++i) {
+            if (vigente(monticulo[i])) monticulo[n++] = monticulo[i];
+        }
+        tamanio = n;
+        make_heap(monticulo, monticulo + tamanio, VenceDespues());
+    }
+public:
+    // a vence antes que b, tolerando el desborde del contador de milisegundos
+    static bool antes(DWORD a, DWORD b) {
+        return static_cast<int32_t>(static_cast<uint32_t>(a - b)) < 0;
+    }
+
+    PlanificadorEventos() {
+        vaciar();
+    }
+
+    void vaciar() {
+        tamanio = 0;
+        for (int i = 0; i < MAX_EVENTOS_PLANIFICADOR; ++i) {
+            generacion[i] = 0;
+            activo[i]     = false;
+        }
+    }
+
+    // Programa (o reprograma) el evento para que venza en 'vence'
+    void programar(int evento, DWORD vence) {
+        generacion[evento]++;
+        activo[evento] = true;
+        Entrada e = { vence, generacion[evento], evento };
+        monticulo[tamanio++] = e;
+        push_heap(monticulo, monticulo + tamanio, VenceDespues());
+        if (tamanio >= CAPACIDAD_MONTICULO) compactar();
+    }
+
+    void cancelar(int evento) {
+        if (!activo[evento]) return;
+        activo[evento] = false;
+        generacion[evento]++;
+    }
+
+    bool pendiente(int evento) const { return activo[evento]; }
+
+    /**
+     * Saca el evento vencido más antiguo.
+     * @param vencimiento Si no es NULL recibe el momento en que venció
+     * @return false si ningún evento vence en 'ahora' o antes
+     */
+    bool extraerVencido(DWORD ahora, int& evento, DWORD* vencimiento = NULL) {
+        purgar();
+        if (tamanio == 0 || antes(ahora, monticulo[0].vence)) return false;
+        evento = monticulo[0].evento;
+        if (vencimiento) *vencimiento = monticulo[0].vence;
+        activo[evento] = false;
+        pop_heap(monticulo, monticulo + tamanio, VenceDespues());
+        tamanio--;
+        return true;
+    }
+
+    // Milisegundos desde 'ahora' hasta el próximo vencimiento, como mucho 'tope'
+    DWORD espera(DWORD ahora, DWORD tope) {
+        purgar();
+        if (tamanio == 0) return tope;
+        DWORD vence = monticulo[0].vence;
+        if (!antes(ahora, vence)) return 0;
+        return min(static_cast<DWORD>(vence - ahora), tope);
+    }
+};
+
+// ============================================================================
+// CLASE: AnilloInstantaneas
+// ============================================================================
+// Últimas instantáneas del estado de un motor, en un arreglo circular: cada
+// una nueva pisa la más antigua. Los motores de consola toman una cada
+// INTERVALO_INSTANTANEAS_MS de su reloj mediante un evento del planificador,
+// así que en vivo, en headless y al reproducir se toman en los mismos
+// instantes y con el mismo estado. Para volver a un instante cualquiera el
+// motor copia de vuelta la última instantánea anterior y vuelve a simular
+// las teclas que guardó desde ella (RegistroEntradas), ver restaurarEn().
+// ============================================================================
+static const DWORD INTERVALO_INSTANTANEAS_MS = 500;
+static const int   NUM_INSTANTANEAS          = 32;   // 16 s de historia
+static const DWORD RETROCESO_MINIMO_MS       = 1000; // Cuánto vuelve atrás cada Z como mínimo
+
+template <class Instantanea, int CAPACIDAD>
+class AnilloInstantaneas {
+private:
+    Instantanea datos[CAPACIDAD];
+    DWORD       instantes[CAPACIDAD];  // ms del reloj del motor de cada una
+    int         inicio;
+    int         cantidad;
+public:
+    AnilloInstantaneas() : inicio(0), cantidad(0) {}
+
+    int  tamanio() const { return cantidad; }
+    void vaciar()        { inicio = 0; cantidad = 0; }
+
+    // Hueco para una instantánea nueva (descarta la más antigua si está lleno)
+    Instantanea& nueva(DWORD ms) {
+        int i;
+        if (cantidad == CAPACIDAD) {
+            i = inicio;
+            inicio = (inicio + 1) % CAPACIDAD;
+        } else {
+            i = (inicio + cantidad++) % CAPACIDAD;
+        }
+        instantes[i] = ms;
+        return datos[i];
+    }
+
+    // Instante de la más antigua (debe haber alguna)
+    DWORD masAntigua() const { return instantes[inicio]; }
+    const Instantanea& primera() const { return datos[inicio]; }
+
+    /**
+     * Devuelve la instantánea más reciente tomada en 'ms' o antes y descarta
+     * las posteriores, que volverán a tomarse al simular desde ella. Si no
+     * hay ninguna tan antigua devuelve NULL y no descarta nada.
+     */
+    const Instantanea* ultimaHasta(DWORD ms) {
+        int n = cantidad;
+        while (n > 0 && PlanificadorEventos::antes(ms, instantes[(inicio + n - 1) % CAPACIDAD])) n--;
+        if (n == 0) return NULL;
+        cantidad = n;
+        return &datos[(inicio + n - 1) % CAPACIDAD];
+    }
+};
+
+// ============================================================================
+// REPETICIONES: grabación compacta y reproducción determinista
+// ============================================================================
+// Los motores de consola corren sobre un reloj virtual que empieza en 0, así
+// que una partida queda determinada por la semilla y por las teclas con su
+// instante. El archivo guarda solo eso:
+//
+//   "RPL1"              firma (4 bytes)
+//   juego               'T' (Tetris) o 'S' (Snake); 't' o 's' en ventana
+//   semilla             varint
+//   hash_config         8 bytes little-endian (FNV-1a del archivo AST)
+//   registros           varint(ms desde el registro anterior) + tecla (1 byte)
+//                       tecla 0 = fin de la sesión
+//
+// En consola la tecla es el carácter leído. En ventana (GDI) es el código
+// de tecla virtual, con TECLA_SOLTADA si se soltó: allí mantener A, D o S
+// pulsada importa, y el reloj cuenta desde el comienzo de la sesión.
+//
+// Dos o tres bytes por tecla pulsada. Reproducir vuelve a simular la
+// partida a toda velocidad hasta el instante pedido.
+// ============================================================================
+static const char FIRMA_REPETICION[4] = { 'R', 'P', 'L', '1' };
+static const int  TECLA_SOLTADA       = 0x80;  // Las teclas virtuales usadas caben en 7 bits
+
+static void escribirVarint(vector<uint8_t>& salida, uint64_t v) {
+    while (v >= 0x80) {
+        salida.push_back(static_cast<uint8_t>(v) | 0x80);
+        v >>= 7;
+    }
+    salida.push_back(static_cast<uint8_t>(v));
+}
+
+static bool leerVarint(const vector<uint8_t>& datos, size_t& pos, uint64_t& v) {
+    v = 0;
+    for (int desplazamiento = 0; pos < datos.size() && desplazamiento < 64; desplazamiento += 7) {
+        uint8_t b = datos[pos++];
+        v |= static_cast<uint64_t>(b & 0x7F) << desplazamiento;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// FNV-1a de 64 bits del contenido de un archivo (0 si no se puede leer)
+static uint64_t hashArchivo(const string& ruta) {
+    ifstream archivo(ruta.c_str(), ios::binary);
+    if (!archivo.is_open()) return 0;
+    uint64_t h = 14695981039346656037ULL;
+    char     bloque[4096];
+    while (archivo.read(bloque, sizeof(bloque)) || archivo.gcount() > 0) {
+        for (streamsize i = 0; i < archivo.gcount(); ++i) {
+            h ^= static_cast<uint8_t>(bloque[i]);
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+struct EntradaRepeticion {
+    DWORD ms;     // Instante del reloj virtual del motor
+    char  tecla;
+};
+
+// ============================================================================
+// CLASE: RegistroEntradas
+// ============================================================================
+// Teclas que aplicó un motor desde su instantánea más antigua, con su
+// instante, en un arreglo circular. Con ellas y una instantánea el motor
+// vuelve a cualquier instante reciente (restaurarEn). La capacidad solo se
+// duplica si hace falta (un bot pulsa en cada tick); en régimen no reserva.
+// ============================================================================
+class RegistroEntradas {
+private:
+    vector<EntradaRepeticion> datos;  // Capacidad potencia de dos
+    size_t                    inicio;
+    size_t                    cantidad;
+
+    size_t indice(size_t i) const { return (inicio + i) & (datos.size() - 1); }
+public:
+    RegistroEntradas() : datos(64), inicio(0), cantidad(0) {}
+
+    size_t tamanio() const { return cantidad; }
+    void   vaciar()        { inicio = 0; cantidad = 0; }
+
+    // Entrada i, de la más antigua (0) a la más reciente
+    const EntradaRepeticion& operator[](size_t i) const { return datos[indice(i)]; }
+
+    void agregar(DWORD ms, char tecla) {
+        if (cantidad == datos.size()) {
+            vector<EntradaRepeticion> nuevos(datos.size() * 2);
+            for (size_t i = 0; i < cantidad; ++i) nuevos[i] = (*this)[i];
+            datos.swap(nuevos);
+            inicio = 0;
+        }
+        EntradaRepeticion e = { ms, tecla };
+        datos[indice(cantidad++)] = e;
+    }
+
+    // Olvida las anteriores a 'ms' (la instantánea más antigua que queda)
+    void descartarAntesDe(DWORD ms) {
+        while (cantidad > 0 && PlanificadorEventos::antes((*this)[0].ms, ms)) {
+            inicio = indice(1);
+            cantidad--;
+        }
+    }
+
+    // Olvida las posteriores a 'ms': al volver atrás esa historia se reescribe
+    void descartarDespuesDe(DWORD ms) {
+        while (cantidad > 0 && PlanificadorEventos::antes(ms, (*this)[cantidad - 1].ms)) cantidad--;
+    }
+};
+
+// Repetición leída de disco
+struct Repeticion {
+    char                      juego;  // 'T' o 'S' ('t' o 's' si se grabó en ventana)
+    uint32_t                  semilla;
+    uint64_t                  hash_config;
+    vector<EntradaRepeticion> entradas;
+    DWORD                     duracion;  // ms de la sesión (último registro si quedó cortada)
+
+    Repeticion() : juego(0), semilla(0), hash_config(0), duracion(0) {}
+
+    /**
+     * Lee una repetición. Un archivo cortado (p. ej. por un cierre abrupto)
+     * se acepta hasta el último registro completo.
+     */
+    bool cargar(const string& ruta) {
+        ifstream archivo(ruta.c_str(), ios::binary);
+        if (!archivo.is_open()) return false;
+        vector<uint8_t> datos((istreambuf_iterator<char>(archivo)), istreambuf_iterator<char>());
+        if (datos.size() < 5 || memcmp(&datos[0], FIRMA_REPETICION, 4) != 0) return false;
+        size_t   pos = 4;
+        uint64_t v   = 0;
+        juego = static_cast<char>(datos[pos++]);
+        if (!leerVarint(datos, pos, v) || pos + 8 > datos.size()) return false;
+        semilla     = static_cast<uint32_t>(v);
+        hash_config = 0;
+        for (int i = 0; i < 8; ++i) hash_config |= static_cast<uint64_t>(datos[pos++]) << (8 * i);
+        entradas.clear();
+        uint32_t ms = 0;  // Módulo 2^32, como se grabaron las diferencias
+        while (pos < datos.size()) {
+            if (!leerVarint(datos, pos, v) || pos >= datos.size()) break;
+            ms += static_cast<uint32_t>(v);
+            char tecla = static_cast<char>(datos[pos++]);
+            if (tecla == 0) break;
+            EntradaRepeticion e = { ms, tecla };
+            entradas.push_back(e);
+        }
+        duracion = ms;
+        return true;
+    }
+};
+
+// ============================================================================
+// CLASE: GrabadorRepeticion
+// ============================================================================
+// El hilo del juego solo codifica cada tecla (varint + byte) en un búfer
+// protegido por un cerrojo; un hilo escritor lo vacía en el archivo cada
+// medio segundo o al llenarse, de modo que el disco nunca frena un frame.
+// ============================================================================
+class GrabadorRepeticion {
+private:
+    string                  ruta;
+    char                    juego;
+    uint64_t                hash_config;
+    ofstream                archivo;
+    std::mutex              cerrojo;
+    std::condition_variable aviso;
+    vector<uint8_t>         pendiente;  // Bytes codificados aún sin escribir
+    std::thread             escritor;
+    bool                    cerrando;
+    DWORD                   ultimo_ms;
+
+    void escribir() {
+        vector<uint8_t> lote;
+        std::unique_lock<std::mutex> g(cerrojo);
+        for (;;) {
+            aviso.wait_for(g, std::chrono::milliseconds(500));
+            lote.swap(pendiente);
+            bool fin = cerrando;
+            g.unlock();
+            if (!lote.empty()) {
+                archivo.write(reinterpret_cast<const char*>(&lote[0]), static_cast<streamsize>(lote.size()));
+                archivo.flush();
+                lote.clear();
+            }
+            g.lock();
+            if (fin && pendiente.empty()) return;
+        }
+    }
+
+    void encolar(DWORD ms, char tecla) {
+        std::lock_guard<std::mutex> g(cerrojo);
+        escribirVarint(pendiente, static_cast<uint32_t>(ms - ultimo_ms));
+        pendiente.push_back(static_cast<uint8_t>(tecla));
+        ultimo_ms = ms;
+        if (pendiente.size() >= 4096) aviso.notify_one();
+    }
+public:
+    /**
+     * @param juego 'T' o 'S'
+     * @param ruta_config AST con el que se juega (se guarda su hash)
+     */
+    GrabadorRepeticion(const string& ruta_, char juego_, const string& ruta_config)
+        : ruta(ruta_), juego(juego_), hash_config(hashArchivo(ruta_config)), cerrando(false), ultimo_ms(0) {}
+
+    ~GrabadorRepeticion() {
+        terminar(ultimo_ms);
+    }
+
+    // Abre el archivo, escribe la cabecera y arranca el hilo escritor
+    bool comenzar(uint32_t semilla) {
+        archivo.open(ruta.c_str(), ios::binary | ios::trunc);
+        if (!archivo.is_open()) return false;
+        vector<uint8_t> cabecera(FIRMA_REPETICION, FIRMA_REPETICION + 4);
+        cabecera.push_back(static_cast<uint8_t>(juego));
+        escribirVarint(cabecera, semilla);
+        for (int i = 0; i < 8; ++i) cabecera.push_back(static_cast<uint8_t>(hash_config >> (8 * i)));
+        archivo.write(reinterpret_cast<const char*>(&cabecera[0]), static_cast<streamsize>(cabecera.size()));
+        ultimo_ms = 0;
+        escritor  = std::thread(&GrabadorRepeticion::escribir, this);
+        return true;
+    }
+
+    void registrar(DWORD ms, char tecla) {
+        if (escritor.joinable() && tecla != 0) encolar(ms, tecla);
+    }
+
+    // Antes de comenzar: la sesión se juega en ventana ('t' o 's', ver arriba)
+    void grabarEnVentana() {
+        juego = static_cast<char>(tolower(juego));
+    }
+
+    // Escribe el registro de fin y espera a que el hilo vacíe el búfer
+    void terminar(DWORD ms) {
+        if (!escritor.joinable()) return;
+        encolar(ms, 0);
+        {
+            std::lock_guard<std::mutex> g(cerrojo);
+            cerrando = true;
+        }
+        aviso.notify_one();
+        escritor.join();
+        archivo.close();
+    }
+
+    const string& rutaArchivo() const { return ruta; }
+};
+
+// ================================================================
+// Tetris
+// ================================================================
+enum TipoPieza { I=0, J=1, L=2, O=3, S=4, Z=5, T=6, VACIO=7 };
+enum ColorTetris { CIAN=11, AZUL=9, NARANJA=12, AMARILLO=14, VERDE=10, ROJO=12, MAGENTA=13, BLANCO=15, GRIS=8 };
+
+typedef unsigned int FilaBits;  // Fila empaquetada: bit x = columna x ocupada
+static const int ANCHO_TABLERO_MAXIMO = 32;  // Bits disponibles en FilaBits
+static const int ANCHO_TABLERO_MINIMO = 4;   // Debe caber la pieza I acostada
+static const int ALTO_TABLERO_MINIMO  = 4;   // Debe caber al menos una pieza
+static const int ALTO_TABLERO_MAXIMO  = 256; // Cuatro bandas de claves Zobrist (ver ZobristTetris)
+
+static const int NUM_TIPOS_PIEZA    = 7;
+static const int NUM_ROTACIONES     = 4;
+static const int TAMANIO_CAJA_PIEZA = 4;  // Lado máximo de la caja de una forma
+
+/**
+ * Devuelve el nombre de un tipo de pieza tal como aparece en el .brik ("I", "J", ...).
+ */
+static const char* nombreTipoPieza(TipoPieza t) {
+    static const char* nombres[NUM_TIPOS_PIEZA] = { "I", "J", "L", "O", "S", "Z", "T" };
+    return (t >= 0 && t < NUM_TIPOS_PIEZA) ? nombres[t] : "I";
+}
+
+// ----------------------------------------------------------------------------
+// FormaPieza: una rotación de una pieza empaquetada por filas. Se precalcula
+// una sola vez al cargar la configuración y todas las piezas la comparten.
+// ----------------------------------------------------------------------------
+struct FormaPieza {
+    FilaBits filas[TAMANIO_CAJA_PIEZA];  // Máscara de cada fila de la caja
+    int      alto;                       // Filas de la caja
+    int      ancho;                      // Columnas de la caja
+    int      col_min;                    // Primera columna ocupada
+    int      col_max;                    // Última columna ocupada
+    int      fila_min;                   // Primera fila ocupada
+    int      fila_max;                   // Última fila ocupada
+    int      fondo[TAMANIO_CAJA_PIEZA];  // Fila ocupada más baja de cada columna (-1 = vacía)
+
+    bool ocupa(int px, int py) const {
+        return py >= 0 && py < alto && px >= 0 && px < ancho && ((filas[py] >> px) & 1u) != 0;
+    }
+
+    // true si ocupa exactamente las mismas celdas (rotaciones equivalentes)
+    bool mismaForma(const FormaPieza& o) const {
+        for (int i = 0; i < TAMANIO_CAJA_PIEZA; ++i) {
+            if (filas[i] != o.filas[i]) return false;
+        }
+        return true;
+    }
+
+    // true si es la misma figura aunque esté desplazada dentro de la caja
+    // (en SRS, los estados 0 y 2 de S, Z e I)
+    bool mismaSilueta(const FormaPieza& o) const {
+        if (fila_max - fila_min != o.fila_max - o.fila_min) return false;
+        for (int i = 0; i <= fila_max - fila_min; ++i) {
+            if ((filas[fila_min + i] >> col_min) != (o.filas[o.fila_min + i] >> o.col_min)) return false;
+        }
+        return true;
+    }
+};
+
+// Formas de todas las piezas indexadas por [tipo][rotación]
+struct TablaRotaciones {
+    FormaPieza formas[NUM_TIPOS_PIEZA][NUM_ROTACIONES];
+
+    const FormaPieza& forma(TipoPieza t, int rotacion) const {
+        return formas[t][rotacion];
+    }
+};
+
+/**
+ * Indica si una forma cabe con su caja en (x, y) sobre filas de bits: una
+ * prueba de máscara por fila. Las filas por encima (y < 0) solo validan paredes.
+ */
+static inline bool formaCabe(const FormaPieza& f, const FilaBits* filas, int ancho, int alto, int x, int y) {
+    if (x + f.col_min < 0 || x + f.col_max >= ancho) return false;
+    for (int py = f.fila_min; py <= f.fila_max; ++py) {
+        int wy = y + py;
+        if (wy < 0) continue;
+        if (wy >= alto) return false;
+        FilaBits m = (x >= 0) ? (f.filas[py] << x) : (f.filas[py] >> -x);
+        if (filas[wy] & m) return false;
+    }
+    return true;
+}
+
+class ConfigTetris {
+public:
+    map<string, int> colores;  // Colores para consola (códigos)
+    map<string, vector<int> > colores_rgb;  // Colores RGB para renderizado gráfico [R, G, B]
+    map<string, string> pieza_a_color;  // Mapeo de tipo de pieza a nombre de color (ej: "I" -> "cian")
+    map<string, vector<vector<vector<int> > > > rotaciones_piezas;
+    TablaRotaciones tabla_rotaciones;  // rotaciones_piezas empaquetadas en máscaras de bits
+    vector<string> tipos_piezas;
+    string nombre_juego;
+    int ancho_tablero;
+    int alto_tablero;
+    int velocidad_inicial;
+    // Physics and gameplay params read from AST
+    int velocidad_caida_rapida;
+    int tiempo_fijacion_pieza;     // Tope de ms apoyada antes de fijarse, aunque se siga moviendo
+    int tiempo_antes_de_bloquear;  // Retardo de bloqueo: se reinicia al mover o rotar la pieza apoyada
+    int retardo_repeticion;        // DAS: ms con A/D pulsada antes de repetir el movimiento
+    int intervalo_repeticion;      // ARR: ms entre movimientos repetidos
+    int aceleracion_por_nivel;
+    int velocidad_maxima;
+    bool gravedad_automatica;
+    int lineas_para_nivel;
+    int tamanio_celda;
+    int nivel_inicial;
+    int puntos_linea_simple;
+    int puntos_linea_doble;
+    int puntos_linea_triple;
+    int puntos_linea_tetris;
+    int semilla;  // Semilla del generador de piezas (0 = tomar del reloj)
+    string generador_piezas;  // "aleatorio" (uniforme) o "bolsa" (las 7 piezas barajadas)
+    int vista_previa;         // Piezas siguientes que se muestran y ven los bots
+
+    explicit ConfigTetris(const string& ruta_ast = "build/arbol.ast") {
+        cargarDesdeAST(ruta_ast);
+        ajustarDimensiones();
+        configurarRotacionesHardcoded();
+        construirTablaRotaciones();
+    }
+public:
+    void printConfig() const {
+        std::cout << "[ConfigTetris] nombre_juego=" << nombre_juego
+                  << " ancho_tablero=" << ancho_tablero
+                  << " alto_tablero=" << alto_tablero
+                  << " tamanio_celda=" << tamanio_celda
+                  << " velocidad_inicial=" << velocidad_inicial
+                  << " aceleracion_por_nivel=" << aceleracion_por_nivel
+                  << " lineas_para_nivel=" << lineas_para_nivel
+                  << " nivel_inicial=" << nivel_inicial
+                  << " puntos_linea_simple=" << puntos_linea_simple
+                  << " puntos_linea_tetris=" << puntos_linea_tetris
+                  << " semilla=" << semilla
+                  << " generador_piezas=" << generador_piezas
+                  << " vista_previa=" << vista_previa
+                  << std::endl;
+    }
+    
+    // Obtener color RGB de una pieza por su tipo
+    vector<int> obtenerColorRGB(const string& tipo_pieza) const {
+        if (pieza_a_color.count(tipo_pieza)) {
+            string color_nombre = pieza_a_color.find(tipo_pieza)->second;
+            return obtenerColorRGBPorNombre(color_nombre);
+        }
+        // Valores por defecto basados en el tipo de pieza
+        vector<int> rgb;
+        if (tipo_pieza == "I") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(255); } // cian
+        else if (tipo_pieza == "J") { rgb.push_back(0); rgb.push_back(100); rgb.push_back(255); } // azul
+        else if (tipo_pieza == "L") { rgb.push_back(255); rgb.push_back(165); rgb.push_back(0); } // naranja
+        else if (tipo_pieza == "O") { rgb.push_back(255); rgb.push_back(255); rgb.push_back(0); } // amarillo
+        else if (tipo_pieza == "S") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(0); } // verde
+        else if (tipo_pieza == "Z") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(0); } // rojo
+        else if (tipo_pieza == "T") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(255); } // magenta
+        else { rgb.push_back(128); rgb.push_back(128); rgb.push_back(128); } // gris
+        return rgb;
+    }
+    
+    // Obtener color RGB por nombre de color
+    vector<int> obtenerColorRGBPorNombre(const string& nombre_color) const {
+        if (colores_rgb.count(nombre_color)) {
+            return colores_rgb.find(nombre_color)->second;
+        }
+        // Valores por defecto
+        vector<int> rgb;
+        if (nombre_color == "cian") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(255); }
+        else if (nombre_color == "azul") { rgb.push_back(0); rgb.push_back(100); rgb.push_back(255); }
+        else if (nombre_color == "naranja") { rgb.push_back(255); rgb.push_back(165); rgb.push_back(0); }
+        else if (nombre_color == "amarillo") { rgb.push_back(255); rgb.push_back(255); rgb.push_back(0); }
+        else if (nombre_color == "verde") { rgb.push_back(0); rgb.push_back(255); rgb.push_back(0); }
+        else if (nombre_color == "rojo") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(0); }
+        else if (nombre_color == "magenta") { rgb.push_back(255); rgb.push_back(0); rgb.push_back(255); }
+        else if (nombre_color == "blanco") { rgb.push_back(255); rgb.push_back(255); rgb.push_back(255); }
+        else { rgb.push_back(128); rgb.push_back(128); rgb.push_back(128); }
+        return rgb;
+    }
+private:
+    /**
+     * Lleva las dimensiones del tablero a lo que admite TableroTetris (cada
+     * fila es una máscara de FilaBits) y avisa si hubo que recortarlas, para
+     * que el motor y la ventana GDI usen las mismas.
+     */
+    void ajustarDimensiones() {
+        int ancho = max(ANCHO_TABLERO_MINIMO, min(ancho_tablero, ANCHO_TABLERO_MAXIMO));
+        int alto  = max(ALTO_TABLERO_MINIMO, min(alto_tablero, ALTO_TABLERO_MAXIMO));
+        if (ancho != ancho_tablero || alto != alto_tablero) {
+            cerr << "[ConfigTetris] Tablero de " << ancho_tablero << "x" << alto_tablero
+                 << " fuera de rango (ancho " << ANCHO_TABLERO_MINIMO << "-" << ANCHO_TABLERO_MAXIMO
+                 << ", alto " << ALTO_TABLERO_MINIMO << "-" << ALTO_TABLERO_MAXIMO << "): se usa " << ancho << "x" << alto << "\n";
+            ancho_tablero = ancho;
+            alto_tablero  = alto;
+        }
+    }
+
+    void cargarDesdeAST(const string& ruta_ast) {
+        ASTParser parser;
+        if (!parser.cargarDesdeAST(ruta_ast)) {
+            nombre_juego = "Tetris Clásico";
+            ancho_tablero = 10;
+            alto_tablero = 20;
+            velocidad_inicial = 800;
+            // defaults
+            velocidad_caida_rapida = 50;
+            tiempo_fijacion_pieza = 1000;
+            tiempo_antes_de_bloquear = 1000;
+            retardo_repeticion = 170;
+            intervalo_repeticion = 50;
+            aceleracion_por_nivel = 50;
+            velocidad_maxima = 1000;
+            gravedad_automatica = true;
+            lineas_para_nivel = 10;
+            tamanio_celda = 30;
+            nivel_inicial = 1;
+            puntos_linea_simple = 100;
+            puntos_linea_doble = 300;
+            puntos_linea_triple = 500;
+            puntos_linea_tetris = 800;
+            semilla = 0;
+            generador_piezas = "aleatorio";
+            vista_previa = 1;
+            return;
+        }
+        nombre_juego = parser.obtenerString("nombre_juego", "Tetris Clásico");
+        ancho_tablero = parser.obtenerInt("ancho_tablero", 10);
+        alto_tablero = parser.obtenerInt("alto_tablero", 20);
+        velocidad_inicial = parser.obtenerInt("velocidad_inicial", 800);
+        // Read additional physics/gameplay params
+        velocidad_caida_rapida = parser.obtenerInt("velocidad_caida_rapida", 50);
+        tiempo_fijacion_pieza = parser.obtenerInt("tiempo_fijacion_pieza", 1000);
+        tiempo_antes_de_bloquear = parser.obtenerInt("tiempo_antes_de_bloquear", 1000);
+        retardo_repeticion = parser.obtenerInt("retardo_repeticion", 170);
+        intervalo_repeticion = parser.obtenerInt("intervalo_repeticion", 50);
+        aceleracion_por_nivel = parser.obtenerInt("aceleracion_por_nivel", 50);
+        velocidad_maxima = parser.obtenerInt("velocidad_maxima", 1000);
+        gravedad_automatica = (parser.obtenerInt("gravedad_automatica", 1) != 0);
+        lineas_para_nivel = parser.obtenerInt("lineas_para_nivel", 10);
+        tamanio_celda = parser.obtenerInt("tamanio_celda", 30);
+        nivel_inicial = parser.obtenerInt("nivel_inicial", 1);
+        puntos_linea_simple = parser.obtenerInt("puntos_linea_simple", 100);
+        puntos_linea_doble = parser.obtenerInt("puntos_linea_doble", 300);
+        puntos_linea_triple = parser.obtenerInt("puntos_linea_triple", 500);
+        puntos_linea_tetris = parser.obtenerInt("puntos_linea_tetris", 800);
+        semilla = parser.obtenerInt("semilla", 0);
+        generador_piezas = parser.obtenerString("generador_piezas", "aleatorio");
+        vista_previa = parser.obtenerInt("vista_previa", 1);
+        {
+            vector<string> tmp_tipos;
+            tmp_tipos.push_back("I"); tmp_tipos.push_back("J"); tmp_tipos.push_back("L");
+            tmp_tipos.push_back("O"); tmp_tipos.push_back("S"); tmp_tipos.push_back("Z"); tmp_tipos.push_back("T");
+            tipos_piezas = tmp_tipos;
         }
         for (size_t _i = 0; _i < tipos_piezas.size(); ++_i) {
             string pieza = tipos_piezas[_i];
@@ -488,1175 +1776,4952 @@ private:
                 if (parser.objects_int["codigos_color"].count(color_nombre)) {
                     colores[pieza] = parser.objects_int["codigos_color"][color_nombre];
                 }
-                // Cargar colores RGB (valores por defecto basados en el nombre del color)
-                vector<int> rgb_default;
-                if (color_nombre == "cian") {
-                    rgb_default.push_back(0); rgb_default.push_back(255); rgb_default.push_back(255);
-                } else if (color_nombre == "azul") {
-                    rgb_default.push_back(0); rgb_default.push_back(100); rgb_default.push_back(255);
-                } else if (color_nombre == "naranja") {
-                    rgb_default.push_back(255); rgb_default.push_back(165); rgb_default.push_back(0);
-                } else if (color_nombre == "amarillo") {
-                    rgb_default.push_back(255); rgb_default.push_back(255); rgb_default.push_back(0);
-                } else if (color_nombre == "verde") {
-                    rgb_default.push_back(0); rgb_default.push_back(255); rgb_default.push_back(0);
-                } else if (color_nombre == "rojo") {
-                    rgb_default.push_back(255); rgb_default.push_back(0); rgb_default.push_back(0);
-                } else if (color_nombre == "magenta") {
-                    rgb_default.push_back(255); rgb_default.push_back(0); rgb_default.push_back(255);
-                } else if (color_nombre == "blanco") {
-                    rgb_default.push_back(255); rgb_default.push_back(255); rgb_default.push_back(255);
-                } else {
-                    rgb_default.push_back(128); rgb_default.push_back(128); rgb_default.push_back(128); // gris por defecto
+                // Cargar colores RGB (valores por defecto basados en el nombre del color)
+                vector<int> rgb_default;
+                if (color_nombre == "cian") {
+                    rgb_default.push_back(0); rgb_default.push_back(255); rgb_default.push_back(255);
+                } else if (color_nombre == "azul") {
+                    rgb_default.push_back(0); rgb_default.push_back(100); rgb_default.push_back(255);
+                } else if (color_nombre == "naranja") {
+                    rgb_default.push_back(255); rgb_default.push_back(165); rgb_default.push_back(0);
+                } else if (color_nombre == "amarillo") {
+                    rgb_default.push_back(255); rgb_default.push_back(255); rgb_default.push_back(0);
+                } else if (color_nombre == "verde") {
+                    rgb_default.push_back(0); rgb_default.push_back(255); rgb_default.push_back(0);
+                } else if (color_nombre == "rojo") {
+                    rgb_default.push_back(255); rgb_default.push_back(0); rgb_default.push_back(0);
+                } else if (color_nombre == "magenta") {
+                    rgb_default.push_back(255); rgb_default.push_back(0); rgb_default.push_back(255);
+                } else if (color_nombre == "blanco") {
+                    rgb_default.push_back(255); rgb_default.push_back(255); rgb_default.push_back(255);
+                } else {
+                    rgb_default.push_back(128); rgb_default.push_back(128); rgb_default.push_back(128); // gris por defecto
+                }
+                colores_rgb[color_nombre] = rgb_default;
+            }
+        }
+    }
+    void configurarRotacionesHardcoded() {
+        // Construcción explícita de rotaciones (C++03 compatible)
+        // I
+        {
+            vector<vector<vector<int> > > rots;
+            vector<vector<int> > shape;
+            vector<int> row;
+            int a1[] = {0,0,0,0}; int a2[] = {1,1,1,1}; int a3[] = {0,0,0,0}; int a4[] = {0,0,0,0};
+            row.assign(a1, a1+4); shape.push_back(row);
+            row.assign(a2, a2+4); shape.push_back(row);
+            row.assign(a3, a3+4); shape.push_back(row);
+            row.assign(a4, a4+4); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            // Los cuatro estados SRS: la I gira dentro de su caja de 4x4
+            int b1[] = {0,0,1,0}; int b2[] = {0,0,1,0}; int b3[] = {0,0,1,0}; int b4[] = {0,0,1,0};
+            row.assign(b1, b1+4); shape.push_back(row);
+            row.assign(b2, b2+4); shape.push_back(row);
+            row.assign(b3, b3+4); shape.push_back(row);
+            row.assign(b4, b4+4); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int c1[] = {0,0,0,0}; int c2[] = {0,0,0,0}; int c3[] = {1,1,1,1}; int c4[] = {0,0,0,0};
+            row.assign(c1, c1+4); shape.push_back(row);
+            row.assign(c2, c2+4); shape.push_back(row);
+            row.assign(c3, c3+4); shape.push_back(row);
+            row.assign(c4, c4+4); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int d1[] = {0,1,0,0}; int d2[] = {0,1,0,0}; int d3[] = {0,1,0,0}; int d4[] = {0,1,0,0};
+            row.assign(d1, d1+4); shape.push_back(row);
+            row.assign(d2, d2+4); shape.push_back(row);
+            row.assign(d3, d3+4); shape.push_back(row);
+            row.assign(d4, d4+4); shape.push_back(row);
+            rots.push_back(shape);
+            rotaciones_piezas["I"] = rots;
+        }
+        // J
+        {
+            vector<vector<vector<int> > > rots;
+            vector<vector<int> > shape; vector<int> row;
+            int j1[] = {1,0,0}; int j2[] = {1,1,1}; int j3[] = {0,0,0};
+            row.assign(j1, j1+3); shape.push_back(row);
+            row.assign(j2, j2+3); shape.push_back(row);
+            row.assign(j3, j3+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int j4[] = {0,1,1}; int j5[] = {0,1,0}; int j6[] = {0,1,0};
+            row.assign(j4, j4+3); shape.push_back(row);
+            row.assign(j5, j5+3); shape.push_back(row);
+            row.assign(j6, j6+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int j7[] = {0,0,0}; int j8[] = {1,1,1}; int j9[] = {0,0,1};
+            row.assign(j7, j7+3); shape.push_back(row);
+            row.assign(j8, j8+3); shape.push_back(row);
+            row.assign(j9, j9+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int j10[] = {0,1,0}; int j11[] = {0,1,0}; int j12[] = {1,1,0};
+            row.assign(j10, j10+3); shape.push_back(row);
+            row.assign(j11, j11+3); shape.push_back(row);
+            row.assign(j12, j12+3); shape.push_back(row);
+            rots.push_back(shape);
+            rotaciones_piezas["J"] = rots;
+        }
+        // L
+        {
+            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
+            int l1[] = {0,0,1}; int l2[] = {1,1,1}; int l3[] = {0,0,0};
+            row.assign(l1, l1+3); shape.push_back(row);
+            row.assign(l2, l2+3); shape.push_back(row);
+            row.assign(l3, l3+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int l4[] = {0,1,0}; int l5[] = {0,1,0}; int l6[] = {0,1,1};
+            row.assign(l4, l4+3); shape.push_back(row);
+            row.assign(l5, l5+3); shape.push_back(row);
+            row.assign(l6, l6+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int l7[] = {0,0,0}; int l8[] = {1,1,1}; int l9[] = {1,0,0};
+            row.assign(l7, l7+3); shape.push_back(row);
+            row.assign(l8, l8+3); shape.push_back(row);
+            row.assign(l9, l9+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int l10[] = {1,1,0}; int l11[] = {0,1,0}; int l12[] = {0,1,0};
+            row.assign(l10, l10+3); shape.push_back(row);
+            row.assign(l11, l11+3); shape.push_back(row);
+            row.assign(l12, l12+3); shape.push_back(row);
+            rots.push_back(shape);
+            rotaciones_piezas["L"] = rots;
+        }
+        // O (cuadrado)
+        {
+            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
+            int o1[] = {1,1}; int o2[] = {1,1};
+            row.assign(o1, o1+2); shape.push_back(row);
+            row.assign(o2, o2+2); shape.push_back(row);
+            rots.push_back(shape);
+            rots.push_back(shape);
+            rots.push_back(shape);
+            rots.push_back(shape);
+            rotaciones_piezas["O"] = rots;
+        }
+        // S
+        {
+            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
+            int s1[] = {0,1,1}; int s2[] = {1,1,0}; int s3[] = {0,0,0};
+            row.assign(s1, s1+3); shape.push_back(row);
+            row.assign(s2, s2+3); shape.push_back(row);
+            row.assign(s3, s3+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int s4[] = {0,1,0}; int s5[] = {0,1,1}; int s6[] = {0,0,1};
+            row.assign(s4, s4+3); shape.push_back(row);
+            row.assign(s5, s5+3); shape.push_back(row);
+            row.assign(s6, s6+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int s7[] = {0,0,0}; int s8[] = {0,1,1}; int s9[] = {1,1,0};
+            row.assign(s7, s7+3); shape.push_back(row);
+            row.assign(s8, s8+3); shape.push_back(row);
+            row.assign(s9, s9+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int s10[] = {1,0,0}; int s11[] = {1,1,0}; int s12[] = {0,1,0};
+            row.assign(s10, s10+3); shape.push_back(row);
+            row.assign(s11, s11+3); shape.push_back(row);
+            row.assign(s12, s12+3); shape.push_back(row);
+            rots.push_back(shape);
+            rotaciones_piezas["S"] = rots;
+        }
+        // Z
+        {
+            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
+            int z1[] = {1,1,0}; int z2[] = {0,1,1}; int z3[] = {0,0,0};
+            row.assign(z1, z1+3); shape.push_back(row);
+            row.assign(z2, z2+3); shape.push_back(row);
+            row.assign(z3, z3+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int z4[] = {0,0,1}; int z5[] = {0,1,1}; int z6[] = {0,1,0};
+            row.assign(z4, z4+3); shape.push_back(row);
+            row.assign(z5, z5+3); shape.push_back(row);
+            row.assign(z6, z6+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int z7[] = {0,0,0}; int z8[] = {1,1,0}; int z9[] = {0,1,1};
+            row.assign(z7, z7+3); shape.push_back(row);
+            row.assign(z8, z8+3); shape.push_back(row);
+            row.assign(z9, z9+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int z10[] = {0,1,0}; int z11[] = {1,1,0}; int z12[] = {1,0,0};
+            row.assign(z10, z10+3); shape.push_back(row);
+            row.assign(z11, z11+3); shape.push_back(row);
+            row.assign(z12, z12+3); shape.push_back(row);
+            rots.push_back(shape);
+            rotaciones_piezas["Z"] = rots;
+        }
+        // T
+        {
+            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
+            int t1[] = {0,1,0}; int t2[] = {1,1,1}; int t3[] = {0,0,0};
+            row.assign(t1, t1+3); shape.push_back(row);
+            row.assign(t2, t2+3); shape.push_back(row);
+            row.assign(t3, t3+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int t4[] = {0,1,0}; int t5[] = {0,1,1}; int t6[] = {0,1,0};
+            row.assign(t4, t4+3); shape.push_back(row);
+            row.assign(t5, t5+3); shape.push_back(row);
+            row.assign(t6, t6+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int t7[] = {0,0,0}; int t8[] = {1,1,1}; int t9[] = {0,1,0};
+            row.assign(t7, t7+3); shape.push_back(row);
+            row.assign(t8, t8+3); shape.push_back(row);
+            row.assign(t9, t9+3); shape.push_back(row);
+            rots.push_back(shape);
+            shape.clear();
+            int t10[] = {0,1,0}; int t11[] = {1,1,0}; int t12[] = {0,1,0};
+            row.assign(t10, t10+3); shape.push_back(row);
+            row.assign(t11, t11+3); shape.push_back(row);
+            row.assign(t12, t12+3); shape.push_back(row);
+            rots.push_back(shape);
+            rotaciones_piezas["T"] = rots;
+        }
+    }
+    // Empaqueta rotaciones_piezas en la tabla de máscaras que usan las piezas
+    void construirTablaRotaciones() {
+        for (int t = 0; t < NUM_TIPOS_PIEZA; ++t) {
+            map<string, vector<vector<vector<int> > > >::const_iterator it =
+                rotaciones_piezas.find(nombreTipoPieza(static_cast<TipoPieza>(t)));
+            for (int r = 0; r < NUM_ROTACIONES; ++r) {
+                FormaPieza& f = tabla_rotaciones.formas[t][r];
+                for (int i = 0; i < TAMANIO_CAJA_PIEZA; ++i) {
+                    f.filas[i] = 0;
+                    f.fondo[i] = -1;
+                }
+                f.alto = 0;
+                f.ancho = 0;
+                f.col_min = TAMANIO_CAJA_PIEZA;
+                f.col_max = -1;
+                f.fila_min = TAMANIO_CAJA_PIEZA;
+                f.fila_max = -1;
+                if (it == rotaciones_piezas.end() || it->second.empty()) continue;
+
+                const vector<vector<int> >& m = it->second[r % it->second.size()];
+                f.alto = min(static_cast<int>(m.size()), TAMANIO_CAJA_PIEZA);
+                f.ancho = m.empty() ? 0 : min(static_cast<int>(m[0].size()), TAMANIO_CAJA_PIEZA);
+                for (int py = 0; py < f.alto; ++py) {
+                    for (int px = 0; px < f.ancho && px < static_cast<int>(m[py].size()); ++px) {
+                        if (m[py][px] != 1) continue;
+                        f.filas[py] |= (1u << px);
+                        f.fondo[px] = max(f.fondo[px], py);
+                        f.col_min = min(f.col_min, px);
+                        f.col_max = max(f.col_max, px);
+                        f.fila_min = min(f.fila_min, py);
+                        f.fila_max = max(f.fila_max, py);
+                    }
+                }
+            }
+        }
+    }
+};
+
+// ----------------------------------------------------------------------------
+// PiezaTetris: valor pequeño con el tipo, la rotación y la posición. La forma
+// se obtiene de la TablaRotaciones de la configuración, así que crear o copiar
+// una pieza no reserva memoria.
+// ----------------------------------------------------------------------------
+struct PiezaTetris {
+    TipoPieza tipo;
+    int       rotacion_actual;
+    int       x;
+    int       y;
+
+    explicit PiezaTetris(TipoPieza t = I)
+        : tipo(t), rotacion_actual(0), x(0), y(0) {}
+};
+
+// ----------------------------------------------------------------------------
+// Patadas de pared SRS (Super Rotation System)
+// ----------------------------------------------------------------------------
+// Si la pieza no cabe al rotar, se prueban en orden hasta cinco
+// desplazamientos y se usa el primero que cabe; cada prueba es una consulta
+// de máscaras con formaCabe. Las tablas son las de la guía SRS para J, L, S,
+// T, Z y para la I (la O no se desplaza), con dy ya invertido porque aquí
+// y crece hacia abajo. Índices: [rotación de origen][sentido][prueba], con
+// sentido 0 = horario y 1 = antihorario.
+// ----------------------------------------------------------------------------
+struct PatadaSRS {
+    signed char dx;
+    signed char dy;
+};
+
+static const int NUM_PATADAS_SRS = 5;
+
+static constexpr PatadaSRS PATADAS_SRS_JLSTZ[NUM_ROTACIONES][2][NUM_PATADAS_SRS] = {
+    { { {0,0}, {-1,0}, {-1,-1}, {0, 2}, {-1, 2} },    // 0 -> R
+      { {0,0}, { 1,0}, { 1,-1}, {0, 2}, { 1, 2} } },  // 0 -> L
+    { { {0,0}, { 1,0}, { 1, 1}, {0,-2}, { 1,-2} },    // R -> 2
+      { {0,0}, { 1,0}, { 1, 1}, {0,-2}, { 1,-2} } },  // R -> 0
+    { { {0,0}, { 1,0}, { 1,-1}, {0, 2}, { 1, 2} },    // 2 -> L
+      { {0,0}, {-1,0}, {-1,-1}, {0, 2}, {-1, 2} } },  // 2 -> R
+    { { {0,0}, {-1,0}, {-1, 1}, {0,-2}, {-1,-2} },    // L -> 0
+      { {0,0}, {-1,0}, {-1, 1}, {0,-2}, {-1,-2} } }   // L -> 2
+};
+
+static constexpr PatadaSRS PATADAS_SRS_I[NUM_ROTACIONES][2][NUM_PATADAS_SRS] = {
+    { { {0,0}, {-2,0}, { 1,0}, {-2, 1}, { 1,-2} },    // 0 -> R
+      { {0,0}, {-1,0}, { 2,0}, {-1,-2}, { 2, 1} } },  // 0 -> L
+    { { {0,0}, {-1,0}, { 2,0}, {-1,-2}, { 2, 1} },    // R -> 2
+      { {0,0}, { 2,0}, {-1,0}, { 2,-1}, {-1, 2} } },  // R -> 0
+    { { {0,0}, { 2,0}, {-1,0}, { 2,-1}, {-1, 2} },    // 2 -> L
+      { {0,0}, { 1,0}, {-2,0}, { 1, 2}, {-2,-1} } },  // 2 -> R
+    { { {0,0}, { 1,0}, {-2,0}, { 1, 2}, {-2,-1} },    // L -> 0
+      { {0,0}, {-2,0}, { 1,0}, {-2, 1}, { 1,-2} } }   // L -> 2
+};
+
+// Prueba k de la rotación de la pieza t desde rotacion (sentido 0 = horario)
+static inline PatadaSRS patadaSRS(TipoPieza t, int rotacion, int sentido, int k) {
+    if (t == O) {
+        PatadaSRS quieta = { 0, 0 };
+        return quieta;
+    }
+    return (t == I) ? PATADAS_SRS_I[rotacion][sentido][k] : PATADAS_SRS_JLSTZ[rotacion][sentido][k];
+}
+
+/**
+ * Rota la pieza un cuarto de vuelta con patadas SRS sobre filas de bits.
+ * @param horario true = sentido horario (rotación + 1)
+ * @return true si alguna prueba cabe; la pieza queda rotada y desplazada
+ */
+static inline bool rotarSRS(const TablaRotaciones& tabla, PiezaTetris& p, bool horario,
+                            const FilaBits* filas, int ancho, int alto) {
+    int sentido = horario ? 0 : 1;
+    int nr      = (p.rotacion_actual + (horario ? 1 : NUM_ROTACIONES - 1)) % NUM_ROTACIONES;
+    const FormaPieza& f = tabla.forma(p.tipo, nr);
+    int pruebas = (p.tipo == O) ? 1 : NUM_PATADAS_SRS;
+    for (int k = 0; k < pruebas; ++k) {
+        PatadaSRS d = patadaSRS(p.tipo, p.rotacion_actual, sentido, k);
+        if (formaCabe(f, filas, ancho, alto, p.x + d.dx, p.y + d.dy)) {
+            p.x += d.dx;
+            p.y += d.dy;
+            p.rotacion_actual = nr;
+            return true;
+        }
+    }
+    return false;
+}
+
+// ----------------------------------------------------------------------------
+// AnilloPiezas: cola de próximas piezas sobre un arreglo circular de
+// capacidad fija.
+// ----------------------------------------------------------------------------
+static const int CAPACIDAD_COLA_PIEZAS = 16;
+// Deja sitio para reponer una tanda completa de piezas sobre la vista previa
+static const int MAX_VISTA_PREVIA      = CAPACIDAD_COLA_PIEZAS - NUM_TIPOS_PIEZA;
+
+template <int CAPACIDAD>
+class AnilloPiezas {
+private:
+    TipoPieza datos[CAPACIDAD];
+    int       inicio;
+    int       cantidad;
+public:
+    AnilloPiezas() : inicio(0), cantidad(0) {}
+
+    int  tamanio() const { return cantidad; }
+    bool vacio()   const { return cantidad == 0; }
+    bool lleno()   const { return cantidad == CAPACIDAD; }
+    void vaciar()        { inicio = 0; cantidad = 0; }
+
+    void agregar(TipoPieza t) {
+        if (lleno()) return;
+        datos[(inicio + cantidad) % CAPACIDAD] = t;
+        cantidad++;
+    }
+
+    TipoPieza extraer() {
+        TipoPieza t = datos[inicio];
+        inicio = (inicio + 1) % CAPACIDAD;
+        cantidad--;
+        return t;
+    }
+
+    // Pieza en la posición i de la cola (0 = la siguiente)
+    TipoPieza ver(int i) const {
+        return datos[(inicio + i) % CAPACIDAD];
+    }
+};
+
+// ----------------------------------------------------------------------------
+// GeneradorPiezas: decide el orden de las piezas y repone la cola por tandas
+// de siete. Con "bolsa" cada tanda es una permutación de las siete piezas
+// (nunca pasan más de 12 piezas sin una I); con "aleatorio" cada pieza es
+// uniforme e independiente, en el mismo orden en que salían de una en una.
+// ----------------------------------------------------------------------------
+class GeneradorPiezas {
+private:
+    bool bolsa;
+    int  vista_previa;
+public:
+    explicit GeneradorPiezas(const ConfigTetris& cfg)
+        : bolsa(cfg.generador_piezas == "bolsa")
+        , vista_previa(max(1, min(cfg.vista_previa, MAX_VISTA_PREVIA))) {}
+
+    int  vistaPrevia() const { return vista_previa; }
+    bool usaBolsa() const { return bolsa; }
+
+    // Agrega tandas hasta que la cola tenga al menos vista_previa piezas
+    template <int CAPACIDAD>
+    void reponer(AnilloPiezas<CAPACIDAD>& cola, GeneradorAleatorio& aleatorio) const {
+        while (cola.tamanio() < vista_previa) {
+            TipoPieza tanda[NUM_TIPOS_PIEZA];
+            for (int i = 0; i < NUM_TIPOS_PIEZA; ++i) {
+                tanda[i] = static_cast<TipoPieza>(bolsa ? i : aleatorio.rango(NUM_TIPOS_PIEZA));
+            }
+            if (bolsa) {
+                // Fisher-Yates
+                for (int i = NUM_TIPOS_PIEZA - 1; i > 0; --i) {
+                    std::swap(tanda[i], tanda[aleatorio.rango(i + 1)]);
+                }
+            }
+            for (int i = 0; i < NUM_TIPOS_PIEZA; ++i) cola.agregar(tanda[i]);
+        }
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Hash Zobrist del tablero de Tetris
+// ----------------------------------------------------------------------------
+// Cada columna tiene una clave de 64 bits y la celda (x, y) usa esa clave
+// rotada y bits. Así el aporte de una fila es rotl(R(fila), y), con R la
+// XOR de las claves de sus columnas (cuatro consultas por byte), y bajar un
+// bloque de filas k posiciones es rotar su aporte k bits. Al eliminar líneas
+// el aporte del bloque de encima se saca del propio hash quitándole el de
+// las filas de debajo, que en una pila de Tetris suelen ser pocas: el coste
+// es el del lado menor, no el de todas las filas desplazadas.
+//
+// Una rotación de 64 bits repite cada 64 filas, así que las filas van por
+// bandas de FILAS_BANDA_ZOBRIST con claves de columna propias: y e y+64 no
+// comparten clave. Si las líneas eliminadas caen fuera de la primera banda
+// las filas que bajan se recolocan una a una.
+// ----------------------------------------------------------------------------
+static inline uint64_t rotl64(uint64_t x, int k) {
+    k &= 63;
+    return k ? ((x << k) | (x >> (64 - k))) : x;
+}
+
+static const int FILAS_BANDA_ZOBRIST = 64;  // Periodo de rotl64
+static const int BANDAS_ZOBRIST      = ALTO_TABLERO_MAXIMO / FILAS_BANDA_ZOBRIST;
+
+class ZobristTetris {
+private:
+    uint64_t columnas[BANDAS_ZOBRIST][ANCHO_TABLERO_MAXIMO];
+    uint64_t por_byte[BANDAS_ZOBRIST][4][256];    // R() de cada byte de la fila, por banda
+    uint64_t piezas[NUM_TIPOS_PIEZA + 1];         // Pieza a colocar (+VACIO)
+    uint64_t siguientes[NUM_TIPOS_PIEZA + 1];     // Pieza siguiente conocida (+VACIO)
+    uint64_t rotaciones[NUM_ROTACIONES];
+    uint64_t posiciones_x[ANCHO_TABLERO_MAXIMO + 2 * TAMANIO_CAJA_PIEZA];
+    uint64_t posiciones_y[ALTO_TABLERO_MAXIMO + 2 * TAMANIO_CAJA_PIEZA];
+    uint64_t profundidades[16];
+
+    uint64_t clave64(GeneradorAleatorio& g) {
+        uint64_t alto = g.siguiente();
+        return (alto << 32) | g.siguiente();
+    }
+public:
+    ZobristTetris() {
+        GeneradorAleatorio g(0x5A0B2157u);  // Semilla fija: las claves son iguales en cada ejecución
+        for (int x = 0; x < ANCHO_TABLERO_MAXIMO; ++x) columnas[0][x] = clave64(g);
+        for (int t = 0; t <= NUM_TIPOS_PIEZA; ++t) piezas[t]     = clave64(g);
+        for (int t = 0; t <= NUM_TIPOS_PIEZA; ++t) siguientes[t] = clave64(g);
+        for (int r = 0; r < NUM_ROTACIONES; ++r)   rotaciones[r] = clave64(g);
+        for (int x = 0; x < ANCHO_TABLERO_MAXIMO + 2 * TAMANIO_CAJA_PIEZA; ++x) posiciones_x[x] = clave64(g);
+        for (int d = 0; d < 16; ++d) profundidades[d] = clave64(g);
+        for (int b = 1; b < BANDAS_ZOBRIST; ++b) {
+            for (int x = 0; x < ANCHO_TABLERO_MAXIMO; ++x) columnas[b][x] = clave64(g);
+        }
+        for (int y = 0; y < ALTO_TABLERO_MAXIMO + 2 * TAMANIO_CAJA_PIEZA; ++y) posiciones_y[y] = clave64(g);
+        for (int banda = 0; banda < BANDAS_ZOBRIST; ++banda) {
+            for (int b = 0; b < 4; ++b) {
+                for (int v = 0; v < 256; ++v) {
+                    uint64_t h = 0;
+                    for (int bit = 0; bit < 8; ++bit) {
+                        if ((v >> bit) & 1) h ^= columnas[banda][b * 8 + bit];
+                    }
+                    por_byte[banda][b][v] = h;
+                }
+            }
+        }
+    }
+
+    uint64_t celda(int x, int y) const {
+        return rotl64(columnas[y / FILAS_BANDA_ZOBRIST][x], y);
+    }
+
+    // Aporte de una fila completa al hash
+    uint64_t fila(FilaBits f, int y) const {
+        const uint64_t (*t)[256] = por_byte[y / FILAS_BANDA_ZOBRIST];
+        uint64_t r = t[0][f & 0xFF] ^ t[1][(f >> 8) & 0xFF] ^ t[2][(f >> 16) & 0xFF] ^ t[3][(f >> 24) & 0xFF];
+        return rotl64(r, y);
+    }
+
+    uint64_t tablero(const FilaBits* filas, int alto) const {
+        uint64_t h = 0;
+        for (int y = 0; y < alto; ++y) {
+            if (filas[y]) h ^= fila(filas[y], y);
+        }
+        return h;
+    }
+
+    // Hash tras fijar una forma en (x, y); las celdas nuevas no se solapan con las existentes
+    uint64_t alFijar(uint64_t h, const FormaPieza& f, int x, int y, int alto) const {
+        for (int py = f.fila_min; py <= f.fila_max; ++py) {
+            int wy = y + py;
+            if (wy < 0 || wy >= alto) continue;
+            h ^= fila((x >= 0) ? (f.filas[py] << x) : (f.filas[py] >> -x), wy);
+        }
+        return h;
+    }
+
+    /**
+     * Hash tras eliminar las filas llenas entre desde y hasta de un tablero
+     * de alto filas. filas es el estado antes de compactar. Las del rango se
+     * recolocan una a una; las de encima bajan en bloque (una rotación) si
+     * todo queda en la primera banda y, si no, también una a una. El aporte
+     * del bloque se suma fila a fila o, si hay menos filas debajo de hasta
+     * que encima de desde, se obtiene de h quitando el resto.
+     */
+    uint64_t alEliminarLineas(uint64_t h, const FilaBits* filas, FilaBits llena, int desde, int hasta,
+                              int alto) const {
+        uint64_t rango = 0;  // Aporte de [desde, hasta] antes de compactar
+        uint64_t nuevo = 0;  // Y después
+        int destino = hasta;
+        for (int y = hasta; y >= desde; --y) {
+            rango ^= fila(filas[y], y);
+            if (filas[y] != llena) {
+                nuevo ^= fila(filas[y], destino);
+                destino--;
+            }
+        }
+        int bajan = destino - desde + 1;  // Tantas filas como llenas había
+        if (hasta < FILAS_BANDA_ZOBRIST) {
+            uint64_t arriba = 0;
+            if (alto - 1 - hasta < desde) {
+                arriba = h ^ rango;
+                for (int y = hasta + 1; y < alto; ++y) {
+                    if (filas[y]) arriba ^= fila(filas[y], y);
+                }
+            } else {
+                for (int y = 0; y < desde; ++y) {
+                    if (filas[y]) arriba ^= fila(filas[y], y);
+                }
+            }
+            return h ^ rango ^ nuevo ^ arriba ^ rotl64(arriba, bajan);
+        }
+        h ^= rango ^ nuevo;
+        for (int y = 0; y < desde; ++y) {
+            if (filas[y]) h ^= fila(filas[y], y) ^ fila(filas[y], y + bajan);
+        }
+        return h;
+    }
+
+    // Clave de búsqueda: tablero + pieza a colocar + siguiente conocida + plies restantes
+    uint64_t claveBusqueda(uint64_t h, TipoPieza pieza, TipoPieza siguiente, int resto) const {
+        return h ^ piezas[pieza] ^ siguientes[siguiente] ^ profundidades[resto & 15];
+    }
+
+    // Clave del estado completo con la pieza activa en su posición
+    uint64_t claveEstado(uint64_t h, const PiezaTetris& p) const {
+        int ix = max(0, min(p.x + TAMANIO_CAJA_PIEZA, ANCHO_TABLERO_MAXIMO + 2 * TAMANIO_CAJA_PIEZA - 1));
+        int iy = max(0, min(p.y + TAMANIO_CAJA_PIEZA, ALTO_TABLERO_MAXIMO + 2 * TAMANIO_CAJA_PIEZA - 1));
+        return h ^ piezas[p.tipo] ^ rotaciones[p.rotacion_actual & 3] ^ posiciones_x[ix] ^ posiciones_y[iy];
+    }
+};
+
+// Claves compartidas por todos los tableros (se generan una vez)
+static const ZobristTetris& obtenerZobrist() {
+    static ZobristTetris instancia;
+    return instancia;
+}
+
+// ----------------------------------------------------------------------------
+// TablaTransposicion: caché de valoraciones de tamaño fijo sin cerrojos
+// ----------------------------------------------------------------------------
+// Cada entrada guarda (clave ^ dato, dato) en dos atómicos relajados. Si otro
+// hilo escribe a la vez y la lectura mezcla dos escrituras, la XOR no
+// coincide con la clave y la entrada se trata como vacía.
+// ----------------------------------------------------------------------------
+class TablaTransposicion {
+private:
+    struct Entrada {
+        std::atomic<uint64_t> clave_xor;
+        std::atomic<uint64_t> dato;
+    };
+
+    Entrada* entradas;
+    uint64_t mascara;
+
+    TablaTransposicion(const TablaTransposicion&);
+    TablaTransposicion& operator=(const TablaTransposicion&);
+public:
+    /**
+     * @param bits La tabla tiene 2^bits entradas
+     */
+    explicit TablaTransposicion(int bits = 18)
+        : entradas(new Entrada[static_cast<size_t>(1) << bits])
+        , mascara((static_cast<uint64_t>(1) << bits) - 1) {
+        limpiar();
+    }
+
+    ~TablaTransposicion() { delete[] entradas; }
+
+    void limpiar() {
+        for (uint64_t i = 0; i <= mascara; ++i) {
+            entradas[i].clave_xor.store(0, std::memory_order_relaxed);
+            entradas[i].dato.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    bool buscar(uint64_t clave, double& valor) const {
+        const Entrada& e = entradas[clave & mascara];
+        uint64_t dato = e.dato.load(std::memory_order_relaxed);
+        uint64_t cx   = e.clave_xor.load(std::memory_order_relaxed);
+        if ((cx ^ dato) != clave || (cx == 0 && dato == 0)) return false;
+        memcpy(&valor, &dato, sizeof(valor));
+        return true;
+    }
+
+    void guardar(uint64_t clave, double valor) {
+        uint64_t dato;
+        memcpy(&dato, &valor, sizeof(dato));
+        Entrada& e = entradas[clave & mascara];
+        e.dato.store(dato, std::memory_order_relaxed);
+        e.clave_xor.store(clave ^ dato, std::memory_order_relaxed);
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Políticas de juego para Tetris (modo headless y lotes)
+// ----------------------------------------------------------------------------
+// Una política recibe una vista de solo lectura del estado en cada tick y
+// devuelve la tecla a pulsar (0 = ninguna), como si fuera un jugador.
+// ----------------------------------------------------------------------------
+struct VistaTetris {
+    const FilaBits*        filas;       // filas[y], bit x = celda ocupada
+    int                    ancho;
+    int                    alto;
+    const TablaRotaciones* rotaciones;
+    uint64_t               hash;        // Hash Zobrist del tablero (sin la pieza que cae)
+    PiezaTetris            pieza;       // Pieza que cae
+    TipoPieza              siguiente;   // Próxima pieza (VACIO si no hay)
+    TipoPieza              proximas[MAX_VISTA_PREVIA];  // Vista previa; proximas[0] == siguiente
+    int                    num_proximas;
+    long                   tick;
+};
+
+class PoliticaTetris {
+public:
+    virtual ~PoliticaTetris() {}
+    virtual char decidir(const VistaTetris& v) = 0;
+};
+
+// Repite un guion de teclas fijo
+class PoliticaGuionTetris : public PoliticaTetris {
+private:
+    GuionEntrada guion;
+public:
+    explicit PoliticaGuionTetris(const string& teclas) : guion(teclas) {}
+    char decidir(const VistaTetris& v) { return guion.tecla(v.tick); }
+};
+
+// Pulsa teclas de movimiento al azar (línea base para comparar bots)
+class PoliticaAleatoriaTetris : public PoliticaTetris {
+private:
+    GeneradorAleatorio aleatorio;
+public:
+    explicit PoliticaAleatoriaTetris(uint32_t semilla) : aleatorio(semilla) {}
+    char decidir(const VistaTetris&) {
+        static const char teclas[] = "adws....";
+        return teclas[aleatorio.rango(8)];
+    }
+};
+
+// ============================================================================
+// CLASE: TableroTetris
+// ============================================================================
+// Tablero de Tetris parametrizado por sus dimensiones. Además del tipo de
+// pieza de cada celda, cada fila se guarda empaquetada en una máscara de bits
+// (bit x = columna x ocupada): saber si una fila está completa es una sola
+// comparación y las colisiones se prueban por fila. Al fijar una pieza solo
+// se revisan las filas que ocupa (eliminarLineasCompletas); la máscara hace
+// el papel que antes tenía el contador de celdas por fila.
+//
+// Las instancias de tamaño fijo (10x20, 10x40) usan arreglos estáticos para
+// que el compilador pueda desenrollar los bucles; TableroTetris<0, 0> es la
+// alternativa genérica con las dimensiones leídas de la configuración.
+// ============================================================================
+// Almacenamiento para dimensiones conocidas en compilación
+template <int ANCHO_T, int ALTO_T>
+class AlmacenTablero {
+protected:
+    FilaBits      filas[ALTO_T];
+    unsigned char celdas[ANCHO_T * ALTO_T];
+
+    void dimensionar(int, int) {}
+public:
+    int ancho() const { return ANCHO_T; }
+    int alto()  const { return ALTO_T; }
+};
+
+// Almacenamiento para dimensiones leídas en tiempo de ejecución
+template <>
+class AlmacenTablero<0, 0> {
+protected:
+    vector<FilaBits>      filas;
+    vector<unsigned char> celdas;
+    int                   ancho_;
+    int                   alto_;
+
+    void dimensionar(int ancho, int alto) {
+        ancho_ = max(ANCHO_TABLERO_MINIMO, min(ancho, ANCHO_TABLERO_MAXIMO));
+        alto_  = max(ALTO_TABLERO_MINIMO, min(alto, ALTO_TABLERO_MAXIMO));
+        filas.assign(alto_, 0);
+        celdas.assign(ancho_ * alto_, static_cast<unsigned char>(VACIO));
+    }
+public:
+    AlmacenTablero() : ancho_(0), alto_(0) {}
+    int ancho() const { return ancho_; }
+    int alto()  const { return alto_; }
+};
+
+template <int ANCHO_T, int ALTO_T>
+class TableroTetris : public AlmacenTablero<ANCHO_T, ALTO_T> {
+public:
+    /**
+     * Constructor: las dimensiones solo se usan en la versión genérica.
+     */
+    explicit TableroTetris(int ancho = ANCHO_T, int alto = ALTO_T) : hash_(0) {
+        this->dimensionar(ancho, alto);
+        vaciar();
+    }
+
+    // Fila de la celda ocupada más alta de la columna x (alto si está vacía)
+    int cima(int x) const { return cimas_[x]; }
+    int alturaColumna(int x) const { return this->alto() - cimas_[x]; }
+
+    /**
+     * Filas que puede bajar la forma desde (x, y) antes de apoyarse. Si la
+     * pieza está por encima de la cima en todas sus columnas, la distancia
+     * sale del perfil inferior de la forma y de las cimas (sin recorrer
+     * filas); si está bajo algún saliente se prueba fila a fila.
+     */
+    int caida(const FormaPieza& f, int x, int y) const {
+        int d = this->alto();
+        for (int px = f.col_min; px <= f.col_max; ++px) {
+            if (f.fondo[px] < 0) continue;
+            int fondo = y + f.fondo[px];
+            int cima_columna = cimas_[x + px];
+            if (fondo >= cima_columna) {
+                int n = 0;
+                while (cabe(f, x, y + n + 1)) n++;
+                return n;
+            }
+            d = min(d, cima_columna - fondo - 1);
+        }
+        return d;
+    }
+
+    // Hash Zobrist de las celdas ocupadas, mantenido al colocar y al eliminar líneas
+    uint64_t hash() const { return hash_; }
+
+    FilaBits mascaraLlena() const {
+        return (this->ancho() >= ANCHO_TABLERO_MAXIMO) ? ~0u : ((1u << this->ancho()) - 1u);
+    }
+
+    FilaBits fila(int y) const { return this->filas[y]; }
+    const FilaBits* datosFilas() const { return &this->filas[0]; }
+
+    bool ocupada(int x, int y) const {
+        return ((this->filas[y] >> x) & 1u) != 0;
+    }
+
+    TipoPieza tipo(int x, int y) const {
+        return static_cast<TipoPieza>(this->celdas[y * this->ancho() + x]);
+    }
+
+    void colocar(int x, int y, TipoPieza t) {
+        if (!((this->filas[y] >> x) & 1u)) hash_ ^= obtenerZobrist().celda(x, y);
+        if (y < cimas_[x]) cimas_[x] = y;
+        this->filas[y] |= (1u << x);
+        this->celdas[y * this->ancho() + x] = static_cast<unsigned char>(t);
+    }
+
+    bool filaCompleta(int y) const {
+        return this->filas[y] == mascaraLlena();
+    }
+
+    bool cabe(const FormaPieza& f, int x, int y) const {
+        return formaCabe(f, datosFilas(), this->ancho(), this->alto(), x, y);
+    }
+
+    /**
+     * Copia las celdas de una forma al tablero (se ignora lo que quede fuera).
+     */
+    void fijar(const FormaPieza& f, int x, int y, TipoPieza t) {
+        for (int py = f.fila_min; py <= f.fila_max; ++py) {
+            int wy = y + py;
+            if (wy < 0 || wy >= this->alto()) continue;
+            for (int px = f.col_min; px <= f.col_max; ++px) {
+                int wx = x + px;
+                if (f.ocupa(px, py) && wx >= 0 && wx < this->ancho()) {
+                    colocar(wx, wy, t);
+                }
+            }
+        }
+    }
+
+    /**
+     * Elimina las filas completas entre fila_desde y fila_hasta y hace caer
+     * las superiores. Solo se desplazan las filas por encima de fila_hasta.
+     * @return Número de líneas eliminadas
+     */
+    int eliminarLineasCompletas(int fila_desde, int fila_hasta) {
+        if (fila_desde < 0) fila_desde = 0;
+        if (fila_hasta >= this->alto()) fila_hasta = this->alto() - 1;
+        int eliminadas = 0;
+        for (int y = fila_desde; y <= fila_hasta; ++y) {
+            if (filaCompleta(y)) eliminadas++;
+        }
+        if (eliminadas == 0) return 0;
+
+        hash_ = obtenerZobrist().alEliminarLineas(hash_, datosFilas(), mascaraLlena(), fila_desde, fila_hasta,
+                                                  this->alto());
+
+        // Compactar de abajo hacia arriba saltando las filas completas
+        const int w = this->ancho();
+        int destino = fila_hasta;
+        for (int origen = fila_hasta; origen >= 0; --origen) {
+            if (origen >= fila_desde && filaCompleta(origen)) continue;
+            if (destino != origen) {
+                this->filas[destino] = this->filas[origen];
+                for (int x = 0; x < w; ++x) {
+                    this->celdas[destino * w + x] = this->celdas[origen * w + x];
+                }
+            }
+            destino--;
+        }
+        for (int y = destino; y >= 0; --y) {
+            limpiarFila(y);
+        }
+        recalcularCimas();
+        return eliminadas;
+    }
+
+    void vaciar() {
+        for (int y = 0; y < this->alto(); ++y) {
+            limpiarFila(y);
+        }
+        hash_ = 0;
+        for (int x = 0; x < ANCHO_TABLERO_MAXIMO; ++x) cimas_[x] = this->alto();
+    }
+private:
+    uint64_t hash_;
+    int      cimas_[ANCHO_TABLERO_MAXIMO];  // Perfil superior (skyline) por columna
+
+    /**
+     * Tras eliminar líneas las cimas solo pueden bajar: se recorren las filas
+     * desde la cima más alta anterior hasta encontrar todas las columnas.
+     */
+    void recalcularCimas() {
+        int desde = this->alto();
+        for (int x = 0; x < this->ancho(); ++x) {
+            desde = min(desde, cimas_[x]);
+            cimas_[x] = this->alto();
+        }
+        FilaBits pendientes = mascaraLlena();
+        for (int y = desde; y < this->alto() && pendientes; ++y) {
+            FilaBits nuevas = this->filas[y] & pendientes;
+            for (int x = 0; nuevas; ++x, nuevas >>= 1) {
+                if (nuevas & 1u) cimas_[x] = y;
+            }
+            pendientes &= ~this->filas[y];
+        }
+    }
+
+    void limpiarFila(int y) {
+        const int w = this->ancho();
+        this->filas[y] = 0;
+        for (int x = 0; x < w; ++x) {
+            this->celdas[y * w + x] = static_cast<unsigned char>(VACIO);
+        }
+    }
+};
+
+typedef TableroTetris<10, 20> TableroTetris10x20;
+typedef TableroTetris<10, 40> TableroTetris10x40;
+typedef TableroTetris<0, 0>   TableroTetrisDinamico;
+
+/**
+ * Elige el tablero según las dimensiones de la configuración: los tamaños
+ * habituales usan tableros de tamaño fijo y cualquier otro la versión
+ * genérica. 'accion' es un functor con una plantilla de miembro
+ * template <class Tablero> void ejecutar(), que instancia el motor que
+ * necesite con ese tablero.
+ */
+template <class Accion>
+static void conTableroTetris(const ConfigTetris& cfg, Accion& accion) {
+    if (cfg.ancho_tablero == 10 && cfg.alto_tablero == 20) {
+        accion.template ejecutar<TableroTetris10x20>();
+    } else if (cfg.ancho_tablero == 10 && cfg.alto_tablero == 40) {
+        accion.template ejecutar<TableroTetris10x40>();
+    } else {
+        accion.template ejecutar<TableroTetrisDinamico>();
+    }
+}
+
+// ============================================================================
+// CLASE: BotColocacion
+// ============================================================================
+// Jugador automático de Tetris. Para cada pieza nueva enumera las
+// colocaciones (rotación, columna) a las que se llega rotando en el sitio,
+// desplazándose por la fila y soltando, con pruebas de máscara sobre las
+// filas de bits; deja caer cada una, limpia líneas y puntúa el tablero
+// resultante con una heurística lineal (altura total, líneas, huecos y
+// rugosidad). No prueba patadas SRS, deslizamientos bajo un saliente ni
+// giros ya apoyada: esas colocaciones existen pero el bot no las ve. Con
+// ancho_haz > 0 conserva las mejores colocaciones y las expande con la
+// pieza siguiente (búsqueda en haz), repartiendo la expansión en un
+// PoolTrabajo si se le pasa uno. Después traduce el objetivo a teclas:
+// rotar, desplazar y soltar.
+//
+// La búsqueda no reserva memoria por pieza: cada buscador guarda un tablero
+// de trabajo por nivel de profundidad y el bot conserva un sub-buscador por
+// hilo del pool.
+// ============================================================================
+static inline int contarBits(FilaBits v) {
+#ifdef __GNUC__
+    return __builtin_popcount(v);
+#else
+    int n = 0;
+    for (; v; v &= v - 1) n++;
+    return n;
+#endif
+}
+
+struct Colocacion {
+    int    rotacion;
+    int    x;
+    int    y;       // Fila final tras la caída
+    int    lineas;  // Líneas que completa
+    double valor;   // Puntuación heurística (mayor es mejor)
+
+    Colocacion() : rotacion(0), x(0), y(0), lineas(0), valor(0.0) {}
+};
+
+static const int MAX_COLOCACIONES = NUM_ROTACIONES * (ANCHO_TABLERO_MAXIMO + TAMANIO_CAJA_PIEZA);
+
+// Colocaciones que se expanden de una pieza promediada (desconocida). Cada
+// una se multiplica por los siete tipos del nivel de abajo: con todo el haz,
+// --profundidad 3 valora unas 50 veces más tableros que 2.
+static const int HAZ_PIEZA_PROMEDIADA = 2;
+
+class BotColocacion : public PoliticaTetris {
+public:
+    struct Pesos {
+        double altura;     // Suma de alturas de columnas
+        double lineas;     // Líneas completadas
+        double huecos;     // Celdas vacías con algo encima
+        double rugosidad;  // Suma de diferencias de altura entre columnas vecinas
+
+        Pesos() : altura(-0.510066), lineas(0.760666), huecos(-0.35663), rugosidad(-0.184483) {}
+    };
+private:
+    Pesos        pesos;
+    int          ancho_haz;   // 0 = solo la pieza actual
+    int          profundidad; // Piezas posteriores a la actual que se exploran
+    PoolTrabajo* pool;        // Opcional: expande el haz en paralelo
+    TablaTransposicion* transposiciones;  // Valores ya buscados (compartida entre hilos)
+    bool         tabla_propia;
+    bool         con_plan;
+    Colocacion   objetivo;
+    TipoPieza    tipo_plan;
+    int          ultima_y;
+    long         evaluadas;   // Colocaciones puntuadas (para medir rendimiento)
+
+    // Tableros de trabajo: el nivel 'resto' (0..profundidad-1) lo usa
+    // valorarSiguiente y el nivel 'profundidad' la copia de enumerar
+    vector<FilaBits>        trabajo;
+    int                     alto_trabajo;
+    vector<BotColocacion*>  sub_buscadores;  // Uno por hilo del pool (planificar)
+
+    /**
+     * Copia la forma en las filas y compacta las filas llenas.
+     * @return Líneas eliminadas
+     */
+    static int colocarYLimpiar(const FormaPieza& f, FilaBits* filas, int ancho, int alto, int x, int y,
+                               uint64_t* hash = NULL) {
+        const FilaBits llena = (ancho >= ANCHO_TABLERO_MAXIMO) ? ~0u : ((1u << ancho) - 1u);
+        int desde = alto;
+        int hasta = -1;
+        bool hay_llenas = false;
+        for (int py = f.fila_min; py <= f.fila_max; ++py) {
+            int wy = y + py;
+            if (wy < 0 || wy >= alto) continue;
+            filas[wy] |= (x >= 0) ? (f.filas[py] << x) : (f.filas[py] >> -x);
+            desde = min(desde, wy);
+            hasta = max(hasta, wy);
+            hay_llenas = hay_llenas || filas[wy] == llena;
+        }
+        if (hash) {
+            const ZobristTetris& z = obtenerZobrist();
+            *hash = z.alFijar(*hash, f, x, y, alto);
+            if (hay_llenas) *hash = z.alEliminarLineas(*hash, filas, llena, desde, hasta, alto);
+        }
+        int eliminadas = 0;
+        int destino = hasta;
+        for (int origen = hasta; origen >= 0; --origen) {
+            if (origen >= desde && filas[origen] == llena) {
+                eliminadas++;
+                continue;
+            }
+            if (eliminadas > 0) filas[destino] = filas[origen];
+            destino--;
+        }
+        for (int yy = destino; eliminadas > 0 && yy >= 0 && yy > destino - eliminadas; --yy) {
+            filas[yy] = 0;
+        }
+        return eliminadas;
+    }
+
+    static int caer(const FormaPieza& f, const FilaBits* filas, int ancho, int alto, int x, int y) {
+        while (formaCabe(f, filas, ancho, alto, x, y + 1)) y++;
+        return y;
+    }
+
+    BotColocacion(const BotColocacion&);
+    BotColocacion& operator=(const BotColocacion&);
+
+    // Sub-buscador de un hilo: comparte pesos y tabla, cuenta sus propias evaluaciones
+    BotColocacion(const BotColocacion& padre, int)
+        : pesos(padre.pesos), ancho_haz(padre.ancho_haz), profundidad(padre.profundidad), pool(NULL)
+        , transposiciones(padre.transposiciones), tabla_propia(false)
+        , con_plan(false), tipo_plan(VACIO), ultima_y(0), evaluadas(0), alto_trabajo(0) {}
+
+    // Tablero de trabajo del nivel indicado para un tablero de 'alto' filas
+    FilaBits* tableroTrabajo(int nivel, int alto) {
+        if (alto != alto_trabajo) {
+            trabajo.assign(static_cast<size_t>(profundidad + 1) * alto, 0);
+            alto_trabajo = alto;
+        }
+        return &trabajo[static_cast<size_t>(nivel) * alto];
+    }
+public:
+    /**
+     * @param haz         Candidatas que se expanden en cada nivel (0 = voraz)
+     * @param p           Pool opcional para expandir en paralelo
+     * @param prof        Piezas posteriores a la actual que se exploran; la
+     *                    primera es la siguiente conocida y las demás se
+     *                    promedian sobre los siete tipos
+     */
+    explicit BotColocacion(int haz = 0, PoolTrabajo* p = NULL, int prof = 1)
+        : ancho_haz(haz), profundidad(max(1, min(prof, 8))), pool(p)
+        , transposiciones(NULL), tabla_propia(false)
+        , con_plan(false), tipo_plan(VACIO), ultima_y(0), evaluadas(0), alto_trabajo(0) {
+        if (ancho_haz > 0 && profundidad > 1) {
+            transposiciones = new TablaTransposicion();
+            tabla_propia    = true;
+        }
+    }
+
+    ~BotColocacion() {
+        for (size_t h = 0; h < sub_buscadores.size(); ++h) delete sub_buscadores[h];
+        if (tabla_propia) delete transposiciones;
+    }
+
+    long colocacionesEvaluadas() const { return evaluadas; }
+
+    /**
+     * Puntúa un tablero con la heurística lineal. Las alturas y los huecos
+     * salen de recorrer las filas de arriba abajo acumulando las columnas ya
+     * cubiertas (una operación de bits por fila).
+     */
+    double evaluar(const FilaBits* filas, int ancho, int alto, int lineas) const {
+        int      alturas[ANCHO_TABLERO_MAXIMO];
+        FilaBits cubiertas = 0;
+        int      huecos = 0;
+        for (int x = 0; x < ancho; ++x) alturas[x] = 0;
+        for (int y = 0; y < alto; ++y) {
+            FilaBits nuevas = filas[y] & ~cubiertas;
+            while (nuevas) {
+                int x = 0;
+                while (!((nuevas >> x) & 1u)) x++;
+                alturas[x] = alto - y;
+                nuevas &= nuevas - 1;
+            }
+            huecos    += contarBits(cubiertas & ~filas[y]);
+            cubiertas |= filas[y];
+        }
+        int suma = 0, rugosidad = 0;
+        for (int x = 0; x < ancho; ++x) {
+            suma += alturas[x];
+            if (x > 0) rugosidad += abs(alturas[x] - alturas[x - 1]);
+        }
+        return pesos.altura * suma + pesos.lineas * lineas + pesos.huecos * huecos + pesos.rugosidad * rugosidad;
+    }
+
+    /**
+     * Enumera las colocaciones de una pieza que rota en el sitio, se desplaza
+     * por la fila (x0, y0) y cae (sin patadas SRS ni movimientos ya apoyada).
+     * Las rotaciones que repiten silueta (solo desplazada en la caja) se
+     * omiten.
+     * @return Número de colocaciones escritas en salida
+     */
+    int enumerar(const TablaRotaciones& tabla, TipoPieza t, const FilaBits* filas, int ancho, int alto,
+                 int x0, int y0, int rot0, Colocacion* salida) {
+        int       n     = 0;
+        FilaBits* copia = tableroTrabajo(profundidad, alto);
+        for (int k = 0; k < NUM_ROTACIONES; ++k) {
+            int r = (rot0 + k) % NUM_ROTACIONES;
+            const FormaPieza& f = tabla.forma(t, r);
+            if (!formaCabe(f, filas, ancho, alto, x0, y0)) break;  // Las siguientes rotaciones pasan por esta
+            bool repetida = false;
+            for (int j = 0; j < k && !repetida; ++j) {
+                repetida = f.mismaSilueta(tabla.forma(t, (rot0 + j) % NUM_ROTACIONES));
+            }
+            if (repetida) continue;
+            for (int dir = -1; dir <= 1; dir += 2) {
+                for (int x = (dir < 0) ? x0 : x0 + 1; formaCabe(f, filas, ancho, alto, x, y0); x += dir) {
+                    Colocacion& c = salida[n++];
+                    c.rotacion = r;
+                    c.x        = x;
+                    c.y        = caer(f, filas, ancho, alto, x, y0);
+                    for (int yy = 0; yy < alto; ++yy) copia[yy] = filas[yy];
+                    c.lineas = colocarYLimpiar(f, copia, ancho, alto, c.x, c.y);
+                    c.valor  = evaluar(copia, ancho, alto, c.lineas);
+                    evaluadas++;
+                }
+            }
+        }
+        return n;
+    }
+
+    /**
+     * Valor de colocar la pieza t en el tablero (filas, hash) y seguir
+     * buscando resto piezas más. siguiente es la pieza que viene después si
+     * se conoce (VACIO si no); las desconocidas se promedian sobre los siete
+     * tipos. Solo se expanden las ancho_haz mejores colocaciones de cada
+     * nivel (HAZ_PIEZA_PROMEDIADA si la pieza es una de las promediadas).
+     * La clave es el tablero ya sin las líneas eliminadas. Los valores se guardan en la tabla de transposición: el mismo
+     * tablero aparece por varios caminos al limpiar líneas o al caer dos
+     * piezas iguales en orden inverso.
+     */
+    double buscar(const TablaRotaciones& tabla, const FilaBits* filas, int ancho, int alto, uint64_t hash,
+                  TipoPieza t, TipoPieza siguiente, int resto) {
+        uint64_t clave = obtenerZobrist().claveBusqueda(hash, t, siguiente, resto);
+        double   guardado;
+        if (transposiciones && transposiciones->buscar(clave, guardado)) return guardado;
+
+        Colocacion candidatas[MAX_COLOCACIONES];
+        int n = enumerar(tabla, t, filas, ancho, alto, ancho / 2 - 2, 0, 0, candidatas);
+        if (n == 0) return evaluar(filas, ancho, alto, 0) - 1000.0;  // Sin sitio: casi perdida
+        double mejor = candidatas[0].valor;
+        if (resto == 0) {
+            for (int i = 1; i < n; ++i) mejor = max(mejor, candidatas[i].valor);
+            if (transposiciones) transposiciones->guardar(clave, mejor);
+            return mejor;
+        }
+        // Solo la siguiente conocida se busca con resto == profundidad - 1
+        int haz = min(resto < profundidad - 1 ? min(ancho_haz, HAZ_PIEZA_PROMEDIADA) : ancho_haz, n);
+        std::partial_sort(candidatas, candidatas + haz, candidatas + n, mayorValor);
+        for (int i = 0; i < haz; ++i) {
+            const Colocacion& c = candidatas[i];
+            double valor = pesos.lineas * c.lineas + valorarSiguiente(tabla, filas, ancho, alto, hash,
+                                                                      t, c, siguiente, resto - 1);
+            if (i == 0 || valor > mejor) mejor = valor;
+        }
+        if (transposiciones) transposiciones->guardar(clave, mejor);
+        return mejor;
+    }
+
+    /**
+     * Elige la colocación de la pieza actual. Con haz, cada candidata se
+     * valora por la búsqueda de las piezas posteriores.
+     */
+    Colocacion planificar(const VistaTetris& v) {
+        Colocacion candidatas[MAX_COLOCACIONES];
+        int n = enumerar(*v.rotaciones, v.pieza.tipo, v.filas, v.ancho, v.alto,
+                         v.pieza.x, v.pieza.y, v.pieza.rotacion_actual, candidatas);
+        if (n == 0) {
+            Colocacion quieta;
+            quieta.rotacion = v.pieza.rotacion_actual;
+            quieta.x        = v.pieza.x;
+            return quieta;
+        }
+        if (ancho_haz > 0 && v.siguiente != VACIO) {
+            int haz = min(ancho_haz, n);
+            std::partial_sort(candidatas, candidatas + haz, candidatas + n, mayorValor);
+            size_t hilos = pool ? static_cast<size_t>(pool->tamanio()) : 1;
+            while (sub_buscadores.size() < hilos) sub_buscadores.push_back(new BotColocacion(*this, 0));
+            double valores[MAX_COLOCACIONES];
+            std::function<void(long, int)> expandir = [&](long i, int h) {
+                const Colocacion& c = candidatas[i];
+                // Las líneas de la primera pieza también cuentan en el valor final
+                valores[i] = pesos.lineas * c.lineas
+                           + sub_buscadores[h]->valorarSiguiente(*v.rotaciones, v.filas, v.ancho, v.alto, v.hash,
+                                                                 v.pieza.tipo, c, v.siguiente, profundidad - 1);
+            };
+            if (pool) {
+                pool->paraCada(haz, expandir);
+            } else {
+                for (int i = 0; i < haz; ++i) expandir(i, 0);
+            }
+            int elegida = 0;
+            for (int i = 0; i < haz; ++i) {
+                if (valores[i] > valores[elegida]) elegida = i;
+            }
+            for (size_t h = 0; h < sub_buscadores.size(); ++h) {
+                evaluadas += sub_buscadores[h]->evaluadas;
+                sub_buscadores[h]->evaluadas = 0;
+            }
+            return candidatas[elegida];
+        }
+        int mejor = 0;
+        for (int i = 1; i < n; ++i) {
+            if (candidatas[i].valor > candidatas[mejor].valor) mejor = i;
+        }
+        return candidatas[mejor];
+    }
+
+    char decidir(const VistaTetris& v) {
+        // Pieza nueva: cambia el tipo o vuelve a aparecer arriba
+        if (!con_plan || v.pieza.tipo != tipo_plan || v.pieza.y < ultima_y) {
+            objetivo  = planificar(v);
+            tipo_plan = v.pieza.tipo;
+            con_plan  = true;
+        }
+        ultima_y = v.pieza.y;
+
+        if (v.pieza.rotacion_actual != objetivo.rotacion) {
+            int nr = (v.pieza.rotacion_actual + 1) % NUM_ROTACIONES;
+            if (formaCabe(v.rotaciones->forma(v.pieza.tipo, nr), v.filas, v.ancho, v.alto, v.pieza.x, v.pieza.y)) {
+                return 'w';
+            }
+        }
+        if (v.pieza.x < objetivo.x) return 'd';
+        if (v.pieza.x > objetivo.x) return 'a';
+        return 'x';  // Alineada: soltar
+    }
+private:
+    static bool mayorValor(const Colocacion& a, const Colocacion& b) {
+        return a.valor > b.valor;
+    }
+
+    /**
+     * Aplica la colocación c de la pieza t sobre una copia del tablero y
+     * busca la pieza siguiente (o el promedio de los siete tipos si no se
+     * conoce). La copia es el tablero de trabajo del nivel 'resto': los
+     * niveles más profundos usan los suyos.
+     */
+    double valorarSiguiente(const TablaRotaciones& tabla, const FilaBits* filas, int ancho, int alto, uint64_t hash,
+                            TipoPieza t, const Colocacion& c, TipoPieza siguiente, int resto) {
+        FilaBits* tablero = tableroTrabajo(resto, alto);
+        for (int y = 0; y < alto; ++y) tablero[y] = filas[y];
+        colocarYLimpiar(tabla.forma(t, c.rotacion), tablero, ancho, alto, c.x, c.y, &hash);
+        if (siguiente != VACIO) {
+            return buscar(tabla, tablero, ancho, alto, hash, siguiente, VACIO, resto);
+        }
+        double suma = 0.0;
+        for (int k = 0; k < NUM_TIPOS_PIEZA; ++k) {
+            suma += buscar(tabla, tablero, ancho, alto, hash, static_cast<TipoPieza>(k), VACIO, resto);
+        }
+        return suma / NUM_TIPOS_PIEZA;
+    }
+};
+
+// Temporizadores de los motores de Tetris (índices del PlanificadorEventos)
+enum EventoTetris {
+    EVENTO_GRAVEDAD = 0,     // La pieza baja una fila
+    EVENTO_BLOQUEO,          // Vence el retardo de bloqueo de la pieza apoyada
+    EVENTO_FIJACION_MAXIMA,  // Vence el tope de tiempo apoyada
+    EVENTO_REPETICION,       // DAS/ARR del movimiento horizontal (ventana GDI)
+    EVENTO_CAIDA_RAPIDA,     // Repetición de la caída rápida (ventana GDI)
+    EVENTO_INSTANTANEA       // Toca guardar una instantánea (motor de consola)
+};
+
+// Espera máxima del bucle principal cuando no hay eventos (pausa o game over)
+static const DWORD ESPERA_MAXIMA_MS = 250;
+
+// Estado de una partida de Tetris en un instante (todo salvo la configuración).
+// Con tableros de tamaño fijo es un bloque plano de unos cientos de bytes.
+template <class Tablero>
+struct InstantaneaTetris {
+    DWORD                               reloj;
+    Tablero                             tablero;
+    PiezaTetris                         pieza_actual;
+    AnilloPiezas<CAPACIDAD_COLA_PIEZAS> cola_siguientes;
+    GeneradorAleatorio                  aleatorio;
+    PlanificadorEventos                 planificador;
+    int   puntos;
+    int   nivel;
+    int   lineas_completadas;
+    int   contadores_linea[4];  // Simples, dobles, triples y tetris
+    int   velocidad_caida;
+    DWORD ultimo_movimiento;
+    DWORD last_horiz_move;
+    DWORD last_soft_drop;
+    DWORD last_rotate;
+};
+
+template <class Tablero>
+class TetrisEngine {
+private:
+    ConfigTetris config;
+
+    Tablero      tablero;
+    ColorTetris  colores_por_tipo[NUM_TIPOS_PIEZA];  // Color de consola de cada tipo de pieza
+
+    PiezaTetris                               pieza_actual;
+    AnilloPiezas<CAPACIDAD_COLA_PIEZAS>       cola_siguientes;  // Próximas piezas (la primera es la siguiente)
+    GeneradorPiezas                           generador_piezas; // Bolsa o uniforme, según el .brik
+    GeneradorAleatorio                        aleatorio;        // Generador propio de la partida
+    uint32_t                                  semilla_partida;  // Semilla resuelta (se graba en las repeticiones)
+
+    int puntos;
+    int nivel;
+    int lineas_completadas;
+    int contador_linea_simple;  // Contador de líneas simples completadas
+    int contador_linea_doble;    // Contador de líneas dobles completadas
+    int contador_linea_triple;   // Contador de líneas triples completadas
+    int contador_linea_tetris;   // Contador de tetris (4 líneas) completados
+    int velocidad_caida;
+    DWORD last_horiz_move;
+    DWORD last_soft_drop;
+    DWORD last_rotate;
+
+    bool juego_activo;
+    bool pausado;
+    bool game_over;
+
+    DWORD ultimo_movimiento;
+
+    PlanificadorEventos planificador;  // Gravedad y bloqueo de la pieza
+    bool                sucio;         // Hay cambios sin dibujar
+
+    AnilloInstantaneas<InstantaneaTetris<Tablero>, NUM_INSTANTANEAS> instantaneas;  // Para retroceder (Z)
+    RegistroEntradas registro_entradas;  // Teclas desde la instantánea más antigua (restaurarEn)
+
+    bool  simulado;        // El tiempo lo da reloj_simulado (headless, repeticiones y ejecutar())
+    DWORD reloj_simulado;  // Reloj virtual en ms desde el inicio de la partida
+
+    DWORD ahoraMs() const {
+        return simulado ? reloj_simulado : GetTickCount();
+    }
+
+    string obtenerColorAnsi(int c) {
+        switch (c) {
+            case 9:  return "\033[94m";  // Azul claro
+            case 10: return "\033[92m";  // Verde claro
+            case 11: return "\033[96m";  // Cian
+            case 12: return "\033[91m";  // Rojo
+            case 13: return "\033[95m";  // Magenta
+            case 14: return "\033[93m";  // Amarillo
+            case 15: return "\033[97m";  // Blanco
+            default: return "\033[37m";  // Blanco normal
+        }
+    }
+public:
+    explicit TetrisEngine(const ConfigTetris& cfg)
+        : config(cfg)
+        , tablero(config.ancho_tablero, config.alto_tablero)
+        , generador_piezas(config)
+        , puntos(0)
+        , nivel(1)
+        , lineas_completadas(0)
+        , contador_linea_simple(0)
+        , contador_linea_doble(0)
+        , contador_linea_triple(0)
+        , contador_linea_tetris(0)
+        , velocidad_caida(800)
+        , juego_activo(true)
+        , pausado(false)
+        , game_over(false)
+        , sucio(true)
+        , simulado(false)
+        , reloj_simulado(0) {
+        // Inicializar temporizadores (ms)
+        DWORD ahora = ahoraMs();
+        ultimo_movimiento = ahora;
+        // Inicializar el generador de la partida
+        semilla_partida = resolverSemilla(config.semilla);
+        aleatorio.sembrar(semilla_partida);
+        last_horiz_move = ahoraMs();
+        last_soft_drop = ahoraMs();
+        last_rotate = 0;
+        // Apply config-driven physics
+        nivel = (config.nivel_inicial > 0) ? config.nivel_inicial : 1;
+        velocidad_caida = config.velocidad_inicial;
+        lineas_completadas = 0;
+        for (int t = 0; t < NUM_TIPOS_PIEZA; ++t) {
+            map<string, int>::const_iterator it = config.colores.find(nombreTipoPieza(static_cast<TipoPieza>(t)));
+            colores_por_tipo[t] = (it != config.colores.end()) ? static_cast<ColorTetris>(it->second) : BLANCO;
+        }
+        generarNuevaPieza();
+        generarSiguientePieza();
+        reiniciarTemporizadoresPieza(ahora);
+    }
+
+    const FormaPieza& forma(const PiezaTetris& p, int rotacion) const {
+        return config.tabla_rotaciones.forma(p.tipo, rotacion);
+    }
+
+    void generarNuevaPieza() {
+        if (cola_siguientes.vacio()) {
+            generarSiguientePieza();
+        }
+        pieza_actual = PiezaTetris(cola_siguientes.extraer());
+
+        pieza_actual.x = tablero.ancho() / 2 - 2;
+        pieza_actual.y = 0;
+        pieza_actual.rotacion_actual = 0;
+
+        if (!esMovimientoValido(pieza_actual.x, pieza_actual.y, pieza_actual.rotacion_actual)) {
+            game_over    = true;
+            juego_activo = false;
+        }
+    }
+
+    // Repone la cola hasta cubrir la vista previa (por tandas de siete)
+    void generarSiguientePieza() {
+        generador_piezas.reponer(cola_siguientes, aleatorio);
+    }
+
+    bool esMovimientoValido(int nx, int ny, int nr) {
+        return tablero.cabe(forma(pieza_actual, nr), nx, ny);
+    }
+
+    void fijarPieza(DWORD ahora) {
+        const FormaPieza& f = forma(pieza_actual, pieza_actual.rotacion_actual);
+        tablero.fijar(f, pieza_actual.x, pieza_actual.y, pieza_actual.tipo);
+
+        // Solo las filas que tocó la pieza pueden haberse completado
+        verificarLineasCompletas(pieza_actual.y + f.fila_min, pieza_actual.y + f.fila_max);
+        generarNuevaPieza();
+        generarSiguientePieza();
+        reiniciarTemporizadoresPieza(ahora);
+    }
+
+    bool puedeBajar() {
+        return esMovimientoValido(pieza_actual.x, pieza_actual.y + 1, pieza_actual.rotacion_actual);
+    }
+
+    // Pieza nueva: la gravedad cuenta desde ahora y se olvida el bloqueo anterior
+    void reiniciarTemporizadoresPieza(DWORD ahora) {
+        planificador.cancelar(EVENTO_BLOQUEO);
+        planificador.cancelar(EVENTO_FIJACION_MAXIMA);
+        planificador.programar(EVENTO_GRAVEDAD, ahora + velocidad_caida);
+    }
+
+    /**
+     * Tras mover, rotar o bajar la pieza: si quedó apoyada arranca (o
+     * reinicia) el retardo de bloqueo; el tope de tiempo_fijacion_pieza no se
+     * reinicia. Si vuelve a tener hueco debajo se cancelan ambos.
+     */
+    void alMoverPieza(DWORD ahora) {
+        if (puedeBajar()) {
+            planificador.cancelar(EVENTO_BLOQUEO);
+            planificador.cancelar(EVENTO_FIJACION_MAXIMA);
+            return;
+        }
+        if (config.tiempo_antes_de_bloquear <= 0) {
+            fijarPieza(ahora);
+            return;
+        }
+        planificador.programar(EVENTO_BLOQUEO, ahora + config.tiempo_antes_de_bloquear);
+        if (config.tiempo_fijacion_pieza > 0 && !planificador.pendiente(EVENTO_FIJACION_MAXIMA)) {
+            planificador.programar(EVENTO_FIJACION_MAXIMA, ahora + config.tiempo_fijacion_pieza);
+        }
+    }
+
+    // Al salir de la pausa los temporizadores vencidos cuentan de nuevo desde ahora
+    void reanudarTemporizadores(DWORD ahora) {
+        planificador.programar(EVENTO_GRAVEDAD, ahora + velocidad_caida);
+        if (planificador.pendiente(EVENTO_INSTANTANEA)) {
+            planificador.programar(EVENTO_INSTANTANEA, ahora + INTERVALO_INSTANTANEAS_MS);
+        }
+        if (planificador.pendiente(EVENTO_BLOQUEO)) {
+            planificador.cancelar(EVENTO_FIJACION_MAXIMA);
+            alMoverPieza(ahora);
+        }
+    }
+
+    void verificarLineasCompletas(int fila_desde, int fila_hasta) {
+        int n = tablero.eliminarLineasCompletas(fila_desde, fila_hasta);
+
+        if (n > 0) {
+            calcularPuntos(n);
+            lineas_completadas += n;
+
+            int nivel_base = (config.nivel_inicial > 0) ? config.nivel_inicial : 1;
+            int nuevo_nivel = (lineas_completadas / config.lineas_para_nivel) + nivel_base;
+            if (nuevo_nivel > nivel) {
+                nivel = nuevo_nivel;
+                // decrease fall interval according to aceleracion_por_nivel
+                int decrement = (nivel - config.nivel_inicial) * config.aceleracion_por_nivel;
+                int nueva_vel = config.velocidad_inicial - decrement;
+                if (nueva_vel < 50) nueva_vel = 50; // cap minimum interval
+                velocidad_caida = nueva_vel;
+            }
+        }
+    }
+
+    void calcularPuntos(int n) {
+        // Asegurar que el nivel mínimo sea 1 para el cálculo de puntos
+        int nivel_para_puntos = (nivel > 0) ? nivel : 1;
+        switch (n) {
+            case 1: 
+                puntos += config.puntos_linea_simple * nivel_para_puntos;
+                contador_linea_simple++;
+                break;
+            case 2: 
+                puntos += config.puntos_linea_doble * nivel_para_puntos;
+                contador_linea_doble++;
+                break;
+            case 3: 
+                puntos += config.puntos_linea_triple * nivel_para_puntos;
+                contador_linea_triple++;
+                break;
+            case 4: 
+                puntos += config.puntos_linea_tetris * nivel_para_puntos; // TETRIS
+                contador_linea_tetris++;
+                break;
+        }
+    }
+
+    /**
+     * Aplica las teclas que dejó el hilo de entrada, cada una en el instante
+     * en que llegó: antes se atienden los eventos vencidos hasta entonces,
+     * igual que en reproducir(). Una tecla que llega mientras se dibuja
+     * cuenta desde su llegada y no desde que el bucle la ve.
+     * @param inicio Instante real en que el reloj virtual valía 0 (Z lo mueve)
+     */
+    void procesarEntrada(HiloEntrada& entrada, DWORD& inicio, GrabadorRepeticion* grabador) {
+        EventoTecla e;
+        while (juego_activo && entrada.sacar(e)) {
+            DWORD llegada = e.ms - inicio;
+            if (static_cast<long>(llegada - reloj_simulado) > 0) {
+                reloj_simulado = llegada;
+                actualizarFisica();
+            }
+            char  tecla       = static_cast<char>(tolower(e.tecla));
+            DWORD antes_tecla = reloj_simulado;
+            if (grabador) grabador->registrar(reloj_simulado, tecla);
+            procesarTecla(tecla);
+            // Z hizo retroceder el reloj virtual: el real sigue desde ahí
+            if (reloj_simulado != antes_tecla) inicio = GetTickCount() - reloj_simulado;
+            sucio = true;
+        }
+    }
+
+    /**
+     * Aplica una tecla de la partida y, con reloj virtual, la guarda para
+     * restaurarEn() (olvidando las anteriores a la instantánea más antigua).
+     * Z no se guarda: no es una entrada de la partida sino un salto en su
+     * historia.
+     */
+    void procesarTecla(char t) {
+        if (simulado && t != 'z') {
+            if (instantaneas.tamanio() > 0) registro_entradas.descartarAntesDe(instantaneas.masAntigua());
+            registro_entradas.agregar(reloj_simulado, t);
+        }
+        aplicarTecla(t);
+    }
+
+    void aplicarTecla(char t) {
+        if (game_over) {
+            if (t == 'r') reiniciarJuego();
+            return;
+        }
+        switch (t) {
+            case 'a': {
+                DWORD ahora = ahoraMs();
+                if (ahora - last_horiz_move >= 120) {
+                    if (esMovimientoValido(pieza_actual.x - 1, pieza_actual.y, pieza_actual.rotacion_actual)) {
+                        pieza_actual.x--;
+                        alMoverPieza(ahora);
+                    }
+                    last_horiz_move = ahora;
+                }
+                break;
+            }
+            case 'd': {
+                DWORD ahora = ahoraMs();
+                if (ahora - last_horiz_move >= 120) {
+                    if (esMovimientoValido(pieza_actual.x + 1, pieza_actual.y, pieza_actual.rotacion_actual)) {
+                        pieza_actual.x++;
+                        alMoverPieza(ahora);
+                    }
+                    last_horiz_move = ahora;
+                }
+                break;
+            }
+            case 's': {
+                // soft drop: descend one cell per key event (rate-limited)
+                DWORD ahora = ahoraMs();
+                if (ahora - last_soft_drop >= 80) {
+                    if (puedeBajar()) {
+                        pieza_actual.y++;
+                        alMoverPieza(ahora);
+                    } else {
+                        fijarPieza(ahora);
+                    }
+                    last_soft_drop = ahora;
+                }
+                break;
+            }
+            case 'x':
+                // Caída instantánea: la distancia sale de las cimas de las columnas
+                pieza_actual.y += tablero.caida(forma(pieza_actual, pieza_actual.rotacion_actual),
+                                                pieza_actual.x, pieza_actual.y);
+                fijarPieza(ahoraMs());
+                break;
+            case 'w':
+            case ' ': {
+                DWORD ahoraR = ahoraMs();
+                if (ahoraR - last_rotate >= 200) {
+                    if (rotarSRS(config.tabla_rotaciones, pieza_actual, true,
+                                 tablero.datosFilas(), tablero.ancho(), tablero.alto())) {
+                        alMoverPieza(ahoraR);
+                    }
+                    last_rotate = ahoraR;
+                }
+                break;
+            }
+            case 'p':
+                pausado = !pausado;
+                if (!pausado) reanudarTemporizadores(ahoraMs());
+                break;
+            case 'z':
+                retroceder();
+                break;
+            case 27: // ESC
+            case 'q':
+                juego_activo = false;
+                break;
+        }
+    }
+
+    // Copia el estado de la partida en una instantánea tomada en 'ms'
+    void tomarInstantanea(InstantaneaTetris<Tablero>& s, DWORD ms) const {
+        s.reloj               = ms;
+        s.tablero             = tablero;
+        s.pieza_actual        = pieza_actual;
+        s.cola_siguientes     = cola_siguientes;
+        s.aleatorio           = aleatorio;
+        s.planificador        = planificador;
+        s.puntos              = puntos;
+        s.nivel               = nivel;
+        s.lineas_completadas  = lineas_completadas;
+        s.contadores_linea[0] = contador_linea_simple;
+        s.contadores_linea[1] = contador_linea_doble;
+        s.contadores_linea[2] = contador_linea_triple;
+        s.contadores_linea[3] = contador_linea_tetris;
+        s.velocidad_caida     = velocidad_caida;
+        s.ultimo_movimiento   = ultimo_movimiento;
+        s.last_horiz_move     = last_horiz_move;
+        s.last_soft_drop      = last_soft_drop;
+        s.last_rotate         = last_rotate;
+    }
+
+    // Vuelve al estado de una instantánea, reloj virtual incluido
+    void restaurarInstantanea(const InstantaneaTetris<Tablero>& s) {
+        reloj_simulado        = s.reloj;
+        tablero               = s.tablero;
+        pieza_actual          = s.pieza_actual;
+        cola_siguientes       = s.cola_siguientes;
+        aleatorio             = s.aleatorio;
+        planificador          = s.planificador;
+        puntos                = s.puntos;
+        nivel                 = s.nivel;
+        lineas_completadas    = s.lineas_completadas;
+        contador_linea_simple = s.contadores_linea[0];
+        contador_linea_doble  = s.contadores_linea[1];
+        contador_linea_triple = s.contadores_linea[2];
+        contador_linea_tetris = s.contadores_linea[3];
+        velocidad_caida       = s.velocidad_caida;
+        ultimo_movimiento     = s.ultimo_movimiento;
+        last_horiz_move       = s.last_horiz_move;
+        last_soft_drop        = s.last_soft_drop;
+        last_rotate           = s.last_rotate;
+        pausado               = false;
+        game_over             = false;
+        juego_activo          = true;
+        sucio                 = true;
+    }
+
+    /**
+     * Vuelve al estado de la partida en el instante 'ms': restaura la última
+     * instantánea tomada hasta entonces y vuelve a simular las teclas
+     * guardadas desde ella, igual que reproducir(). Lo que pasó después de
+     * 'ms' se descarta. Solo con reloj virtual.
+     * @return false si ya no hay una instantánea tan antigua
+     */
+    bool restaurarEn(DWORD ms) {
+        if (!simulado) return false;
+        const InstantaneaTetris<Tablero>* s = instantaneas.ultimaHasta(ms);
+        if (!s) return false;
+        DWORD desde = s->reloj;
+        restaurarInstantanea(*s);
+        registro_entradas.descartarDespuesDe(ms);
+        for (size_t i = 0; i < registro_entradas.tamanio(); ++i) {
+            const EntradaRepeticion& e = registro_entradas[i];
+            if (PlanificadorEventos::antes(e.ms, desde)) continue;
+            reloj_simulado = e.ms;
+            if (!pausado && !game_over) actualizarFisica();
+            aplicarTecla(e.tecla);
+        }
+        reloj_simulado = ms;
+        if (!pausado && !game_over) actualizarFisica();
+        return true;
+    }
+
+    // Z: vuelve RETROCESO_MINIMO_MS atrás en el reloj de la partida
+    void retroceder() {
+        restaurarEn(reloj_simulado - RETROCESO_MINIMO_MS);
+    }
+
+    void reiniciarJuego() {
+        tablero.vaciar();
+        puntos            = 0;
+        nivel             = (config.nivel_inicial > 0) ? config.nivel_inicial : 1;
+        lineas_completadas = 0;
+        contador_linea_simple = 0;
+        contador_linea_doble = 0;
+        contador_linea_triple = 0;
+        contador_linea_tetris = 0;
+        velocidad_caida   = config.velocidad_inicial;
+        game_over         = false;
+        juego_activo      = true;
+        pausado           = false;
+
+        cola_siguientes.vaciar();
+        generarNuevaPieza();
+        generarSiguientePieza();
+
+        DWORD ahora = ahoraMs();
+        ultimo_movimiento = ahora;
+        reiniciarTemporizadoresPieza(ahora);
+        if (simulado) {
+            instantaneas.vaciar();
+            registro_entradas.vaciar();
+            planificador.programar(EVENTO_INSTANTANEA, ahora + INTERVALO_INSTANTANEAS_MS);
+        }
+    }
+
+    /**
+     * Atiende los eventos vencidos del planificador. Cada uno se procesa en
+     * su instante de vencimiento, no en el de la llamada: así el resultado no
+     * depende de cuándo despierte el bucle y una repetición lo reproduce igual.
+     */
+    void actualizarFisica() {
+        if (pausado || game_over) return;
+        DWORD ahora = ahoraMs();
+        DWORD vencio;
+        int   evento;
+        while (!game_over && planificador.extraerVencido(ahora, evento, &vencio)) {
+            switch (evento) {
+                case EVENTO_GRAVEDAD:
+                    if (puedeBajar()) {
+                        pieza_actual.y++;
+                        if (!puedeBajar()) alMoverPieza(vencio);
+                    } else if (!planificador.pendiente(EVENTO_BLOQUEO)) {
+                        alMoverPieza(vencio);
+                    }
+                    if (!planificador.pendiente(EVENTO_GRAVEDAD)) {
+                        planificador.programar(EVENTO_GRAVEDAD, vencio + velocidad_caida);
+                    }
+                    break;
+                case EVENTO_BLOQUEO:
+                case EVENTO_FIJACION_MAXIMA:
+                    if (!puedeBajar()) fijarPieza(vencio);
+                    break;
+                case EVENTO_INSTANTANEA:
+                    // Se reprograma antes de copiar: al restaurar sigue el ciclo
+                    planificador.programar(EVENTO_INSTANTANEA, vencio + INTERVALO_INSTANTANEAS_MS);
+                    tomarInstantanea(instantaneas.nueva(vencio), vencio);
+                    continue;  // No cambia nada visible
+            }
+            sucio = true;
+        }
+    }
+
+    void renderizar() {
+        stringstream buf;
+        buf << "\033[2J\033[H";
+        buf << "\033[37;1m=== Tetris ===           Controles:\033[0m\n";
+        buf << "\033[33mPuntos: " << puntos << "                      A/D - Mover\033[0m\n";
+        buf << "\033[33mNivel: "  << nivel  << "                        S - Caida rapida, X - Soltar\033[0m\n";
+        buf << "\033[33mLineas: " << lineas_completadas << "                     W/SPACE - Rotar\033[0m\n";
+        buf << "\033[90m                                  P - Pausa, Z - Retroceder, ESC - Salir\033[0m\n\n";
+
+        if (game_over) {
+            buf << "\033[91m    !GAME OVER!\033[0m\n";
+            buf << "\033[91m    Puntuacion Final: " << puntos << "\033[0m\n";
+            buf << "\033[91m    Presiona R para reiniciar\033[0m\n\n";
+        }
+        if (pausado) {
+            buf << "\033[95;1m    *** PAUSADO ***\033[0m\n";
+            buf << "\033[95m    Presiona P para continuar\033[0m\n\n";
+        }
+
+        // Marco superior
+        buf << "\033[90m         " << string(tablero.ancho() * 2 + 2, '=') << "\033[0m\n";
+
+        // Pieza fantasma: donde caería la pieza actual
+        const FormaPieza& forma_actual = forma(pieza_actual, pieza_actual.rotacion_actual);
+        int fantasma_y = pieza_actual.y + tablero.caida(forma_actual, pieza_actual.x, pieza_actual.y);
+
+        for (int y = 0; y < tablero.alto(); ++y) {
+            buf << "\033[90m         |\033[0m";
+            for (int x = 0; x < tablero.ancho(); ++x) {
+                bool   pieza   = false;
+                char   simbolo = ' ';
+                string cansi   = "\033[37m";
+
+                // Pieza actual y su fantasma
+                if (!pausado && !game_over) {
+                    if (forma_actual.ocupa(x - pieza_actual.x, y - pieza_actual.y)) {
+                        simbolo = (char)219;
+                        cansi   = obtenerColorAnsi(static_cast<int>(colores_por_tipo[pieza_actual.tipo]));
+                        pieza   = true;
+                    } else if (forma_actual.ocupa(x - pieza_actual.x, y - fantasma_y)) {
+                        simbolo = (char)176;
+                        cansi   = obtenerColorAnsi(static_cast<int>(colores_por_tipo[pieza_actual.tipo]));
+                        pieza   = true;
+                    }
+                }
+
+                // Fija/Tablero
+                if (!pieza) {
+                    if (tablero.ocupada(x, y)) {
+                        simbolo = (char)219;
+                        cansi   = obtenerColorAnsi(static_cast<int>(colores_por_tipo[tablero.tipo(x, y)]));
+                    } else {
+                        simbolo = '.';
+                        cansi   = "\033[90m";
+                    }
                 }
-                colores_rgb[color_nombre] = rgb_default;
+
+                buf << cansi << simbolo << simbolo << "\033[0m";
+            }
+
+            buf << "\033[90m|\033[0m";
+
+            // Vista previa: una casilla de 3 filas por pieza, desde la fila 4
+            int casilla = (y - 4) / 3;
+            if (y == 2) {
+                buf << "\033[97m  Siguiente:\033[0m";
+            } else if (y >= 4 && casilla < generador_piezas.vistaPrevia() && casilla < cola_siguientes.tamanio()) {
+                buf << "  ";
+                PiezaTetris siguiente(cola_siguientes.ver(casilla));
+                const FormaPieza& f = forma(siguiente, 0);
+                int   py = f.fila_min + (y - 4) % 3;
+                if (py <= f.fila_max) {
+                    string cansi = obtenerColorAnsi(static_cast<int>(colores_por_tipo[siguiente.tipo]));
+                    for (int px = 0; px < f.ancho; ++px) {
+                        if (f.ocupa(px, py)) {
+                            buf << cansi << (char)219 << (char)219 << "\033[0m";
+                        } else {
+                            buf << "  ";
+                        }
+                    }
+                }
+            }
+            buf << "\n";
+        }
+
+        // Marco inferior
+        buf << "\033[90m         " << string(tablero.ancho() * 2 + 2, '=') << "\033[0m\n";
+
+        // FPS (medido en ms con GetTickCount)
+        static DWORD ultimo_fps = ahoraMs();
+        static int  fps        = 0;
+        fps++;
+        DWORD ahora_fps = ahoraMs();
+        DWORD ms    = ahora_fps - ultimo_fps;
+        if (ms >= 1000) {
+            buf << "\033[92mFPS: " << fps << " | Cargado desde AST\033[0m\n";
+            fps = 0;
+            ultimo_fps = ahora_fps;
+        }
+
+        cout << buf.str();
+        cout.flush();
+    }
+
+    /**
+     * Ejecuta la partida sin render ni teclado (modo headless).
+     * Cada tick avanza el reloj virtual op.tick_ms y aplica la tecla que
+     * decide la política; al perder se reinicia hasta completar op.ticks.
+     */
+    ResultadoSimulacion simular(const OpcionesHeadless& op, PoliticaTetris& politica,
+                                GrabadorRepeticion* grabador = NULL) {
+        ResultadoSimulacion r;
+        entrarModoSimulado();
+        if (grabador) grabador->comenzar(semilla_partida);
+        for (long tick = 0; tick < op.ticks && juego_activo; ++tick) {
+            char tecla = politica.decidir(vista(tick));
+            if (grabador) grabador->registrar(reloj_simulado, tecla);
+            pasoSimulado(tecla, op.tick_ms);
+            if (game_over) {
+                r.cerrarPartida(puntos, lineas_completadas);
+                // Igual que pulsar R tras perder (así lo ve la repetición)
+                if (grabador) grabador->registrar(reloj_simulado, 'r');
+                procesarTecla('r');
+            }
+            r.ticks++;
+        }
+        if (grabador) grabador->terminar(reloj_simulado);
+        r.puntos_en_curso = puntos;
+        return r;
+    }
+
+    /**
+     * Vuelve a simular una repetición grabada, a toda velocidad, hasta el
+     * instante 'hasta' (ms del reloj de la partida) o hasta su final.
+     * En el resumen, ticks son los ms reproducidos.
+     */
+    ResumenPartida reproducir(const Repeticion& rep, DWORD hasta) {
+        aleatorio.sembrar(rep.semilla);
+        reiniciarJuego();
+        entrarModoSimulado();
+        // Perder desactiva el juego, pero la grabación sigue con la R
+        for (size_t i = 0; i < rep.entradas.size() && rep.entradas[i].ms <= hasta && (juego_activo || game_over); ++i) {
+            reloj_simulado = rep.entradas[i].ms;
+            if (!pausado && !game_over) actualizarFisica();
+            procesarTecla(rep.entradas[i].tecla);
+        }
+        if (!pausado && !game_over) {
+            reloj_simulado = min(hasta, rep.duracion);
+            actualizarFisica();
+        }
+        ResumenPartida r;
+        r.puntos     = puntos;
+        r.ticks      = static_cast<long>(reloj_simulado);
+        r.eventos    = lineas_completadas;
+        r.detalle[0] = contador_linea_simple;
+        r.detalle[1] = contador_linea_doble;
+        r.detalle[2] = contador_linea_triple;
+        r.detalle[3] = contador_linea_tetris;
+        r.terminada  = game_over;
+        return r;
+    }
+
+    /**
+     * Juega una sola partida desde cero con la semilla dada (modo lote).
+     * @param max_ticks La partida se corta al llegar a este número de ticks
+     */
+    ResumenPartida jugarPartida(uint32_t semilla, PoliticaTetris& politica, long max_ticks, int tick_ms) {
+        aleatorio.sembrar(semilla);
+        reiniciarJuego();
+        entrarModoSimulado();
+        long tick = 0;
+        while (tick < max_ticks && juego_activo && !game_over) {
+            pasoSimulado(politica.decidir(vista(tick)), tick_ms);
+            tick++;
+        }
+        ResumenPartida r;
+        r.puntos     = puntos;
+        r.ticks      = tick;
+        r.eventos    = lineas_completadas;
+        r.detalle[0] = contador_linea_simple;
+        r.detalle[1] = contador_linea_doble;
+        r.detalle[2] = contador_linea_triple;
+        r.detalle[3] = contador_linea_tetris;
+        r.terminada  = game_over;
+        return r;
+    }
+private:
+    // Temporizadores desde cero: misma semilla y entradas => misma partida
+    void entrarModoSimulado() {
+        simulado          = true;
+        reloj_simulado    = 0;
+        ultimo_movimiento = 0;
+        last_horiz_move   = 0;
+        last_soft_drop    = 0;
+        last_rotate       = 0;
+        planificador.vaciar();
+        reiniciarTemporizadoresPieza(0);
+        instantaneas.vaciar();
+        registro_entradas.vaciar();
+        planificador.programar(EVENTO_INSTANTANEA, INTERVALO_INSTANTANEAS_MS);
+    }
+
+    void pasoSimulado(char tecla, int tick_ms) {
+        if (tecla) procesarTecla(tecla);
+        reloj_simulado += tick_ms;
+        if (!pausado && !game_over) {
+            actualizarFisica();
+        }
+    }
+
+    VistaTetris vista(long tick) const {
+        VistaTetris v;
+        v.filas      = tablero.datosFilas();
+        v.ancho      = tablero.ancho();
+        v.alto       = tablero.alto();
+        v.rotaciones = &config.tabla_rotaciones;
+        v.hash       = tablero.hash();
+        v.pieza      = pieza_actual;
+        v.siguiente  = cola_siguientes.vacio() ? VACIO : cola_siguientes.ver(0);
+        v.num_proximas = min(generador_piezas.vistaPrevia(), cola_siguientes.tamanio());
+        for (int i = 0; i < v.num_proximas; ++i) v.proximas[i] = cola_siguientes.ver(i);
+        v.tick       = tick;
+        return v;
+    }
+public:
+
+    /**
+     * Bucle interactivo: duerme hasta el próximo evento del planificador o
+     * hasta que llegue una tecla, y solo redibuja si algo cambió. El motor
+     * corre sobre el reloj virtual, que aquí se alimenta del reloj real. Las
+     * teclas las lee un HiloEntrada y se aplican en su instante de llegada,
+     * después de los eventos vencidos hasta entonces, igual que en
+     * reproducir().
+     * @param grabador Si no es NULL, graba la sesión como repetición
+     */
+    void ejecutar(GrabadorRepeticion* grabador = NULL) {
+        aleatorio.sembrar(semilla_partida);
+        reiniciarJuego();
+        entrarModoSimulado();
+        if (grabador) grabador->comenzar(semilla_partida);
+        EntradaConsola entrada;
+        DWORD inicio = GetTickCount();
+        while (juego_activo) {
+            DWORD espera = (pausado || game_over)
+                         ? ESPERA_MAXIMA_MS
+                         : planificador.espera(GetTickCount() - inicio, ESPERA_MAXIMA_MS);
+            if (espera > 0) entrada.esperar(espera);
+            procesarEntrada(entrada, inicio, grabador);
+            reloj_simulado = GetTickCount() - inicio;
+            actualizarFisica();
+            if (sucio) {
+                renderizar();
+                sucio = false;
+            }
+        }
+        if (grabador) grabador->terminar(reloj_simulado);
+    }
+};
+
+// ============================================================================
+// FUNCIÓN: ejecutarTetrisConsola
+// ============================================================================
+// Instancia el motor de consola con el tablero adecuado a las dimensiones de
+// la configuración (ver conTableroTetris).
+// @param cfg Configuración ya cargada desde el AST
+// ============================================================================
+struct AccionConsolaTetris {
+    const ConfigTetris& cfg;
+    GrabadorRepeticion* grabador;
+
+    AccionConsolaTetris(const ConfigTetris& c, GrabadorRepeticion* g) : cfg(c), grabador(g) {}
+
+    template <class Tablero> void ejecutar() {
+        TetrisEngine<Tablero> t(cfg);
+        t.ejecutar(grabador);
+    }
+};
+
+static void ejecutarTetrisConsola(const ConfigTetris& cfg, GrabadorRepeticion* grabador = NULL) {
+    AccionConsolaTetris accion(cfg, grabador);
+    conTableroTetris(cfg, accion);
+}
+
+// Reproduce una repetición de Tetris y dibuja el tablero en el instante pedido
+struct AccionReproducirTetris {
+    const ConfigTetris& cfg;
+    const Repeticion&   rep;
+    DWORD               hasta;
+    ResumenPartida      resultado;
+
+    AccionReproducirTetris(const ConfigTetris& c, const Repeticion& r, DWORD h) : cfg(c), rep(r), hasta(h) {}
+
+    template <class Tablero> void ejecutar() {
+        TetrisEngine<Tablero> t(cfg);
+        resultado = t.reproducir(rep, hasta);
+        t.renderizar();
+    }
+};
+
+static ResumenPartida reproducirTetris(const ConfigTetris& cfg, const Repeticion& rep, DWORD hasta) {
+    AccionReproducirTetris accion(cfg, rep, hasta);
+    conTableroTetris(cfg, accion);
+    return accion.resultado;
+}
+
+// Igual que ejecutarTetrisConsola pero en modo headless (ver TetrisEngine::simular)
+struct AccionSimularTetris {
+    const ConfigTetris&     cfg;
+    const OpcionesHeadless& op;
+    PoliticaTetris&         politica;
+    GrabadorRepeticion*     grabador;
+    ResultadoSimulacion     resultado;
+
+    AccionSimularTetris(const ConfigTetris& c, const OpcionesHeadless& o, PoliticaTetris& p, GrabadorRepeticion* g)
+        : cfg(c), op(o), politica(p), grabador(g) {}
+
+    template <class Tablero> void ejecutar() {
+        TetrisEngine<Tablero> t(cfg);
+        resultado = t.simular(op, politica, grabador);
+    }
+};
+
+static ResultadoSimulacion simularTetris(const ConfigTetris& cfg, const OpcionesHeadless& op,
+                                         PoliticaTetris& politica, GrabadorRepeticion* grabador = NULL) {
+    AccionSimularTetris accion(cfg, op, politica, grabador);
+    conTableroTetris(cfg, accion);
+    return accion.resultado;
+}
+
+// ================================================================
+// Snake
+// ================================================================
+struct Posicion {
+    int x;
+    int y;
+    Posicion(int x_ = 0, int y_ = 0) : x(x_), y(y_) {}
+    bool operator==(const Posicion& o) const { return x == o.x && y == o.y; }
+};
+
+// Casilla empaquetada en 4 bytes (tableros de hasta 32767 de lado)
+struct CeldaSnake {
+    int16_t x;
+    int16_t y;
+};
+
+// ============================================================================
+// CLASE: CuerpoSnake
+// ============================================================================
+// Cuerpo de la serpiente sobre un arreglo circular de casillas empaquetadas.
+// Avanzar agrega la cabeza delante del inicio y quita la cola del final, sin
+// desplazar el resto: mover o crecer cuesta O(1) sea cual sea la longitud. La
+// capacidad es potencia de dos (el índice se envuelve con una máscara) y se
+// reserva según el área del tablero; solo se amplía si la serpiente la supera
+// (p. ej. sin choque con el propio cuerpo).
+// ============================================================================
+class CuerpoSnake {
+private:
+    vector<CeldaSnake> celdas;
+    int                mascara;   // capacidad - 1
+    int                inicio;    // Índice de la cabeza
+    int                cantidad;
+
+    static CeldaSnake empaquetar(const Posicion& p) {
+        CeldaSnake c = { static_cast<int16_t>(p.x), static_cast<int16_t>(p.y) };
+        return c;
+    }
+
+    // Duplica la capacidad dejando la cabeza en el índice 0
+    void ampliar() {
+        vector<CeldaSnake> nuevas(celdas.empty() ? 16 : celdas.size() * 2);
+        for (int i = 0; i < cantidad; ++i) nuevas[i] = celdas[(inicio + i) & mascara];
+        celdas.swap(nuevas);
+        mascara = static_cast<int>(celdas.size()) - 1;
+        inicio  = 0;
+    }
+public:
+    CuerpoSnake() : mascara(-1), inicio(0), cantidad(0) {}
+
+    // Vacía el cuerpo y asegura sitio para 'capacidad' segmentos
+    void reservar(int capacidad) {
+        size_t n = 16;
+        while (n < static_cast<size_t>(capacidad)) n *= 2;
+        if (celdas.size() < n) celdas.assign(n, CeldaSnake());
+        mascara  = static_cast<int>(celdas.size()) - 1;
+        inicio   = 0;
+        cantidad = 0;
+    }
+
+    void vaciar()        { inicio = 0; cantidad = 0; }
+    int  tamanio() const { return cantidad; }
+    bool vacio()   const { return cantidad == 0; }
+
+    // Segmento i (0 = cabeza)
+    Posicion operator[](int i) const {
+        const CeldaSnake& c = celdas[(inicio + i) & mascara];
+        return Posicion(c.x, c.y);
+    }
+    Posicion cabeza() const { return (*this)[0]; }
+    Posicion cola()   const { return (*this)[cantidad - 1]; }
+
+    void agregarCabeza(const Posicion& p) {
+        if (cantidad == static_cast<int>(celdas.size())) ampliar();
+        inicio = (inicio - 1) & mascara;
+        celdas[inicio] = empaquetar(p);
+        cantidad++;
+    }
+
+    // Segmento extra al final (al crecer se repite la cola)
+    void agregarCola(const Posicion& p) {
+        if (cantidad == static_cast<int>(celdas.size())) ampliar();
+        celdas[(inicio + cantidad) & mascara] = empaquetar(p);
+        cantidad++;
+    }
+
+    void quitarCola() {
+        if (cantidad > 0) cantidad--;
+    }
+
+    // Copia lineal de los segmentos (cabeza primero), p. ej. para instantáneas
+    void copiarA(vector<CeldaSnake>& destino) const {
+        destino.resize(cantidad);
+        for (int i = 0; i < cantidad; ++i) destino[i] = celdas[(inicio + i) & mascara];
+    }
+
+    void cargarDesde(const vector<CeldaSnake>& origen) {
+        vaciar();
+        while (static_cast<int>(celdas.size()) < static_cast<int>(origen.size())) ampliar();
+        for (size_t i = 0; i < origen.size(); ++i) celdas[i] = origen[i];
+        cantidad = static_cast<int>(origen.size());
+    }
+};
+
+// ============================================================================
+// CLASE: MapaOcupacion
+// ============================================================================
+// Cuántos segmentos de serpiente hay en cada casilla del tablero. Se cuenta
+// en lugar de marcar porque al crecer la cola se repite en la misma casilla.
+// Se actualiza al mover la cabeza y retirar la cola, así que saber si una
+// casilla está ocupada es una sola consulta en vez de recorrer el cuerpo.
+//
+// Cada casilla guarda también la entidad que hay en ella: nada, un
+// obstáculo o una fruta (su índice en FrutasTablero). Así lo que encuentra
+// la cabeza se sabe con una consulta, haya las frutas y obstáculos que haya.
+//
+// Además lleva el conjunto de casillas libres del interior (los bordes son
+// pared): sin serpiente ni entidad. Están en un arreglo con su índice
+// inverso; una casilla entra o sale cuando cambia su estado, quitándola con
+// un intercambio con la última. Elegir una casilla libre al azar es O(1)
+// aunque el tablero esté casi lleno.
+//
+// Opcionalmente anota cada cambio (conteo, entidad, alta o baja en la lista
+// de libres) en un diario circular, para deshacerlos después en orden
+// inverso. Así una instantánea guarda solo una marca del diario y no copia
+// el tablero: volver a ella cuesta lo que cambió desde entonces, y el orden
+// de las libres, que decide dónde sale cada fruta, queda igual que era.
+// ============================================================================
+static const int SIN_ENTIDAD = -1;
+static const int OBSTACULO   = -2;
+
+class MapaOcupacion {
+private:
+    enum TipoCambio { CAMBIO_OCUPAR, CAMBIO_LIBERAR, CAMBIO_ENTIDAD, CAMBIO_ALTA_LIBRE, CAMBIO_BAJA_LIBRE };
+
+    struct Cambio {
+        int tipo;
+        int casilla;
+        int dato;  // Entidad anterior (CAMBIO_ENTIDAD) o posición que tenía en 'libres' (CAMBIO_BAJA_LIBRE)
+    };
+
+    vector<uint16_t> conteos;
+    vector<int>      entidades;    // SIN_ENTIDAD, OBSTACULO o índice de fruta
+    vector<int>      libres;       // Índices (y * ancho + x) de las casillas libres
+    vector<int>      pos_libre;    // Posición de cada casilla en 'libres' (-1 si no está)
+    int              ancho;
+    int              alto;
+    bool             anotando;      // Los cambios van al diario
+    vector<Cambio>   diario;        // Arreglo circular, capacidad potencia de dos
+    uint64_t         diario_desde;  // Marca de la anotación más antigua que se conserva
+    uint64_t         diario_hasta;  // Marca de la siguiente anotación
+
+    void anotar(int tipo, int casilla, int dato) {
+        if (!anotando) return;
+        if (diario_hasta - diario_desde == diario.size()) {
+            vector<Cambio> mas(diario.empty() ? 256 : diario.size() * 2);
+            for (uint64_t m = diario_desde; m < diario_hasta; ++m) {
+                mas[m & (mas.size() - 1)] = diario[m & (diario.size() - 1)];
+            }
+            diario.swap(mas);
+        }
+        Cambio c = { tipo, casilla, dato };
+        diario[diario_hasta++ & (diario.size() - 1)] = c;
+    }
+
+    bool interior(int i) const {
+        int x = i % ancho;
+        int y = i / ancho;
+        return x >= 1 && x < ancho - 1 && y >= 1 && y < alto - 1;
+    }
+
+    void agregarLibre(int i) {
+        pos_libre[i] = static_cast<int>(libres.size());
+        libres.push_back(i);
+    }
+
+    void quitarLibre(int i) {
+        int k      = pos_libre[i];
+        int ultima = libres.back();
+        libres[k]         = ultima;
+        pos_libre[ultima] = k;
+        libres.pop_back();
+        pos_libre[i] = -1;
+    }
+
+    // Pone o quita la casilla del conjunto de libres según su estado actual
+    void sincronizar(int i) {
+        bool libre = conteos[i] == 0 && entidades[i] == SIN_ENTIDAD && interior(i);
+        if (libre && pos_libre[i] < 0) {
+            anotar(CAMBIO_ALTA_LIBRE, i, 0);
+            agregarLibre(i);
+        } else if (!libre && pos_libre[i] >= 0) {
+            anotar(CAMBIO_BAJA_LIBRE, i, pos_libre[i]);
+            quitarLibre(i);
+        }
+    }
+
+    // Inverso de quitarLibre: la casilla vuelve a la posición k y la que la
+    // había ocupado, al final
+    void reponerLibre(int i, int k) {
+        if (k < static_cast<int>(libres.size())) {
+            int movida = libres[k];
+            pos_libre[movida] = static_cast<int>(libres.size());
+            libres.push_back(movida);
+            libres[k] = i;
+        } else {
+            libres.push_back(i);
+        }
+        pos_libre[i] = k;
+    }
+public:
+    MapaOcupacion() : ancho(0), alto(0), anotando(false), diario_desde(0), diario_hasta(0) {}
+
+    // Ajusta el mapa al tablero y lo deja vacío, con todo el interior libre
+    void dimensionar(int ancho_, int alto_) {
+        ancho = ancho_;
+        alto  = alto_;
+        size_t n = static_cast<size_t>(ancho) * alto;
+        conteos.assign(n, 0);
+        entidades.assign(n, SIN_ENTIDAD);
+        pos_libre.assign(n, -1);
+        libres.clear();
+        libres.reserve(n);
+        for (int y = 1; y < alto - 1; ++y) {
+            for (int x = 1; x < ancho - 1; ++x) agregarLibre(y * ancho + x);
+        }
+        diario_desde = diario_hasta;
+    }
+
+    void ocupar(const Posicion& p) {
+        int i = p.y * ancho + p.x;
+        anotar(CAMBIO_OCUPAR, i, 0);
+        if (conteos[i]++ == 0) sincronizar(i);
+    }
+
+    void liberar(const Posicion& p) {
+        int i = p.y * ancho + p.x;
+        anotar(CAMBIO_LIBERAR, i, 0);
+        if (--conteos[i] == 0) sincronizar(i);
+    }
+
+    void ponerEntidad(const Posicion& p, int e) {
+        int i = p.y * ancho + p.x;
+        anotar(CAMBIO_ENTIDAD, i, entidades[i]);
+        entidades[i] = e;
+        sincronizar(i);
+    }
+
+    // Empieza a anotar los cambios desde el estado actual (diario vacío)
+    void anotarCambios() {
+        anotando     = true;
+        diario_desde = diario_hasta;
+    }
+
+    // Marca del estado actual, para deshacerCambiosHasta()
+    uint64_t marcaCambios() const { return diario_hasta; }
+
+    // Olvida las anotaciones anteriores a 'marca' (ya no se volverá tan atrás)
+    void olvidarCambiosAntesDe(uint64_t marca) {
+        if (marca > diario_desde) diario_desde = min(marca, diario_hasta);
+    }
+
+    // Deshace los cambios posteriores a 'marca', que debe seguir en el diario
+    void deshacerCambiosHasta(uint64_t marca) {
+        while (diario_hasta > marca) {
+            const Cambio& c = diario[--diario_hasta & (diario.size() - 1)];
+            int i = c.casilla;
+            switch (c.tipo) {
+                case CAMBIO_OCUPAR:     conteos[i]--;                  break;
+                case CAMBIO_LIBERAR:    conteos[i]++;                  break;
+                case CAMBIO_ENTIDAD:    entidades[i] = c.dato;         break;
+                case CAMBIO_ALTA_LIBRE: libres.pop_back(); pos_libre[i] = -1; break;
+                case CAMBIO_BAJA_LIBRE: reponerLibre(i, c.dato);       break;
             }
         }
     }
-    void configurarRotacionesHardcoded() {
-        // Construcción explícita de rotaciones (C++03 compatible)
-        // I
-        {
-            vector<vector<vector<int> > > rots;
-            vector<vector<int> > shape;
-            vector<int> row;
-            int a1[] = {0,0,0,0}; int a2[] = {1,1,1,1}; int a3[] = {0,0,0,0}; int a4[] = {0,0,0,0};
-            row.assign(a1, a1+4); shape.push_back(row);
-            row.assign(a2, a2+4); shape.push_back(row);
-            row.assign(a3, a3+4); shape.push_back(row);
-            row.assign(a4, a4+4); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int b1[] = {0,1,0,0}; int b2[] = {0,1,0,0}; int b3[] = {0,1,0,0}; int b4[] = {0,1,0,0};
-            row.assign(b1, b1+4); shape.push_back(row);
-            row.assign(b2, b2+4); shape.push_back(row);
-            row.assign(b3, b3+4); shape.push_back(row);
-            row.assign(b4, b4+4); shape.push_back(row);
-            rots.push_back(shape);
-            // repetir primeras rotaciones para completar 4
-            rots.push_back(rots[0]);
-            rots.push_back(rots[1]);
-            rotaciones_piezas["I"] = rots;
+
+    bool tieneDimensiones(int ancho_, int alto_) const { return ancho == ancho_ && alto == alto_; }
+
+    int entidad(int x, int y) const { return entidades[static_cast<size_t>(y) * ancho + x]; }
+    int entidad(const Posicion& p) const { return entidad(p.x, p.y); }
+
+    int numLibres() const { return static_cast<int>(libres.size()); }
+
+    // Casilla libre elegida al azar (requiere numLibres() > 0)
+    Posicion libreAleatoria(GeneradorAleatorio& aleatorio) const {
+        int i = libres[aleatorio.rango(numLibres())];
+        return Posicion(i % ancho, i / ancho);
+    }
+
+    int cuenta(int x, int y) const { return conteos[static_cast<size_t>(y) * ancho + x]; }
+    int cuenta(const Posicion& p) const { return cuenta(p.x, p.y); }
+    bool ocupada(int x, int y) const { return cuenta(x, y) != 0; }
+    bool ocupada(const Posicion& p) const { return cuenta(p) != 0; }
+};
+
+/**
+ * ¿Chocaría con el cuerpo una cabeza nueva en p? No cuentan la cabeza actual
+ * ni la cola, que se retira en el mismo paso (mismo criterio que recorrer
+ * los segmentos 1 .. n-2).
+ */
+static bool chocaConCuerpo(const CuerpoSnake& cuerpo, const MapaOcupacion& mapa, const Posicion& p) {
+    if (cuerpo.tamanio() < 2) return false;
+    int n = mapa.cuenta(p);
+    if (cuerpo.cabeza() == p) n--;
+    if (cuerpo.cola() == p)   n--;
+    return n > 0;
+}
+
+// ============================================================================
+// CLASE: TablaFrutas
+// ============================================================================
+// Reglas de cada tipo de fruta resueltas una sola vez al cargar la
+// configuración: puntos, crecimiento, cambio de velocidad y color. En juego
+// una fruta es su índice en la tabla, que es también la casilla de su
+// contador, así que comerla es un acceso a un arreglo. Admite cualquier
+// número de tipos (los que liste frutas_disponibles).
+// ============================================================================
+// Lectura de claves de una configuración de Snake ya cargada
+static int enteroConfig(const SnakeAST& config, const string& clave, int defecto) {
+    map<string, int>::const_iterator it = config.integers.find(clave);
+    return it != config.integers.end() ? it->second : defecto;
+}
+
+static string textoConfig(const SnakeAST& config, const string& clave, const string& defecto) {
+    map<string, string>::const_iterator it = config.strings.find(clave);
+    return it != config.strings.end() ? it->second : defecto;
+}
+
+struct ReglaFruta {
+    string nombre;
+    int    puntos;
+    int    crecimiento;       // Segmentos que añade (negativo = acorta)
+    int    cambio_velocidad;  // ms que se suman al paso (negativo = más rápido)
+    string color;             // Nombre del color (como en color_fruta)
+};
+
+class TablaFrutas {
+private:
+    vector<ReglaFruta> reglas;
+    vector<int>        sorteo;  // frutas_disponibles como índices (un tipo repetido sale más)
+
+    // Índice del tipo, añadiéndolo a la tabla si es nuevo
+    int registrar(const SnakeAST& config, const string& nombre) {
+        int i = indice(nombre);
+        if (i >= 0) return i;
+
+        // Valores por defecto de los tipos conocidos; el resto usa los generales
+        static const struct { const char* nombre; int puntos, crecimiento, velocidad; const char* color; } conocidas[] = {
+            { "manzana", 10, -1,   0, "rojo"     },
+            { "cereza",  20,  0,  20, "rojo"     },
+            { "banana",  15,  0, -15, "amarillo" },
+            { "uva",     25,  2,   0, "magenta"  },
+            { "naranja", 30,  1,   0, "naranja"  }
+        };
+        ReglaFruta r;
+        r.nombre           = nombre;
+        r.puntos           = enteroConfig(config, "puntos_por_fruta", 10);
+        r.crecimiento      = 1;
+        r.cambio_velocidad = 0;
+        r.color            = textoConfig(config, "color_fruta", "rojo");
+        for (size_t k = 0; k < sizeof(conocidas) / sizeof(conocidas[0]); ++k) {
+            if (nombre == conocidas[k].nombre) {
+                r.puntos           = conocidas[k].puntos;
+                r.crecimiento      = conocidas[k].crecimiento;
+                r.cambio_velocidad = conocidas[k].velocidad;
+                r.color            = conocidas[k].color;
+            }
         }
-        // J
-        {
-            vector<vector<vector<int> > > rots;
-            vector<vector<int> > shape; vector<int> row;
-            int j1[] = {1,0,0}; int j2[] = {1,1,1}; int j3[] = {0,0,0};
-            row.assign(j1, j1+3); shape.push_back(row);
-            row.assign(j2, j2+3); shape.push_back(row);
-            row.assign(j3, j3+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int j4[] = {0,1,1}; int j5[] = {0,1,0}; int j6[] = {0,1,0};
-            row.assign(j4, j4+3); shape.push_back(row);
-            row.assign(j5, j5+3); shape.push_back(row);
-            row.assign(j6, j6+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int j7[] = {0,0,0}; int j8[] = {1,1,1}; int j9[] = {0,0,1};
-            row.assign(j7, j7+3); shape.push_back(row);
-            row.assign(j8, j8+3); shape.push_back(row);
-            row.assign(j9, j9+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int j10[] = {0,1,0}; int j11[] = {0,1,0}; int j12[] = {1,1,0};
-            row.assign(j10, j10+3); shape.push_back(row);
-            row.assign(j11, j11+3); shape.push_back(row);
-            row.assign(j12, j12+3); shape.push_back(row);
-            rots.push_back(shape);
-            rotaciones_piezas["J"] = rots;
+        // Lo que diga el .brik para este tipo manda
+        r.puntos           = enteroConfig(config, "puntos_" + nombre, r.puntos);
+        r.crecimiento      = enteroConfig(config, "crecimiento_" + nombre, r.crecimiento);
+        r.cambio_velocidad = enteroConfig(config, "velocidad_" + nombre, r.cambio_velocidad);
+        r.color            = textoConfig(config, "color_" + nombre, r.color);
+        reglas.push_back(r);
+        return static_cast<int>(reglas.size()) - 1;
+    }
+public:
+    void compilar(const SnakeAST& config) {
+        reglas.clear();
+        sorteo.clear();
+        vector<string> disponibles;
+        map<string, vector<string> >::const_iterator it = config.arrays.find("frutas_disponibles");
+        if (it != config.arrays.end()) {
+            disponibles = it->second;
+        } else {
+            // Frutas por defecto
+            disponibles.push_back("manzana");
+            disponibles.push_back("cereza");
+            disponibles.push_back("banana");
         }
-        // L
-        {
-            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
-            int l1[] = {0,0,1}; int l2[] = {1,1,1}; int l3[] = {0,0,0};
-            row.assign(l1, l1+3); shape.push_back(row);
-            row.assign(l2, l2+3); shape.push_back(row);
-            row.assign(l3, l3+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int l4[] = {0,1,0}; int l5[] = {0,1,0}; int l6[] = {0,1,1};
-            row.assign(l4, l4+3); shape.push_back(row);
-            row.assign(l5, l5+3); shape.push_back(row);
-            row.assign(l6, l6+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int l7[] = {0,0,0}; int l8[] = {1,1,1}; int l9[] = {1,0,0};
-            row.assign(l7, l7+3); shape.push_back(row);
-            row.assign(l8, l8+3); shape.push_back(row);
-            row.assign(l9, l9+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int l10[] = {1,1,0}; int l11[] = {0,1,0}; int l12[] = {0,1,0};
-            row.assign(l10, l10+3); shape.push_back(row);
-            row.assign(l11, l11+3); shape.push_back(row);
-            row.assign(l12, l12+3); shape.push_back(row);
-            rots.push_back(shape);
-            rotaciones_piezas["L"] = rots;
+        if (disponibles.empty()) disponibles.push_back("manzana");
+        for (size_t i = 0; i < disponibles.size(); ++i) {
+            sorteo.push_back(registrar(config, disponibles[i]));
         }
-        // O (cuadrado)
-        {
-            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
-            int o1[] = {1,1}; int o2[] = {1,1};
-            row.assign(o1, o1+2); shape.push_back(row);
-            row.assign(o2, o2+2); shape.push_back(row);
-            rots.push_back(shape);
-            rots.push_back(shape);
-            rots.push_back(shape);
-            rots.push_back(shape);
-            rotaciones_piezas["O"] = rots;
+    }
+
+    int tamanio() const { return static_cast<int>(reglas.size()); }
+    const ReglaFruta& operator[](int i) const { return reglas[i]; }
+
+    // Tipo de la próxima fruta
+    int sortear(GeneradorAleatorio& aleatorio) const {
+        return sorteo[aleatorio.rango(static_cast<int>(sorteo.size()))];
+    }
+
+    int indice(const string& nombre) const {
+        for (size_t i = 0; i < reglas.size(); ++i) {
+            if (reglas[i].nombre == nombre) return static_cast<int>(i);
         }
-        // S
-        {
-            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
-            int s1[] = {0,1,1}; int s2[] = {1,1,0}; int s3[] = {0,0,0};
-            row.assign(s1, s1+3); shape.push_back(row);
-            row.assign(s2, s2+3); shape.push_back(row);
-            row.assign(s3, s3+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int s4[] = {0,1,0}; int s5[] = {0,1,1}; int s6[] = {0,0,1};
-            row.assign(s4, s4+3); shape.push_back(row);
-            row.assign(s5, s5+3); shape.push_back(row);
-            row.assign(s6, s6+3); shape.push_back(row);
-            rots.push_back(shape);
-            rots.push_back(rots[0]);
-            rots.push_back(rots[1]);
-            rotaciones_piezas["S"] = rots;
+        return -1;
+    }
+};
+
+// ============================================================================
+// CLASE: FrutasTablero
+// ============================================================================
+// Frutas en juego (hasta frutas_simultaneas) y reapariciones pendientes.
+// La casilla de cada fruta guarda en el MapaOcupacion su índice en la lista,
+// así que comerla es quitarla con un intercambio con la última, sin buscar.
+// Como respawn_fruta_ms es fijo, las reapariciones vencen en el mismo orden
+// en que se comieron las frutas: basta una cola y un solo temporizador
+// (EVENTO_FRUTA) programado para la primera.
+// ============================================================================
+struct FrutaEnTablero {
+    Posicion pos;
+    int      tipo;  // Índice en la TablaFrutas
+};
+
+class FrutasTablero {
+private:
+    vector<FrutaEnTablero> frutas;
+    deque<DWORD>           pendientes;  // Vencimientos de las reapariciones, en orden
+public:
+    // Olvida todo (el mapa ya se redimensionó y no tiene entidades)
+    void vaciar() {
+        frutas.clear();
+        pendientes.clear();
+    }
+
+    // Retira las frutas del mapa y olvida las pendientes
+    void vaciar(MapaOcupacion& mapa) {
+        for (size_t i = 0; i < frutas.size(); ++i) mapa.ponerEntidad(frutas[i].pos, SIN_ENTIDAD);
+        vaciar();
+    }
+
+    int tamanio() const { return static_cast<int>(frutas.size()); }
+    const FrutaEnTablero& operator[](int i) const { return frutas[i]; }
+
+    // Pone una fruta de tipo sorteado en una casilla libre; false si no hay sitio
+    bool generar(MapaOcupacion& mapa, const TablaFrutas& tabla, GeneradorAleatorio& aleatorio) {
+        if (mapa.numLibres() == 0) return false;
+        FrutaEnTablero f;
+        f.pos  = mapa.libreAleatoria(aleatorio);
+        f.tipo = tabla.sortear(aleatorio);
+        mapa.ponerEntidad(f.pos, static_cast<int>(frutas.size()));
+        frutas.push_back(f);
+        return true;
+    }
+
+    // Retira la fruta de la casilla p (debe haberla) y devuelve su tipo
+    int comer(MapaOcupacion& mapa, const Posicion& p) {
+        int k    = mapa.entidad(p);
+        int tipo = frutas[k].tipo;
+        frutas[k] = frutas.back();
+        mapa.ponerEntidad(frutas[k].pos, k);
+        frutas.pop_back();
+        mapa.ponerEntidad(p, SIN_ENTIDAD);
+        return tipo;
+    }
+
+    void encolarReaparicion(DWORD vence) { pendientes.push_back(vence); }
+    bool hayPendientes() const { return !pendientes.empty(); }
+    DWORD proximaReaparicion() const { return pendientes.front(); }
+    void sacarReaparicion() { pendientes.pop_front(); }
+};
+
+/**
+ * Coloca los obstáculos de la configuración: los de obstaculos_fijos
+ * (pares x, y dentro del tablero y fuera de la serpiente) y después
+ * obstaculos_aleatorios en casillas libres al azar. El carril por delante
+ * de la cabeza se reserva mientras tanto para no empezar contra uno.
+ * Las casillas usadas se añaden a 'colocados'.
+ */
+static void colocarObstaculos(const SnakeAST& config, MapaOcupacion& mapa, GeneradorAleatorio& aleatorio,
+                              const Posicion& cabeza, const Posicion& direccion, int ancho, int alto,
+                              vector<Posicion>& colocados) {
+    map<string, vector<string> >::const_iterator it = config.arrays.find("obstaculos_fijos");
+    if (it != config.arrays.end()) {
+        const vector<string>& v = it->second;
+        for (size_t i = 0; i + 1 < v.size(); i += 2) {
+            Posicion p(atoi(v[i].c_str()), atoi(v[i + 1].c_str()));
+            if (p.x < 1 || p.x >= ancho - 1 || p.y < 1 || p.y >= alto - 1) continue;
+            if (mapa.ocupada(p) || mapa.entidad(p) != SIN_ENTIDAD) continue;
+            mapa.ponerEntidad(p, OBSTACULO);
+            colocados.push_back(p);
         }
-        // Z
-        {
-            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
-            int z1[] = {1,1,0}; int z2[] = {0,1,1}; int z3[] = {0,0,0};
-            row.assign(z1, z1+3); shape.push_back(row);
-            row.assign(z2, z2+3); shape.push_back(row);
-            row.assign(z3, z3+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int z4[] = {0,0,1}; int z5[] = {0,1,1}; int z6[] = {0,1,0};
-            row.assign(z4, z4+3); shape.push_back(row);
-            row.assign(z5, z5+3); shape.push_back(row);
-            row.assign(z6, z6+3); shape.push_back(row);
-            rots.push_back(shape);
-            rots.push_back(rots[0]);
-            rots.push_back(rots[1]);
-            rotaciones_piezas["Z"] = rots;
+    }
+
+    int n = enteroConfig(config, "obstaculos_aleatorios", 0);
+    if (n <= 0) return;
+    vector<Posicion> carril;
+    for (Posicion p(cabeza.x + direccion.x, cabeza.y + direccion.y);
+         p.x >= 1 && p.x < ancho - 1 && p.y >= 1 && p.y < alto - 1;
+         p = Posicion(p.x + direccion.x, p.y + direccion.y)) {
+        if (mapa.ocupada(p) || mapa.entidad(p) != SIN_ENTIDAD) continue;
+        mapa.ponerEntidad(p, OBSTACULO);
+        carril.push_back(p);
+    }
+    for (int i = 0; i < n && mapa.numLibres() > 0; ++i) {
+        Posicion p = mapa.libreAleatoria(aleatorio);
+        mapa.ponerEntidad(p, OBSTACULO);
+        colocados.push_back(p);
+    }
+    for (size_t i = 0; i < carril.size(); ++i) mapa.ponerEntidad(carril[i], SIN_ENTIDAD);
+}
+
+// ----------------------------------------------------------------------------
+// Políticas de juego para Snake (modo headless y lotes)
+// ----------------------------------------------------------------------------
+
+/**
+ * Buffers de búsqueda del bot "ruta" (costes, padres, marcas y montículo),
+ * dimensionados según el tablero. Una casilla cuenta como visitada si su
+ * marca es la de la búsqueda en curso, así que empezar una búsqueda no
+ * recorre el tablero ni reserva memoria. Entre una decisión y la siguiente
+ * no guardan nada: varias políticas que no deciden a la vez pueden compartir
+ * los mismos (la arena usa unos por hilo y no por serpiente).
+ */
+struct BusquedaRutaSnake {
+    struct Nodo {
+        int f;      // Coste hasta la casilla + estimación hasta el destino
+        int h;      // Estimación (a igual f se expande la más cercana al destino)
+        int celda;
+        bool operator>(const Nodo& o) const { return f != o.f ? f > o.f : h > o.h; }
+    };
+
+    vector<int>      coste;      // Pasos desde el origen (válido si visita == generacion)
+    vector<int>      padre;
+    vector<uint32_t> visita;
+    vector<uint32_t> bloqueo;    // Cuerpo simulado: bloqueada si == generacion_bloqueo
+    uint32_t         generacion;
+    uint32_t         generacion_bloqueo;
+    vector<Nodo>     monticulo;
+    vector<int>      camino;     // Última búsqueda: del destino al primer paso
+    vector<int>      propuesta;  // Ruta a una fruta mientras se comprueba
+
+    BusquedaRutaSnake() : generacion(0), generacion_bloqueo(0) {}
+
+    // Ajusta los buffers a un tablero de n casillas (no hace nada si ya lo están)
+    void dimensionar(size_t n) {
+        if (visita.size() == n) return;
+        coste.assign(n, 0);
+        padre.assign(n, -1);
+        visita.assign(n, 0);
+        bloqueo.assign(n, 0);
+        generacion = generacion_bloqueo = 0;
+        monticulo.reserve(n);
+        camino.reserve(n);
+        propuesta.reserve(n);
+    }
+
+    uint32_t nuevaBusqueda() {
+        if (++generacion == 0) {
+            fill(visita.begin(), visita.end(), 0u);
+            generacion = 1;
         }
-        // T
-        {
-            vector<vector<vector<int> > > rots; vector<vector<int> > shape; vector<int> row;
-            int t1[] = {0,1,0}; int t2[] = {1,1,1}; int t3[] = {0,0,0};
-            row.assign(t1, t1+3); shape.push_back(row);
-            row.assign(t2, t2+3); shape.push_back(row);
-            row.assign(t3, t3+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int t4[] = {0,1,0}; int t5[] = {0,1,1}; int t6[] = {0,1,0};
-            row.assign(t4, t4+3); shape.push_back(row);
-            row.assign(t5, t5+3); shape.push_back(row);
-            row.assign(t6, t6+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int t7[] = {0,0,0}; int t8[] = {1,1,1}; int t9[] = {0,1,0};
-            row.assign(t7, t7+3); shape.push_back(row);
-            row.assign(t8, t8+3); shape.push_back(row);
-            row.assign(t9, t9+3); shape.push_back(row);
-            rots.push_back(shape);
-            shape.clear();
-            int t10[] = {0,1,0}; int t11[] = {1,1,0}; int t12[] = {0,1,0};
-            row.assign(t10, t10+3); shape.push_back(row);
-            row.assign(t11, t11+3); shape.push_back(row);
-            row.assign(t12, t12+3); shape.push_back(row);
-            rots.push_back(shape);
-            rotaciones_piezas["T"] = rots;
+        return generacion;
+    }
+
+    void nuevoBloqueo() {
+        if (++generacion_bloqueo == 0) {
+            fill(bloqueo.begin(), bloqueo.end(), 0u);
+            generacion_bloqueo = 1;
+        }
+    }
+};
+
+struct VistaSnake {
+    const CuerpoSnake*      cuerpo;     // (*cuerpo)[0] es la cabeza
+    const MapaOcupacion*    ocupacion;  // Segmentos, frutas y obstáculos por casilla
+    const FrutasTablero*    frutas;     // Puede estar vacía mientras reaparecen
+    const TablaFrutas*      tabla;      // Reglas de cada tipo de fruta
+    Posicion                direccion;
+    int                     ancho;
+    int                     alto;
+    bool                    paredes;    // true si chocar con el borde termina la partida
+    long                    tick;
+    BusquedaRutaSnake*      busqueda;   // Buffers del bot "ruta" a compartir (NULL = los suyos)
+};
+
+class PoliticaSnake {
+public:
+    virtual ~PoliticaSnake() {}
+    virtual char decidir(const VistaSnake& v) = 0;
+};
+
+class PoliticaGuionSnake : public PoliticaSnake {
+private:
+    GuionEntrada guion;
+public:
+    explicit PoliticaGuionSnake(const string& teclas) : guion(teclas) {}
+    char decidir(const VistaSnake& v) { return guion.tecla(v.tick); }
+};
+
+class PoliticaAleatoriaSnake : public PoliticaSnake {
+private:
+    GeneradorAleatorio aleatorio;
+public:
+    explicit PoliticaAleatoriaSnake(uint32_t semilla) : aleatorio(semilla) {}
+    char decidir(const VistaSnake&) {
+        static const char teclas[] = "wasd............";
+        return teclas[aleatorio.rango(16)];
+    }
+};
+
+// Avanza hacia la fruta más cercana por la dirección segura que más acerque a ella.
+// La fruta elegida se mantiene mientras siga en su casilla, así que la lista
+// de frutas solo se recorre cuando desaparece el objetivo.
+class PoliticaVorazSnake : public PoliticaSnake {
+private:
+    Posicion objetivo;
+
+    static bool segura(const VistaSnake& v, const Posicion& p) {
+        Posicion q = p;
+        if (q.x < 1 || q.x >= v.ancho - 1 || q.y < 1 || q.y >= v.alto - 1) {
+            if (v.paredes) return false;
+            if (q.x < 1) q.x = v.ancho - 2; else if (q.x >= v.ancho - 1) q.x = 1;
+            if (q.y < 1) q.y = v.alto - 2;  else if (q.y >= v.alto - 1)  q.y = 1;
+        }
+        return v.ocupacion->entidad(q) != OBSTACULO && !chocaConCuerpo(*v.cuerpo, *v.ocupacion, q);
+    }
+public:
+    PoliticaVorazSnake() : objetivo(-1, -1) {}
+
+    char decidir(const VistaSnake& v) {
+        static const char     teclas[4] = { 'w', 's', 'a', 'd' };
+        static const Posicion deltas[4] = { Posicion(0, -1), Posicion(0, 1), Posicion(-1, 0), Posicion(1, 0) };
+        const Posicion cabeza = v.cuerpo->cabeza();
+        bool vigente = objetivo.x >= 0 && objetivo.x < v.ancho && objetivo.y >= 0 && objetivo.y < v.alto
+                    && v.ocupacion->entidad(objetivo) >= 0;
+        if (!vigente) {
+            objetivo = Posicion(-1, -1);
+            int cercania = 0;
+            for (int i = 0; i < v.frutas->tamanio(); ++i) {
+                const Posicion& f = (*v.frutas)[i].pos;
+                int d = abs(f.x - cabeza.x) + abs(f.y - cabeza.y);
+                if (i == 0 || d < cercania) {
+                    objetivo = f;
+                    cercania = d;
+                }
+            }
         }
+        int  mejor      = -1;
+        int  mejor_dist = 0;
+        for (int i = 0; i < 4; ++i) {
+            // No se puede invertir la marcha
+            if (deltas[i].x == -v.direccion.x && deltas[i].y == -v.direccion.y) continue;
+            Posicion p(cabeza.x + deltas[i].x, cabeza.y + deltas[i].y);
+            if (!segura(v, p)) continue;
+            int dist = abs(objetivo.x - p.x) + abs(objetivo.y - p.y);
+            if (mejor < 0 || dist < mejor_dist) {
+                mejor      = i;
+                mejor_dist = dist;
+            }
+        }
+        if (mejor < 0 || (deltas[mejor] == v.direccion)) return 0;
+        return teclas[mejor];
     }
 };
 
-enum TipoPieza { I=0, J=1, L=2, O=3, S=4, Z=5, T=6, VACIO=7 };
-enum ColorTetris { CIAN=11, AZUL=9, NARANJA=12, AMARILLO=14, VERDE=10, ROJO=12, MAGENTA=13, BLANCO=15, GRIS=8 };
+// El bot "ruta" pasa al ciclo hamiltoniano cuando la serpiente ocupa
+// 1/DIVISOR_CICLO_SNAKE del interior del tablero (antes se alinea con el
+// ciclo con más facilidad; con la mitad a veces queda dando vueltas)
+static const int DIVISOR_CICLO_SNAKE = 3;
 
-class PiezaTetris {
-public:
-    vector<vector<vector<int> > > rotaciones;
-    string                      tipo_str;
-    TipoPieza                   tipo;
-    ColorTetris                 color;
-    int                         x;
-    int                         y;
-    int                         rotacion_actual;
-
-    explicit PiezaTetris(TipoPieza t, const ConfigTetris& config)
-        : tipo(t), x(0), y(0), rotacion_actual(0) {
-        configurarPieza(config);
-    }
+// Casillas del cuerpo que el bot "ruta" sigue tras alcanzar su cola antes de
+// volver a buscar: alargar más ahorra búsquedas pero deja de buscar hueco
+// y encierra a la serpiente en tableros grandes
+static const int EXTENSION_COLA_SNAKE = 4;
+
+/**
+ * Bot "ruta" de Snake. Planea con A* el camino a la fruta más cercana sobre
+ * el mapa de ocupación y solo lo toma si, simulando el cuerpo al llegar, la
+ * cabeza aún alcanza la cola (no se encierra). Si no hay camino seguro
+ * persigue su cola por la casilla más alejada de ella. Cuando la serpiente
+ * ocupa un tercio del interior y no hay obstáculos, recorre un ciclo
+ * hamiltoniano del interior: una vez alineada con él llena el tablero sin
+ * chocar.
+ *
+ * Busca sobre los BusquedaRutaSnake que trae la vista o, si no trae, sobre
+ * los suyos; lo único que guarda del tablero entre pasos es la ruta en
+ * curso. La ruta se planea una vez por fruta; en los demás pasos solo se
+ * comprueba que la casilla siguiente siga libre, y entre paso y paso de la
+ * serpiente el bot no hace nada.
+ */
+class PoliticaRutaSnake : public PoliticaSnake {
 private:
-    void configurarPieza(const ConfigTetris& config) {
-        switch (tipo) {
-            case I: tipo_str = "I"; break;
-            case J: tipo_str = "J"; break;
-            case L: tipo_str = "L"; break;
-            case O: tipo_str = "O"; break;
-            case S: tipo_str = "S"; break;
-            case Z: tipo_str = "Z"; break;
-            case T: tipo_str = "T"; break;
-            default:  tipo_str = "I"; break;
+    typedef BusquedaRutaSnake::Nodo NodoRuta;
+
+    int                ancho;
+    int                alto;
+    bool               paredes;
+    BusquedaRutaSnake  propia;    // Buffers propios, si la vista no trae otros
+    BusquedaRutaSnake* busqueda;  // Los de la decisión en curso
+    bool               sobre_simulado;  // Las búsquedas usan el cuerpo simulado y no el real
+    vector<int>        ruta;      // Ruta en curso, del destino al primer paso; se consume por el final
+
+    int              espera_plan;   // Pasos que faltan para volver a planear tras un fallo
+    int              fallos_plan;   // Fallos seguidos (la espera se dobla con cada uno)
+    bool             ruta_cola;     // La ruta en curso lleva a la cola y no a una fruta
+    int              ruta_desde;    // Casilla en la que debe estar la cabeza para seguir la ruta
+    int              ruta_tamanio;  // Largo de la serpiente con el que se planeó
+    Posicion         ultima_cabeza; // Estado en la última decisión
+    int              ultimo_tamanio;
+    int              ultimas_frutas;
+    bool             en_ciclo;
+    bool             ciclo_descartado;  // Tablero sin ciclo (lados impares u obstáculos)
+    bool             alineada;          // Todo el cuerpo va detrás de la cabeza por el ciclo
+    int              pasos_ciclo;       // Pasos seguidos por el ciclo desde que se empezó a alinear
+
+    int indice(const Posicion& p) const { return p.y * ancho + p.x; }
+    Posicion posicion(int celda) const { return Posicion(celda % ancho, celda / ancho); }
+
+    void dimensionar(const VistaSnake& v) {
+        paredes  = v.paredes;
+        busqueda = v.busqueda ? v.busqueda : &propia;
+        busqueda->dimensionar(static_cast<size_t>(v.ancho) * v.alto);
+        if (v.ancho == ancho && v.alto == alto) return;
+        ancho = v.ancho;
+        alto  = v.alto;
+        reiniciar();
+    }
+
+    // Olvida la ruta y el ciclo (partida nueva)
+    void reiniciar() {
+        ruta.clear();
+        ruta_desde       = -1;
+        espera_plan      = 0;
+        fallos_plan      = 0;
+        en_ciclo         = false;
+        ciclo_descartado = false;
+        alineada         = false;
+        pasos_ciclo      = 0;
+    }
+
+    // Casilla vecina en la dirección d (0 arriba, 1 abajo, 2 izquierda, 3 derecha); sin paredes se envuelve
+    bool vecina(int celda, int d, int& destino) const {
+        static const int dx[4] = { 0, 0, -1, 1 };
+        static const int dy[4] = { -1, 1, 0, 0 };
+        int x = celda % ancho + dx[d];
+        int y = celda / ancho + dy[d];
+        if (x < 1 || x >= ancho - 1 || y < 1 || y >= alto - 1) {
+            if (paredes) return false;
+            if (x < 1) x = ancho - 2; else if (x >= ancho - 1) x = 1;
+            if (y < 1) y = alto - 2;  else if (y >= alto - 1)  y = 1;
         }
-        {
-            map<string, vector<vector<vector<int> > > >::const_iterator it = config.rotaciones_piezas.find(tipo_str);
-            if (it != config.rotaciones_piezas.end()) {
-                rotaciones = it->second;
+        destino = y * ancho + x;
+        return true;
+    }
+
+    // Distancia Manhattan (por el lado corto si los bordes se cruzan)
+    int estimacion(int a, int b) const {
+        int dx = abs(a % ancho - b % ancho);
+        int dy = abs(a / ancho - b / ancho);
+        if (!paredes) {
+            dx = min(dx, ancho - 2 - dx);
+            dy = min(dy, alto - 2 - dy);
+        }
+        return dx + dy;
+    }
+
+    bool transitable(const VistaSnake& v, int celda, int destino) const {
+        if (celda == destino) return true;
+        Posicion p = posicion(celda);
+        if (v.ocupacion->entidad(p) == OBSTACULO) return false;
+        if (sobre_simulado) return busqueda->bloqueo[celda] != busqueda->generacion_bloqueo;
+        return !v.ocupacion->ocupada(p);
+    }
+
+    // ¿Puede la cabeza entrar ya en la casilla? (mismo criterio que el motor)
+    bool segura(const VistaSnake& v, int celda) const {
+        Posicion p = posicion(celda);
+        return v.ocupacion->entidad(p) != OBSTACULO && !chocaConCuerpo(*v.cuerpo, *v.ocupacion, p);
+    }
+
+    // Resultados de buscar() sin camino
+    enum {
+        SIN_CAMINO = -1,  // Se agotó la región del origen
+        AGOTADA    = -2   // Se expandieron 'limite' casillas sin llegar
+    };
+
+    /**
+     * A* de origen a destino. 'atras' es la casilla a la que no se puede
+     * salir desde el origen (invertir la marcha), o -1. Para en cuanto
+     * expande 'limite' casillas: así una búsqueda fallida no recorre todo
+     * un tablero grande, y haberlas expandido ya prueba que la región del
+     * origen tiene al menos ese tamaño.
+     * @return Pasos del camino (queda en 'camino', vacío si no hay), SIN_CAMINO o AGOTADA
+     */
+    int buscar(const VistaSnake& v, int origen, int destino, int atras, long limite) {
+        uint32_t g = busqueda->nuevaBusqueda();
+        busqueda->monticulo.clear();
+        busqueda->camino.clear();
+        busqueda->visita[origen] = g;
+        busqueda->coste[origen]  = 0;
+        busqueda->padre[origen]  = -1;
+        int h0 = estimacion(origen, destino);
+        NodoRuta inicio = { h0, h0, origen };
+        busqueda->monticulo.push_back(inicio);
+        while (!busqueda->monticulo.empty()) {
+            pop_heap(busqueda->monticulo.begin(), busqueda->monticulo.end(), greater<NodoRuta>());
+            NodoRuta n = busqueda->monticulo.back();
+            busqueda->monticulo.pop_back();
+            if (n.f - n.h > busqueda->coste[n.celda]) continue;  // Entrada vieja: ya se llegó por un camino más corto
+            if (n.celda == destino) {
+                for (int c = destino; c != origen; c = busqueda->padre[c]) busqueda->camino.push_back(c);
+                return busqueda->coste[destino];
+            }
+            if (--limite < 0) return AGOTADA;
+            for (int d = 0; d < 4; ++d) {
+                int w;
+                if (!vecina(n.celda, d, w)) continue;
+                if (n.celda == origen && w == atras) continue;
+                if (!transitable(v, w, destino)) continue;
+                int c = busqueda->coste[n.celda] + 1;
+                if (busqueda->visita[w] == g && busqueda->coste[w] <= c) continue;
+                busqueda->visita[w] = g;
+                busqueda->coste[w]  = c;
+                busqueda->padre[w]  = n.celda;
+                int h = estimacion(w, destino);
+                NodoRuta siguiente = { c + h, h, w };
+                busqueda->monticulo.push_back(siguiente);
+                push_heap(busqueda->monticulo.begin(), busqueda->monticulo.end(), greater<NodoRuta>());
             }
         }
-        {
-            map<string,int>::const_iterator it2 = config.colores.find(tipo_str);
-            if (it2 != config.colores.end()) {
-                color = static_cast<ColorTetris>(it2->second);
+        return SIN_CAMINO;
+    }
+
+    /**
+     * ¿Llega una cabeza en 'origen' hasta la cola en 'cola' sin pisarla antes
+     * de que gaste sus 'copias'? Si la búsqueda se agota, la región tiene
+     * varias veces más casillas que segmentos la serpiente: hay sitio para
+     * moverse hasta que la cola avance, y se da por buena.
+     * @return Distancia a la cola (límite si se agotó) o SIN_CAMINO
+     */
+    static long limiteCola(const VistaSnake& v) { return 4L * v.cuerpo->tamanio() + 256; }
+
+    int distanciaCola(const VistaSnake& v, int origen, int cola, int copias, long limite) {
+        int dist = buscar(v, origen, cola, -1, limite);
+        if (dist == AGOTADA) return static_cast<int>(limite);
+        return dist >= copias ? dist : SIN_CAMINO;
+    }
+
+    /**
+     * Planea la ruta a la fruta más cercana. Se acepta solo si, con el cuerpo
+     * como quedaría al comerla (el camino delante de los segmentos que siguen
+     * y el crecimiento de esa fruta), la cabeza todavía llega a la cola; si
+     * no, la ruta en curso no cambia.
+     */
+    bool planear(const VistaSnake& v, int cabeza, int atras) {
+        int objetivo  = -1;
+        int cercania  = 0;
+        for (int i = 0; i < v.frutas->tamanio(); ++i) {
+            int f = indice((*v.frutas)[i].pos);
+            int d = estimacion(cabeza, f);
+            if (objetivo < 0 || d < cercania) {
+                objetivo = f;
+                cercania = d;
+            }
+        }
+        if (objetivo < 0) return false;
+
+        sobre_simulado = false;
+        int pasos = buscar(v, cabeza, objetivo, atras, static_cast<long>(ancho) * alto);
+        if (pasos < 0) return false;
+
+        // Cuerpo simulado al llegar: camino (cabeza primero) y luego el cuerpo actual
+        const CuerpoSnake& cuerpo = *v.cuerpo;
+        int tipo        = (*v.frutas)[v.ocupacion->entidad(posicion(objetivo))].tipo;
+        int crecimiento = (*v.tabla)[tipo].crecimiento;
+        int largo       = min(max(1, cuerpo.tamanio() + 1 + crecimiento), cuerpo.tamanio() + 1);
+        busqueda->camino.swap(busqueda->propuesta);
+        if (largo > 1) {
+            busqueda->nuevoBloqueo();
+            for (int i = 1; i < largo - 1; ++i) {
+                int c = i < pasos ? busqueda->propuesta[i] : indice(cuerpo[i - pasos]);
+                busqueda->bloqueo[c] = busqueda->generacion_bloqueo;
+            }
+            int cola = largo - 1 < pasos ? busqueda->propuesta[largo - 1] : indice(cuerpo[largo - 1 - pasos]);
+            // La cola no se mueve hasta gastar sus copias (las del crecimiento y las que ya tenga)
+            int copias = 1 + max(0, crecimiento);
+            for (int i = largo - 2; i >= pasos && indice(cuerpo[i - pasos]) == cola; --i) copias++;
+            sobre_simulado = true;
+            bool alcanza = distanciaCola(v, objetivo, cola, copias, limiteCola(v)) >= 0;
+            sobre_simulado = false;
+            if (!alcanza) return false;
+        }
+        ruta.assign(busqueda->propuesta.begin(), busqueda->propuesta.end());
+        return true;
+    }
+
+    /**
+     * Sin ruta segura: entre las casillas a las que se puede entrar, la que
+     * sigue conectada con la cola por el camino más largo (gana tiempo hasta
+     * que se abra hueco); después, una desde la que la búsqueda se agotó
+     * (región grande); si ninguna, la que tenga más vecinas libres.
+     * El camino hasta la cola queda como ruta, seguido de unas casillas del
+     * cuerpo desde la cola hacia la cabeza: se van liberando una por paso,
+     * antes de que llegue la cabeza, y la búsqueda no se repite a cada paso.
+     */
+    bool perseguirCola(const VistaSnake& v, int cabeza, int atras) {
+        int cola        = indice(v.cuerpo->cola());
+        int copias      = v.ocupacion->cuenta(v.cuerpo->cola());
+        int mejor_clase = -1;
+        int mejor_dist  = -1;
+        int mejor_grado = -1;
+        ruta.clear();
+        sobre_simulado = false;
+        for (int d = 0; d < 4; ++d) {
+            int w;
+            if (!vecina(cabeza, d, w) || w == atras || !segura(v, w)) continue;
+            int dist  = w == cola ? 0 : distanciaCola(v, w, cola, copias - 1, 4 * limiteCola(v));
+            int clase = dist < 0 ? 0 : (w == cola || !busqueda->camino.empty()) ? 2 : 1;
+            int grado = 0;
+            for (int e = 0; e < 4; ++e) {
+                int u;
+                if (vecina(w, e, u) && u != cabeza && segura(v, u)) grado++;
+            }
+            if (clase > mejor_clase || (clase == mejor_clase && (dist > mejor_dist
+                || (dist == mejor_dist && grado > mejor_grado)))) {
+                ruta.clear();
+                if (clase == 2) {
+                    const CuerpoSnake& cuerpo = *v.cuerpo;
+                    for (int i = std::max(1, cuerpo.tamanio() - 1 - EXTENSION_COLA_SNAKE); i < cuerpo.tamanio() - 1; ++i) {
+                        int c = indice(cuerpo[i]);
+                        if (ruta.empty() || ruta.back() != c) ruta.push_back(c);
+                    }
+                    // 'camino' lleva de la cola hasta después de w
+                    for (size_t i = 0; i < busqueda->camino.size() && w != cola; ++i) {
+                        if (ruta.empty() || ruta.back() != busqueda->camino[i]) ruta.push_back(busqueda->camino[i]);
+                    }
+                }
+                if (ruta.empty() || ruta.back() != w) ruta.push_back(w);
+                mejor_clase = clase;
+                mejor_dist  = dist;
+                mejor_grado = grado;
+            }
+        }
+        ruta_cola = true;
+        return !ruta.empty();
+    }
+
+    // Toma el primer paso de la ruta en curso
+    int avanzarRuta(int tamanio) {
+        int w = ruta.back();
+        ruta.pop_back();
+        ruta_desde   = w;
+        ruta_tamanio = tamanio;
+        return w;
+    }
+
+    // ¿Admite el interior un ciclo hamiltoniano? Hace falta un lado par y ningún obstáculo
+    bool cicloPosible(const VistaSnake& v) const {
+        int w = ancho - 2;
+        int h = alto - 2;
+        if (w < 2 || h < 2 || (w % 2 != 0 && h % 2 != 0)) return false;
+        for (int y = 1; y < alto - 1; ++y) {
+            for (int x = 1; x < ancho - 1; ++x) {
+                if (v.ocupacion->entidad(x, y) == OBSTACULO) return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Casilla siguiente del ciclo, calculada sin tabla. Con un número par de
+     * filas: la columna 0 del interior es la vuelta (se sube por ella) y las
+     * demás columnas se recorren fila a fila en zigzag; con filas impares y
+     * columnas pares, lo mismo traspuesto.
+     */
+    int siguienteEnCiclo(int celda) const {
+        int w = ancho - 2;
+        int h = alto - 2;
+        int i = celda % ancho - 1;
+        int j = celda / ancho - 1;
+        bool traspuesto = h % 2 != 0;
+        if (traspuesto) {
+            swap(i, j);
+            swap(w, h);
+        }
+        int ni = i;
+        int nj = j;
+        if (i == 0)          { if (j > 0) nj = j - 1; else ni = 1; }
+        else if (j % 2 == 0) { if (i < w - 1) ni = i + 1; else nj = j + 1; }
+        else if (i > 1)      ni = i - 1;
+        else if (j == h - 1) ni = 0;
+        else                 nj = j + 1;
+        if (traspuesto) swap(ni, nj);
+        return (nj + 1) * ancho + (ni + 1);
+    }
+
+    /**
+     * ¿Puede la cabeza seguir el ciclo durante tantos pasos como segmentos
+     * tiene? Cada casilla del recorrido debe estar libre o quedar libre a
+     * tiempo: el segmento i (0 = cabeza) se va tras largo - i pasos, y cada
+     * fruta comida por el camino lo retrasa. Tras esos pasos el cuerpo entero
+     * va en el orden del ciclo.
+     */
+    bool cicloSeguro(const VistaSnake& v, int cabeza) {
+        const CuerpoSnake& cuerpo = *v.cuerpo;
+        int largo = cuerpo.tamanio();
+        uint32_t g = busqueda->nuevaBusqueda();
+        for (int i = largo - 1; i >= 0; --i) {
+            int c = indice(cuerpo[i]);
+            busqueda->visita[c] = g;
+            busqueda->coste[c]  = largo - i;  // Pasos hasta que se libera (la primera aparición manda)
+        }
+        int retraso = 0;
+        int c = cabeza;
+        for (int t = 1; t <= largo; ++t) {
+            c = siguienteEnCiclo(c);
+            if (busqueda->visita[c] == g && busqueda->coste[c] + retraso > t) return false;
+            int e = v.ocupacion->entidad(posicion(c));
+            if (e >= 0) retraso += 1 + max(0, (*v.tabla)[(*v.frutas)[e].tipo].crecimiento);
+        }
+        return true;
+    }
+
+    // ¿Sigue conectada con la cola una cabeza que entre en la casilla?
+    bool alcanzaCola(const VistaSnake& v, int celda) {
+        Posicion cola = v.cuerpo->cola();
+        if (celda == indice(cola)) return true;
+        sobre_simulado = false;
+        return distanciaCola(v, celda, indice(cola), v.ocupacion->cuenta(cola) - 1, limiteCola(v)) >= 0;
+    }
+
+    int elegirPaso(const VistaSnake& v, int cabeza, int atras) {
+        int tamanio = v.cuerpo->tamanio();
+        if (!en_ciclo && !ciclo_descartado
+            && static_cast<long>(tamanio) * DIVISOR_CICLO_SNAKE >= static_cast<long>(ancho - 2) * (alto - 2)) {
+            if (cicloPosible(v)) {
+                en_ciclo    = true;
+                pasos_ciclo = 0;
+                ruta.clear();
             } else {
-                color = BLANCO;
+                ciclo_descartado = true;
+            }
+        }
+
+        // En el ciclo: alineada, la casilla siguiente siempre está libre.
+        // Para alinearse sigue el ciclo mientras sea seguro; empieza a
+        // seguirlo cuando el recorrido entero lo es o cuando no queda ruta
+        // segura a la fruta.
+        int ciclo = -1;
+        if (en_ciclo) {
+            ciclo = siguienteEnCiclo(cabeza);
+            if (alineada && segura(v, ciclo)) return ciclo;
+            alineada = false;
+            if (ciclo == atras || !segura(v, ciclo)) {
+                ciclo       = -1;
+                pasos_ciclo = 0;
+            } else if ((pasos_ciclo > 0 && alcanzaCola(v, ciclo)) || cicloSeguro(v, cabeza)) {
+                return seguirCiclo(ciclo, tamanio);
+            }
+        }
+
+        // Ruta en curso: hacia la fruta mientras siga allí; hacia la cola
+        // hasta que toque volver a planear
+        pasos_ciclo = 0;
+        if (!ruta.empty()) {
+            int w = ruta.back();
+            bool vigente = ruta_desde == cabeza && ruta_tamanio == tamanio && w != atras && segura(v, w)
+                        && (ruta_cola || v.ocupacion->entidad(posicion(ruta.front())) >= 0);
+            if (!vigente) {
+                ruta.clear();
+            } else if (!ruta_cola) {
+                return avanzarRuta(tamanio);
+            } else if (espera_plan > 0) {
+                espera_plan--;
+                return avanzarRuta(tamanio);
             }
         }
+        // Tras un fallo se espera antes de volver a planear (1, 2, 4... hasta 32 pasos):
+        // mientras la serpiente sigue a su cola el tablero cambia poco de un paso a otro
+        if (espera_plan > 0) {
+            espera_plan--;
+        } else if (planear(v, cabeza, atras)) {
+            fallos_plan = 0;
+            ruta_cola   = false;
+            return avanzarRuta(tamanio);
+        } else {
+            espera_plan = min(1 << fallos_plan, 32) - 1;
+            if (fallos_plan < 5) fallos_plan++;
+        }
+        if (ciclo >= 0 && alcanzaCola(v, ciclo)) return seguirCiclo(ciclo, tamanio);
+        if (!ruta.empty()) return avanzarRuta(tamanio);  // Sigue hacia la cola
+        return perseguirCola(v, cabeza, atras) ? avanzarRuta(tamanio) : -1;
+    }
+
+    // Paso por el ciclo; tras tantos seguidos como segmentos, el cuerpo queda alineado
+    int seguirCiclo(int celda, int tamanio) {
+        if (++pasos_ciclo >= tamanio) alineada = true;
+        ruta.clear();
+        return celda;
+    }
+public:
+    PoliticaRutaSnake()
+        : ancho(0), alto(0), paredes(true), busqueda(&propia), sobre_simulado(false),
+          espera_plan(0), fallos_plan(0), ruta_cola(false), ruta_desde(-1), ruta_tamanio(0), ultima_cabeza(-1, -1), ultimo_tamanio(0), ultimas_frutas(0),
+          en_ciclo(false), ciclo_descartado(false), alineada(false), pasos_ciclo(0) {}
+
+    char decidir(const VistaSnake& v) {
+        if (v.cuerpo->vacio()) return 0;
+        dimensionar(v);
+        Posicion cabeza  = v.cuerpo->cabeza();
+        int      tamanio = v.cuerpo->tamanio();
+        int      frutas  = v.frutas->tamanio();
+        // Entre dos pasos de la serpiente no hay nada nuevo que decidir
+        if (cabeza == ultima_cabeza && tamanio == ultimo_tamanio && frutas == ultimas_frutas) return 0;
+        // La cabeza solo salta a una casilla no vecina al empezar otra partida
+        int dx = abs(cabeza.x - ultima_cabeza.x);
+        int dy = abs(cabeza.y - ultima_cabeza.y);
+        bool contigua = dx + dy == 1 || (dy == 0 && dx == ancho - 3) || (dx == 0 && dy == alto - 3);
+        if (!contigua && !(cabeza == ultima_cabeza)) reiniciar();
+        ultima_cabeza  = cabeza;
+        ultimo_tamanio = tamanio;
+        ultimas_frutas = frutas;
+
+        int origen = indice(cabeza);
+        // El motor no deja invertir la marcha, ni siquiera con un solo segmento
+        int atras  = -1;
+        int opuesta = v.direccion.y > 0 ? 0 : v.direccion.y < 0 ? 1 : v.direccion.x > 0 ? 2 : 3;
+        if (!vecina(origen, opuesta, atras)) atras = -1;
+        int paso = elegirPaso(v, origen, atras);
+        if (paso < 0) return 0;
+
+        Posicion p = posicion(paso);
+        int mx = p.x - cabeza.x;
+        int my = p.y - cabeza.y;
+        if (mx > 1) mx = -1; else if (mx < -1) mx = 1;
+        if (my > 1) my = -1; else if (my < -1) my = 1;
+        if (Posicion(mx, my) == v.direccion) return 0;
+        if (my < 0) return 'w';
+        if (my > 0) return 's';
+        return mx < 0 ? 'a' : 'd';
     }
 };
 
-class TetrisEngine {
+// Temporizadores de los motores de Snake (índices del PlanificadorEventos)
+enum EventoSnake {
+    EVENTO_PASO = 0,           // La serpiente avanza una casilla
+    EVENTO_FRUTA,              // Reaparece la fruta tras respawn_fruta_ms
+    EVENTO_INSTANTANEA_SNAKE   // Toca guardar una instantánea (motor de consola)
+};
+
+// Giro pedido con el teclado o un bot, con el instante (reloj de la partida)
+// en que llegó. Cada paso de la serpiente aplica a lo sumo uno, así que dos
+// giros rápidos entre paso y paso se aplican en pasos seguidos en vez de
+// pisarse.
+struct EventoDireccion {
+    DWORD    ms;
+    Posicion direccion;
+    EventoDireccion(DWORD m = 0, const Posicion& d = Posicion()) : ms(m), direccion(d) {}
+};
+
+static const int CAPACIDAD_GIROS_SNAKE = 8;
+
+// Giros pendientes de una serpiente, en un arreglo circular de capacidad
+// fija. Los mete y los saca el mismo hilo (el del juego), así que no hace
+// falta sincronizar nada; si está llena, meter() falla y el giro se ignora.
+class ColaGiros {
 private:
-    static const int ANCHO = 10;
-    static const int ALTO  = 20;
+    EventoDireccion datos[CAPACIDAD_GIROS_SNAKE];
+    int             inicio;
+    int             cantidad;
+public:
+    ColaGiros() : inicio(0), cantidad(0) {}
 
-    vector<vector<TipoPieza> >   tablero;
-    vector<vector<ColorTetris> > colores_tablero;
+    int  tamanio() const { return cantidad; }
+    void vaciar()        { inicio = 0; cantidad = 0; }
 
-    PiezaTetris* pieza_actual;
-    PiezaTetris* siguiente_pieza;
+    bool meter(const EventoDireccion& g) {
+        if (cantidad == CAPACIDAD_GIROS_SNAKE) return false;
+        datos[(inicio + cantidad) % CAPACIDAD_GIROS_SNAKE] = g;
+        cantidad++;
+        return true;
+    }
 
-    // usando rand() en lugar de <random>
+    // El giro más antiguo sin sacarlo (NULL si no hay)
+    const EventoDireccion* frente() const {
+        return (cantidad > 0) ? &datos[inicio] : NULL;
+    }
 
-    int puntos;
-    int nivel;
-    int lineas_completadas;
-    int contador_linea_simple;  // Contador de líneas simples completadas
-    int contador_linea_doble;    // Contador de líneas dobles completadas
-    int contador_linea_triple;   // Contador de líneas triples completadas
-    int contador_linea_tetris;   // Contador de tetris (4 líneas) completados
-    int velocidad_caida;
-    DWORD last_horiz_move;
-    DWORD last_soft_drop;
+    // Quita el giro de frente() (debe haberlo)
+    void descartar() {
+        inicio = (inicio + 1) % CAPACIDAD_GIROS_SNAKE;
+        cantidad--;
+    }
+};
 
-    bool juego_activo;
-    bool pausado;
-    bool game_over;
+// Estado de una partida de Snake en un instante (todo salvo la configuración).
+// Cuesta lo que la serpiente y las frutas, no el tablero: del mapa de
+// ocupación solo se guarda la marca de su diario, y al restaurar se deshacen
+// los cambios posteriores. Los obstáculos no cambian durante una partida
+// (al reiniciar se vacían las instantáneas), así que ya están en el mapa.
+struct InstantaneaSnake {
+    DWORD               reloj;
+    vector<CeldaSnake>  cuerpo_snake;  // Solo los segmentos vivos; reutiliza su reserva
+    Posicion            direccion_actual;
+    ColaGiros           giros;
+    Posicion            direccion_encolada;
+    FrutasTablero       frutas_tablero;
+    uint64_t            marca_mapa;    // MapaOcupacion::marcaCambios() al tomarla
+    GeneradorAleatorio  aleatorio;
+    PlanificadorEventos planificador;
+    int                 puntos;
+    int                 nivel;
+    int                 velocidad_ms;
+    vector<int>         contadores_fruta;  // Uno por tipo de la TablaFrutas
+    int                 total_frutas_comidas;
+};
 
-    DWORD ultimo_movimiento;
-    DWORD ultima_caida;
+// Disposición de la consola de Snake: filas de texto sobre el marco y sangría
+static const int FILAS_CABECERA_SNAKE = 6;
+static const int MARGEN_VISTA_SNAKE   = 9;
 
-    ConfigTetris config;
+/**
+ * Origen de la vista en un eje. Solo se mueve cuando la cabeza se acerca a
+ * menos de un cuarto de la vista del borde, y entonces la vuelve a centrar:
+ * mientras tanto la vista está quieta y cada cuadro cambia pocas casillas.
+ */
+static int seguirCabeza(int camara, int cabeza, int vista, int total) {
+    if (vista >= total) return 0;
+    int margen = vista / 4;
+    if (cabeza < camara + margen || cabeza >= camara + vista - margen) camara = cabeza - vista / 2;
+    return max(0, min(camara, total - vista));
+}
 
-    string obtenerColorAnsi(int c) {
-        switch (c) {
-            case 9:  return "\033[94m";  // Azul claro
-            case 10: return "\033[92m";  // Verde claro
-            case 11: return "\033[96m";  // Cian
-            case 12: return "\033[91m";  // Rojo
-            case 13: return "\033[95m";  // Magenta
-            case 14: return "\033[93m";  // Amarillo
-            case 15: return "\033[97m";  // Blanco
-            default: return "\033[37m";  // Blanco normal
+class SnakeEngine {
+private:
+    // Configuración y estado
+    SnakeAST           config;
+    ColorConsola       colorConsola;
+    CuerpoSnake        cuerpo_snake;
+    MapaOcupacion      ocupacion;         // Segmentos, frutas y obstáculos por casilla
+    Posicion           direccion_actual;
+    ColaGiros          giros;             // Giros pendientes, uno por paso
+    Posicion           direccion_encolada;  // La que quedará tras los giros pendientes
+    TablaFrutas        frutas;            // Reglas por tipo, compiladas de la configuración
+    FrutasTablero      frutas_tablero;    // Frutas en juego y reapariciones pendientes
+    vector<Posicion>   obstaculos;        // Casillas con obstáculo en esta partida
+    bool               juego_activo;
+    bool               pausado;
+    bool               game_over;
+    bool               tablero_completo;  // La partida terminó por no quedar casillas libres
+    int                puntos;
+    int                nivel;
+    vector<int>        contadores_fruta;      // Frutas comidas por tipo (índice de 'frutas')
+    int                total_frutas_comidas;  // Total de todas las frutas comidas
+    GeneradorAleatorio aleatorio;  // Generador propio de la partida (posición y tipo de fruta)
+    uint32_t           semilla_partida;  // Semilla resuelta (se graba en las repeticiones)
+    int                ancho_tablero;
+    int                alto_tablero;
+    int                velocidad_ms;
+    int                respawn_fruta_ms;  // Espera hasta la siguiente fruta (0 = inmediata)
+    int                frutas_simultaneas;  // Frutas en el tablero a la vez
+    bool               bordes_solidos;    // false: los bordes no son pared y se da la vuelta
+    string             nombre_juego;
+    PlanificadorEventos planificador;     // Pasos de la serpiente y reaparición de la fruta
+    DWORD              reloj;             // Reloj virtual en ms desde el inicio de la partida
+    bool               sucio;             // Hay cambios sin dibujar
+    AnilloInstantaneas<InstantaneaSnake, NUM_INSTANTANEAS> instantaneas;  // Para retroceder (Z)
+    RegistroEntradas   registro_entradas; // Teclas desde la instantánea más antigua (restaurarEn)
+    DWORD              reloj_game_over;   // Instante en que terminó la partida (Z tras perder)
+    LienzoConsola      lienzo;            // Solo se reescriben las casillas que cambian
+    int                camara_x;          // Esquina superior izquierda de la vista
+    int                camara_y;
+public:
+    SnakeEngine()
+        : juego_activo(true),
+         pausado(false),
+         game_over(false),
+         tablero_completo(false),
+         puntos(0),
+         nivel(1),
+         total_frutas_comidas(0),
+         reloj(0),
+         sucio(true),
+         reloj_game_over(0),
+         camara_x(0),
+         camara_y(0) {
+        iniciar();
+    }
+
+    // Usa una configuración ya cargada (p. ej. la misma para muchas partidas)
+    explicit SnakeEngine(const SnakeAST& cfg)
+        : config(cfg),
+         juego_activo(true),
+         pausado(false),
+         game_over(false),
+         tablero_completo(false),
+         puntos(0),
+         nivel(1),
+         total_frutas_comidas(0),
+         reloj(0),
+         sucio(true),
+         reloj_game_over(0),
+         camara_x(0),
+         camara_y(0) {
+        iniciar();
+    }
+private:
+    void iniciar() {
+        cargarConfiguracionAST();
+        // Sembrar antes de colocar la primera fruta
+        semilla_partida = resolverSemilla(config.integers.count("semilla") ? config.integers["semilla"] : 0);
+        aleatorio.sembrar(semilla_partida);
+        inicializarJuego();
+    }
+
+    void cargarConfiguracionAST() {
+        if (!config.cargado && !config.cargarDesdeAST("build/arbol.ast")) {
+            nombre_juego  = "Snake Clasico";
+            ancho_tablero = 25;
+            alto_tablero  = 20;
+            velocidad_ms  = 150;
+            respawn_fruta_ms = 0;
+            frutas_simultaneas = 1;
+            bordes_solidos   = true;
+            frutas.compilar(config);
+            return;
         }
+        nombre_juego  = config.strings.count("nombre_juego")  ? config.strings["nombre_juego"]  : "Snake Clásico";
+        ancho_tablero = config.integers.count("ancho_tablero") ? config.integers["ancho_tablero"] : 25;
+        alto_tablero  = config.integers.count("alto_tablero")  ? config.integers["alto_tablero"]  : 20;
+        velocidad_ms  = config.integers.count("velocidad_inicial") ? config.integers["velocidad_inicial"] : 150;
+        respawn_fruta_ms = config.integers.count("respawn_fruta_ms") ? config.integers["respawn_fruta_ms"] : 0;
+        frutas_simultaneas = config.integers.count("frutas_simultaneas") ? max(1, config.integers["frutas_simultaneas"]) : 1;
+        bordes_solidos   = config.booleans.count("bordes_solidos") ? config.booleans["bordes_solidos"] : true;
+        frutas.compilar(config);
     }
-public:
-    TetrisEngine()
-        : tablero(ALTO, vector<TipoPieza>(ANCHO, VACIO))
-        , colores_tablero(ALTO, vector<ColorTetris>(ANCHO, GRIS))
-        , pieza_actual(NULL)
-        , siguiente_pieza(NULL)
-        , puntos(0)
-        , nivel(1)
-        , lineas_completadas(0)
-        , contador_linea_simple(0)
-        , contador_linea_doble(0)
-        , contador_linea_triple(0)
-        , contador_linea_tetris(0)
-        , velocidad_caida(800)
-        , juego_activo(true)
-        , pausado(false)
-        , game_over(false) {
-        // Inicializar temporizadores usando GetTickCount (ms)
-        DWORD ahora = GetTickCount();
-        ultimo_movimiento = ahora;
-        ultima_caida      = ahora;
-        // Inicializar semilla aleatoria
-        srand((unsigned)time(NULL));
-        last_horiz_move = GetTickCount();
-        last_soft_drop = GetTickCount();
-        // Apply config-driven physics
-        nivel = (config.nivel_inicial > 0) ? config.nivel_inicial : 1;
-        velocidad_caida = config.velocidad_inicial;
-        lineas_completadas = 0;
-        generarNuevaPieza();
-        generarSiguientePieza();
+
+    /**
+     * Prepara una partida nueva. Con el mismo tablero basta retirar la
+     * serpiente, las frutas y los obstáculos, con un coste proporcional a lo
+     * que había y no al área. desde_cero rehace el mapa entero para que el
+     * orden de las casillas libres, y con él la partida, dependa solo de la
+     * semilla (partidas de lote en motores reutilizados).
+     */
+    void inicializarJuego(bool desde_cero = false) {
+        if (desde_cero || !ocupacion.tieneDimensiones(ancho_tablero, alto_tablero)) {
+            cuerpo_snake.reservar(ancho_tablero * alto_tablero);
+            ocupacion.dimensionar(ancho_tablero, alto_tablero);
+            frutas_tablero.vaciar();
+        } else {
+            while (!cuerpo_snake.vacio()) quitarCola();
+            frutas_tablero.vaciar(ocupacion);
+            for (size_t i = 0; i < obstaculos.size(); ++i) ocupacion.ponerEntidad(obstaculos[i], SIN_ENTIDAD);
+        }
+        obstaculos.clear();
+        int cx = ancho_tablero / 2;
+        int cy = alto_tablero / 2;
+        int longitud = config.integers.count("longitud_inicial") ? config.integers["longitud_inicial"] : 3;
+        for (int i = 0; i < longitud; ++i) {
+            agregarCola(Posicion(cx - i, cy));
+        }
+        direccion_actual = Posicion(1, 0);
+        olvidarGiros();
+        planificador.cancelar(EVENTO_FRUTA);
+        game_over        = false;
+        tablero_completo = false;
+        colocarObstaculos(config, ocupacion, aleatorio, Posicion(cx, cy), direccion_actual,
+                          ancho_tablero, alto_tablero, obstaculos);
+        for (int i = 0; i < frutas_simultaneas && !game_over; ++i) generarNuevaFruta();
+        puntos    = 0;
+        // Resetear contadores de frutas
+        contadores_fruta.assign(frutas.tamanio(), 0);
+        total_frutas_comidas = 0;
+    }
+
+    // Añade una fruta en una casilla libre al azar
+    void generarNuevaFruta() {
+        if (frutas_tablero.generar(ocupacion, frutas, aleatorio)) return;
+        // Sin casillas libres ni frutas que comer la serpiente llenó el tablero
+        if (frutas_tablero.tamanio() == 0) {
+            tablero_completo = true;
+            game_over        = true;
+        }
+    }
+
+    bool esPosicionOcupadaPorSnake(const Posicion& p) {
+        return ocupacion.ocupada(p);
+    }
+
+    bool hayColisionConCuerpo(const Posicion& p) {
+        // La cabeza y la cola no cuentan: la cola se retira en el mismo paso
+        return chocaConCuerpo(cuerpo_snake, ocupacion, p);
+    }
+
+    // Cambios del cuerpo: siempre junto con el mapa de ocupación
+    void agregarCabeza(const Posicion& p) {
+        cuerpo_snake.agregarCabeza(p);
+        ocupacion.ocupar(p);
+    }
+
+    void agregarCola(const Posicion& p) {
+        cuerpo_snake.agregarCola(p);
+        ocupacion.ocupar(p);
+    }
+
+    void quitarCola() {
+        ocupacion.liberar(cuerpo_snake.cola());
+        cuerpo_snake.quitarCola();
+    }
+
+    bool estaFueraDelTablero(const Posicion& p) {
+        // Verificar límites del tablero
+        // La serpiente puede moverse en el área interior: x de 1 a ancho-2, y de 1 a alto-2
+        // Los bordes (x=0, x=ancho-1, y=0, y=alto-1) son paredes
+        return p.x < 1 || p.x >= ancho_tablero - 1 || p.y < 1 || p.y >= alto_tablero - 1;
+    }
+
+    /**
+     * Aplica las teclas que dejó el hilo de entrada, todas las que haya y
+     * cada una en el instante en que llegó: antes se atienden los eventos
+     * vencidos hasta entonces, igual que en reproducir().
+     * @param inicio Instante real en que el reloj virtual valía 0 (Z lo mueve)
+     */
+    void procesarEntrada(HiloEntrada& entrada, DWORD& inicio, GrabadorRepeticion* grabador) {
+        EventoTecla e;
+        while (juego_activo && entrada.sacar(e)) {
+            DWORD llegada = e.ms - inicio;
+            if (static_cast<long>(llegada - reloj) > 0) atenderEventos(llegada);
+            char  tecla       = static_cast<char>(e.tecla);
+            DWORD antes_tecla = reloj;
+            if (grabador) grabador->registrar(reloj, tecla);
+            procesarTecla(tecla);
+            // Z hizo retroceder el reloj virtual: el real sigue desde ahí
+            if (reloj != antes_tecla) inicio = GetTickCount() - reloj;
+            sucio = true;
+        }
+    }
+
+    /**
+     * Encola un giro si es perpendicular a la dirección que tendrá la
+     * serpiente tras los ya encolados (no se puede invertir la marcha ni
+     * repetir la dirección). Con la cola llena el giro se ignora.
+     */
+    void encolarGiro(const Posicion& d) {
+        if (d.x * direccion_encolada.x + d.y * direccion_encolada.y != 0) return;
+        if (giros.meter(EventoDireccion(reloj, d))) direccion_encolada = d;
+    }
+
+    // Aplica el giro más antiguo que llegó antes del paso de 'ahora'
+    void aplicarGiro(DWORD ahora) {
+        const EventoDireccion* g = giros.frente();
+        if (!g || g->ms > ahora) return;
+        direccion_actual = g->direccion;
+        giros.descartar();
+    }
+
+    // Al reiniciar o restaurar, los giros pendientes ya no tienen sentido
+    void olvidarGiros() {
+        giros.vaciar();
+        direccion_encolada = direccion_actual;
+    }
+
+    /**
+     * Lleva el reloj virtual hasta 'ahora' y atiende los eventos vencidos,
+     * cada uno en su instante de vencimiento: los pasos van a ritmo fijo (sin
+     * deriva) y el resultado no depende de cuándo despierte el bucle.
+     */
+    void atenderEventos(DWORD ahora) {
+        reloj = ahora;
+        int   evento;
+        DWORD vencio;
+        while (!pausado && !game_over && planificador.extraerVencido(ahora, evento, &vencio)) {
+            if (evento == EVENTO_PASO) {
+                actualizarFisica(vencio);
+                planificador.programar(EVENTO_PASO, vencio + velocidad_ms);
+            } else if (evento == EVENTO_FRUTA) {
+                // Reaparece la fruta comida hace más tiempo; las demás esperan su turno
+                frutas_tablero.sacarReaparicion();
+                generarNuevaFruta();
+                if (frutas_tablero.hayPendientes()) {
+                    planificador.programar(EVENTO_FRUTA, frutas_tablero.proximaReaparicion());
+                }
+            } else if (evento == EVENTO_INSTANTANEA_SNAKE) {
+                // Se reprograma antes de copiar: al restaurar sigue el ciclo
+                planificador.programar(EVENTO_INSTANTANEA_SNAKE, vencio + INTERVALO_INSTANTANEAS_MS);
+                tomarInstantanea(instantaneas.nueva(vencio), vencio);
+                ocupacion.olvidarCambiosAntesDe(instantaneas.primera().marca_mapa);
+                continue;  // No cambia nada visible
+            }
+            if (game_over) reloj_game_over = vencio;
+            sucio = true;
+        }
     }
 
-    ~TetrisEngine() {
-        delete pieza_actual;
-        delete siguiente_pieza;
+    // Partida nueva con el reloj en 0 (headless, lotes, repeticiones y ejecutar())
+    void comenzarPartida(uint32_t semilla) {
+        aleatorio.sembrar(semilla);
+        inicializarJuego(true);
+        reloj = 0;
+        reloj_game_over = 0;
+        planificador.vaciar();
+        planificador.programar(EVENTO_PASO, velocidad_ms);
+        instantaneas.vaciar();
+        registro_entradas.vaciar();
+        ocupacion.anotarCambios();
+        planificador.programar(EVENTO_INSTANTANEA_SNAKE, INTERVALO_INSTANTANEAS_MS);
     }
 
-    void generarNuevaPieza() {
-        if (siguiente_pieza) {
-            delete pieza_actual;
-            pieza_actual   = siguiente_pieza;
-            siguiente_pieza = NULL;
-        } else {
-            pieza_actual = new PiezaTetris(static_cast<TipoPieza>(rand() % 7), config);
-        }
+    // Copia el estado de la partida en una instantánea tomada en 'ms'
+    void tomarInstantanea(InstantaneaSnake& s, DWORD ms) const {
+        s.reloj                = ms;
+        cuerpo_snake.copiarA(s.cuerpo_snake);
+        s.direccion_actual     = direccion_actual;
+        s.giros                = giros;
+        s.direccion_encolada   = direccion_encolada;
+        s.frutas_tablero       = frutas_tablero;
+        s.marca_mapa           = ocupacion.marcaCambios();
+        s.aleatorio            = aleatorio;
+        s.planificador         = planificador;
+        s.puntos               = puntos;
+        s.nivel                = nivel;
+        s.velocidad_ms         = velocidad_ms;
+        s.contadores_fruta     = contadores_fruta;
+        s.total_frutas_comidas = total_frutas_comidas;
+    }
 
-        pieza_actual->x = ANCHO / 2 - 2;
-        pieza_actual->y = 0;
-        pieza_actual->rotacion_actual = 0;
+    // Vuelve al estado de una instantánea, reloj virtual incluido
+    void restaurarInstantanea(const InstantaneaSnake& s) {
+        reloj                = s.reloj;
+        ocupacion.deshacerCambiosHasta(s.marca_mapa);
+        cuerpo_snake.cargarDesde(s.cuerpo_snake);
+        direccion_actual     = s.direccion_actual;
+        giros                = s.giros;
+        direccion_encolada   = s.direccion_encolada;
+        frutas_tablero       = s.frutas_tablero;
+        aleatorio            = s.aleatorio;
+        planificador         = s.planificador;
+        puntos               = s.puntos;
+        nivel                = s.nivel;
+        velocidad_ms         = s.velocidad_ms;
+        contadores_fruta     = s.contadores_fruta;
+        total_frutas_comidas = s.total_frutas_comidas;
+        pausado              = false;
+        game_over            = false;
+        tablero_completo     = false;
+        sucio                = true;
+    }
 
-        if (!esMovimientoValido(pieza_actual->x, pieza_actual->y, pieza_actual->rotacion_actual)) {
-            game_over    = true;
-            juego_activo = false;
+    /**
+     * Vuelve al estado de la partida en el instante 'ms': restaura la última
+     * instantánea tomada hasta entonces y vuelve a simular las teclas
+     * guardadas desde ella, igual que reproducir(). Lo que pasó después de
+     * 'ms' se descarta.
+     * @return false si ya no hay una instantánea tan antigua
+     */
+    bool restaurarEn(DWORD ms) {
+        const InstantaneaSnake* s = instantaneas.ultimaHasta(ms);
+        if (!s) return false;
+        DWORD desde = s->reloj;
+        restaurarInstantanea(*s);
+        registro_entradas.descartarDespuesDe(ms);
+        for (size_t i = 0; i < registro_entradas.tamanio(); ++i) {
+            const EntradaRepeticion& e = registro_entradas[i];
+            if (PlanificadorEventos::antes(e.ms, desde)) continue;
+            atenderEventos(e.ms);
+            aplicarTecla(e.tecla);
         }
+        atenderEventos(ms);
+        return true;
     }
 
-    void generarSiguientePieza() {
-        siguiente_pieza = new PiezaTetris(static_cast<TipoPieza>(rand() % 7), config);
+    // Z: vuelve RETROCESO_MINIMO_MS atrás en el reloj de la partida (tras perder, desde el choque)
+    void retroceder() {
+        restaurarEn((game_over ? reloj_game_over : reloj) - RETROCESO_MINIMO_MS);
     }
 
-    bool esMovimientoValido(int nx, int ny, int nr) {
-        if (!pieza_actual) return false;
-
-        vector<vector<int> >& forma = pieza_actual->rotaciones[nr];
-        int   h     = static_cast<int>(forma.size());
-        int   w     = static_cast<int>(forma[0].size());
-
-        for (int py = 0; py < h; ++py) {
-            for (int px = 0; px < w; ++px) {
-                if (forma[py][px] == 1) {
-                    int wx = nx + px;
-                    int wy = ny + py;
-                    if (wx < 0 || wx >= ANCHO || wy >= ALTO) return false;
-                    if (wy >= 0 && tablero[wy][wx] != VACIO) return false;
-                }
-            }
+    // Reprograma la próxima instantánea tras una pausa o al reiniciar
+    void reanudarInstantaneas() {
+        planificador.programar(EVENTO_INSTANTANEA_SNAKE, reloj + INTERVALO_INSTANTANEAS_MS);
+    }
+
+    /**
+     * Aplica una tecla de la partida y la guarda para restaurarEn()
+     * (olvidando las anteriores a la instantánea más antigua). Z no se
+     * guarda: no es una entrada de la partida sino un salto en su historia.
+     */
+    void procesarTecla(char t) {
+        if (t != 'z' && t != 'Z') {
+            if (instantaneas.tamanio() > 0) registro_entradas.descartarAntesDe(instantaneas.masAntigua());
+            registro_entradas.agregar(reloj, t);
         }
-        return true;
+        aplicarTecla(t);
     }
 
-    void fijarPieza() {
-        if (!pieza_actual) return;
-        vector<vector<int> >& forma = pieza_actual->rotaciones[pieza_actual->rotacion_actual];
-        int   h     = static_cast<int>(forma.size());
-        int   w     = static_cast<int>(forma[0].size());
-
-        for (int py = 0; py < h; ++py) {
-            for (int px = 0; px < w; ++px) {
-                if (forma[py][px] == 1) {
-                    int wx = pieza_actual->x + px;
-                    int wy = pieza_actual->y + py;
-                    if (wy >= 0 && wx >= 0 && wx < ANCHO && wy < ALTO) {
-                        tablero[wy][wx]        = pieza_actual->tipo;
-                        colores_tablero[wy][wx] = pieza_actual->color;
-                    }
-                }
+    void aplicarTecla(char t) {
+        if (game_over) {
+            if (t == 'r' || t == 'R') {
+                inicializarJuego();
+                reloj_game_over = reloj;
+                planificador.programar(EVENTO_PASO, reloj + velocidad_ms);
+                instantaneas.vaciar();
+                registro_entradas.vaciar();
+                ocupacion.anotarCambios();
+                reanudarInstantaneas();
+            } else if (t == 'z' || t == 'Z') {
+                // Deshace la muerte volviendo a una instantánea anterior
+                retroceder();
+            } else if (t == 27) { // ESC
+                juego_activo = false;
             }
+            return;
+        }
+        switch (t) {
+            case 'w': case 'W': encolarGiro(Posicion(0, -1)); break;
+            case 's': case 'S': encolarGiro(Posicion(0,  1)); break;
+            case 'a': case 'A': encolarGiro(Posicion(-1, 0)); break;
+            case 'd': case 'D': encolarGiro(Posicion( 1, 0)); break;
+            case 'p': case 'P':
+                pausado = !pausado;
+                // Al reanudar, el paso vencido durante la pausa cuenta desde ahora
+                if (!pausado) {
+                    planificador.programar(EVENTO_PASO, reloj + velocidad_ms);
+                    reanudarInstantaneas();
+                }
+                break;
+            case 'z': case 'Z':  retroceder();           break;
+            case 27:             juego_activo = false;   break; // ESC
         }
-
-        verificarLineasCompletas();
-        generarNuevaPieza();
-        generarSiguientePieza();
     }
 
-    void verificarLineasCompletas() {
-        vector<int> lineas;
-        for (int y = 0; y < ALTO; ++y) {
-            bool completa = true;
-            for (int x = 0; x < ANCHO; ++x) {
-                if (tablero[y][x] == VACIO) {
-                    completa = false;
-                    break;
-                }
-            }
-            if (completa) {
-                lineas.push_back(y);
-            }
+    void actualizarFisica(DWORD ahora) {
+        if (pausado || game_over) return;
+        
+        // Verificar que la serpiente tenga al menos un segmento
+        if (cuerpo_snake.vacio()) {
+            game_over = true;
+            return;
         }
 
-        if (!lineas.empty()) {
-            eliminarLineas(lineas);
-            calcularPuntos(static_cast<int>(lineas.size()));
-            lineas_completadas += static_cast<int>(lineas.size());
+        aplicarGiro(ahora);
+        
+        // Verificar que la dirección sea válida (no sea (0,0))
+        if (direccion_actual.x == 0 && direccion_actual.y == 0) {
+            return; // No moverse si no hay dirección
+        }
+        
+        // Calcular nueva posición de la cabeza
+        Posicion cabeza = cuerpo_snake.cabeza();
+        Posicion nueva(cabeza.x + direccion_actual.x,
+                       cabeza.y + direccion_actual.y);
 
-            int nivel_base = (config.nivel_inicial > 0) ? config.nivel_inicial : 1;
-            int nuevo_nivel = (lineas_completadas / config.lineas_para_nivel) + nivel_base;
-            if (nuevo_nivel > nivel) {
-                nivel = nuevo_nivel;
-                // decrease fall interval according to aceleracion_por_nivel
-                int decrement = (nivel - config.nivel_inicial) * config.aceleracion_por_nivel;
-                int nueva_vel = config.velocidad_inicial - decrement;
-                if (nueva_vel < 50) nueva_vel = 50; // cap minimum interval
-                velocidad_caida = nueva_vel;
+        // Verificar configuración de colisiones
+        bool fin_borde = config.booleans.count("terminar_al_chocar_borde")
+                        ? config.booleans["terminar_al_chocar_borde"]
+                        : true;
+        bool fin_cuerpo = config.booleans.count("terminar_al_chocar_cuerpo")
+                        ? config.booleans["terminar_al_chocar_cuerpo"]
+                        : true;
+
+        // Verificar colisión con bordes (mejorado); sin bordes sólidos no hay pared
+        if (fin_borde && bordes_solidos) {
+            // Verificar límites exactos del tablero
+            if (nueva.x < 1 || nueva.x >= ancho_tablero - 1 || 
+                nueva.y < 1 || nueva.y >= alto_tablero - 1) {
+                game_over = true;
+                return;
             }
+        } else {
+            // Si no termina al chocar borde, hacer wrap-around (teleportar al otro lado)
+            if (nueva.x < 1) nueva.x = ancho_tablero - 2;
+            else if (nueva.x >= ancho_tablero - 1) nueva.x = 1;
+            if (nueva.y < 1) nueva.y = alto_tablero - 2;
+            else if (nueva.y >= alto_tablero - 1) nueva.y = 1;
+        }
+        
+        // Verificar colisión con el cuerpo (mejorado)
+        // IMPORTANTE: Solo verificamos colisión con segmentos que permanecerán después del movimiento
+        // La cola (último segmento) se eliminará, así que no cuenta como colisión
+        if (fin_cuerpo && hayColisionConCuerpo(nueva)) {
+            game_over = true;
+            return;
+        }
+
+        // Lo que haya en la casilla se sabe por el mapa: obstáculo o fruta
+        int entidad = ocupacion.entidad(nueva);
+        if (entidad == OBSTACULO) {
+            game_over = true;
+            return;
         }
-    }
 
-    void eliminarLineas(const vector<int>& lineas) {
-        for (int i = static_cast<int>(lineas.size()) - 1; i >= 0; --i) {
-            int linea = lineas[i];
-            for (int y = linea; y > 0; --y) {
-                for (int x = 0; x < ANCHO; ++x) {
-                    tablero[y][x]        = tablero[y - 1][x];
-                    colores_tablero[y][x] = colores_tablero[y - 1][x];
+        agregarCabeza(nueva);
+        if (entidad >= 0) {
+            int tipo = frutas_tablero.comer(ocupacion, nueva);
+            const ReglaFruta& regla = frutas[tipo];
+            puntos += regla.puntos;
+            contadores_fruta[tipo]++;
+            total_frutas_comidas++;  // Incrementar total
+            
+            // Aplicar crecimiento (si es negativo, acortar la serpiente)
+            if (regla.crecimiento > 0) {
+                // Crecer: agregar segmentos al final
+                for (int i = 0; i < regla.crecimiento; ++i) {
+                    if (!cuerpo_snake.vacio()) {
+                        agregarCola(cuerpo_snake.cola());
+                    }
+                }
+            } else if (regla.crecimiento < 0) {
+                // Acortar: eliminar segmentos del final (mínimo 1 segmento)
+                int acortar = -regla.crecimiento;
+                for (int i = 0; i < acortar && cuerpo_snake.tamanio() > 1; ++i) {
+                    quitarCola();
                 }
             }
-            for (int x = 0; x < ANCHO; ++x) {
-                tablero[0][x]        = VACIO;
-                colores_tablero[0][x] = GRIS;
+            
+            // Cambio de velocidad (positivo = más lento, negativo = más rápido)
+            velocidad_ms += regla.cambio_velocidad;
+            // Límites de velocidad (más bajo = más rápido, más alto = más lento)
+            int velocidad_min = config.integers.count("velocidad_minima") 
+                              ? config.integers["velocidad_minima"] 
+                              : 50;
+            int velocidad_max = config.integers.count("velocidad_maxima") 
+                              ? config.integers["velocidad_maxima"] 
+                              : 500;
+            if (velocidad_ms < velocidad_min) velocidad_ms = velocidad_min;
+            if (velocidad_ms > velocidad_max) velocidad_ms = velocidad_max;
+            
+            if (respawn_fruta_ms > 0) {
+                // Vuelve a salir cuando le toque; solo la primera pendiente tiene temporizador
+                if (!frutas_tablero.hayPendientes()) {
+                    planificador.programar(EVENTO_FRUTA, ahora + respawn_fruta_ms);
+                }
+                frutas_tablero.encolarReaparicion(ahora + respawn_fruta_ms);
+            } else {
+                generarNuevaFruta();
             }
+        } else {
+            quitarCola();
         }
     }
 
-    void calcularPuntos(int n) {
-        // Asegurar que el nivel mínimo sea 1 para el cálculo de puntos
-        int nivel_para_puntos = (nivel > 0) ? nivel : 1;
-        switch (n) {
-            case 1: 
-                puntos += config.puntos_linea_simple * nivel_para_puntos;
-                contador_linea_simple++;
-                break;
-            case 2: 
-                puntos += config.puntos_linea_doble * nivel_para_puntos;
-                contador_linea_doble++;
-                break;
-            case 3: 
-                puntos += config.puntos_linea_triple * nivel_para_puntos;
-                contador_linea_triple++;
-                break;
-            case 4: 
-                puntos += config.puntos_linea_tetris * nivel_para_puntos; // TETRIS
-                contador_linea_tetris++;
-                break;
+public:
+    void renderizar() {
+        // Área visible: el tablero entero si cabe en la terminal; si no, una
+        // vista que sigue a la cabeza. Cabecera de 6 filas, marco y pie.
+        int columnas, filas;
+        tamanioTerminal(columnas, filas);
+        int vista_ancho = max(1, min(ancho_tablero, columnas - MARGEN_VISTA_SNAKE - 2));
+        int vista_alto  = max(1, min(alto_tablero, filas - FILAS_CABECERA_SNAKE - 4));
+        Posicion cabeza = cuerpo_snake.vacio() ? Posicion(-1, -1) : cuerpo_snake.cabeza();
+        if (!cuerpo_snake.vacio()) {
+            camara_x = seguirCabeza(camara_x, cabeza.x, vista_ancho, ancho_tablero);
+            camara_y = seguirCabeza(camara_y, cabeza.y, vista_alto, alto_tablero);
         }
-    }
+        camara_x = max(0, min(camara_x, ancho_tablero - vista_ancho));
+        camara_y = max(0, min(camara_y, alto_tablero - vista_alto));
+        lienzo.preparar(FILAS_CABECERA_SNAKE, MARGEN_VISTA_SNAKE, vista_ancho + 2, vista_alto + 2);
 
-    void procesarEntrada() {
-        while (_kbhit()) {
-            char tecla = static_cast<char>(tolower(_getch()));
-            procesarTecla(tecla);
-        }
-    }
+        string titulo = config.strings.count("nombre_juego")
+                       ? config.strings["nombre_juego"]
+                       : string("Snake Clasico");
 
-    void procesarTecla(char t) {
+        std::ostringstream marcador;
+        marcador << "\033[93mPuntos: " << puntos
+                 << " | Nivel: " << nivel
+                 << " | Longitud: " << cuerpo_snake.tamanio()
+                 << " | Frutas: " << total_frutas_comidas;
+        lienzo.linea(0, "\033[97;1m=== " + titulo + " ===");
+        lienzo.linea(1, marcador.str());
+        lienzo.linea(2, "\033[90mControles: WASD - Mover, P - Pausa, Z - Retroceder, ESC - Salir");
+
+        string aviso, ayuda;
         if (game_over) {
-            if (t == 'r') reiniciarJuego();
-            return;
-        }
-        switch (t) {
-            case 'a': {
-                DWORD ahora = GetTickCount();
-                if (ahora - last_horiz_move >= 120) {
-                    if (esMovimientoValido(pieza_actual->x - 1, pieza_actual->y, pieza_actual->rotacion_actual)) pieza_actual->x--;
-                    last_horiz_move = ahora;
-                }
-                break;
-            }
-            case 'd': {
-                DWORD ahora = GetTickCount();
-                if (ahora - last_horiz_move >= 120) {
-                    if (esMovimientoValido(pieza_actual->x + 1, pieza_actual->y, pieza_actual->rotacion_actual)) pieza_actual->x++;
-                    last_horiz_move = ahora;
-                }
-                break;
+            string msg = config.strings.count("mensaje_game_over")
+                       ? config.strings["mensaje_game_over"]
+                       : string("GAME OVER - Puntuación: {puntos}");
+            size_t p = msg.find("{puntos}");
+            if (p != string::npos) {
+                std::ostringstream oss; oss << puntos;
+                msg.replace(p, 8, oss.str());
             }
-            case 's': {
-                // soft drop: descend one cell per key event (rate-limited)
-                DWORD ahora = GetTickCount();
-                if (ahora - last_soft_drop >= 80) {
-                    if (esMovimientoValido(pieza_actual->x, pieza_actual->y + 1, pieza_actual->rotacion_actual)) {
-                        pieza_actual->y++;
+            aviso = (tablero_completo ? string("\033[92;1mTABLERO COMPLETO \033[91;1m") : string("\033[91;1m")) + msg;
+            ayuda = "\033[91mPresiona R para reiniciar, Z para retroceder o ESC para salir";
+        } else if (pausado) {
+            string msg = config.strings.count("mensaje_pausa")
+                       ? config.strings["mensaje_pausa"]
+                       : string("PAUSA - Presiona P para continuar");
+            aviso = "\033[95;1m" + msg;
+        }
+        lienzo.linea(3, aviso);
+        lienzo.linea(4, ayuda);
+
+        string posicion;
+        if (vista_ancho < ancho_tablero || vista_alto < alto_tablero) {
+            std::ostringstream oss;
+            oss << "\033[90mVista x " << camara_x << "-" << (camara_x + vista_ancho - 1)
+                << ", y " << camara_y << "-" << (camara_y + vista_alto - 1)
+                << " de " << ancho_tablero << "x" << alto_tablero;
+            posicion = oss.str();
+        }
+        lienzo.linea(5, posicion);
+        lienzo.linea(FILAS_CABECERA_SNAKE + vista_alto + 2,
+                     "\033[92mCargado desde AST: " + titulo + " | Configuracion completa desde Snake.brik");
+
+        // Paleta: 0 fondo y marco, 1 cabeza, 2 cuerpo, 3 obstáculos, 4.. frutas por tipo
+        vector<string> colores;
+        if (config.arrays.count("colores_snake")) {
+            colores = config.arrays["colores_snake"];
+        } else {
+            colores.push_back("verde_claro"); colores.push_back("verde_oscuro"); colores.push_back("verde_medio");
+        }
+        vector<string> paleta;
+        paleta.push_back("\033[90m");
+        paleta.push_back(colores.empty()    ? string("\033[37m") : colorConsola.obtenerColorAnsi(colores[0]));
+        paleta.push_back(colores.size() > 1 ? colorConsola.obtenerColorAnsi(colores[1]) : string("\033[37m"));
+        paleta.push_back(colorConsola.obtenerColorAnsi(textoConfig(config, "color_obstaculo", "gris")));
+        for (int i = 0; i < frutas.tamanio(); ++i) paleta.push_back(colorConsola.obtenerColorAnsi(frutas[i].color));
+
+        // Marco
+        for (int x = 0; x < vista_ancho + 2; ++x) {
+            char ch = (x == 0 || x == vista_ancho + 1) ? '+' : '=';
+            lienzo.celda(x, 0, ch, 0);
+            lienzo.celda(x, vista_alto + 1, ch, 0);
+        }
+        for (int y = 1; y <= vista_alto; ++y) {
+            lienzo.celda(0, y, '|', 0);
+            lienzo.celda(vista_ancho + 1, y, '|', 0);
+        }
+
+        // Casillas visibles, consultando el mapa de ocupación
+        for (int y = 0; y < vista_alto; ++y) {
+            int by = camara_y + y;
+            for (int x = 0; x < vista_ancho; ++x) {
+                int  bx    = camara_x + x;
+                char ch    = '.';
+                int  color = 0;
+                int  e     = ocupacion.entidad(bx, by);
+                if (e >= 0) {
+                    ch    = '@';
+                    color = 4 + frutas_tablero[e].tipo;
+                } else if (e == OBSTACULO) {
+                    ch    = 'X';
+                    color = 3;
+                } else if (ocupacion.ocupada(bx, by)) {
+                    if (Posicion(bx, by) == cabeza && !colores.empty()) {
+                        ch    = 'O';
+                        color = 1;
                     } else {
-                        fijarPieza();
+                        ch    = '#';
+                        color = 2;
                     }
-                    last_soft_drop = ahora;
                 }
-                break;
+                lienzo.celda(x + 1, y + 1, ch, color);
             }
-            case 'w':
-            case ' ': {
-                static DWORD last_rotate = 0;
-                DWORD ahoraR = GetTickCount();
-                if (ahoraR - last_rotate >= 200) {
-                    int nr = (pieza_actual->rotacion_actual + 1) % static_cast<int>(pieza_actual->rotaciones.size());
-                    if (esMovimientoValido(pieza_actual->x, pieza_actual->y, nr)) {
-                        pieza_actual->rotacion_actual = nr;
-                    }
-                    last_rotate = ahoraR;
-                }
-                break;
+        }
+
+        lienzo.presentar(cout, paleta);
+    }
+
+    /**
+     * Ejecuta la partida sin render ni teclado (modo headless).
+     * El reloj virtual avanza op.tick_ms por tick y la serpiente se mueve cada
+     * velocidad_ms, igual que en ejecutar(); al perder se reinicia la partida.
+     */
+    ResultadoSimulacion simular(const OpcionesHeadless& op, PoliticaSnake& politica,
+                                GrabadorRepeticion* grabador = NULL) {
+        ResultadoSimulacion r;
+        comenzarPartida(semilla_partida);
+        if (grabador) grabador->comenzar(semilla_partida);
+
+        for (long tick = 0; tick < op.ticks && juego_activo; ++tick) {
+            char t = politica.decidir(vista(tick));
+            if (grabador) grabador->registrar(reloj, t);
+            if (t) procesarTecla(t);
+            atenderEventos(reloj + op.tick_ms);
+            if (game_over) {
+                r.cerrarPartida(puntos, total_frutas_comidas);
+                // Igual que pulsar R tras perder (así lo ve la repetición)
+                if (grabador) grabador->registrar(reloj, 'r');
+                procesarTecla('r');
             }
-            case 'p':
-                pausado = !pausado;
-                break;
-            case 27: // ESC
-            case 'q':
-                juego_activo = false;
-                break;
+            r.ticks++;
+        }
+        if (grabador) grabador->terminar(reloj);
+        r.puntos_en_curso = puntos;
+        return r;
+    }
+
+    /**
+     * Juega una sola partida desde cero con la semilla dada (modo lote).
+     * La velocidad vuelve a la inicial de la configuración.
+     * @param max_ticks La partida se corta al llegar a este número de ticks
+     */
+    ResumenPartida jugarPartida(uint32_t semilla, PoliticaSnake& politica, long max_ticks, int tick_ms) {
+        cargarConfiguracionAST();
+        comenzarPartida(semilla);
+        long tick = 0;
+        while (tick < max_ticks && juego_activo && !game_over) {
+            char t = politica.decidir(vista(tick));
+            if (t) procesarTecla(t);
+            atenderEventos(reloj + tick_ms);
+            tick++;
+        }
+        ResumenPartida r;
+        r.puntos     = puntos;
+        r.ticks      = tick;
+        r.eventos    = total_frutas_comidas;
+        for (int i = 0; i < frutas.tamanio() && i < NUM_DETALLES_PARTIDA; ++i) r.detalle[i] = contadores_fruta[i];
+        r.terminada  = game_over;
+        return r;
+    }
+private:
+    VistaSnake vista(long tick) {
+        VistaSnake v;
+        v.cuerpo    = &cuerpo_snake;
+        v.ocupacion = &ocupacion;
+        v.frutas    = &frutas_tablero;
+        v.tabla     = &frutas;
+        v.direccion = direccion_encolada;  // La que verá el próximo paso si no gira más
+        v.ancho     = ancho_tablero;
+        v.alto      = alto_tablero;
+        v.paredes   = bordes_solidos && (config.booleans.count("terminar_al_chocar_borde")
+                    ? config.booleans["terminar_al_chocar_borde"]
+                    : true);
+        v.tick      = tick;
+        v.busqueda  = NULL;
+        return v;
+    }
+public:
+    /**
+     * Vuelve a simular una repetición grabada, a toda velocidad, hasta el
+     * instante 'hasta' (ms del reloj de la partida) o hasta su final.
+     * En el resumen, ticks son los ms reproducidos.
+     */
+    ResumenPartida reproducir(const Repeticion& rep, DWORD hasta) {
+        cargarConfiguracionAST();
+        comenzarPartida(rep.semilla);
+        for (size_t i = 0; i < rep.entradas.size() && rep.entradas[i].ms <= hasta && juego_activo; ++i) {
+            atenderEventos(rep.entradas[i].ms);
+            procesarTecla(rep.entradas[i].tecla);
         }
+        if (juego_activo) atenderEventos(min(hasta, rep.duracion));
+        ResumenPartida r;
+        r.puntos     = puntos;
+        r.ticks      = static_cast<long>(reloj);
+        r.eventos    = total_frutas_comidas;
+        for (int i = 0; i < frutas.tamanio() && i < NUM_DETALLES_PARTIDA; ++i) r.detalle[i] = contadores_fruta[i];
+        r.terminada  = game_over;
+        return r;
+    }
+
+    /**
+     * Bucle interactivo: duerme hasta el próximo paso (o fruta) o hasta que
+     * llegue una tecla, y solo redibuja si algo cambió. El reloj virtual se
+     * alimenta del reloj real. Las teclas las lee un HiloEntrada y se aplican
+     * en su instante de llegada, después de los eventos vencidos hasta
+     * entonces, igual que en reproducir().
+     * @param grabador Si no es NULL, graba la sesión como repetición
+     */
+    void ejecutar(GrabadorRepeticion* grabador = NULL) {
+        comenzarPartida(semilla_partida);
+        if (grabador) grabador->comenzar(semilla_partida);
+        EntradaConsola entrada;
+        DWORD inicio = GetTickCount();
+        while (juego_activo) {
+            DWORD espera = (pausado || game_over)
+                         ? ESPERA_MAXIMA_MS
+                         : planificador.espera(GetTickCount() - inicio, ESPERA_MAXIMA_MS);
+            if (espera > 0) entrada.esperar(espera);
+            procesarEntrada(entrada, inicio, grabador);
+            atenderEventos(GetTickCount() - inicio);
+            if (sucio) {
+                renderizar();
+                sucio = false;
+            }
+        }
+        if (grabador) grabador->terminar(reloj);
+    }
+};
+
+// ============================================================================
+// FUNCIÓN: compilarJuegoSiPosible
+// ============================================================================
+// Intenta compilar el juego especificado antes de ejecutarlo.
+// Esto asegura que el AST esté actualizado con la última configuración.
+// @param juego Nombre del juego a compilar ("tetris" o "snake")
+// ============================================================================
+static void compilarJuegoSiPosible(const string& juego) {
+    // Construir comando de compilación según el juego
+    string comando;
+    if (juego == "tetris") {
+#ifdef _WIN32
+        comando = "bin\\compilador.exe config\\games\\Tetris.brik";
+#else
+        comando = "bin/compilador config/games/Tetris.brik";
+#endif
+    } else if (juego == "snake") {
+#ifdef _WIN32
+        comando = "bin\\compilador.exe config\\games\\Snake.brik";
+#else
+        comando = "bin/compilador config/games/Snake.brik";
+#endif
+    } else {
+        return;  // Juego no reconocido
+    }
+    
+    // Verificar que el compilador existe antes de ejecutarlo
+#ifdef _WIN32
+    DWORD attrs = GetFileAttributesA("bin\\compilador.exe");
+    if (attrs != INVALID_FILE_ATTRIBUTES && !(attrs & FILE_ATTRIBUTE_DIRECTORY)) {
+        system(comando.c_str());
+    }
+#else
+    if (access("bin/compilador", X_OK) == 0) {
+        int estado = system(comando.c_str());
+        (void)estado;
     }
+#endif
+}
 
-    void reiniciarJuego() {
-        for (int y = 0; y < ALTO; ++y) {
-            for (int x = 0; x < ANCHO; ++x) {
-                tablero[y][x]        = VACIO;
-                colores_tablero[y][x] = GRIS;
-            }
-        }
-        puntos            = 0;
-        nivel             = (config.nivel_inicial > 0) ? config.nivel_inicial : 1;
-        lineas_completadas = 0;
-        contador_linea_simple = 0;
-        contador_linea_doble = 0;
-        contador_linea_triple = 0;
-        contador_linea_tetris = 0;
-        velocidad_caida   = config.velocidad_inicial;
-        game_over         = false;
-        juego_activo      = true;
-        pausado           = false;
+// ============================================================================
+// LOTES DE SIMULACIÓN PARA BALANCEO DE CONFIGURACIONES
+// ============================================================================
+// Juega muchas partidas con semillas consecutivas por cada configuración,
+// repartidas entre todos los núcleos con PoolTrabajo, y resume puntos,
+// supervivencia, líneas/frutas y la distribución de los contadores.
+// ============================================================================
+struct OpcionesLote {
+    OpcionesHeadless base;     // juego, bot, guion, tick_ms y máximo de ticks por partida
+    long             partidas; // Partidas por configuración
+    int              hilos;    // 0 = todos los núcleos
+    vector<string>   configs;  // Archivos AST a comparar (vacío = build/arbol.ast)
 
-        delete pieza_actual;
-        delete siguiente_pieza;
-        pieza_actual   = NULL;
-        siguiente_pieza = NULL;
+    OpcionesLote() : partidas(1000), hilos(0) {}
+};
 
-        generarNuevaPieza();
-        generarSiguientePieza();
+// Ancho del haz del bot "haz" (colocaciones que se expanden con la pieza siguiente)
+static const int ANCHO_HAZ_BOT = 8;
 
-        DWORD ahora = GetTickCount();
-        ultimo_movimiento = ahora;
-        ultima_caida      = ahora;
-    }
+/**
+ * Crea la política de Tetris pedida con --bot.
+ * @param pool Hilos para la búsqueda en haz (NULL si las partidas ya van en paralelo)
+ */
+static PoliticaTetris* crearPoliticaTetris(const OpcionesHeadless& op, uint32_t semilla, PoolTrabajo* pool = NULL) {
+    if (op.bot == "aleatorio")  return new PoliticaAleatoriaTetris(semilla);
+    if (op.bot == "colocacion") return new BotColocacion(0, NULL);
+    if (op.bot == "haz")        return new BotColocacion(ANCHO_HAZ_BOT, pool, op.profundidad);
+    return new PoliticaGuionTetris(op.guion);
+}
 
-    void actualizarFisica() {
-        if (pausado || game_over || !pieza_actual) return;
-        DWORD ahora = GetTickCount();
-        DWORD dt    = ahora - ultima_caida;
-        if (dt >= (DWORD)velocidad_caida) {
-            if (esMovimientoValido(pieza_actual->x, pieza_actual->y + 1, pieza_actual->rotacion_actual)) {
-                pieza_actual->y++;
-            } else {
-                fijarPieza();
-            }
-            ultima_caida = ahora;
-        }
+static PoliticaSnake* crearPoliticaSnake(const OpcionesHeadless& op, uint32_t semilla) {
+    if (op.bot == "aleatorio") return new PoliticaAleatoriaSnake(semilla);
+    if (op.bot == "voraz")     return new PoliticaVorazSnake();
+    if (op.bot == "ruta")      return new PoliticaRutaSnake();
+    return new PoliticaGuionSnake(op.guion);
+}
+
+// Juega las partidas de una configuración de Tetris; un motor por hilo
+struct AccionLoteTetris {
+    const ConfigTetris&     cfg;
+    const OpcionesHeadless& op;
+    uint32_t                semilla_base;
+    PoolTrabajo&            pool;
+    vector<ResumenPartida>& resultados;
+
+    AccionLoteTetris(const ConfigTetris& c, const OpcionesHeadless& o, uint32_t semilla,
+                     PoolTrabajo& p, vector<ResumenPartida>& r)
+        : cfg(c), op(o), semilla_base(semilla), pool(p), resultados(r) {}
+
+    template <class Tablero> void ejecutar() {
+        vector<TetrisEngine<Tablero>*> motores(pool.tamanio(), static_cast<TetrisEngine<Tablero>*>(NULL));
+        pool.paraCada(static_cast<long>(resultados.size()), [&](long i, int h) {
+            if (!motores[h]) motores[h] = new TetrisEngine<Tablero>(cfg);
+            uint32_t semilla = semilla_base + static_cast<uint32_t>(i);
+            PoliticaTetris* politica = crearPoliticaTetris(op, semilla);
+            resultados[i] = motores[h]->jugarPartida(semilla, *politica, op.ticks, op.tick_ms);
+            delete politica;
+        });
+        for (size_t h = 0; h < motores.size(); ++h) delete motores[h];
     }
+};
 
-    void renderizar() {
-        stringstream buf;
-        buf << "\033[2J\033[H";
-        buf << "\033[37;1m=== Tetris ===           Controles:\033[0m\n";
-        buf << "\033[33mPuntos: " << puntos << "                      A/D - Mover\033[0m\n";
-        buf << "\033[33mNivel: "  << nivel  << "                        S - Caida rapida\033[0m\n";
-        buf << "\033[33mLineas: " << lineas_completadas << "                     W/SPACE - Rotar\033[0m\n";
-        buf << "\033[90m                                  P - Pausa, ESC - Salir\033[0m\n\n";
+static void jugarLoteSnake(const SnakeAST& cfg, const OpcionesHeadless& op, uint32_t semilla_base,
+                           PoolTrabajo& pool, vector<ResumenPartida>& resultados) {
+    vector<SnakeEngine*> motores(pool.tamanio(), static_cast<SnakeEngine*>(NULL));
+    pool.paraCada(static_cast<long>(resultados.size()), [&](long i, int h) {
+        if (!motores[h]) motores[h] = new SnakeEngine(cfg);
+        uint32_t semilla = semilla_base + static_cast<uint32_t>(i);
+        PoliticaSnake* politica = crearPoliticaSnake(op, semilla);
+        resultados[i] = motores[h]->jugarPartida(semilla, *politica, op.ticks, op.tick_ms);
+        delete politica;
+    });
+    for (size_t h = 0; h < motores.size(); ++h) delete motores[h];
+}
 
-        if (game_over) {
-            buf << "\033[91m    !GAME OVER!\033[0m\n";
-            buf << "\033[91m    Puntuacion Final: " << puntos << "\033[0m\n";
-            buf << "\033[91m    Presiona R para reiniciar\033[0m\n\n";
-        }
-        if (pausado) {
-            buf << "\033[95;1m    *** PAUSADO ***\033[0m\n";
-            buf << "\033[95m    Presiona P para continuar\033[0m\n\n";
-        }
+// Imprime media y percentiles de una serie de valores
+static void imprimirDistribucion(const string& nombre, vector<long long> valores) {
+    if (valores.empty()) return;
+    sort(valores.begin(), valores.end());
+    long long suma = 0;
+    for (size_t i = 0; i < valores.size(); ++i) suma += valores[i];
+    size_t n = valores.size();
+    cout << "  " << nombre
+         << ": media=" << (suma / static_cast<long long>(n))
+         << " min=" << valores[0]
+         << " p10=" << valores[n / 10]
+         << " p50=" << valores[n / 2]
+         << " p90=" << valores[(n * 9) / 10]
+         << " max=" << valores[n - 1] << "\n";
+}
 
-        // Marco superior
-        buf << "\033[90m         =========================\033[0m\n";
+// 'detalles' nombra las casillas de ResumenPartida::detalle que se muestran
+static void imprimirResumenLote(const string& juego, const vector<ResumenPartida>& resultados,
+                                const vector<string>& detalles) {
+    vector<long long> puntos, ticks, eventos;
+    long long         totales[NUM_DETALLES_PARTIDA] = { 0 };
+    long long         suma_detalles = 0;
+    long              cortadas = 0;
+    for (size_t i = 0; i < resultados.size(); ++i) {
+        const ResumenPartida& r = resultados[i];
+        puntos.push_back(r.puntos);
+        ticks.push_back(r.ticks);
+        eventos.push_back(r.eventos);
+        if (!r.terminada) cortadas++;
+        for (int d = 0; d < NUM_DETALLES_PARTIDA; ++d) {
+            totales[d]    += r.detalle[d];
+            suma_detalles += r.detalle[d];
+        }
+    }
+    imprimirDistribucion("puntos       ", puntos);
+    imprimirDistribucion("supervivencia", ticks);
+    imprimirDistribucion(juego == "tetris" ? "lineas       " : "frutas       ", eventos);
+    cout << "  partidas cortadas por max ticks: " << cortadas << "\n";
+    cout << "  " << (juego == "tetris" ? "contador_linea_*" : "frutas por tipo") << ":";
+    for (int d = 0; d < NUM_DETALLES_PARTIDA && d < static_cast<int>(detalles.size()); ++d) {
+        cout << " " << detalles[d] << "=" << totales[d];
+        if (suma_detalles > 0) cout << " (" << (totales[d] * 100 / suma_detalles) << "%)";
+    }
+    cout << "\n";
+}
 
-        for (int y = 0; y < ALTO; ++y) {
-            buf << "\033[90m         |\033[0m";
-            for (int x = 0; x < ANCHO; ++x) {
-                bool   pieza   = false;
-                char   simbolo = ' ';
-                string cansi   = "\033[37m";
+// ============================================================================
+// ARENA DE SNAKE: MUCHAS SERPIENTES EN UN TABLERO
+// ============================================================================
+// Prueba de carga del motor: cientos de serpientes, cada una con su política
+// (bot o guion), comparten un tablero grande y un solo MapaOcupacion. Cada
+// tick tiene dos fases:
+//   1. En paralelo, cada hilo decide el giro de sus serpientes y calcula la
+//      casilla a la que entra cada una. Solo se lee el estado del tick
+//      anterior, que nadie modifica durante la fase.
+//   2. El último hilo en llegar a la barrera resuelve los conflictos sobre el
+//      mapa y aplica los movimientos, las frutas y las reapariciones
+//      recorriendo las serpientes en orden.
+// La fase paralela solo escribe en su propia serpiente y la secuencial sigue
+// un orden fijo, así que la partida depende de la semilla y no del número de
+// hilos.
+//
+// Todas avanzan una casilla por tick (sin cambios de velocidad). Dos cabezas
+// que entran en la misma casilla mueren las dos; una casilla con cuerpo solo
+// se puede pisar si es una cola que se retira en este tick (su serpiente no
+// crece, no tiene la cola repetida o se estrella). Una serpiente muerta
+// reaparece en una casilla libre al azar con longitud_inicial segmentos
+// apilados, que se despliegan al avanzar igual que al crecer. Las frutas
+// reaparecen al momento y hay al menos una por serpiente.
+// ============================================================================
+static const int CASILLAS_POR_SERPIENTE_ARENA = 400;  // El tablero se amplía hasta dar este interior a cada una
 
-                // Pieza actual
-                if (pieza_actual && !pausado && !game_over) {
-                    vector<vector<int> >& f = pieza_actual->rotaciones[pieza_actual->rotacion_actual];
-                    int py = y - pieza_actual->y;
-                    int px = x - pieza_actual->x;
-                    if (py >= 0 && py < static_cast<int>(f.size()) &&
-                        px >= 0 && px < static_cast<int>(f[0].size()) &&
-                        f[py][px] == 1) {
-                        simbolo = (char)219;
-                        cansi   = obtenerColorAnsi(static_cast<int>(pieza_actual->color));
-                        pieza   = true;
-                    }
-                }
+struct OpcionesArena {
+    int  serpientes;
+    long ticks;
+    int  hilos;  // 0 = todos los núcleos
 
-                // Fija/Tablero
-                if (!pieza) {
-                    if (tablero[y][x] != VACIO) {
-                        simbolo = (char)219;
-                        cansi   = obtenerColorAnsi(static_cast<int>(colores_tablero[y][x]));
-                    } else {
-                        simbolo = '.';
-                        cansi   = "\033[90m";
-                    }
-                }
+    OpcionesArena() : serpientes(0), ticks(10000), hilos(0) {}
+};
 
-                buf << cansi << simbolo << simbolo << "\033[0m";
-            }
+class ArenaSnake {
+private:
+    struct Serpiente {
+        CuerpoSnake    cuerpo;
+        Posicion       direccion;
+        PoliticaSnake* politica;
+        bool           viva;
+        int            puntos;   // De la vida en curso
+        int            frutas;
+        // Resultado de la fase paralela
+        int            destino;  // Casilla en la que entra la cabeza (-1 = se estrella)
+        int            fruta;    // Tipo de la fruta que hay en destino (-1 = ninguna)
+        bool           muere;
+    };
 
-            buf << "\033[90m|\033[0m";
+    SnakeAST            config;
+    TablaFrutas         tabla;
+    MapaOcupacion       mapa;
+    FrutasTablero       frutas;
+    GeneradorAleatorio  aleatorio;   // Solo lo usa la fase secuencial
+    vector<Serpiente>   serpientes;
+    vector<uint16_t>    reclamos;    // Cabezas que entran en cada casilla este tick
+    vector<uint8_t>     cola_libre;  // 1 si la cola que hay en la casilla se retira este tick
+    int                 ancho;
+    int                 alto;
+    bool                paredes;
+    bool                choque_cuerpo;
+    int                 longitud_inicial;
+    int                 frutas_objetivo;
+    long                tick;
+    long long           frutas_comidas;
+    ResultadoSimulacion resultado;  // Cada muerte cierra una "partida"
 
-            // Vista previa de la siguiente pieza
-            if (y == 2) {
-                buf << "\033[97m  Siguiente:\033[0m";
-            } else if (y >= 4 && y <= 7 && siguiente_pieza) {
-                buf << "  ";
-                vector<vector<int> >& f = siguiente_pieza->rotaciones[0];
-                int   py = y - 4;
-                if (py < static_cast<int>(f.size())) {
-                    string cansi = obtenerColorAnsi(static_cast<int>(siguiente_pieza->color));
-                    for (int px = 0; px < min(4, static_cast<int>(f[0].size())); ++px) {
-                        if (px < static_cast<int>(f[0].size()) && f[py][px] == 1) {
-                            buf << cansi << (char)219 << (char)219 << "\033[0m";
-                        } else {
-                            buf << "  ";
-                        }
-                    }
-                }
-            }
-            buf << "\n";
-        }
+    int indice(const Posicion& p) const { return p.y * ancho + p.x; }
 
-        // Marco inferior
-        buf << "\033[90m         =========================\033[0m\n";
+    static void mezclar(uint64_t& h, int v) { h = (h ^ static_cast<uint32_t>(v)) * 1099511628211ULL; }
 
-        // FPS (medido en ms con GetTickCount)
-        static DWORD ultimo_fps = GetTickCount();
-        static int  fps        = 0;
-        fps++;
-        DWORD ahora_fps = GetTickCount();
-        DWORD ms    = ahora_fps - ultimo_fps;
-        if (ms >= 1000) {
-            buf << "\033[92mFPS: " << fps << " | Cargado desde AST\033[0m\n";
-            fps = 0;
-            ultimo_fps = ahora_fps;
+    // Solo giros perpendiculares a la dirección actual. Es el criterio de
+    // SnakeEngine::encolarGiro con la cola vacía: en la arena cada serpiente
+    // decide una vez por paso y el giro se aplica en ese mismo paso, así que
+    // nunca hay giros pendientes
+    static Posicion girar(const Posicion& d, char t) {
+        switch (t) {
+            case 'w': case 'W': if (d.y == 0) return Posicion(0, -1); break;
+            case 's': case 'S': if (d.y == 0) return Posicion(0,  1); break;
+            case 'a': case 'A': if (d.x == 0) return Posicion(-1, 0); break;
+            case 'd': case 'D': if (d.x == 0) return Posicion( 1, 0); break;
         }
-
-        cout << buf.str();
-        cout.flush();
+        return d;
     }
 
-    void ejecutar() {
-        const int TARGET_FPS = 60;
-        const int FRAME_MS   = 1000 / TARGET_FPS;
-        DWORD proximo = GetTickCount() + FRAME_MS;
-        while (juego_activo) {
-            DWORD inicio = GetTickCount();
-            procesarEntrada();
-            if (!pausado && !game_over) {
-                actualizarFisica();
-            }
-            if (inicio >= proximo) {
-                renderizar();
-                proximo += FRAME_MS;
-            }
-            DWORD now = GetTickCount();
-            if (proximo > now) {
-                Sleep(proximo - now);
+    // Fase paralela para las serpientes [desde, hasta), con los buffers de búsqueda del hilo
+    void decidir(int desde, int hasta, BusquedaRutaSnake& busqueda) {
+        for (int i = desde; i < hasta; ++i) {
+            Serpiente& s = serpientes[i];
+            if (!s.viva) continue;
+            VistaSnake v;
+            v.cuerpo    = &s.cuerpo;
+            v.ocupacion = &mapa;
+            v.frutas    = &frutas;
+            v.tabla     = &tabla;
+            v.direccion = s.direccion;
+            v.ancho     = ancho;
+            v.alto      = alto;
+            v.paredes   = paredes;
+            v.tick      = tick;
+            v.busqueda  = &busqueda;
+            s.direccion = girar(s.direccion, s.politica->decidir(v));
+
+            Posicion cabeza = s.cuerpo.cabeza();
+            Posicion nueva(cabeza.x + s.direccion.x, cabeza.y + s.direccion.y);
+            s.destino = -1;
+            s.fruta   = -1;
+            if (nueva.x < 1 || nueva.x >= ancho - 1 || nueva.y < 1 || nueva.y >= alto - 1) {
+                if (paredes) continue;
+                if (nueva.x < 1) nueva.x = ancho - 2; else if (nueva.x >= ancho - 1) nueva.x = 1;
+                if (nueva.y < 1) nueva.y = alto - 2;  else if (nueva.y >= alto - 1)  nueva.y = 1;
             }
+            int e = mapa.entidad(nueva);
+            if (e == OBSTACULO) continue;
+            s.destino = indice(nueva);
+            if (e >= 0) s.fruta = frutas[e].tipo;
         }
     }
-};
 
-// ================================================================
-// Snake
-// ================================================================
-struct Posicion {
-    int x;
-    int y;
-    Posicion(int x_ = 0, int y_ = 0) : x(x_), y(y_) {}
-    bool operator==(const Posicion& o) const { return x == o.x && y == o.y; }
-};
+    void quitarCola(Serpiente& s) {
+        mapa.liberar(s.cuerpo.cola());
+        s.cuerpo.quitarCola();
+    }
 
-class SnakeEngine {
-private:
-    // Configuración y estado
-    SnakeAST           config;
-    ColorConsola       colorConsola;
-    vector<Posicion>   cuerpo_snake;
-    Posicion           direccion_actual;
-    Posicion           fruta_posicion;
-    string             fruta_tipo_actual;  // Tipo de fruta actual (manzana, cereza, etc.)
-    bool               juego_activo;
-    bool               pausado;
-    bool               game_over;
-    int                puntos;
-    int                nivel;
-    // Contadores de frutas comidas
-    int                contador_manzana;
-    int                contador_cereza;
-    int                contador_banana;
-    int                contador_uva;
-    int                contador_naranja;
-    int                total_frutas_comidas;  // Total de todas las frutas comidas
-    // se usará rand() en lugar de mt19937 para compatibilidad C++03
-    int                ancho_tablero;
-    int                alto_tablero;
-    int                velocidad_ms;
-    string             nombre_juego;
-public:
-    SnakeEngine()
-        : juego_activo(true),
-         pausado(false),
-         game_over(false),
-         puntos(0),
-         nivel(1),
-         contador_manzana(0),
-         contador_cereza(0),
-         contador_banana(0),
-         contador_uva(0),
-         contador_naranja(0),
-         total_frutas_comidas(0) {
-        // semilla para rand()
-        srand((unsigned)time(NULL));
-        cargarConfiguracionAST();
-        inicializarJuego();
+    void agregarCola(Serpiente& s, const Posicion& p) {
+        s.cuerpo.agregarCola(p);
+        mapa.ocupar(p);
     }
-private:
-    void cargarConfiguracionAST() {
-        if (!config.cargarDesdeAST("build/arbol.ast")) {
-            nombre_juego  = "Snake Clasico";
-            ancho_tablero = 25;
-            alto_tablero  = 20;
-            velocidad_ms  = 150;
+
+    void morir(Serpiente& s) {
+        resultado.cerrarPartida(s.puntos, s.frutas);
+        while (!s.cuerpo.vacio()) quitarCola(s);
+        s.viva = false;
+    }
+
+    // Aplica el paso ya validado, con las mismas reglas de fruta que SnakeEngine
+    void mover(Serpiente& s) {
+        Posicion nueva(s.destino % ancho, s.destino / ancho);
+        s.cuerpo.agregarCabeza(nueva);
+        mapa.ocupar(nueva);
+        if (s.fruta < 0) {
+            quitarCola(s);
             return;
         }
-        nombre_juego  = config.strings.count("nombre_juego")  ? config.strings["nombre_juego"]  : "Snake Clásico";
-        ancho_tablero = config.integers.count("ancho_tablero") ? config.integers["ancho_tablero"] : 25;
-        alto_tablero  = config.integers.count("alto_tablero")  ? config.integers["alto_tablero"]  : 20;
-        velocidad_ms  = config.integers.count("velocidad_inicial") ? config.integers["velocidad_inicial"] : 150;
+        const ReglaFruta& regla = tabla[frutas.comer(mapa, nueva)];
+        s.puntos += regla.puntos;
+        s.frutas++;
+        frutas_comidas++;
+        for (int k = 0; k < regla.crecimiento; ++k) agregarCola(s, s.cuerpo.cola());
+        for (int k = 0; k < -regla.crecimiento && s.cuerpo.tamanio() > 1; ++k) quitarCola(s);
     }
 
-    void inicializarJuego() {
-        cuerpo_snake.clear();
-        int cx = ancho_tablero / 2;
-        int cy = alto_tablero / 2;
-        int longitud = config.integers.count("longitud_inicial") ? config.integers["longitud_inicial"] : 3;
-        for (int i = 0; i < longitud; ++i) {
-            cuerpo_snake.push_back(Posicion(cx - i, cy));
+    // Devuelve al tablero las serpientes muertas y las frutas comidas
+    void reponer() {
+        static const Posicion direcciones[4] = { Posicion(0, -1), Posicion(0, 1), Posicion(-1, 0), Posicion(1, 0) };
+        for (size_t i = 0; i < serpientes.size() && mapa.numLibres() > 0; ++i) {
+            Serpiente& s = serpientes[i];
+            if (s.viva) continue;
+            Posicion p = mapa.libreAleatoria(aleatorio);
+            for (int k = 0; k < longitud_inicial; ++k) agregarCola(s, p);
+            s.direccion = direcciones[aleatorio.rango(4)];
+            s.viva      = true;
+            s.puntos    = 0;
+            s.frutas    = 0;
         }
-        direccion_actual = Posicion(1, 0);
-        fruta_tipo_actual = "manzana";  // Inicializar tipo de fruta
-        generarNuevaFruta();
-        puntos    = 0;
-        game_over = false;
-        // Resetear contadores de frutas
-        contador_manzana = 0;
-        contador_cereza = 0;
-        contador_banana = 0;
-        contador_uva = 0;
-        contador_naranja = 0;
-        total_frutas_comidas = 0;
+        while (frutas.tamanio() < frutas_objetivo && frutas.generar(mapa, tabla, aleatorio)) {}
     }
 
-    void generarNuevaFruta() {
-        int minx = 1;
-        int maxx = ancho_tablero - 2;
-        int miny = 1;
-        int maxy = alto_tablero - 2;
-        do {
-            int rx = (rand() % (maxx - minx + 1)) + minx;
-            int ry = (rand() % (maxy - miny + 1)) + miny;
-            fruta_posicion = Posicion(rx, ry);
-        } while (esPosicionOcupadaPorSnake(fruta_posicion));
-        
-        // Seleccionar tipo de fruta aleatorio
-        vector<string> frutas_disponibles;
-        if (config.arrays.count("frutas_disponibles")) {
-            frutas_disponibles = config.arrays["frutas_disponibles"];
-        } else {
-            // Frutas por defecto
-            frutas_disponibles.push_back("manzana");
-            frutas_disponibles.push_back("cereza");
-            frutas_disponibles.push_back("banana");
+    // Fase secuencial: la ejecuta un solo hilo mientras los demás esperan
+    void resolver() {
+        for (size_t i = 0; i < serpientes.size(); ++i) {
+            const Serpiente& s = serpientes[i];
+            if (!s.viva) continue;
+            if (s.destino >= 0) reclamos[s.destino]++;
+            // La cola deja su casilla si no crece ni está repetida; si la
+            // serpiente se estrella se retira entera
+            bool crece = s.fruta >= 0 && tabla[s.fruta].crecimiento >= 0;
+            Posicion cola = s.cuerpo.cola();
+            if (s.destino < 0 || (!crece && mapa.cuenta(cola) == 1)) cola_libre[indice(cola)] = 1;
         }
-        
-        if (!frutas_disponibles.empty()) {
-            fruta_tipo_actual = frutas_disponibles[rand() % frutas_disponibles.size()];
-        } else {
-            fruta_tipo_actual = "manzana";  // Por defecto
+        for (size_t i = 0; i < serpientes.size(); ++i) {
+            Serpiente& s = serpientes[i];
+            if (!s.viva) continue;
+            s.muere = s.destino < 0;
+            if (!s.muere && choque_cuerpo) {
+                Posicion d(s.destino % ancho, s.destino / ancho);
+                s.muere = reclamos[s.destino] > 1 || mapa.cuenta(d) > cola_libre[s.destino];
+            }
+        }
+        for (size_t i = 0; i < serpientes.size(); ++i) {
+            const Serpiente& s = serpientes[i];
+            if (!s.viva) continue;
+            if (s.destino >= 0) reclamos[s.destino] = 0;
+            cola_libre[indice(s.cuerpo.cola())] = 0;
+        }
+        for (size_t i = 0; i < serpientes.size(); ++i) {
+            Serpiente& s = serpientes[i];
+            if (!s.viva) continue;
+            if (s.muere) morir(s);
+            else         mover(s);
         }
+        reponer();
+        tick++;
     }
 
-    bool esPosicionOcupadaPorSnake(const Posicion& p) {
-        for (size_t i = 0; i < cuerpo_snake.size(); ++i) {
-            if (cuerpo_snake[i] == p) return true;
+    void trabajar(int h, int hilos, long ticks, BarreraHilos& barrera) {
+        long n     = static_cast<long>(serpientes.size());
+        int  desde = static_cast<int>(n * h / hilos);
+        int  hasta = static_cast<int>(n * (h + 1) / hilos);
+        // Un juego de buffers por hilo: con uno por serpiente la memoria
+        // crecería con el cuadrado de las serpientes (el tablero crece con ellas)
+        BusquedaRutaSnake busqueda;
+        for (long t = 0; t < ticks; ++t) {
+            decidir(desde, hasta, busqueda);
+            barrera.esperar([this] { resolver(); });
         }
-        return false;
     }
+public:
+    /**
+     * @param cfg        Configuración de Snake (tablero, frutas, obstáculos)
+     * @param op         Política de las serpientes (--bot, --guion)
+     * @param n          Número de serpientes
+     * @param semilla    Semilla de la arena; la serpiente i juega con semilla + i
+     */
+    ArenaSnake(const SnakeAST& cfg, const OpcionesHeadless& op, int n, uint32_t semilla)
+        : config(cfg), aleatorio(semilla), tick(0), frutas_comidas(0) {
+        tabla.compilar(config);
+        ancho = enteroConfig(config, "ancho_tablero", 25);
+        alto  = enteroConfig(config, "alto_tablero", 20);
+        long necesario = static_cast<long>(n) * CASILLAS_POR_SERPIENTE_ARENA;
+        int  escala    = 1;
+        while (static_cast<long>(ancho - 2) * escala * (alto - 2) * escala < necesario) escala++;
+        ancho = 2 + (ancho - 2) * escala;
+        alto  = 2 + (alto - 2) * escala;
+        bool borde = config.booleans.count("terminar_al_chocar_borde") ? config.booleans["terminar_al_chocar_borde"] : true;
+        paredes          = borde && (config.booleans.count("bordes_solidos") ? config.booleans["bordes_solidos"] : true);
+        choque_cuerpo    = config.booleans.count("terminar_al_chocar_cuerpo") ? config.booleans["terminar_al_chocar_cuerpo"] : true;
+        longitud_inicial = max(1, enteroConfig(config, "longitud_inicial", 3));
+        frutas_objetivo  = max(n, enteroConfig(config, "frutas_simultaneas", 1));
 
-    bool hayColisionConCuerpo(const Posicion& p) {
-        // Verificar que haya al menos 2 segmentos (cabeza + cuerpo)
-        if (cuerpo_snake.size() < 2) return false;
-        
-        // Verificar colisión con el cuerpo (excluyendo la cabeza en índice 0)
-        // IMPORTANTE: Excluimos la cola (último segmento) porque se eliminará al moverse
-        // Si la nueva cabeza está en la posición de la cola, NO es una colisión
-        // Solo verificamos colisión con segmentos que permanecerán después del movimiento
-        size_t ultimo_indice = cuerpo_snake.size() - 1;  // Índice de la cola
-        for (size_t i = 1; i < ultimo_indice; ++i) {
-            if (cuerpo_snake[i] == p) return true;
+        mapa.dimensionar(ancho, alto);
+        reclamos.assign(static_cast<size_t>(ancho) * alto, 0);
+        cola_libre.assign(static_cast<size_t>(ancho) * alto, 0);
+        // Sin cabeza que proteger: ningún carril reservado
+        vector<Posicion> obstaculos;
+        colocarObstaculos(config, mapa, aleatorio, Posicion(0, 0), Posicion(0, 0), ancho, alto, obstaculos);
+
+        serpientes.resize(n);
+        for (int i = 0; i < n; ++i) {
+            Serpiente& s = serpientes[i];
+            s.cuerpo.reservar(longitud_inicial);
+            s.politica = crearPoliticaSnake(op, semilla + static_cast<uint32_t>(i));
+            s.viva     = false;
+            s.puntos   = 0;
+            s.frutas   = 0;
+            s.destino  = -1;
+            s.fruta    = -1;
+            s.muere    = false;
         }
-        return false;
+        reponer();
     }
 
-    bool estaFueraDelTablero(const Posicion& p) {
-        // Verificar límites del tablero
-        // La serpiente puede moverse en el área interior: x de 1 a ancho-2, y de 1 a alto-2
-        // Los bordes (x=0, x=ancho-1, y=0, y=alto-1) son paredes
-        return p.x < 1 || p.x >= ancho_tablero - 1 || p.y < 1 || p.y >= alto_tablero - 1;
+    ~ArenaSnake() {
+        for (size_t i = 0; i < serpientes.size(); ++i) delete serpientes[i].politica;
     }
 
-    void procesarEntrada() {
-        if (_kbhit()) {
-            char t = _getch();
-            if (game_over) {
-                if (t == 'r' || t == 'R') {
-                    inicializarJuego();
-                } else if (t == 27) { // ESC
-                    juego_activo = false;
-                }
-                return;
-            }
-            switch (t) {
-                case 'w': case 'W': if (direccion_actual.y == 0) direccion_actual = Posicion(0, -1); break;
-                case 's': case 'S': if (direccion_actual.y == 0) direccion_actual = Posicion(0,  1); break;
-                case 'a': case 'A': if (direccion_actual.x == 0) direccion_actual = Posicion(-1, 0); break;
-                case 'd': case 'D': if (direccion_actual.x == 0) direccion_actual = Posicion( 1, 0); break;
-                case 'p': case 'P': pausado = !pausado; break;
-                case 27:             juego_activo = false;   break; // ESC
-            }
+    /**
+     * Avanza la arena 'ticks' ticks repartiendo las serpientes en bloques
+     * fijos entre los hilos (0 = todos los núcleos).
+     * @return Muertes como partidas cerradas y, en curso, los puntos de las vivas
+     */
+    ResultadoSimulacion simular(long ticks, int hilos) {
+        if (hilos <= 0) hilos = static_cast<int>(std::thread::hardware_concurrency());
+        hilos = max(1, min(hilos, static_cast<int>(serpientes.size())));
+        BarreraHilos        barrera(hilos);
+        vector<std::thread> trabajadores;
+        for (int h = 1; h < hilos; ++h) {
+            trabajadores.push_back(std::thread(&ArenaSnake::trabajar, this, h, hilos, ticks, std::ref(barrera)));
+        }
+        trabajar(0, hilos, ticks, barrera);
+        for (size_t t = 0; t < trabajadores.size(); ++t) trabajadores[t].join();
+
+        ResultadoSimulacion r = resultado;
+        r.ticks = tick;
+        for (size_t i = 0; i < serpientes.size(); ++i) {
+            if (serpientes[i].viva) r.puntos_en_curso += serpientes[i].puntos;
         }
+        return r;
     }
 
-    void actualizarFisica() {
-        if (pausado || game_over) return;
-        
-        // Verificar que la serpiente tenga al menos un segmento
-        if (cuerpo_snake.empty()) {
-            game_over = true;
-            return;
+    int       anchoTablero() const  { return ancho; }
+    int       altoTablero() const   { return alto; }
+    long long frutasComidas() const { return frutas_comidas; }
+
+    int vivas() const {
+        int n = 0;
+        for (size_t i = 0; i < serpientes.size(); ++i) n += serpientes[i].viva ? 1 : 0;
+        return n;
+    }
+
+    int masLarga() const {
+        int n = 0;
+        for (size_t i = 0; i < serpientes.size(); ++i) n = max(n, serpientes[i].cuerpo.tamanio());
+        return n;
+    }
+
+    // Huella FNV-1a de serpientes y frutas, para comparar ejecuciones con distintos hilos
+    uint64_t huella() const {
+        uint64_t h = 1469598103934665603ULL;
+        for (size_t i = 0; i < serpientes.size(); ++i) {
+            const Serpiente& s = serpientes[i];
+            mezclar(h, s.viva ? s.puntos : -1);
+            for (int k = 0; k < s.cuerpo.tamanio(); ++k) mezclar(h, indice(s.cuerpo[k]));
         }
-        
-        // Verificar que la dirección sea válida (no sea (0,0))
-        if (direccion_actual.x == 0 && direccion_actual.y == 0) {
-            return; // No moverse si no hay dirección
+        for (int i = 0; i < frutas.tamanio(); ++i) mezclar(h, indice(frutas[i].pos) * 8 + frutas[i].tipo);
+        return h;
+    }
+};
+
+// ============================================================================
+// ENTORNO VECTORIAL DE TETRIS (MUCHOS TABLEROS POR PASO)
+// ============================================================================
+// Para entrenar y evaluar agentes: cada llamada a paso() avanza todos los
+// tableros con una acción cada uno. El estado vive en arreglos por campo
+// (estructura de arreglos) y las filas están intercaladas: la fila y de los
+// tableros b, b+1, ... es contigua, así que la detección de líneas compara
+// cuatro tableros a la vez y la prueba de colisión reúne las filas de cuatro
+// tableros en un registro SSE2.
+//
+// Reglas: cada paso aplica la acción (rotar usa las patadas SRS) y luego la
+// gravedad baja la pieza una fila; si no puede bajar se fija, se eliminan las líneas y aparece la
+// siguiente. Los puntos siguen la tabla de ConfigTetris multiplicada por el
+// nivel y las piezas salen de GeneradorPiezas como en los motores. Un tablero
+// que pierde queda marcado en terminados() durante ese paso y se reinicia al
+// comienzo del siguiente.
+// ============================================================================
+enum AccionTetris {
+    ACCION_NADA = 0,
+    ACCION_IZQUIERDA,
+    ACCION_DERECHA,
+    ACCION_ROTAR,
+    ACCION_BAJAR,
+    ACCION_CAIDA,      // Caída instantánea hasta apoyarse
+    NUM_ACCIONES_TETRIS
+};
+
+class EntornoTetrisVectorial {
+private:
+    static const int CARRILES = 4;  // Tableros por registro SSE2
+
+    TablaRotaciones tabla;
+    int      n;          // Tableros
+    int      paso_filas; // Tableros reservados por fila (múltiplo de CARRILES)
+    int      ancho;
+    int      alto;
+    FilaBits llena;
+    int      puntos_lineas[5];
+    int      nivel_inicial;
+    int      lineas_para_nivel;
+
+    vector<FilaBits>           filas_;       // [y * paso_filas + b]
+    vector<unsigned char>      tipo_;
+    vector<unsigned char>      rotacion_;
+    vector<unsigned char>      siguiente_;
+    vector<int>                x_;
+    vector<int>                y_;
+    vector<int>                puntos_;
+    vector<int>                lineas_;
+    vector<int>                recompensa_;
+    vector<unsigned char>      terminado_;
+    vector<GeneradorAleatorio> aleatorio_;
+    vector<AnilloPiezas<CAPACIDAD_COLA_PIEZAS> > colas_;  // Próximas piezas de cada tablero
+    GeneradorPiezas            generador_piezas;
+    long                       partidas_terminadas;
+
+    // Memoria de trabajo de paso()
+    vector<int>           cand_x;
+    vector<int>           cand_y;
+    vector<unsigned char> cand_rot;
+    vector<unsigned char> choca;
+    vector<int>           indices;
+    vector<unsigned char> fijada;
+
+    FilaBits fila(int b, int y) const { return filas_[y * paso_filas + b]; }
+
+    /**
+     * Prueba de colisión de la pieza de cada tablero listado en idx con la
+     * posición candidata (cand_x, cand_y, cand_rot). Deja 1 en choca[b] si no
+     * cabe. Las paredes se resuelven por tablero; la superposición con las
+     * filas se calcula para cuatro tableros por instrucción.
+     */
+    void colisiones(const int* idx, int m) {
+        for (int i = 0; i < m; i += CARRILES) {
+            uint32_t mascara[TAMANIO_CAJA_PIEZA][CARRILES];
+            uint32_t contenido[TAMANIO_CAJA_PIEZA][CARRILES];
+            int      fuera[CARRILES];
+            for (int c = 0; c < CARRILES; ++c) {
+                int b = idx[min(i + c, m - 1)];  // Carriles sobrantes repiten el último tablero
+                const FormaPieza& f = tabla.forma(static_cast<TipoPieza>(tipo_[b]), cand_rot[b]);
+                int x = cand_x[b];
+                int y = cand_y[b];
+                fuera[c] = (x + f.col_min < 0 || x + f.col_max >= ancho || y + f.fila_max >= alto);
+                for (int py = 0; py < TAMANIO_CAJA_PIEZA; ++py) {
+                    int wy = y + py;
+                    FilaBits mk = (x >= 0) ? (f.filas[py] << x) : (f.filas[py] >> -x);
+                    bool dentro = (wy >= 0 && wy < alto);
+                    mascara[py][c]   = dentro ? mk : 0u;
+                    contenido[py][c] = dentro ? fila(b, wy) : 0u;
+                }
+            }
+#ifdef RUNTIME_SSE2
+            __m128i acumulado = _mm_setzero_si128();
+            for (int py = 0; py < TAMANIO_CAJA_PIEZA; ++py) {
+                __m128i mk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mascara[py]));
+                __m128i fv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(contenido[py]));
+                acumulado  = _mm_or_si128(acumulado, _mm_and_si128(mk, fv));
+            }
+            int libres = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(acumulado, _mm_setzero_si128())));
+#else
+            int libres = 0;
+            for (int c = 0; c < CARRILES; ++c) {
+                uint32_t acumulado = 0;
+                for (int py = 0; py < TAMANIO_CAJA_PIEZA; ++py) acumulado |= mascara[py][c] & contenido[py][c];
+                if (acumulado == 0) libres |= 1 << c;
+            }
+#endif
+            for (int c = 0; c < CARRILES && i + c < m; ++c) {
+                choca[idx[i + c]] = fuera[c] || !((libres >> c) & 1);
+            }
         }
-        
-        // Calcular nueva posición de la cabeza
-        Posicion nueva(cuerpo_snake[0].x + direccion_actual.x,
-                       cuerpo_snake[0].y + direccion_actual.y);
+    }
 
-        // Verificar configuración de colisiones
-        bool fin_borde = config.booleans.count("terminar_al_chocar_borde")
-                        ? config.booleans["terminar_al_chocar_borde"]
-                        : true;
-        bool fin_cuerpo = config.booleans.count("terminar_al_chocar_cuerpo")
-                        ? config.booleans["terminar_al_chocar_cuerpo"]
-                        : true;
+    void aparecer(int b) {
+        tipo_[b] = static_cast<unsigned char>(colas_[b].extraer());
+        generador_piezas.reponer(colas_[b], aleatorio_[b]);
+        siguiente_[b] = static_cast<unsigned char>(colas_[b].ver(0));
+        rotacion_[b]  = 0;
+        x_[b]         = ancho / 2 - 2;
+        y_[b]         = 0;
+    }
 
-        // Verificar colisión con bordes (mejorado)
-        if (fin_borde) {
-            // Verificar límites exactos del tablero
-            if (nueva.x < 1 || nueva.x >= ancho_tablero - 1 || 
-                nueva.y < 1 || nueva.y >= alto_tablero - 1) {
-                game_over = true;
-                return;
-            }
-        } else {
-            // Si no termina al chocar borde, hacer wrap-around (teleportar al otro lado)
-            if (nueva.x < 1) nueva.x = ancho_tablero - 2;
-            else if (nueva.x >= ancho_tablero - 1) nueva.x = 1;
-            if (nueva.y < 1) nueva.y = alto_tablero - 2;
-            else if (nueva.y >= alto_tablero - 1) nueva.y = 1;
+    void reiniciarTablero(int b) {
+        for (int y = 0; y < alto; ++y) filas_[y * paso_filas + b] = 0;
+        puntos_[b]    = 0;
+        lineas_[b]    = 0;
+        terminado_[b] = 0;
+        colas_[b].vaciar();
+        generador_piezas.reponer(colas_[b], aleatorio_[b]);
+        aparecer(b);
+    }
+
+    void fijar(int b) {
+        const FormaPieza& f = tabla.forma(static_cast<TipoPieza>(tipo_[b]), rotacion_[b]);
+        int x = x_[b];
+        for (int py = f.fila_min; py <= f.fila_max; ++py) {
+            int wy = y_[b] + py;
+            if (wy < 0 || wy >= alto) continue;
+            filas_[wy * paso_filas + b] |= (x >= 0) ? (f.filas[py] << x) : (f.filas[py] >> -x);
         }
-        
-        // Verificar colisión con el cuerpo (mejorado)
-        // IMPORTANTE: Solo verificamos colisión con segmentos que permanecerán después del movimiento
-        // La cola (último segmento) se eliminará, así que no cuenta como colisión
-        if (fin_cuerpo) {
-            // Si hay menos de 2 segmentos, no puede haber colisión con el cuerpo
-            if (cuerpo_snake.size() >= 2) {
-                // Verificar colisión con todos los segmentos excepto la cabeza (índice 0) y la cola (último índice)
-                size_t ultimo_indice = cuerpo_snake.size() - 1;
-                for (size_t i = 1; i < ultimo_indice; ++i) {
-                    if (cuerpo_snake[i] == nueva) {
-                        game_over = true;
-                        return;
-                    }
-                }
-            }
+    }
+
+    // Compacta el tablero b saltando las filas llenas; devuelve las eliminadas
+    int compactar(int b) {
+        int destino = alto - 1;
+        for (int origen = alto - 1; origen >= 0; --origen) {
+            FilaBits v = fila(b, origen);
+            if (v == llena) continue;
+            filas_[destino * paso_filas + b] = v;
+            destino--;
         }
+        int eliminadas = destino + 1;
+        for (int y = destino; y >= 0; --y) filas_[y * paso_filas + b] = 0;
+        return eliminadas;
+    }
 
-        cuerpo_snake.insert(cuerpo_snake.begin(), nueva);
-        if (nueva == fruta_posicion) {
-            // Calcular puntos según el tipo de fruta
-            int pf = config.integers.count("puntos_por_fruta")
-                   ? config.integers["puntos_por_fruta"]
-                   : 10;
-            
-            // Buscar puntos específicos del tipo de fruta en el AST
-            // Formato esperado: "puntos_manzana", "puntos_cereza", etc.
-            string clave_puntos = "puntos_" + fruta_tipo_actual;
-            if (config.integers.count(clave_puntos)) {
-                pf = config.integers[clave_puntos];
-            } else {
-                // Intentar obtener desde objetos anidados (si el parser lo soporta)
-                // Por ahora usamos valores por defecto según el tipo
-                if (fruta_tipo_actual == "manzana") pf = 10;
-                else if (fruta_tipo_actual == "cereza") pf = 20;
-                else if (fruta_tipo_actual == "banana") pf = 15;
-                else if (fruta_tipo_actual == "uva") pf = 25;
-                else if (fruta_tipo_actual == "naranja") pf = 30;
+    /**
+     * Busca filas llenas en los tableros que fijaron pieza, cuatro tableros
+     * por comparación, y compacta y puntúa los que tengan alguna.
+     */
+    void eliminarLineas() {
+        for (int g = 0; g < n; g += CARRILES) {
+            int carriles = 0;
+            for (int c = 0; c < CARRILES && g + c < n; ++c) {
+                if (fijada[g + c]) carriles |= 1 << c;
             }
-            
-            puntos += pf;
-            // Incrementar contador según el tipo de fruta
-            if (fruta_tipo_actual == "manzana") contador_manzana++;
-            else if (fruta_tipo_actual == "cereza") contador_cereza++;
-            else if (fruta_tipo_actual == "banana") contador_banana++;
-            else if (fruta_tipo_actual == "uva") contador_uva++;
-            else if (fruta_tipo_actual == "naranja") contador_naranja++;
-            total_frutas_comidas++;  // Incrementar total
-            
-            // Aplicar efectos de la fruta
-            // 1. Efecto de crecimiento (puede ser negativo para acortar)
-            int crecimiento = 1;  // Por defecto crece 1
-            string clave_crecimiento = "crecimiento_" + fruta_tipo_actual;
-            if (config.integers.count(clave_crecimiento)) {
-                crecimiento = config.integers[clave_crecimiento];
-            } else {
-                // Valores por defecto (actualizados según configuración)
-                if (fruta_tipo_actual == "manzana") crecimiento = -1;  // Disminuye 1
-                else if (fruta_tipo_actual == "cereza") crecimiento = 0;  // Sin crecimiento
-                else if (fruta_tipo_actual == "banana") crecimiento = 0;  // Sin crecimiento
-                else if (fruta_tipo_actual == "uva") crecimiento = 2;  // Aumenta 2
-                else if (fruta_tipo_actual == "naranja") crecimiento = 1;  // Normal (crece 1)
+            if (!carriles) continue;
+            int con_lineas = 0;
+#ifdef RUNTIME_SSE2
+            const __m128i vllena = _mm_set1_epi32(static_cast<int>(llena));
+            for (int y = 0; y < alto && (con_lineas & carriles) != carriles; ++y) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&filas_[y * paso_filas + g]));
+                con_lineas |= _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(v, vllena)));
             }
-            
-            // Aplicar crecimiento (si es negativo, acortar la serpiente)
-            if (crecimiento > 0) {
-                // Crecer: agregar segmentos al final
-                for (int i = 0; i < crecimiento; ++i) {
-                    if (!cuerpo_snake.empty()) {
-                        Posicion ultimo = cuerpo_snake.back();
-                        cuerpo_snake.push_back(ultimo);
-                    }
-                }
-            } else if (crecimiento < 0) {
-                // Acortar: eliminar segmentos del final (mínimo 1 segmento)
-                int acortar = -crecimiento;
-                for (int i = 0; i < acortar && cuerpo_snake.size() > 1; ++i) {
-                    cuerpo_snake.pop_back();
+#else
+            for (int y = 0; y < alto; ++y) {
+                for (int c = 0; c < CARRILES; ++c) {
+                    if (filas_[y * paso_filas + g + c] == llena) con_lineas |= 1 << c;
                 }
             }
-            
-            // 2. Efecto de velocidad (positivo = más lento, negativo = más rápido)
-            int cambio_velocidad = 0;  // Por defecto sin cambio
-            string clave_velocidad = "velocidad_" + fruta_tipo_actual;
-            if (config.integers.count(clave_velocidad)) {
-                cambio_velocidad = config.integers[clave_velocidad];
-            } else {
-                // Valores por defecto (actualizados según configuración)
-                if (fruta_tipo_actual == "manzana") cambio_velocidad = 0;  // Sin cambio
-                else if (fruta_tipo_actual == "cereza") cambio_velocidad = 20;  // Más lento
-                else if (fruta_tipo_actual == "banana") cambio_velocidad = -15;  // Más rápido
-                else if (fruta_tipo_actual == "uva") cambio_velocidad = 0;  // Sin cambio
-                else if (fruta_tipo_actual == "naranja") cambio_velocidad = 0;  // Normal (sin cambio)
+#endif
+            con_lineas &= carriles;
+            for (int c = 0; c < CARRILES; ++c) {
+                if (!((con_lineas >> c) & 1)) continue;
+                int b = g + c;
+                int eliminadas = compactar(b);
+                int nivel = lineas_[b] / lineas_para_nivel + nivel_inicial;
+                int ganados = puntos_lineas[min(eliminadas, 4)] * nivel;
+                lineas_[b]     += eliminadas;
+                puntos_[b]     += ganados;
+                recompensa_[b] += ganados;
             }
-            
-            // Aplicar cambio de velocidad
-            velocidad_ms += cambio_velocidad;
-            // Límites de velocidad (más bajo = más rápido, más alto = más lento)
-            int velocidad_min = config.integers.count("velocidad_minima") 
-                              ? config.integers["velocidad_minima"] 
-                              : 50;
-            int velocidad_max = config.integers.count("velocidad_maxima") 
-                              ? config.integers["velocidad_maxima"] 
-                              : 500;
-            if (velocidad_ms < velocidad_min) velocidad_ms = velocidad_min;
-            if (velocidad_ms > velocidad_max) velocidad_ms = velocidad_max;
-            
-            generarNuevaFruta();
-        } else {
-            cuerpo_snake.pop_back();
         }
     }
 
-    void renderizar() {
-        stringstream buf;
-        buf << "\033[2J\033[H";
-
-        string titulo = config.strings.count("nombre_juego")
-                       ? config.strings["nombre_juego"]
-                       : string("Snake Clasico");
+    EntornoTetrisVectorial(const EntornoTetrisVectorial&);
+    EntornoTetrisVectorial& operator=(const EntornoTetrisVectorial&);
+public:
+    /**
+     * @param cfg          Reglas (tablero, formas y puntos)
+     * @param num_tableros Tableros que avanza cada paso
+     * @param semilla      El tablero b usa la semilla semilla + b
+     */
+    EntornoTetrisVectorial(const ConfigTetris& cfg, int num_tableros, uint32_t semilla)
+        : tabla(cfg.tabla_rotaciones)
+        , n(max(1, num_tableros))
+        , paso_filas((max(1, num_tableros) + CARRILES - 1) / CARRILES * CARRILES)
+        , ancho(max(ANCHO_TABLERO_MINIMO, min(cfg.ancho_tablero, ANCHO_TABLERO_MAXIMO)))
+        , alto(max(ALTO_TABLERO_MINIMO, min(cfg.alto_tablero, ALTO_TABLERO_MAXIMO)))
+        , nivel_inicial((cfg.nivel_inicial > 0) ? cfg.nivel_inicial : 1)
+        , lineas_para_nivel(max(1, cfg.lineas_para_nivel))
+        , filas_(static_cast<size_t>(alto) * paso_filas, 0u)
+        , tipo_(n), rotacion_(n), siguiente_(n), x_(n), y_(n)
+        , puntos_(n), lineas_(n), recompensa_(n, 0), terminado_(n, 0)
+        , aleatorio_(n)
+        , colas_(n)
+        , generador_piezas(cfg)
+        , partidas_terminadas(0)
+        , cand_x(n), cand_y(n), cand_rot(n), choca(n), indices(n), fijada(n) {
+        llena = (ancho >= ANCHO_TABLERO_MAXIMO) ? ~0u : ((1u << ancho) - 1u);
+        puntos_lineas[0] = 0;
+        puntos_lineas[1] = cfg.puntos_linea_simple;
+        puntos_lineas[2] = cfg.puntos_linea_doble;
+        puntos_lineas[3] = cfg.puntos_linea_triple;
+        puntos_lineas[4] = cfg.puntos_linea_tetris;
+        for (int b = 0; b < n; ++b) {
+            aleatorio_[b].sembrar(semilla + static_cast<uint32_t>(b));
+            reiniciarTablero(b);
+        }
+    }
 
-        buf << "\033[97;1m=== " << titulo << " ===\033[0m\n";
-        buf << "\033[93mPuntos: " << puntos
-            << " | Nivel: " << nivel
-            << " | Longitud: " << cuerpo_snake.size()
-            << " | Frutas: " << total_frutas_comidas
-            << "\033[0m\n";
-        buf << "\033[90mControles: WASD - Mover, P - Pausa, ESC - Salir\033[0m\n\n";
+    /**
+     * Avanza todos los tableros un paso.
+     * @param acciones Una AccionTetris por tablero
+     */
+    void paso(const unsigned char* acciones) {
+        int m = 0;
+        for (int b = 0; b < n; ++b) {
+            recompensa_[b] = 0;
+            fijada[b]      = 0;
+            if (terminado_[b]) reiniciarTablero(b);
 
-        if (game_over) {
-            string msg = config.strings.count("mensaje_game_over")
-                       ? config.strings["mensaje_game_over"]
-                       : string("GAME OVER - Puntuación: {puntos}");
-            size_t p = msg.find("{puntos}");
-            if (p != string::npos) {
-                std::ostringstream oss; oss << puntos;
-                msg.replace(p, 8, oss.str());
+            // Acción: posición candidata (la caída instantánea se resuelve aparte)
+            cand_x[b]   = x_[b];
+            cand_y[b]   = y_[b];
+            cand_rot[b] = rotacion_[b];
+            switch (acciones[b]) {
+                case ACCION_IZQUIERDA: cand_x[b]--; break;
+                case ACCION_DERECHA:   cand_x[b]++; break;
+                case ACCION_ROTAR:     cand_rot[b] = static_cast<unsigned char>((cand_rot[b] + 1) % NUM_ROTACIONES); break;
+                case ACCION_BAJAR:     cand_y[b]++; break;
+                default: continue;
             }
-            buf << "\033[91;1m" << msg << "\033[0m\n";
-            buf << "\033[91mPresiona R para reiniciar o ESC para salir\033[0m\n\n";
-        }
-        if (pausado) {
-            string msg = config.strings.count("mensaje_pausa")
-                       ? config.strings["mensaje_pausa"]
-                       : string("PAUSA - Presiona P para continuar");
-            buf << "\033[95;1m" << msg << "\033[0m\n\n";
+            indices[m++] = b;
         }
-
-        // Marco superior
-        buf << "\033[90m         ";
-        for (int i = 0; i < ancho_tablero; ++i) {
-            buf << ((i == 0 || i == ancho_tablero - 1) ? "+" : "=");
+        colisiones(&indices[0], m);
+        int rechazadas = 0;
+        for (int i = 0; i < m; ++i) {
+            int b = indices[i];
+            if (choca[b]) {
+                if (acciones[b] == ACCION_ROTAR) indices[rechazadas++] = b;
+                continue;
+            }
+            x_[b]        = cand_x[b];
+            y_[b]        = cand_y[b];
+            rotacion_[b] = cand_rot[b];
         }
-        buf << "\033[0m\n";
 
-        // Tablero
-        for (int y = 0; y < alto_tablero; ++y) {
-            buf << "\033[90m         |\033[0m";
-            for (int x = 0; x < ancho_tablero; ++x) {
-                char   ch  = ' ';
-                string col = "\033[37m";
-                if (Posicion(x, y) == fruta_posicion) {
-                    // Obtener color según el tipo de fruta actual
-                    string color_fruta = "rojo";  // Por defecto
-                    
-                    // Buscar color específico del tipo de fruta
-                    string clave_color = "color_" + fruta_tipo_actual;
-                    if (config.strings.count(clave_color)) {
-                        color_fruta = config.strings[clave_color];
-                    } else {
-                        // Valores por defecto según tipo de fruta
-                        if (fruta_tipo_actual == "manzana") color_fruta = "rojo";
-                        else if (fruta_tipo_actual == "cereza") color_fruta = "rojo";
-                        else if (fruta_tipo_actual == "banana") color_fruta = "amarillo";
-                        else if (fruta_tipo_actual == "uva") color_fruta = "magenta";
-                        else if (fruta_tipo_actual == "naranja") color_fruta = "naranja";
-                        else {
-                            // Fallback al color_fruta general
-                            color_fruta = config.strings.count("color_fruta")
-                                        ? config.strings["color_fruta"]
-                                        : string("rojo");
-                        }
-                    }
-                    
-                    ch  = '@';
-                    col = colorConsola.obtenerColorAnsi(color_fruta);
-                } else {
-                    bool es_cuerpo = false;
-                    for (size_t i = 0; i < cuerpo_snake.size(); ++i) {
-                        if (cuerpo_snake[i] == Posicion(x, y)) {
-                            es_cuerpo = true;
-                            vector<string> colores;
-                            if (config.arrays.count("colores_snake")) {
-                                colores = config.arrays["colores_snake"];
-                            } else {
-                                colores.push_back("verde_claro"); colores.push_back("verde_oscuro"); colores.push_back("verde_medio");
-                            }
-                            if (i == 0 && !colores.empty()) {
-                                col = colorConsola.obtenerColorAnsi(colores[0]);
-                                ch  = 'O';
-                            } else {
-                                if (colores.size() > 1) {
-                                    col = colorConsola.obtenerColorAnsi(colores[1]);
-                                }
-                                ch = '#';
-                            }
-                            break;
-                        }
-                    }
-                    if (!es_cuerpo) {
-                        ch  = '.';
-                        col = "\033[90m";
-                    }
+        // Rotaciones que chocaron: patadas SRS, una prueba por ronda para todos
+        m = rechazadas;
+        for (int k = 1; k < NUM_PATADAS_SRS && m > 0; ++k) {
+            for (int i = 0; i < m; ++i) {
+                int b = indices[i];
+                PatadaSRS d = patadaSRS(static_cast<TipoPieza>(tipo_[b]), rotacion_[b], 0, k);
+                cand_x[b] = x_[b] + d.dx;
+                cand_y[b] = y_[b] + d.dy;
+            }
+            colisiones(&indices[0], m);
+            int quedan = 0;
+            for (int i = 0; i < m; ++i) {
+                int b = indices[i];
+                if (choca[b]) {
+                    indices[quedan++] = b;
+                    continue;
                 }
-                buf << col << ch << "\033[0m";
+                x_[b]        = cand_x[b];
+                y_[b]        = cand_y[b];
+                rotacion_[b] = cand_rot[b];
             }
-            buf << "\033[90m|\033[0m\n";
+            m = quedan;
         }
 
-        // Marco inferior
-        buf << "\033[90m         ";
-        for (int i = 0; i < ancho_tablero; ++i) {
-            buf << ((i == 0 || i == ancho_tablero - 1) ? "+" : "=");
+        // Caída instantánea: bajan en bloque los tableros que aún caben
+        m = 0;
+        for (int b = 0; b < n; ++b) {
+            if (acciones[b] == ACCION_CAIDA) indices[m++] = b;
+        }
+        while (m > 0) {
+            for (int i = 0; i < m; ++i) {
+                int b = indices[i];
+                cand_x[b]   = x_[b];
+                cand_y[b]   = y_[b] + 1;
+                cand_rot[b] = rotacion_[b];
+            }
+            colisiones(&indices[0], m);
+            int quedan = 0;
+            for (int i = 0; i < m; ++i) {
+                int b = indices[i];
+                if (choca[b]) continue;
+                y_[b] = cand_y[b];
+                indices[quedan++] = b;
+            }
+            m = quedan;
         }
-        buf << "\033[0m\n";
 
-        buf << "\033[92mCargado desde AST: " << titulo << " | Configuracion completa desde Snake.brik\033[0m\n";
+        // Gravedad: una fila por paso; la pieza que no puede bajar se fija
+        for (int b = 0; b < n; ++b) {
+            cand_x[b]   = x_[b];
+            cand_y[b]   = y_[b] + 1;
+            cand_rot[b] = rotacion_[b];
+            indices[b]  = b;
+        }
+        colisiones(&indices[0], n);
+        m = 0;
+        for (int b = 0; b < n; ++b) {
+            if (!choca[b]) {
+                y_[b] = cand_y[b];
+                continue;
+            }
+            fijar(b);
+            fijada[b]    = 1;
+            indices[m++] = b;
+        }
+        eliminarLineas();
 
-        cout << buf.str();
-        cout.flush();
-    }
-public:
-    void ejecutar() {
-        DWORD proximo = GetTickCount() + velocidad_ms;
-        while (juego_activo) {
-            DWORD inicio = GetTickCount();
-            procesarEntrada();
-            if (inicio >= proximo) {
-                actualizarFisica();
-                proximo += velocidad_ms;
+        // Nuevas piezas; si la de aparición no cabe, la partida termina
+        for (int i = 0; i < m; ++i) {
+            int b = indices[i];
+            aparecer(b);
+            cand_x[b]   = x_[b];
+            cand_y[b]   = y_[b];
+            cand_rot[b] = rotacion_[b];
+        }
+        colisiones(&indices[0], m);
+        for (int i = 0; i < m; ++i) {
+            int b = indices[i];
+            if (choca[b]) {
+                terminado_[b] = 1;
+                partidas_terminadas++;
             }
-            renderizar();
-            Sleep(16); // Suaviza render (~60 FPS)
         }
     }
-};
 
-// ============================================================================
-// FUNCIÓN: compilarJuegoSiPosible
-// ============================================================================
-// Intenta compilar el juego especificado antes de ejecutarlo.
-// Esto asegura que el AST esté actualizado con la última configuración.
-// @param juego Nombre del juego a compilar ("tetris" o "snake")
-// ============================================================================
-static void compilarJuegoSiPosible(const string& juego) {
-    // Construir comando de compilación según el juego
-    string comando;
-    if (juego == "tetris") {
-        comando = "bin\\compilador.exe config\\games\\Tetris.brik";
-    } else if (juego == "snake") {
-        comando = "bin\\compilador.exe config\\games\\Snake.brik";
-    } else {
-        return;  // Juego no reconocido
-    }
-    
-    // Verificar que el compilador existe antes de ejecutarlo
-    DWORD attrs = GetFileAttributesA("bin\\compilador.exe");
-    if (attrs != INVALID_FILE_ATTRIBUTES && !(attrs & FILE_ATTRIBUTE_DIRECTORY)) {
-        system(comando.c_str());
-    }
-}
+    int  tamanio() const { return n; }
+    int  anchoTablero() const { return ancho; }
+    int  altoTablero() const { return alto; }
+    long partidasTerminadas() const { return partidas_terminadas; }
+
+    // Filas intercaladas: la fila y del tablero b está en filas()[y * pasoFilas() + b]
+    const FilaBits*      filas() const { return &filas_[0]; }
+    int                  pasoFilas() const { return paso_filas; }
+    const unsigned char* tipos() const { return &tipo_[0]; }
+    const unsigned char* rotaciones() const { return &rotacion_[0]; }
+    const unsigned char* siguientes() const { return &siguiente_[0]; }
+    const int*           posicionesX() const { return &x_[0]; }
+    const int*           posicionesY() const { return &y_[0]; }
+    const int*           puntos() const { return &puntos_[0]; }
+    const int*           lineas() const { return &lineas_[0]; }
+    const int*           recompensas() const { return &recompensa_[0]; }
+    const unsigned char* terminados() const { return &terminado_[0]; }
+};
 
 // ============================================================================
 // RENDERIZADOR GDI (WINDOWS) - Alternativa ligera compatible con Windows XP
@@ -1667,7 +6732,7 @@ static void compilarJuegoSiPosible(const string& juego) {
 // Características:
 //   - Renderizado en ventana nativa de Windows
 //   - Doble buffer para evitar parpadeo
-//   - Manejo de entrada mediante GetAsyncKeyState
+//   - Entrada por los mensajes WM_KEYDOWN y WM_KEYUP de la ventana
 //   - Soporte completo para Tetris y Snake
 //
 // Compilar con: g++ -DUSE_GDI -o runtime runtime.cpp -lgdi32 -luser32
@@ -1684,6 +6749,76 @@ static void compilarJuegoSiPosible(const string& juego) {
 static HWND g_hWnd = NULL;      // Handle de la ventana principal
 static bool g_running = true;    // Flag para controlar el bucle principal
 
+class EntradaGDI;
+static EntradaGDI* g_entrada = NULL;  // Recibe las teclas de la ventana (NULL sin partida en curso)
+
+// ============================================================================
+// CLASE: EntradaGDI
+// ============================================================================
+// Teclas de los motores GDI. El procedimiento de la ventana le pasa los
+// WM_KEYDOWN y WM_KEYUP, y ella deja en la cola un evento por cada cambio
+// de una tecla que usa el juego, al pulsar y al soltar (la repetición
+// automática de una tecla mantenida no cambia nada). Así el motor ve las
+// pulsaciones cortas aunque duren menos que un cuadro, y solo las que
+// recibe la ventana: al perder el foco se dan por soltadas todas. Los
+// mensajes los despacha el propio bucle del juego, que ya despierta con
+// ellos, así que no hace falta otro hilo. Cada evento lleva el instante del
+// mensaje (GetMessageTime) y no el de su despacho, que espera a que termine
+// de dibujarse el cuadro en curso.
+//
+// El estado publicado de una tecla solo cambia cuando su evento entra en la
+// cola. Si estaba llena, el cambio queda pendiente y se vuelve a intentar al
+// sacar (ya con el instante de entonces): una suelta perdida dejaría la
+// tecla pulsada para siempre.
+// Solo hay una a la vez: mientras existe, es la que recibe los mensajes.
+// ============================================================================
+class EntradaGDI {
+private:
+    ColaSPSC<EventoTecla, CAPACIDAD_TECLAS> cola;
+    vector<int>  teclas;    // Códigos de tecla virtual vigilados
+    vector<bool> reales;    // Estado según los mensajes recibidos
+    vector<bool> pulsadas;  // Último estado publicado de cada una
+
+    // Publica en 'ms' los cambios que aún no están en la cola; para si se llena
+    void publicarPendientes(DWORD ms) {
+        for (size_t i = 0; i < teclas.size(); ++i) {
+            if (reales[i] == pulsadas[i]) continue;
+            EventoTecla e = { ms, teclas[i], reales[i] };
+            if (!cola.meter(e)) return;
+            pulsadas[i] = reales[i];
+        }
+    }
+public:
+    EntradaGDI(const int* vigiladas, int n)
+        : teclas(vigiladas, vigiladas + n), reales(n, false), pulsadas(n, false) {
+        g_entrada = this;
+    }
+
+    ~EntradaGDI() {
+        if (g_entrada == this) g_entrada = NULL;
+    }
+
+    // WM_KEYDOWN o WM_KEYUP de la tecla virtual 'tecla', enviado en 'ms'
+    void alCambiar(int tecla, bool pulsada, DWORD ms) {
+        for (size_t i = 0; i < teclas.size(); ++i) {
+            if (teclas[i] == tecla) reales[i] = pulsada;
+        }
+        publicarPendientes(ms);
+    }
+
+    // WM_KILLFOCUS: sin foco no llegarían las sueltas
+    void soltarTodas(DWORD ms) {
+        for (size_t i = 0; i < reales.size(); ++i) reales[i] = false;
+        publicarPendientes(ms);
+    }
+
+    bool sacar(EventoTecla& e) {
+        if (cola.sacar(e)) return true;
+        publicarPendientes(GetTickCount());
+        return cola.sacar(e);
+    }
+};
+
 
 LRESULT CALLBACK GDIWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
@@ -1697,6 +6832,18 @@ LRESULT CALLBACK GDIWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
             // Cerrar la ventana
             DestroyWindow(hwnd);
             return 0;
+
+        case WM_KEYDOWN:
+        case WM_KEYUP:
+            if (g_entrada) {
+                g_entrada->alCambiar(static_cast<int>(wParam), msg == WM_KEYDOWN,
+                                     static_cast<DWORD>(GetMessageTime()));
+            }
+            return 0;
+
+        case WM_KILLFOCUS:
+            if (g_entrada) g_entrada->soltarTodas(static_cast<DWORD>(GetMessageTime()));
+            return 0;
     }
     return DefWindowProc(hwnd, msg, wParam, lParam);
 }
@@ -1763,29 +6910,35 @@ static COLORREF ColorRGB(int r, int g, int b) {
     return RGB(r, g, b); 
 }
 
+// Byte que graba una sesión en ventana para una pulsación o suelta (ver GrabadorRepeticion)
+static char codigoTeclaVentana(int tecla, bool pulsada) {
+    return static_cast<char>(pulsada ? tecla : (tecla | TECLA_SOLTADA));
+}
+
 // ============================================================================
 // CLASE: TetrisEngineGDI
 // ============================================================================
 // Motor de Tetris con renderizado gráfico usando GDI (Graphics Device Interface).
 // Esta implementación es compatible con Windows XP y no requiere DLLs externas.
 // Utiliza ventanas nativas de Windows y funciones GDI para el renderizado.
+// El tipo de tablero (dimensiones fijas o genéricas) es parámetro de plantilla.
 // ============================================================================
+template <class Tablero>
 class TetrisEngineGDI {
 public:
-    // Constantes del tablero de Tetris
-    static const int ANCHO = 10;  // Ancho del tablero en celdas
-    static const int ALTO  = 20;  // Alto del tablero en celdas
-    
     // Configuración de renderizado
     int cell;      // Tamaño de cada celda en píxeles
     int offsetX;   // Desplazamiento horizontal del tablero en píxeles
     int offsetY;   // Desplazamiento vertical del tablero en píxeles
 
     // Estado del juego
-    vector<vector<TipoPieza> > tablero;  // Matriz que representa el tablero
-    PiezaTetris* pieza_actual;           // Pieza que está cayendo actualmente
-    PiezaTetris* siguiente_pieza;        // Siguiente pieza que aparecerá
     ConfigTetris config;                  // Configuración cargada desde AST
+    Tablero tablero;                      // Tablero con dimensiones de la configuración
+    PiezaTetris pieza_actual;                            // Pieza que está cayendo actualmente
+    AnilloPiezas<CAPACIDAD_COLA_PIEZAS> cola_siguientes; // Próximas piezas (la primera es la siguiente)
+    GeneradorPiezas generador_piezas;                    // Bolsa o uniforme, según el .brik
+    GeneradorAleatorio aleatorio;                        // Generador propio de la partida
+    uint32_t semilla_partida;                            // Semilla con la que empieza cada sesión
 
     // Estadísticas y progreso
     int puntos;              // Puntuación actual del jugador
@@ -1803,25 +6956,28 @@ public:
     bool game_over;     // Indica si el juego ha terminado
 
     // Temporizadores para control de movimiento
-    DWORD ultima_caida;        // Último momento en que la pieza cayó automáticamente
-    DWORD last_horiz_move;     // Último momento de movimiento horizontal
-    DWORD last_soft_drop;     // Último momento de caída rápida (tecla S)
+    PlanificadorEventos planificador;  // Gravedad, bloqueo, DAS/ARR y caída rápida
+    DWORD reloj;               // Último instante atendido (ms)
     DWORD last_rotate;         // Último momento de rotación
     
-    // Estados anteriores de teclas para detección de flanco
-    bool w_presionada_anterior;      // Estado anterior de la tecla W
-    bool space_presionada_anterior;  // Estado anterior de la tecla Espacio
+    // Teclas mantenidas, según los eventos de EntradaGDI
+    bool a_pulsada;                  // Tecla A (izquierda)
+    bool d_pulsada;                  // Tecla D (derecha)
+    bool s_pulsada;                  // Tecla S (caída rápida)
+    int  direccion_repeticion;       // -1 (A) o +1 (D): sentido que repite EVENTO_REPETICION
 
     /**
      * Constructor del motor de Tetris GDI.
+     * @param cfg Configuración ya cargada (y ajustada) desde el AST
      * @param forced_cell Tamaño forzado de celda en píxeles (0 = usar configuración AST)
      */
-    TetrisEngineGDI(int forced_cell = 0) 
+    TetrisEngineGDI(const ConfigTetris& cfg, int forced_cell = 0) 
         : cell(24)
         , offsetX(20)
         , offsetY(20)
-        , pieza_actual(NULL)
-        , siguiente_pieza(NULL)
+        , config(cfg)
+        , tablero(config.ancho_tablero, config.alto_tablero)
+        , generador_piezas(config)
         , puntos(0)
         , velocidad_caida(800)
         , nivel(1)
@@ -1834,22 +6990,19 @@ public:
         , pausado(false)
         , game_over(false) {
         
-        // Inicializar tablero vacío
-        tablero.assign(ALTO, vector<TipoPieza>(ANCHO, VACIO));
-        
         // Inicializar temporizadores
-        DWORD ahora = GetTickCount();
-        ultima_caida = ahora;
-        last_horiz_move = ahora;
-        last_soft_drop = ahora;
-        last_rotate = ahora;
+        reloj = GetTickCount();
+        last_rotate = reloj;
         
         // Inicializar estados de teclas
-        w_presionada_anterior = false;
-        space_presionada_anterior = false;
+        a_pulsada = false;
+        d_pulsada = false;
+        s_pulsada = false;
+        direccion_repeticion = 0;
         
-        // Inicializar generador de números aleatorios
-        srand((unsigned)time(NULL));
+        // Inicializar el generador de la partida
+        semilla_partida = resolverSemilla(config.semilla);
+        aleatorio.sembrar(semilla_partida);
         
         // Aplicar configuración desde AST
         if (forced_cell > 0) {
@@ -1863,37 +7016,36 @@ public:
         // Generar primera pieza y siguiente pieza
         generarNuevaPieza();
         generarSiguientePieza();
+        reiniciarTemporizadoresPieza(reloj);
     }
 
     /**
-     * Destructor: libera la memoria de las piezas.
+     * Devuelve la forma precalculada de una pieza en la rotación indicada.
+     * @param p Pieza consultada
+     * @param rotacion Índice de rotación (0-3)
      */
-    ~TetrisEngineGDI() { 
-        delete pieza_actual;
-        delete siguiente_pieza;
+    const FormaPieza& forma(const PiezaTetris& p, int rotacion) const {
+        return config.tabla_rotaciones.forma(p.tipo, rotacion);
     }
+
     /**
      * Genera una nueva pieza que comenzará a caer.
-     * Si hay una siguiente pieza preparada, la usa; si no, genera una aleatoria.
+     * Toma la primera pieza de la cola de siguientes; si la cola está vacía
+     * la rellena antes. Las piezas son valores, no se reserva memoria.
      */
     void generarNuevaPieza() {
-        if (siguiente_pieza) {
-            // Usar la siguiente pieza que ya estaba preparada
-            delete pieza_actual;
-            pieza_actual = siguiente_pieza;
-            siguiente_pieza = NULL;
-        } else {
-            // Generar una nueva pieza aleatoria
-            pieza_actual = new PiezaTetris(static_cast<TipoPieza>(rand() % 7), config);
+        if (cola_siguientes.vacio()) {
+            generarSiguientePieza();
         }
+        pieza_actual = PiezaTetris(cola_siguientes.extraer());
         
         // Posicionar la pieza en la parte superior central del tablero
-        pieza_actual->x = ANCHO / 2 - 2;
-        pieza_actual->y = 0;
-        pieza_actual->rotacion_actual = 0;
+        pieza_actual.x = tablero.ancho() / 2 - 2;
+        pieza_actual.y = 0;
+        pieza_actual.rotacion_actual = 0;
         
         // Verificar si la pieza puede colocarse (si no, game over)
-        if (!esMovimientoValido(pieza_actual->x, pieza_actual->y, pieza_actual->rotacion_actual)) {
+        if (!esMovimientoValido(pieza_actual.x, pieza_actual.y, pieza_actual.rotacion_actual)) {
             game_over = true;
             // NO cerrar el juego, permitir reiniciar
             // juego_activo se mantiene en true para que el bucle continúe
@@ -1901,154 +7053,120 @@ public:
     }
 
     /**
-     * Genera la siguiente pieza que aparecerá después de la actual.
-     * Esta pieza se prepara de antemano para una transición suave.
+     * Repone la cola de siguientes hasta cubrir la vista previa. Las piezas
+     * se generan por tandas de siete (una bolsa barajada o siete uniformes).
      */
     void generarSiguientePieza() {
-        siguiente_pieza = new PiezaTetris(static_cast<TipoPieza>(rand() % 7), config);
+        generador_piezas.reponer(cola_siguientes, aleatorio);
     }
    
+    /**
+     * Comprueba si la pieza actual cabe en la posición y rotación dadas.
+     * La comprobación se hace fila a fila con las máscaras de bits del tablero.
+     */
     bool esMovimientoValido(int nx, int ny, int nr) {
-        if (!pieza_actual) {
-            return false;
-        }
-        
-        vector<vector<int> >& forma = pieza_actual->rotaciones[nr];
-        int h = (int)forma.size();
-        int w = (int)forma[0].size();
-
-        // Verificar cada bloque de la pieza
-        for (int py = 0; py < h; ++py) {
-            for (int px = 0; px < w; ++px) {
-                if (forma[py][px] == 1) {
-                    int wx = nx + px;
-                    int wy = ny + py;
-                    
-                    // Verificar límites del tablero
-                    if (wx < 0 || wx >= ANCHO || wy >= ALTO) {
-                        return false;
-                    }
-                    
-                    // Verificar colisión con bloques ya colocados
-                    if (wy >= 0 && tablero[wy][wx] != VACIO) {
-                        return false;
-                    }
-                }
-            }
-        }
-        
-        return true;
+        return tablero.cabe(forma(pieza_actual, nr), nx, ny);
     }
     /**
      * Fija la pieza actual en el tablero cuando no puede seguir cayendo.
      * Después de fijar, verifica líneas completas y genera nuevas piezas.
      */
     void fijarPieza() {
-        if (!pieza_actual) {
-            return;
-        }
-        
-        // Obtener la forma actual de la pieza según su rotación
-        vector<vector<int> >& forma = pieza_actual->rotaciones[pieza_actual->rotacion_actual];
-        int h = (int)forma.size();
-        int w = (int)forma[0].size();
-
-        // Colocar cada bloque de la pieza en el tablero
-        for (int py = 0; py < h; ++py) {
-            for (int px = 0; px < w; ++px) {
-                if (forma[py][px] == 1) {
-                    int wx = pieza_actual->x + px;
-                    int wy = pieza_actual->y + py;
-                    
-                    // Solo colocar si está dentro de los límites del tablero
-                    if (wy >= 0 && wx >= 0 && wx < ANCHO && wy < ALTO) {
-                        tablero[wy][wx] = pieza_actual->tipo;
-                    }
-                }
-            }
-        }
+        const FormaPieza& f = forma(pieza_actual, pieza_actual.rotacion_actual);
+        tablero.fijar(f, pieza_actual.x, pieza_actual.y, pieza_actual.tipo);
         
-        // Verificar y eliminar líneas completas
-        verificarLineasCompletas();
+        // Verificar y eliminar líneas completas (solo las filas que tocó la pieza)
+        verificarLineasCompletas(pieza_actual.y + f.fila_min, pieza_actual.y + f.fila_max);
         
         // Generar nueva pieza y preparar la siguiente
         generarNuevaPieza();
         generarSiguientePieza();
+        reiniciarTemporizadoresPieza(reloj);
+    }
+
+    /**
+     * Indica si la pieza actual puede bajar una fila.
+     */
+    bool puedeBajar() {
+        return esMovimientoValido(pieza_actual.x, pieza_actual.y + 1, pieza_actual.rotacion_actual);
+    }
+
+    /**
+     * Programa la gravedad de una pieza recién aparecida y cancela los
+     * temporizadores de bloqueo de la anterior.
+     * @param ahora Momento actual en ms
+     */
+    void reiniciarTemporizadoresPieza(DWORD ahora) {
+        planificador.cancelar(EVENTO_BLOQUEO);
+        planificador.cancelar(EVENTO_FIJACION_MAXIMA);
+        planificador.programar(EVENTO_GRAVEDAD, ahora + velocidad_caida);
     }
 
     /**
-     * Elimina las líneas completas del tablero y hace caer las líneas superiores.
-     * @param lineas Vector con los índices de las líneas a eliminar
+     * Se llama tras mover, rotar o bajar la pieza. Si quedó apoyada, arranca
+     * o reinicia el retardo de bloqueo (tiempo_antes_de_bloquear); el tope
+     * total (tiempo_fijacion_pieza) cuenta desde que se apoyó por primera vez.
+     * Si vuelve a tener hueco debajo, ambos temporizadores se cancelan.
+     * @param ahora Momento actual en ms
      */
-    void eliminarLineas(const vector<int>& lineas) {
-        if (lineas.empty()) {
+    void alMoverPieza(DWORD ahora) {
+        if (puedeBajar()) {
+            planificador.cancelar(EVENTO_BLOQUEO);
+            planificador.cancelar(EVENTO_FIJACION_MAXIMA);
             return;
         }
-        
-        // Crear un vector de booleanos para marcar qué líneas eliminar
-        vector<bool> marcar_eliminar(ALTO, false);
-        for (size_t i = 0; i < lineas.size(); ++i) {
-            if (lineas[i] >= 0 && lineas[i] < ALTO) {
-                marcar_eliminar[lineas[i]] = true;
-            }
+        if (config.tiempo_antes_de_bloquear <= 0) {
+            fijarPieza();
+            return;
         }
-        
-        // Crear nuevo tablero copiando solo las líneas que NO se eliminan
-        vector<vector<TipoPieza> > nuevo_tablero(ALTO, vector<TipoPieza>(ANCHO, VACIO));
-        int destino = ALTO - 1;
-        
-        // Copiar líneas de abajo hacia arriba, saltando las que se eliminan
-        // Esto hace que las líneas superiores "caigan" automáticamente
-        for (int origen = ALTO - 1; origen >= 0; --origen) {
-            if (!marcar_eliminar[origen]) {
-                // Esta línea se mantiene, copiarla a su nueva posición
-                for (int x = 0; x < ANCHO; ++x) {
-                    nuevo_tablero[destino][x] = tablero[origen][x];
-                }
-                destino--;
-            }
+        planificador.programar(EVENTO_BLOQUEO, ahora + config.tiempo_antes_de_bloquear);
+        if (config.tiempo_fijacion_pieza > 0 && !planificador.pendiente(EVENTO_FIJACION_MAXIMA)) {
+            planificador.programar(EVENTO_FIJACION_MAXIMA, ahora + config.tiempo_fijacion_pieza);
         }
-        
-        // Las líneas superiores ya están con VACIO por defecto
-        // Reemplazar el tablero antiguo con el nuevo
-        tablero = nuevo_tablero;
     }
 
     /**
-     * Verifica si hay líneas completas en el tablero y las elimina.
-     * También actualiza la puntuación, nivel y velocidad según las líneas eliminadas.
+     * Mueve la pieza una columna si cabe.
+     * @param dx -1 izquierda, +1 derecha
      */
-    void verificarLineasCompletas() {
-        vector<int> lineas_completas;
-        
-        // Revisar cada línea del tablero
-        for (int y = 0; y < ALTO; ++y) {
-            bool completa = true;
-            
-            // Verificar si todos los espacios de la línea están ocupados
-            for (int x = 0; x < ANCHO; ++x) {
-                if (tablero[y][x] == VACIO) {
-                    completa = false;
-                    break;
-                }
-            }
-            
-            // Si la línea está completa, agregarla a la lista
-            if (completa) {
-                lineas_completas.push_back(y);
-            }
+    void moverHorizontal(int dx, DWORD ahora) {
+        if (esMovimientoValido(pieza_actual.x + dx, pieza_actual.y, pieza_actual.rotacion_actual)) {
+            pieza_actual.x += dx;
+            alMoverPieza(ahora);
+        }
+    }
+
+    /**
+     * Baja la pieza una fila (caída rápida); si no puede, la fija.
+     */
+    void bajarUnaFila(DWORD ahora) {
+        if (puedeBajar()) {
+            pieza_actual.y++;
+            alMoverPieza(ahora);
+        } else {
+            fijarPieza();
         }
+    }
+
+    /**
+     * Verifica si hay líneas completas entre las filas indicadas y las elimina.
+     * Solo se revisan las filas que ocupó la última pieza fijada; cada fila
+     * se compara contra la máscara de fila llena del tablero.
+     * También actualiza la puntuación, nivel y velocidad según las líneas eliminadas.
+     * @param fila_desde Primera fila a revisar
+     * @param fila_hasta Última fila a revisar (inclusive)
+     */
+    void verificarLineasCompletas(int fila_desde, int fila_hasta) {
+        // Eliminar las líneas completas del tablero
+        int eliminadas = tablero.eliminarLineasCompletas(fila_desde, fila_hasta);
         
         // Si hay líneas completas, procesarlas
-        if (!lineas_completas.empty()) {
-            // Eliminar las líneas del tablero
-            eliminarLineas(lineas_completas);
-            
+        if (eliminadas > 0) {
             // Calcular puntos según el número de líneas eliminadas
-            calcularPuntos((int)lineas_completas.size());
+            calcularPuntos(eliminadas);
             
             // Actualizar contador de líneas completadas
-            lineas_completadas += (int)lineas_completas.size();
+            lineas_completadas += eliminadas;
             
             // Calcular nuevo nivel basado en líneas completadas
             int nivel_base = (config.nivel_inicial > 0) ? config.nivel_inicial : 1;
@@ -2111,11 +7229,7 @@ public:
      */
     void reiniciarJuego() {
         // Limpiar el tablero
-        for (int y = 0; y < ALTO; ++y) {
-            for (int x = 0; x < ANCHO; ++x) {
-                tablero[y][x] = VACIO;
-            }
-        }
+        tablero.vaciar();
         
         // Resetear estadísticas
         puntos = 0;
@@ -2132,158 +7246,207 @@ public:
         juego_activo = true;
         pausado = false;
 
-        // Liberar piezas actuales
-        delete pieza_actual;
-        delete siguiente_pieza;
-        pieza_actual = NULL;
-        siguiente_pieza = NULL;
+        // Descartar las piezas en cola
+        cola_siguientes.vaciar();
 
         // Reiniciar temporizadores
-        DWORD ahora = GetTickCount();
-        ultima_caida = ahora;
-        last_horiz_move = ahora;
-        last_soft_drop = ahora;
+        DWORD ahora = reloj;
+        planificador.vaciar();
         last_rotate = ahora;
         
-        // Resetear estados de teclas
-        w_presionada_anterior = false;
-        space_presionada_anterior = false;
+        // Las teclas mantenidas siguen mantenidas: solo se olvida la repetición
+        direccion_repeticion = 0;
         
         // Generar nuevas piezas
         generarNuevaPieza();
         generarSiguientePieza();
+        reiniciarTemporizadoresPieza(ahora);
     }
     /**
-     * Actualiza la física del juego: hace caer la pieza automáticamente.
-     * Se ejecuta en cada frame del juego.
+     * Atiende los eventos del planificador vencidos en 'ahora': gravedad,
+     * bloqueo de la pieza apoyada y repetición de las teclas mantenidas.
+     * Cada uno se procesa en su instante de vencimiento, como en la consola:
+     * el resultado no depende de cuándo despierte el bucle y una repetición
+     * lo reproduce igual.
      */
-    void actualizarFisica() {
+    void actualizarFisica(DWORD ahora) {
         // No actualizar si el juego está pausado o terminado
         if (pausado || game_over) {
+            reloj = ahora;
             return;
         }
 
-        DWORD ahora = GetTickCount();
-        
-        // Verificar si ha pasado el tiempo suficiente para que la pieza caiga
-        if (ahora - ultima_caida >= (DWORD)velocidad_caida) {
-            // Intentar mover la pieza hacia abajo
-            if (esMovimientoValido(pieza_actual->x, pieza_actual->y + 1, pieza_actual->rotacion_actual)) {
-                pieza_actual->y++;
-            } else {
-                // Si no puede bajar más, fijar la pieza en el tablero
-                fijarPieza();
+        int   evento;
+        DWORD vencio;
+        while (!game_over && planificador.extraerVencido(ahora, evento, &vencio)) {
+            reloj = vencio;
+            switch (evento) {
+                case EVENTO_GRAVEDAD:
+                    // Bajar una fila; al apoyarse empieza el retardo de bloqueo
+                    if (puedeBajar()) {
+                        pieza_actual.y++;
+                        if (!puedeBajar()) alMoverPieza(vencio);
+                    } else if (!planificador.pendiente(EVENTO_BLOQUEO)) {
+                        alMoverPieza(vencio);
+                    }
+                    if (!planificador.pendiente(EVENTO_GRAVEDAD)) {
+                        planificador.programar(EVENTO_GRAVEDAD, vencio + velocidad_caida);
+                    }
+                    break;
+                case EVENTO_BLOQUEO:
+                case EVENTO_FIJACION_MAXIMA:
+                    if (!puedeBajar()) fijarPieza();
+                    break;
+                case EVENTO_REPETICION: {
+                    // ARR: repetir mientras siga pulsada la tecla que arrancó el DAS
+                    if (direccion_repeticion < 0 ? a_pulsada : d_pulsada) {
+                        moverHorizontal(direccion_repeticion, vencio);
+                        planificador.programar(EVENTO_REPETICION, vencio + config.intervalo_repeticion);
+                    }
+                    break;
+                }
+                case EVENTO_CAIDA_RAPIDA:
+                    if (s_pulsada) {
+                        bajarUnaFila(vencio);
+                        planificador.programar(EVENTO_CAIDA_RAPIDA, vencio + config.velocidad_caida_rapida);
+                    }
+                    break;
             }
-            
-            ultima_caida = ahora;
         }
+        reloj = ahora;
     }
     /**
-     * Procesa todas las entradas del teclado del jugador.
-     * Maneja movimiento horizontal, rotación, caída rápida, pausa y reinicio.
+     * Al salir de la pausa los temporizadores vencidos cuentan de nuevo desde
+     * 'ahora' (si no, la gravedad y las repeticiones recuperarían de golpe
+     * todo el tiempo en pausa).
      */
-    void procesarTeclas() {
-        // Reiniciar juego si está en game over
-        if (game_over && (GetAsyncKeyState('R') & 0x8000)) {
-            reiniciarJuego();
-            Sleep(200);  // Pequeño delay para evitar múltiples reinicios
-            return;
+    void reanudarTemporizadores(DWORD ahora) {
+        planificador.programar(EVENTO_GRAVEDAD, ahora + velocidad_caida);
+        if (planificador.pendiente(EVENTO_REPETICION)) {
+            planificador.programar(EVENTO_REPETICION, ahora + config.intervalo_repeticion);
         }
-        
-        // No procesar movimiento si está pausado o en game over
-        if (pausado || game_over) {
-            if (GetAsyncKeyState('P') & 0x8000) { 
-                if (!game_over) {
-                    pausado = !pausado; 
-                    Sleep(200); 
-                }
-            }
-            if (GetAsyncKeyState(VK_ESCAPE) & 0x8000) juego_activo = false;
-            return;
+        if (planificador.pendiente(EVENTO_CAIDA_RAPIDA)) {
+            planificador.programar(EVENTO_CAIDA_RAPIDA, ahora + config.velocidad_caida_rapida);
         }
-        
-        DWORD ahora = GetTickCount();
-        
-        // ============================================================
-        // MOVIMIENTO HORIZONTAL (A = izquierda, D = derecha)
-        // ============================================================
-        // Rate limiting: solo permite un movimiento cada 120ms
-        if ((GetAsyncKeyState('A') & 0x8000) && (ahora - last_horiz_move >= 120)) {
-            if (esMovimientoValido(pieza_actual->x - 1, pieza_actual->y, pieza_actual->rotacion_actual)) {
-                pieza_actual->x--;
-            }
-            last_horiz_move = ahora;
+        if (planificador.pendiente(EVENTO_BLOQUEO)) {
+            planificador.cancelar(EVENTO_FIJACION_MAXIMA);
+            alMoverPieza(ahora);
         }
-        
-        if ((GetAsyncKeyState('D') & 0x8000) && (ahora - last_horiz_move >= 120)) {
-            if (esMovimientoValido(pieza_actual->x + 1, pieza_actual->y, pieza_actual->rotacion_actual)) {
-                pieza_actual->x++;
-            }
-            last_horiz_move = ahora;
+    }
+    /**
+     * Procesa las teclas que recogió la ventana, en orden y cada una en el
+     * instante en que cambió: antes se atienden los eventos del
+     * planificador vencidos hasta entonces. Como EntradaGDI publica al pulsar
+     * y al soltar, no hace falta comparar con el estado del cuadro anterior ni
+     * esperar para no repetir R o P. Cada tecla se graba aquí, con su
+     * instante relativo al comienzo de la sesión.
+     * @param entrada  Teclas recibidas por la ventana
+     * @param inicio   Instante real en que empezó la sesión
+     * @param grabador Si no es NULL, graba la sesión como repetición
+     */
+    void procesarTeclas(EntradaGDI& entrada, DWORD inicio, GrabadorRepeticion* grabador) {
+        EventoTecla e;
+        while (juego_activo && entrada.sacar(e)) {
+            // Un mensaje anterior a lo ya atendido cuenta desde ahí (en vivo y al reproducir)
+            DWORD ms = PlanificadorEventos::antes(e.ms, reloj) ? reloj : e.ms;
+            if (grabador) grabador->registrar(ms - inicio, codigoTeclaVentana(e.tecla, e.pulsada));
+            aplicarTecla(e.tecla, e.pulsada, ms);
         }
-        
-        // ============================================================
-        // CAÍDA RÁPIDA (S = bajar manualmente)
-        // ============================================================
-        // Rate limiting: solo permite un movimiento cada 80ms
-        if ((GetAsyncKeyState('S') & 0x8000) && (ahora - last_soft_drop >= 80)) {
-            if (esMovimientoValido(pieza_actual->x, pieza_actual->y + 1, pieza_actual->rotacion_actual)) {
-                pieza_actual->y++;
-            } else {
-                // Si no puede bajar más, fijar la pieza
-                fijarPieza();
+    }
+    /**
+     * Atiende los eventos vencidos hasta 'ahora' y aplica una pulsación o
+     * suelta. Es el único punto de entrada de teclas, en vivo y al reproducir.
+     */
+    void aplicarTecla(int tecla, bool pulsada, DWORD ahora) {
+        actualizarFisica(ahora);
+        if (pulsada) alPulsar(tecla, ahora);
+        else         alSoltar(tecla);
+    }
+    /**
+     * Maneja movimiento horizontal, rotación, caídas, pausa y reinicio.
+     * @param tecla Código de tecla virtual
+     * @param ahora Instante de la pulsación
+     */
+    void alPulsar(int tecla, DWORD ahora) {
+        if (tecla == 'A') a_pulsada = true;
+        if (tecla == 'D') d_pulsada = true;
+        if (tecla == 'S') s_pulsada = true;
+
+        // Salir, reiniciar (también durante el juego) y pausar
+        if (tecla == VK_ESCAPE) { juego_activo = false; return; }
+        if (tecla == 'R')       { reiniciarJuego(); return; }
+        if (tecla == 'P') {
+            if (!game_over) {
+                pausado = !pausado;
+                if (!pausado) reanudarTemporizadores(ahora);
             }
-            last_soft_drop = ahora;
+            return;
         }
-        
-        // ============================================================
-        // ROTACIÓN (W o Espacio = rotar pieza)
-        // ============================================================
-        // Usar detección de flanco para evitar rotaciones continuas
-        bool w_actual = (GetAsyncKeyState('W') & 0x8000) != 0;
-        bool space_actual = (GetAsyncKeyState(VK_SPACE) & 0x8000) != 0;
-        
-        // Rotar solo cuando la tecla cambia de no presionada a presionada (flanco de subida)
-        if ((w_actual && !w_presionada_anterior) || (space_actual && !space_presionada_anterior)) {
-            DWORD ahoraR = GetTickCount();
-            
-            // Delay mínimo de 150ms para evitar rotaciones demasiado rápidas
-            if (ahoraR - last_rotate >= 150) {
-                // Calcular siguiente rotación (cíclica)
-                int siguiente_rotacion = (pieza_actual->rotacion_actual + 1) % (int)pieza_actual->rotaciones.size();
-                
-                // Solo rotar si el movimiento es válido
-                if (esMovimientoValido(pieza_actual->x, pieza_actual->y, siguiente_rotacion)) {
-                    pieza_actual->rotacion_actual = siguiente_rotacion;
-                }
-                
-                last_rotate = ahoraR;
+
+        // No procesar movimiento si está pausado o en game over
+        if (pausado || game_over) return;
+
+        switch (tecla) {
+            // ============================================================
+            // MOVIMIENTO HORIZONTAL (A = izquierda, D = derecha)
+            // ============================================================
+            // Al pulsar se mueve una columna; si se mantiene, EVENTO_REPETICION
+            // repite tras retardo_repeticion (DAS) cada intervalo_repeticion (ARR)
+            case 'A':
+            case 'D': {
+                int dx = (tecla == 'A') ? -1 : 1;
+                moverHorizontal(dx, ahora);
+                direccion_repeticion = dx;
+                planificador.programar(EVENTO_REPETICION, ahora + config.retardo_repeticion);
+                break;
             }
+            // ============================================================
+            // CAÍDA RÁPIDA (S = bajar manualmente)
+            // ============================================================
+            // Al pulsar baja una fila; mantenida, EVENTO_CAIDA_RAPIDA sigue
+            // bajando cada velocidad_caida_rapida ms
+            case 'S':
+                bajarUnaFila(ahora);
+                planificador.programar(EVENTO_CAIDA_RAPIDA, ahora + config.velocidad_caida_rapida);
+                break;
+            // ============================================================
+            // ROTACIÓN (W o Espacio = rotar pieza)
+            // ============================================================
+            case 'W':
+            case VK_SPACE:
+                // Delay mínimo de 150ms para evitar rotaciones demasiado rápidas
+                if (ahora - last_rotate >= 150) {
+                    // Rotar en sentido horario; si choca, probar las patadas SRS
+                    if (rotarSRS(config.tabla_rotaciones, pieza_actual, true,
+                                 tablero.datosFilas(), tablero.ancho(), tablero.alto())) {
+                        alMoverPieza(ahora);
+                    }
+                    last_rotate = ahora;
+                }
+                break;
+            // ============================================================
+            // CAÍDA INSTANTÁNEA (X = soltar la pieza)
+            // ============================================================
+            case 'X':
+                pieza_actual.y += tablero.caida(forma(pieza_actual, pieza_actual.rotacion_actual),
+                                                pieza_actual.x, pieza_actual.y);
+                fijarPieza();
+                break;
         }
-        
-        // Actualizar estado anterior de las teclas para la próxima iteración
-        w_presionada_anterior = w_actual;
-        space_presionada_anterior = space_actual;
-        
-        // ============================================================
-        // CONTROLES DEL JUEGO
-        // ============================================================
-        // Reiniciar juego (también funciona durante el juego)
-        if (GetAsyncKeyState('R') & 0x8000) {
-            reiniciarJuego();
-            Sleep(200);  // Pequeño delay para evitar múltiples reinicios
-        }
-        
-        // Pausar/despausar juego
-        if (GetAsyncKeyState('P') & 0x8000) {
-            pausado = !pausado;
-            Sleep(200);  // Pequeño delay para evitar múltiples cambios
-        }
-        
-        // Salir del juego
-        if (GetAsyncKeyState(VK_ESCAPE) & 0x8000) {
-            juego_activo = false;
+    }
+    /**
+     * Al soltar A y D se deja de repetir el movimiento; al soltar S, la
+     * caída rápida.
+     * @param tecla Código de tecla virtual
+     */
+    void alSoltar(int tecla) {
+        if (tecla == 'A') a_pulsada = false;
+        if (tecla == 'D') d_pulsada = false;
+        if (tecla == 'S') {
+            s_pulsada = false;
+            planificador.cancelar(EVENTO_CAIDA_RAPIDA);
         }
+        if (!a_pulsada && !d_pulsada) planificador.cancelar(EVENTO_REPETICION);
     }
     /**
      * Renderiza todo el juego en el contexto de dispositivo especificado.
@@ -2291,12 +7454,15 @@ public:
      * @param hdc Contexto de dispositivo donde dibujar
      */
     void renderizar(HDC hdc) {
-        // Limpiar el fondo con color oscuro
-        FillRectColor(hdc, 0, 0, 800, 700, ColorRGB(20, 20, 30));
+        // Limpiar el fondo con color oscuro (toda el área cliente: el tamaño
+        // de la ventana depende de las dimensiones del tablero)
+        RECT area;
+        GetClientRect(g_hWnd, &area);
+        FillRectColor(hdc, 0, 0, area.right - area.left, area.bottom - area.top, ColorRGB(20, 20, 30));
         
         // Calcular dimensiones del tablero
-        int boardW = ANCHO * cell;
-        int boardH = ALTO * cell;
+        int boardW = tablero.ancho() * cell;
+        int boardH = tablero.alto() * cell;
         
         // Dibujar borde del tablero (gris oscuro)
         FillRectColor(hdc, offsetX - 2, offsetY - 2, boardW + 4, boardH + 4, ColorRGB(100, 100, 100));
@@ -2305,25 +7471,13 @@ public:
         FillRectColor(hdc, offsetX, offsetY, boardW, boardH, ColorRGB(40, 40, 50));
         
         // Dibujar celdas del tablero
-        for (int y = 0; y < ALTO; ++y) {
-            for (int x = 0; x < ANCHO; ++x) {
+        for (int y = 0; y < tablero.alto(); ++y) {
+            for (int x = 0; x < tablero.ancho(); ++x) {
                 COLORREF color_celda = ColorRGB(30, 30, 40);  // Color por defecto (vacío)
                 
                 // Si la celda está ocupada, usar el color de la pieza
-                if (tablero[y][x] != VACIO) {
-                    // Convertir TipoPieza a string para buscar el color
-                    string tipo_str;
-                    switch (tablero[y][x]) {
-                        case I: tipo_str = "I"; break;
-                        case J: tipo_str = "J"; break;
-                        case L: tipo_str = "L"; break;
-                        case O: tipo_str = "O"; break;
-                        case S: tipo_str = "S"; break;
-                        case Z: tipo_str = "Z"; break;
-                        case T: tipo_str = "T"; break;
-                        default: tipo_str = "I"; break;
-                    }
-                    vector<int> rgb = config.obtenerColorRGB(tipo_str);
+                if (tablero.ocupada(x, y)) {
+                    vector<int> rgb = config.obtenerColorRGB(nombreTipoPieza(tablero.tipo(x, y)));
                     if (rgb.size() >= 3) {
                         color_celda = ColorRGB(rgb[0], rgb[1], rgb[2]);
                     } else {
@@ -2341,20 +7495,43 @@ public:
             }
         }
         
+        // Dibujar pieza fantasma (posición de apoyo) con el color atenuado
+        {
+            const FormaPieza& f = forma(pieza_actual, pieza_actual.rotacion_actual);
+            int fantasma_y = pieza_actual.y + tablero.caida(f, pieza_actual.x, pieza_actual.y);
+            vector<int> rgb = config.obtenerColorRGB(nombreTipoPieza(pieza_actual.tipo));
+            COLORREF color_fantasma = (rgb.size() >= 3)
+                ? ColorRGB(rgb[0] / 3 + 20, rgb[1] / 3 + 20, rgb[2] / 3 + 20)
+                : ColorRGB(70, 70, 80);
+            for (int py = 0; py < f.alto; ++py) {
+                for (int px = 0; px < f.ancho; ++px) {
+                    int by = fantasma_y + py;
+                    if (f.ocupa(px, py) && by >= 0) {
+                        FillRectColor(hdc,
+                            offsetX + (pieza_actual.x + px) * cell + 1,
+                            offsetY + by * cell + 1,
+                            cell - 2,
+                            cell - 2,
+                            color_fantasma);
+                    }
+                }
+            }
+        }
+
         // Dibujar pieza actual que está cayendo
-        if (pieza_actual) {
-            vector<vector<int> >& forma = pieza_actual->rotaciones[pieza_actual->rotacion_actual];
+        {
+            const FormaPieza& f = forma(pieza_actual, pieza_actual.rotacion_actual);
             
-            for (int py = 0; py < (int)forma.size(); ++py) {
-                for (int px = 0; px < (int)forma[0].size(); ++px) {
-                    if (forma[py][px] == 1) {
-                        int bx = pieza_actual->x + px;
-                        int by = pieza_actual->y + py;
+            for (int py = 0; py < f.alto; ++py) {
+                for (int px = 0; px < f.ancho; ++px) {
+                    if (f.ocupa(px, py)) {
+                        int bx = pieza_actual.x + px;
+                        int by = pieza_actual.y + py;
                         
                         // Solo dibujar si la pieza está dentro del tablero visible
                         if (by >= 0) {
                             // Usar el color RGB de la pieza desde la configuración
-                            vector<int> rgb = config.obtenerColorRGB(pieza_actual->tipo_str);
+                            vector<int> rgb = config.obtenerColorRGB(nombreTipoPieza(pieza_actual.tipo));
                             COLORREF color_pieza;
                             if (rgb.size() >= 3) {
                                 color_pieza = ColorRGB(rgb[0], rgb[1], rgb[2]);
@@ -2430,6 +7607,8 @@ public:
         currentY += lineHeight;
         TextOutA(hdc, panelX, currentY, "S - Bajar rapido", 16);
         currentY += lineHeight;
+        TextOutA(hdc, panelX, currentY, "X - Soltar", 10);
+        currentY += lineHeight;
         TextOutA(hdc, panelX, currentY, "W/ESP - Rotar", 14);
         currentY += lineHeight;
         TextOutA(hdc, panelX, currentY, "P - Pausa", 9);
@@ -2467,22 +7646,79 @@ public:
         SetTextColor(hdc, RGB(255, 255, 255));
     }
 
+    /**
+     * Vuelve a simular una repetición grabada en ventana, a toda velocidad y
+     * sin dibujar, hasta el instante 'hasta' o hasta su final. El reloj de
+     * la sesión empieza en 0 como al grabar (ver run()).
+     * En el resumen, ticks son los ms reproducidos.
+     */
+    ResumenPartida reproducir(const Repeticion& rep, DWORD hasta) {
+        reloj = 0;
+        a_pulsada = d_pulsada = s_pulsada = false;
+        aleatorio.sembrar(rep.semilla);
+        reiniciarJuego();
+        for (size_t i = 0; i < rep.entradas.size() && rep.entradas[i].ms <= hasta && juego_activo; ++i) {
+            uint8_t codigo = static_cast<uint8_t>(rep.entradas[i].tecla);
+            aplicarTecla(codigo & ~TECLA_SOLTADA, (codigo & TECLA_SOLTADA) == 0, rep.entradas[i].ms);
+        }
+        if (juego_activo) actualizarFisica(min(hasta, rep.duracion));
+        ResumenPartida r;
+        r.puntos     = puntos;
+        r.ticks      = static_cast<long>(reloj);
+        r.eventos    = lineas_completadas;
+        r.detalle[0] = contador_linea_simple;
+        r.detalle[1] = contador_linea_doble;
+        r.detalle[2] = contador_linea_triple;
+        r.detalle[3] = contador_linea_tetris;
+        r.terminada  = game_over;
+        return r;
+    }
+
     /**
      * Ejecuta el bucle principal del juego.
      * Maneja mensajes de Windows, procesa entrada, actualiza física y renderiza.
-     * Usa doble buffer para evitar parpadeo.
+     * Usa doble buffer para evitar parpadeo. La partida empieza de nuevo con
+     * la semilla de la sesión y el reloj en 0, así la grabación se puede
+     * reproducir con reproducir().
+     * @param grabador Si no es NULL, graba la sesión como repetición
      */
-    void run() {
+    void run(GrabadorRepeticion* grabador = NULL) {
         // Crear contexto de dispositivo para la ventana
         HDC hdcWindow = GetDC(g_hWnd);
         
-        // Crear contexto de memoria para doble buffer
+        // Crear contexto de memoria para doble buffer del tamaño del área cliente
+        RECT area;
+        GetClientRect(g_hWnd, &area);
+        int bufW = area.right - area.left;
+        int bufH = area.bottom - area.top;
         HDC memDC = CreateCompatibleDC(hdcWindow);
-        HBITMAP hbm = CreateCompatibleBitmap(hdcWindow, 800, 700);
+        HBITMAP hbm = CreateCompatibleBitmap(hdcWindow, bufW, bufH);
         HBITMAP oldbm = (HBITMAP)SelectObject(memDC, hbm);
         
+        // Teclas del juego que recoge la ventana
+        static const int TECLAS[] = { 'A', 'D', 'S', 'W', VK_SPACE, 'X', 'R', 'P', VK_ESCAPE };
+        EntradaGDI entrada(TECLAS, sizeof(TECLAS) / sizeof(TECLAS[0]));
+
+        DWORD inicio = GetTickCount();
+        reloj = inicio;
+        aleatorio.sembrar(semilla_partida);
+        reiniciarJuego();
+        if (grabador) {
+            grabador->grabarEnVentana();
+            grabador->comenzar(semilla_partida);
+        }
+
         // Bucle principal del juego
         while (juego_activo && g_running) {
+            // Dormir hasta el próximo evento del planificador o hasta que
+            // llegue un mensaje (teclas, repintado, cierre de la ventana)
+            DWORD espera = (pausado || game_over)
+                         ? ESPERA_MAXIMA_MS
+                         : planificador.espera(GetTickCount(), ESPERA_MAXIMA_MS);
+            if (espera > 0) {
+                MsgWaitForMultipleObjects(0, NULL, FALSE, espera, QS_ALLINPUT);
+            }
+
             // Procesar mensajes de Windows
             MSG msg;
             while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
@@ -2495,22 +7731,20 @@ public:
             }
             
             // Procesar entrada (incluye reinicio si hay game over)
-            procesarTeclas();
+            procesarTeclas(entrada, inicio, grabador);
             
             // Actualizar física solo si no está pausado ni en game over
             if (!pausado && !game_over) {
-                actualizarFisica();
+                actualizarFisica(GetTickCount());
             }
             
             // Renderizar siempre (muestra game over si es necesario)
             renderizar(memDC);
             
             // Copiar buffer de memoria a la ventana (blit)
-            BitBlt(hdcWindow, 0, 0, 800, 700, memDC, 0, 0, SRCCOPY);
-            
-            // Pequeña pausa para no saturar la CPU (~60 FPS)
-            Sleep(16);
+            BitBlt(hdcWindow, 0, 0, bufW, bufH, memDC, 0, 0, SRCCOPY);
         }
+        if (grabador) grabador->terminar(GetTickCount() - inicio);
         
         // Limpiar recursos de GDI
         SelectObject(memDC, oldbm);
@@ -2520,100 +7754,205 @@ public:
     }
 };
 
+/**
+ * Instancia el motor GDI con el tablero adecuado a las dimensiones de la
+ * configuración (ver conTableroTetris).
+ * @param cfg Configuración ya cargada desde el AST
+ * @param forced_cell Tamaño de celda en píxeles
+ */
+struct AccionGDITetris {
+    const ConfigTetris& cfg;
+    int                 forced_cell;
+    GrabadorRepeticion* grabador;
+
+    AccionGDITetris(const ConfigTetris& c, int celda, GrabadorRepeticion* g) : cfg(c), forced_cell(celda), grabador(g) {}
+
+    template <class Tablero> void ejecutar() {
+        TetrisEngineGDI<Tablero> engine(cfg, forced_cell);
+        engine.run(grabador);
+    }
+};
+
+static void ejecutarTetrisGDI(const ConfigTetris& cfg, int forced_cell, GrabadorRepeticion* grabador = NULL) {
+    AccionGDITetris accion(cfg, forced_cell, grabador);
+    conTableroTetris(cfg, accion);
+}
+
+// Igual que reproducirTetris para una sesión grabada en ventana (sin dibujar)
+struct AccionReproducirTetrisGDI {
+    const ConfigTetris& cfg;
+    const Repeticion&   rep;
+    DWORD               hasta;
+    ResumenPartida      resultado;
+
+    AccionReproducirTetrisGDI(const ConfigTetris& c, const Repeticion& r, DWORD h) : cfg(c), rep(r), hasta(h) {}
+
+    template <class Tablero> void ejecutar() {
+        TetrisEngineGDI<Tablero> engine(cfg);
+        resultado = engine.reproducir(rep, hasta);
+    }
+};
+
+static ResumenPartida reproducirTetrisGDI(const ConfigTetris& cfg, const Repeticion& rep, DWORD hasta) {
+    AccionReproducirTetrisGDI accion(cfg, rep, hasta);
+    conTableroTetris(cfg, accion);
+    return accion.resultado;
+}
+
 // --- Minimal Snake GDI ---
 class SnakeEngineGDI {
 public:
     int cell; int offsetX, offsetY; int ancho_tablero, alto_tablero; int velocidad_ms;
-    vector<Posicion> cuerpo; Posicion fruta; Posicion direccion;
-    string fruta_tipo_actual;  // Tipo de fruta actual para GDI
+    CuerpoSnake cuerpo; Posicion direccion;
+    ColaGiros giros;               // Giros pendientes, uno por paso
+    Posicion direccion_encolada;  // La que quedará tras los giros pendientes
+    MapaOcupacion ocupacion;  // Segmentos, frutas y obstáculos por casilla
+    TablaFrutas frutas;        // Reglas por tipo, compiladas de la configuración
+    vector<COLORREF> colores_fruta;  // Color de cada tipo, resuelto al cargar
+    FrutasTablero frutas_tablero;  // Frutas en juego y reapariciones pendientes
+    int frutas_simultaneas;    // Frutas en el tablero a la vez
+    bool bordes_solidos;       // false: los bordes no son pared y se da la vuelta
     bool juego_activo; bool pausado; bool game_over; int puntos;
-    // Contadores de frutas comidas
-    int contador_manzana, contador_cereza, contador_banana, contador_uva, contador_naranja;
+    vector<int> contadores_fruta;  // Frutas comidas por tipo (índice de 'frutas')
     int total_frutas_comidas;  // Total de todas las frutas comidas
-    DWORD ultima;
+    int respawn_fruta_ms;      // Espera hasta la siguiente fruta (0 = inmediata)
+    PlanificadorEventos planificador;  // Pasos de la serpiente y reaparición de la fruta
+    DWORD reloj;               // Último instante atendido (ms)
     SnakeAST config;
+    GeneradorAleatorio aleatorio;  // Generador propio de la partida
+    uint32_t semilla_partida;      // Semilla con la que empieza cada sesión
     SnakeEngineGDI(): cell(18), offsetX(20), offsetY(60), ancho_tablero(25), alto_tablero(20), velocidad_ms(150) {
-        srand((unsigned)time(NULL)); juego_activo=true; pausado=false; game_over=false; puntos=0; ultima=GetTickCount();
-        contador_manzana=0; contador_cereza=0; contador_banana=0; contador_uva=0; contador_naranja=0; total_frutas_comidas=0;
-        cargarConfiguracion(); inicializarJuego();
+        juego_activo=true; pausado=false; game_over=false; puntos=0; respawn_fruta_ms=0;
+        frutas_simultaneas=1; bordes_solidos=true; total_frutas_comidas=0; reloj=0;
+        cargarConfiguracion();
+        semilla_partida = resolverSemilla(config.integers.count("semilla") ? config.integers["semilla"] : 0);
+        aleatorio.sembrar(semilla_partida);
+        inicializarJuego();
+    }
+    void cargarConfiguracion() { if (!config.cargarDesdeAST("build/arbol.ast")) { ancho_tablero=25; alto_tablero=20; velocidad_ms=150; } else { ancho_tablero = config.integers.count("ancho_tablero")?config.integers["ancho_tablero"]:25; alto_tablero = config.integers.count("alto_tablero")?config.integers["alto_tablero"]:20; velocidad_ms = config.integers.count("velocidad_inicial")?config.integers["velocidad_inicial"]:150; respawn_fruta_ms = config.integers.count("respawn_fruta_ms")?config.integers["respawn_fruta_ms"]:0; frutas_simultaneas = config.integers.count("frutas_simultaneas")?max(1, config.integers["frutas_simultaneas"]):1; bordes_solidos = config.booleans.count("bordes_solidos")?config.booleans["bordes_solidos"]:true; } compilarFrutas(); }
+    void compilarFrutas() {
+        frutas.compilar(config);
+        colores_fruta.clear();
+        for (int i = 0; i < frutas.tamanio(); ++i) colores_fruta.push_back(colorFrutaRGB(frutas[i].color));
+    }
+    static COLORREF colorFrutaRGB(const string& nombre) {
+        if (nombre == "amarillo") return ColorRGB(255, 255, 0);
+        if (nombre == "magenta")  return ColorRGB(255, 0, 255);
+        if (nombre == "naranja")  return ColorRGB(255, 165, 0);
+        if (nombre == "verde")    return ColorRGB(0, 255, 0);
+        if (nombre == "azul")     return ColorRGB(0, 100, 255);
+        if (nombre == "cian")     return ColorRGB(0, 255, 255);
+        if (nombre == "blanco")   return ColorRGB(255, 255, 255);
+        return ColorRGB(255, 80, 80);  // Rojo
     }
-    void cargarConfiguracion() { if (!config.cargarDesdeAST("build/arbol.ast")) { ancho_tablero=25; alto_tablero=20; velocidad_ms=150; } else { ancho_tablero = config.integers.count("ancho_tablero")?config.integers["ancho_tablero"]:25; alto_tablero = config.integers.count("alto_tablero")?config.integers["alto_tablero"]:20; velocidad_ms = config.integers.count("velocidad_inicial")?config.integers["velocidad_inicial"]:150; } }
     void inicializarJuego() { 
-        cuerpo.clear(); 
+        cuerpo.reservar(ancho_tablero*alto_tablero); 
+        ocupacion.dimensionar(ancho_tablero, alto_tablero);
         int cx=ancho_tablero/2, cy=alto_tablero/2; 
         int len = config.integers.count("longitud_inicial")?config.integers["longitud_inicial"]:3; 
-        for (int i=0;i<len;++i) cuerpo.push_back(Posicion(cx-i,cy)); 
+        for (int i=0;i<len;++i) agregarCola(Posicion(cx-i,cy)); 
         direccion = Posicion(1,0); 
-        fruta_tipo_actual = "manzana";  // Inicializar tipo de fruta
-        generarFruta(); 
-        puntos=0; 
+        giros.vaciar(); direccion_encolada = direccion;
+        planificador.cancelar(EVENTO_FRUTA);
         game_over=false;
+        frutas_tablero.vaciar();
+        vector<Posicion> obstaculos;
+        colocarObstaculos(config, ocupacion, aleatorio, Posicion(cx,cy), direccion, ancho_tablero, alto_tablero, obstaculos);
+        for (int i=0; i<frutas_simultaneas && !game_over; ++i) generarFruta(); 
+        puntos=0; 
         // Resetear contadores de frutas
-        contador_manzana=0; contador_cereza=0; contador_banana=0; contador_uva=0; contador_naranja=0; total_frutas_comidas=0; 
+        contadores_fruta.assign(frutas.tamanio(), 0); total_frutas_comidas=0; 
     }
     void generarFruta() { 
-        do { 
-            int rx = (rand()%(ancho_tablero-2))+1; 
-            int ry = (rand()%(alto_tablero-2))+1; 
-            fruta = Posicion(rx,ry); 
-        } while (ocupada(fruta));
-        
-        // Seleccionar tipo de fruta aleatorio
-        vector<string> frutas_disponibles;
-        if (config.arrays.count("frutas_disponibles")) {
-            frutas_disponibles = config.arrays["frutas_disponibles"];
-        } else {
-            frutas_disponibles.push_back("manzana");
-            frutas_disponibles.push_back("cereza");
-            frutas_disponibles.push_back("banana");
-        }
-        
-        if (!frutas_disponibles.empty()) {
-            fruta_tipo_actual = frutas_disponibles[rand() % frutas_disponibles.size()];
-        } else {
-            fruta_tipo_actual = "manzana";
-        }
+        if (frutas_tablero.generar(ocupacion, frutas, aleatorio)) return;
+        // Sin casillas libres ni frutas que comer la serpiente llenó el tablero
+        if (frutas_tablero.tamanio() == 0) game_over = true;
     }
-    bool ocupada(const Posicion& p) { for (size_t i=0;i<cuerpo.size();++i) if (cuerpo[i]==p) return true; return false; }
-    void procesarTeclas() {
-        // Reiniciar juego si está en game over
-        if (game_over && (GetAsyncKeyState('R') & 0x8000)) {
-            inicializarJuego();
-            Sleep(200);  // Pequeño delay para evitar múltiples reinicios
-            return;
+    bool ocupada(const Posicion& p) { return ocupacion.ocupada(p); }
+    // Cambios del cuerpo: siempre junto con el mapa de ocupación
+    void agregarCabeza(const Posicion& p) { cuerpo.agregarCabeza(p); ocupacion.ocupar(p); }
+    void agregarCola(const Posicion& p) { cuerpo.agregarCola(p); ocupacion.ocupar(p); }
+    void quitarCola() { ocupacion.liberar(cuerpo.cola()); cuerpo.quitarCola(); }
+    /**
+     * Procesa las pulsaciones que recogió la ventana, cada una en el
+     * instante en que llegó: antes se atienden los pasos vencidos hasta
+     * entonces. Los giros se encolan como en la consola, así dos giros
+     * rápidos ocupan dos pasos en lugar de pisarse. Cada pulsación se graba
+     * aquí, con su instante relativo al comienzo de la sesión.
+     * @param inicio   Instante real en que empezó la sesión
+     * @param grabador Si no es NULL, graba la sesión como repetición
+     */
+    void procesarTeclas(EntradaGDI& entrada, DWORD inicio, GrabadorRepeticion* grabador) {
+        EventoTecla e;
+        while (juego_activo && entrada.sacar(e)) {
+            if (!e.pulsada) continue;
+            // Un mensaje anterior a lo ya atendido cuenta desde ahí (en vivo y al reproducir)
+            DWORD ms = PlanificadorEventos::antes(e.ms, reloj) ? reloj : e.ms;
+            if (grabador) grabador->registrar(ms - inicio, codigoTeclaVentana(e.tecla, true));
+            aplicarTecla(e.tecla, ms);
         }
-        
-        // No procesar movimiento si está pausado o en game over
-        if (pausado || game_over) {
-            if (GetAsyncKeyState('P') & 0x8000) { 
+    }
+    // Atiende los pasos vencidos hasta 'ahora' y aplica una pulsación (en vivo y al reproducir)
+    void aplicarTecla(int tecla, DWORD ahora) {
+        atenderEventos(ahora);
+        switch (tecla) {
+            case VK_ESCAPE: juego_activo=false; break;
+            case 'R':
+                if (game_over) {
+                    inicializarJuego();
+                    planificador.programar(EVENTO_PASO, ahora + velocidad_ms);
+                }
+                break;
+            case 'P':
                 if (!game_over) {
-                    pausado = !pausado; 
-                    Sleep(200); 
+                    pausado = !pausado;
+                    // Al reanudar, el paso vencido durante la pausa cuenta desde ahora
+                    if (!pausado) planificador.programar(EVENTO_PASO, ahora + velocidad_ms);
+                }
+                break;
+            case 'W': encolarGiro(Posicion(0,-1), ahora); break;
+            case 'S': encolarGiro(Posicion(0, 1), ahora); break;
+            case 'A': encolarGiro(Posicion(-1,0), ahora); break;
+            case 'D': encolarGiro(Posicion( 1,0), ahora); break;
+        }
+    }
+    // Solo giros de 90 grados respecto al último encolado; si la cola está llena se ignora
+    void encolarGiro(const Posicion& d, DWORD ahora) {
+        if (pausado || game_over) return;
+        if (d.x * direccion_encolada.x + d.y * direccion_encolada.y != 0) return;
+        if (giros.meter(EventoDireccion(ahora, d))) direccion_encolada = d;
+    }
+    /**
+     * Atiende los eventos vencidos en 'ahora': un paso cada velocidad_ms
+     * (con el giro pendiente más antiguo) y la reaparición de la fruta.
+     * Cada uno se procesa en su instante de vencimiento, como en la consola,
+     * así una repetición lo reproduce igual.
+     */
+    void atenderEventos(DWORD ahora) {
+        reloj = ahora;
+        int   evento;
+        DWORD vencio;
+        while (!pausado && !game_over && planificador.extraerVencido(ahora, evento, &vencio)) {
+            if (evento == EVENTO_PASO) {
+                const EventoDireccion* g = giros.frente();
+                if (g) { direccion = g->direccion; giros.descartar(); }
+                actualizarFisica(vencio);
+                planificador.programar(EVENTO_PASO, vencio + velocidad_ms);
+            } else if (evento == EVENTO_FRUTA) {
+                // Reaparece la fruta comida hace más tiempo; las demás esperan su turno
+                frutas_tablero.sacarReaparicion();
+                generarFruta();
+                if (frutas_tablero.hayPendientes()) {
+                    planificador.programar(EVENTO_FRUTA, frutas_tablero.proximaReaparicion());
                 }
             }
-            if (GetAsyncKeyState(VK_ESCAPE) & 0x8000) juego_activo=false;
-            return;
         }
-        
-        // Controles de movimiento
-        if (GetAsyncKeyState('W') & 0x8000) if (direccion.y==0) direccion = Posicion(0,-1);
-        if (GetAsyncKeyState('S') & 0x8000) if (directionSafe(0,1)) direccion = Posicion(0,1);
-        if (GetAsyncKeyState('A') & 0x8000) if (direccion.x==0) direccion = Posicion(-1,0);
-        if (GetAsyncKeyState('D') & 0x8000) if (direccion.x==0) direccion = Posicion(1,0);
-        
-        // Pausa y salir
-        if (GetAsyncKeyState('P') & 0x8000) { pausado = !pausado; Sleep(200); }
-        if (GetAsyncKeyState(VK_ESCAPE) & 0x8000) juego_activo=false;
     }
-    bool directionSafe(int dx,int dy) { if (dx == -direccion.x && dy == -direccion.y) return false; return true; }
-    void actualizarFisica() { 
+    void actualizarFisica(DWORD ahora) { 
         if (pausado||game_over) return; 
-        DWORD ahora=GetTickCount(); 
-        if (ahora - ultima < (DWORD)velocidad_ms) return; 
-        ultima = ahora; 
         
         // Verificar que la serpiente tenga al menos un segmento
-        if (cuerpo.empty()) {
+        if (cuerpo.vacio()) {
             game_over = true;
             return;
         }
@@ -2623,7 +7962,8 @@ public:
             return; // No moverse si no hay dirección
         }
         
-        Posicion nueva(cuerpo[0].x+direccion.x, cuerpo[0].y+direccion.y);
+        Posicion cabeza = cuerpo.cabeza();
+        Posicion nueva(cabeza.x+direccion.x, cabeza.y+direccion.y);
         
         // Verificar configuración de colisiones
         bool fin_borde = config.booleans.count("terminar_al_chocar_borde")
@@ -2633,8 +7973,8 @@ public:
                         ? config.booleans["terminar_al_chocar_cuerpo"]
                         : true;
         
-        // Verificar colisión con bordes (mejorado)
-        if (fin_borde) {
+        // Verificar colisión con bordes (mejorado); sin bordes sólidos no hay pared
+        if (fin_borde && bordes_solidos) {
             // Verificar límites exactos del tablero
             if (nueva.x < 1 || nueva.x >= ancho_tablero - 1 || 
                 nueva.y < 1 || nueva.y >= alto_tablero - 1) {
@@ -2652,91 +7992,42 @@ public:
         // Verificar colisión con el cuerpo (mejorado)
         // IMPORTANTE: Solo verificamos colisión con segmentos que permanecerán después del movimiento
         // La cola (último segmento) se eliminará, así que no cuenta como colisión
-        if (fin_cuerpo) {
-            // Si hay menos de 2 segmentos, no puede haber colisión con el cuerpo
-            if (cuerpo.size() >= 2) {
-                // Verificar colisión con todos los segmentos excepto la cabeza (índice 0) y la cola (último índice)
-                size_t ultimo_indice = cuerpo.size() - 1;
-                for (size_t i = 1; i < ultimo_indice; ++i) {
-                    if (cuerpo[i] == nueva) {
-                        game_over = true;
-                        return;
-                    }
-                }
-            }
-        } 
-        cuerpo.insert(cuerpo.begin(), nueva); 
-        if (nueva==fruta) { 
-            // Calcular puntos según tipo de fruta
-            int pf = config.integers.count("puntos_por_fruta")?config.integers["puntos_por_fruta"]:10;
-            string clave_puntos = "puntos_" + fruta_tipo_actual;
-            if (config.integers.count(clave_puntos)) {
-                pf = config.integers[clave_puntos];
-            } else {
-                // Valores por defecto
-                if (fruta_tipo_actual == "manzana") pf = 10;
-                else if (fruta_tipo_actual == "cereza") pf = 20;
-                else if (fruta_tipo_actual == "banana") pf = 15;
-                else if (fruta_tipo_actual == "uva") pf = 25;
-                else if (fruta_tipo_actual == "naranja") pf = 30;
-            }
-            puntos += pf;
-            // Incrementar contador según el tipo de fruta
-            if (fruta_tipo_actual == "manzana") contador_manzana++;
-            else if (fruta_tipo_actual == "cereza") contador_cereza++;
-            else if (fruta_tipo_actual == "banana") contador_banana++;
-            else if (fruta_tipo_actual == "uva") contador_uva++;
-            else if (fruta_tipo_actual == "naranja") contador_naranja++;
+        if (fin_cuerpo && chocaConCuerpo(cuerpo, ocupacion, nueva)) {
+            game_over = true;
+            return;
+        }
+        // Lo que haya en la casilla se sabe por el mapa: obstáculo o fruta
+        int entidad = ocupacion.entidad(nueva);
+        if (entidad == OBSTACULO) {
+            game_over = true;
+            return;
+        }
+        agregarCabeza(nueva); 
+        if (entidad >= 0) { 
+            int tipo = frutas_tablero.comer(ocupacion, nueva);
+            const ReglaFruta& regla = frutas[tipo];
+            puntos += regla.puntos;
+            contadores_fruta[tipo]++;
             total_frutas_comidas++;  // Incrementar total
             
-            // Aplicar efectos de la fruta
-            // 1. Efecto de crecimiento (puede ser negativo para acortar)
-            int crecimiento = 1;  // Por defecto crece 1
-            string clave_crecimiento = "crecimiento_" + fruta_tipo_actual;
-            if (config.integers.count(clave_crecimiento)) {
-                crecimiento = config.integers[clave_crecimiento];
-            } else {
-                // Valores por defecto (actualizados según configuración)
-                if (fruta_tipo_actual == "manzana") crecimiento = -1;  // Disminuye 1
-                else if (fruta_tipo_actual == "cereza") crecimiento = 0;  // Sin crecimiento
-                else if (fruta_tipo_actual == "banana") crecimiento = 0;  // Sin crecimiento
-                else if (fruta_tipo_actual == "uva") crecimiento = 2;  // Aumenta 2
-                else if (fruta_tipo_actual == "naranja") crecimiento = 1;  // Normal (crece 1)
-            }
-            
             // Aplicar crecimiento (si es negativo, acortar la serpiente)
-            if (crecimiento > 0) {
+            if (regla.crecimiento > 0) {
                 // Crecer: agregar segmentos al final
-                for (int i = 0; i < crecimiento; ++i) {
-                    if (!cuerpo.empty()) {
-                        Posicion ultimo = cuerpo.back();
-                        cuerpo.push_back(ultimo);
+                for (int i = 0; i < regla.crecimiento; ++i) {
+                    if (!cuerpo.vacio()) {
+                        agregarCola(cuerpo.cola());
                     }
                 }
-            } else if (crecimiento < 0) {
+            } else if (regla.crecimiento < 0) {
                 // Acortar: eliminar segmentos del final (mínimo 1 segmento)
-                int acortar = -crecimiento;
-                for (int i = 0; i < acortar && cuerpo.size() > 1; ++i) {
-                    cuerpo.pop_back();
+                int acortar = -regla.crecimiento;
+                for (int i = 0; i < acortar && cuerpo.tamanio() > 1; ++i) {
+                    quitarCola();
                 }
             }
             
-            // 2. Efecto de velocidad (positivo = más lento, negativo = más rápido)
-            int cambio_velocidad = 0;  // Por defecto sin cambio
-            string clave_velocidad = "velocidad_" + fruta_tipo_actual;
-            if (config.integers.count(clave_velocidad)) {
-                cambio_velocidad = config.integers[clave_velocidad];
-            } else {
-                // Valores por defecto (actualizados según configuración)
-                if (fruta_tipo_actual == "manzana") cambio_velocidad = 0;  // Sin cambio
-                else if (fruta_tipo_actual == "cereza") cambio_velocidad = 20;  // Más lento
-                else if (fruta_tipo_actual == "banana") cambio_velocidad = -15;  // Más rápido
-                else if (fruta_tipo_actual == "uva") cambio_velocidad = 0;  // Sin cambio
-                else if (fruta_tipo_actual == "naranja") cambio_velocidad = 0;  // Normal (sin cambio)
-            }
-            
-            // Aplicar cambio de velocidad
-            velocidad_ms += cambio_velocidad;
+            // Cambio de velocidad (positivo = más lento, negativo = más rápido)
+            velocidad_ms += regla.cambio_velocidad;
             // Límites de velocidad (más bajo = más rápido, más alto = más lento)
             int velocidad_min = config.integers.count("velocidad_minima") 
                               ? config.integers["velocidad_minima"] 
@@ -2747,28 +8038,19 @@ public:
             if (velocidad_ms < velocidad_min) velocidad_ms = velocidad_min;
             if (velocidad_ms > velocidad_max) velocidad_ms = velocidad_max;
             
-            generarFruta(); 
+            if (respawn_fruta_ms > 0) {
+                // Vuelve a salir cuando le toque; solo la primera pendiente tiene temporizador
+                if (!frutas_tablero.hayPendientes()) {
+                    planificador.programar(EVENTO_FRUTA, ahora + respawn_fruta_ms);
+                }
+                frutas_tablero.encolarReaparicion(ahora + respawn_fruta_ms);
+            } else {
+                generarFruta(); 
+            }
         } else {
-            cuerpo.pop_back();
-        }
-    }
-    /**
-     * Obtiene los puntos de un tipo de fruta desde la configuración.
-     */
-    int obtenerPuntosFruta(const string& tipo) {
-        string clave = "puntos_" + tipo;
-        if (config.integers.count(clave)) {
-            return config.integers[clave];
+            quitarCola();
         }
-        // Valores por defecto
-        if (tipo == "manzana") return 10;
-        else if (tipo == "cereza") return 20;
-        else if (tipo == "banana") return 15;
-        else if (tipo == "uva") return 25;
-        else if (tipo == "naranja") return 30;
-        return 10;
     }
-    
     void renderizar(HDC hdc) {
         RECT r; 
         GetClientRect(g_hWnd, &r); 
@@ -2782,23 +8064,24 @@ public:
         FillRectColor(hdc, offsetX - 2, offsetY - 2, bw + 4, bh + 4, ColorRGB(100, 100, 100));
         FillRectColor(hdc, offsetX, offsetY, bw, bh, ColorRGB(30, 30, 40));
         
-        // Dibujar fruta con color según tipo
-        COLORREF color_fruta_rgb = ColorRGB(255, 80, 80);  // Rojo por defecto
-        if (fruta_tipo_actual == "manzana" || fruta_tipo_actual == "cereza") {
-            color_fruta_rgb = ColorRGB(255, 80, 80);  // Rojo
-        } else if (fruta_tipo_actual == "banana") {
-            color_fruta_rgb = ColorRGB(255, 255, 0);  // Amarillo
-        } else if (fruta_tipo_actual == "uva") {
-            color_fruta_rgb = ColorRGB(255, 0, 255);  // Magenta
-        } else if (fruta_tipo_actual == "naranja") {
-            color_fruta_rgb = ColorRGB(255, 165, 0);  // Naranja
+        // Dibujar obstáculos y frutas (cada fruta con el color de su tipo)
+        for (int y = 1; y < alto_tablero - 1; ++y) {
+            for (int x = 1; x < ancho_tablero - 1; ++x) {
+                if (ocupacion.entidad(x, y) == OBSTACULO) {
+                    FillRectColor(hdc, offsetX + x * cell + 1, offsetY + y * cell + 1, cell - 2, cell - 2, ColorRGB(128, 128, 128));
+                }
+            }
+        }
+        for (int i = 0; i < frutas_tablero.tamanio(); ++i) {
+            const FrutaEnTablero& f = frutas_tablero[i];
+            FillRectColor(hdc, offsetX + f.pos.x * cell + 2, offsetY + f.pos.y * cell + 2, cell - 4, cell - 4, colores_fruta[f.tipo]);
         }
-        FillRectColor(hdc, offsetX + fruta.x * cell + 2, offsetY + fruta.y * cell + 2, cell - 4, cell - 4, color_fruta_rgb);
         
         // Dibujar snake
-        for (size_t i = 0; i < cuerpo.size(); ++i) {
+        for (int i = 0; i < cuerpo.tamanio(); ++i) {
             COLORREF col = (i == 0) ? ColorRGB(200, 255, 200) : ColorRGB(0, 150, 0);
-            FillRectColor(hdc, offsetX + cuerpo[i].x * cell + 1, offsetY + cuerpo[i].y * cell + 1, cell - 2, cell - 2, col);
+            Posicion p = cuerpo[i];
+            FillRectColor(hdc, offsetX + p.x * cell + 1, offsetY + p.y * cell + 1, cell - 2, cell - 2, col);
         }
         
         // Configurar texto
@@ -2822,7 +8105,7 @@ public:
         currentY += lineHeight + 10;
         
         // Longitud
-        sprintf(buf, "Longitud: %d", (int)cuerpo.size());
+        sprintf(buf, "Longitud: %d", cuerpo.tamanio());
         TextOutA(hdc, panelX, currentY, buf, (int)strlen(buf));
         currentY += lineHeight;
         
@@ -2836,34 +8119,11 @@ public:
         currentY += lineHeight;
         
         // Dibujar cada tipo de fruta con su color, puntos y contador
-        vector<string> frutas;
-        frutas.push_back("manzana");
-        frutas.push_back("cereza");
-        frutas.push_back("banana");
-        frutas.push_back("uva");
-        frutas.push_back("naranja");
-        for (size_t i = 0; i < frutas.size(); ++i) {
-            string tipo = frutas[i];
-            int pts = obtenerPuntosFruta(tipo);
-            
-            // Obtener contador según el tipo de fruta
-            int contador = 0;
-            if (tipo == "manzana") contador = contador_manzana;
-            else if (tipo == "cereza") contador = contador_cereza;
-            else if (tipo == "banana") contador = contador_banana;
-            else if (tipo == "uva") contador = contador_uva;
-            else if (tipo == "naranja") contador = contador_naranja;
-            
-            // Dibujar cuadro de color de la fruta
-            COLORREF color_fr = ColorRGB(255, 80, 80);
-            if (tipo == "banana") color_fr = ColorRGB(255, 255, 0);
-            else if (tipo == "uva") color_fr = ColorRGB(255, 0, 255);
-            else if (tipo == "naranja") color_fr = ColorRGB(255, 165, 0);
-            
-            FillRectColor(hdc, panelX, currentY, 12, 12, color_fr);
+        for (int i = 0; i < frutas.tamanio(); ++i) {
+            FillRectColor(hdc, panelX, currentY, 12, 12, colores_fruta[i]);
             
             // Texto con nombre, puntos y contador
-            sprintf(buf, " %s: %d pts x%d", tipo.c_str(), pts, contador);
+            sprintf(buf, " %.40s: %d pts x%d", frutas[i].nombre.c_str(), frutas[i].puntos, contadores_fruta[i]);
             TextOutA(hdc, panelX + 15, currentY, buf, (int)strlen(buf));
             currentY += lineHeight;
         }
@@ -2907,17 +8167,64 @@ public:
         // Restaurar color de texto
         SetTextColor(hdc, RGB(255, 255, 255));
     }
+    /**
+     * Vuelve a simular una repetición grabada en ventana, a toda velocidad y
+     * sin dibujar, hasta el instante 'hasta' o hasta su final.
+     * En el resumen, ticks son los ms reproducidos.
+     */
+    ResumenPartida reproducir(const Repeticion& rep, DWORD hasta) {
+        aleatorio.sembrar(rep.semilla);
+        inicializarJuego();
+        pausado = false;
+        planificador.programar(EVENTO_PASO, velocidad_ms);
+        for (size_t i = 0; i < rep.entradas.size() && rep.entradas[i].ms <= hasta && juego_activo; ++i) {
+            uint8_t codigo = static_cast<uint8_t>(rep.entradas[i].tecla);
+            if (!(codigo & TECLA_SOLTADA)) aplicarTecla(codigo, rep.entradas[i].ms);
+        }
+        if (juego_activo) atenderEventos(min(hasta, rep.duracion));
+        ResumenPartida r;
+        r.puntos     = puntos;
+        r.ticks      = static_cast<long>(reloj);
+        r.eventos    = total_frutas_comidas;
+        for (int i = 0; i < frutas.tamanio() && i < NUM_DETALLES_PARTIDA; ++i) r.detalle[i] = contadores_fruta[i];
+        r.terminada  = game_over;
+        return r;
+    }
     /**
      * Ejecuta el bucle principal del juego.
      * Continúa ejecutándose incluso cuando hay game over para permitir reiniciar.
+     * La partida empieza de nuevo con la semilla de la sesión y el reloj en 0,
+     * así la grabación se puede reproducir con reproducir().
+     * @param grabador Si no es NULL, graba la sesión como repetición
      */
-    void run() {
+    void run(GrabadorRepeticion* grabador = NULL) {
         HDC hdcWindow = GetDC(g_hWnd);
         HDC memDC = CreateCompatibleDC(hdcWindow);
         HBITMAP hbm = CreateCompatibleBitmap(hdcWindow, 900, 700);
         HBITMAP oldbm = (HBITMAP)SelectObject(memDC, hbm);
         
+        // Teclas del juego que recoge la ventana
+        static const int TECLAS[] = { 'W', 'A', 'S', 'D', 'R', 'P', VK_ESCAPE };
+        EntradaGDI entrada(TECLAS, sizeof(TECLAS) / sizeof(TECLAS[0]));
+
+        DWORD inicio = GetTickCount();
+        aleatorio.sembrar(semilla_partida);
+        inicializarJuego();
+        planificador.programar(EVENTO_PASO, inicio + velocidad_ms);
+        if (grabador) {
+            grabador->grabarEnVentana();
+            grabador->comenzar(semilla_partida);
+        }
         while (juego_activo && g_running) {
+            // Dormir hasta el próximo paso o hasta que llegue un mensaje
+            // (teclas, repintado, cierre de la ventana)
+            DWORD espera = (pausado || game_over)
+                         ? ESPERA_MAXIMA_MS
+                         : planificador.espera(GetTickCount(), ESPERA_MAXIMA_MS);
+            if (espera > 0) {
+                MsgWaitForMultipleObjects(0, NULL, FALSE, espera, QS_ALLINPUT);
+            }
+
             // Procesar mensajes de Windows
             MSG msg;
             while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
@@ -2930,11 +8237,11 @@ public:
             }
             
             // Procesar entrada (incluye reinicio si hay game over)
-            procesarTeclas();
+            procesarTeclas(entrada, inicio, grabador);
             
-            // Actualizar física solo si no está pausado ni en game over
+            // Atender eventos solo si no está pausado ni en game over
             if (!pausado && !game_over) {
-                actualizarFisica();
+                atenderEventos(GetTickCount());
             }
             
             // Renderizar siempre (muestra game over si es necesario)
@@ -2942,10 +8249,8 @@ public:
             
             // Copiar buffer a la ventana
             BitBlt(hdcWindow, 0, 0, 900, 700, memDC, 0, 0, SRCCOPY);
-            
-            // Pequeña pausa para no saturar la CPU (~60 FPS)
-            Sleep(16);
         }
+        if (grabador) grabador->terminar(GetTickCount() - inicio);
         
         // Limpiar recursos de GDI
         SelectObject(memDC, oldbm);
@@ -2984,7 +8289,397 @@ ModoRenderizado seleccionarModo() {
 #endif
 }
 
-int main(){
+// ============================================================================
+// FUNCIÓN: ejecutarHeadless
+// ============================================================================
+// Compila la configuración del juego pedido, lo simula sin render y muestra
+// un resumen con el rendimiento alcanzado (ticks por segundo de reloj real).
+// @param op Opciones leídas de la línea de comandos
+// @return Código de salida del proceso
+// ============================================================================
+static int ejecutarHeadless(const OpcionesHeadless& op) {
+    if (op.juego != "tetris" && op.juego != "snake") {
+        cerr << "[Headless] Juego desconocido: " << op.juego << " (usar tetris o snake)\n";
+        return 1;
+    }
+    compilarJuegoSiPosible(op.juego);
+
+    uint32_t semilla_bot = (semillaLineaComandos != 0) ? semillaLineaComandos : 1;
+    GrabadorRepeticion* grabador = op.grabar.empty() ? NULL
+        : new GrabadorRepeticion(op.grabar, op.juego == "tetris" ? 'T' : 'S', "build/arbol.ast");
+    DWORD inicio = GetTickCount();
+    ResultadoSimulacion r;
+    if (op.juego == "tetris") {
+        ConfigTetris    cfg;
+        PoolTrabajo     pool;
+        PoliticaTetris* politica = crearPoliticaTetris(op, semilla_bot, &pool);
+        r = simularTetris(cfg, op, *politica, grabador);
+        delete politica;
+    } else {
+        SnakeEngine    s;
+        PoliticaSnake* politica = crearPoliticaSnake(op, semilla_bot);
+        r = s.simular(op, *politica, grabador);
+        delete politica;
+    }
+    DWORD ms = GetTickCount() - inicio;
+    delete grabador;
+
+    cout << "[Headless] juego=" << op.juego
+         << " ticks=" << r.ticks
+         << " tick_ms=" << op.tick_ms
+         << " partidas=" << r.partidas
+         << " puntos_totales=" << r.puntos_totales
+         << " mejor_puntaje=" << r.mejor_puntaje
+         << " " << (op.juego == "tetris" ? "lineas" : "frutas") << "=" << r.eventos
+         << " puntos_en_curso=" << r.puntos_en_curso << "\n";
+    cout << "[Headless] tiempo_real_ms=" << ms;
+    if (ms > 0) {
+        cout << " ticks_por_segundo=" << static_cast<long long>(r.ticks) * 1000 / ms;
+    }
+    cout << "\n";
+    if (!op.grabar.empty()) {
+        cout << "[Headless] repeticion=" << op.grabar << "\n";
+    }
+    return 0;
+}
+
+// ============================================================================
+// FUNCIÓN: ejecutarRepeticion
+// ============================================================================
+// Carga una repetición, compila la configuración de su juego y vuelve a
+// simular la partida a toda velocidad hasta el instante pedido; luego dibuja
+// el tablero de ese instante y muestra un resumen. Avisa si el AST actual no
+// es el mismo con el que se grabó (la partida podría divergir). Las sesiones
+// grabadas en ventana se reproducen con el motor GDI, sin dibujar, así que
+// requieren un runtime compilado con -DUSE_GDI.
+// @param ruta  Archivo .rpl
+// @param hasta Instante de la partida en ms (--hasta); por defecto, el final
+// @return Código de salida del proceso
+// ============================================================================
+static int ejecutarRepeticion(const string& ruta, DWORD hasta) {
+    Repeticion rep;
+    if (!rep.cargar(ruta)) {
+        cerr << "[Repeticion] No se pudo leer " << ruta << "\n";
+        return 1;
+    }
+    char   motor  = static_cast<char>(toupper(rep.juego));
+    bool   ventana = (rep.juego != motor);
+    string juego  = (motor == 'T') ? "tetris" : "snake";
+#ifndef USE_GDI
+    if (ventana) {
+        cerr << "[Repeticion] " << ruta << " se grabo en ventana: reproducir con un runtime compilado con -DUSE_GDI\n";
+        return 1;
+    }
+#endif
+    compilarJuegoSiPosible(juego);
+    if (hashArchivo("build/arbol.ast") != rep.hash_config) {
+        cerr << "[Repeticion] Aviso: la configuracion actual no es la de la grabacion\n";
+    }
+
+    DWORD inicio = GetTickCount();
+    ResumenPartida r;
+#ifdef USE_GDI
+    if (ventana && motor == 'T') {
+        ConfigTetris cfg;
+        r = reproducirTetrisGDI(cfg, rep, hasta);
+    } else if (ventana) {
+        SnakeEngineGDI s;
+        r = s.reproducir(rep, hasta);
+    } else
+#endif
+    if (motor == 'T') {
+        ConfigTetris cfg;
+        r = reproducirTetris(cfg, rep, hasta);
+    } else {
+        SnakeEngine s;
+        r = s.reproducir(rep, hasta);
+        s.renderizar();
+    }
+    DWORD ms = GetTickCount() - inicio;
+
+    cout << "\n[Repeticion] juego=" << juego
+         << (ventana ? " ventana" : "")
+         << " semilla=" << rep.semilla
+         << " teclas=" << rep.entradas.size()
+         << " duracion_ms=" << rep.duracion
+         << " hasta_ms=" << r.ticks
+         << " puntos=" << r.puntos
+         << " " << (motor == 'T' ? "lineas" : "frutas") << "=" << r.eventos
+         << (r.terminada ? " game_over" : "")
+         << " tiempo_real_ms=" << ms << "\n";
+    return 0;
+}
+
+// ============================================================================
+// FUNCIÓN: ejecutarLote
+// ============================================================================
+// Para cada configuración juega op.partidas partidas con semillas
+// consecutivas (a partir de --semilla, o 1) y muestra el resumen y el
+// rendimiento en partidas por segundo.
+// @param op Opciones leídas de la línea de comandos
+// @return Código de salida del proceso
+// ============================================================================
+static int ejecutarLote(OpcionesLote op) {
+    const string& juego = op.base.juego;
+    if (juego != "tetris" && juego != "snake") {
+        cerr << "[Lote] Juego desconocido: " << juego << " (usar tetris o snake)\n";
+        return 1;
+    }
+    if (op.configs.empty()) {
+        compilarJuegoSiPosible(juego);
+        op.configs.push_back("build/arbol.ast");
+    }
+    uint32_t    semilla_base = (semillaLineaComandos != 0) ? semillaLineaComandos : 1;
+    PoolTrabajo pool(op.hilos);
+
+    for (size_t c = 0; c < op.configs.size(); ++c) {
+        vector<ResumenPartida> resultados(op.partidas);
+        vector<string>         detalles;
+        DWORD inicio = GetTickCount();
+        if (juego == "tetris") {
+            detalles.push_back("simple");
+            detalles.push_back("doble");
+            detalles.push_back("triple");
+            detalles.push_back("tetris");
+            ConfigTetris cfg(op.configs[c]);
+            AccionLoteTetris accion(cfg, op.base, semilla_base, pool, resultados);
+            conTableroTetris(cfg, accion);
+        } else {
+            SnakeAST cfg;
+            if (!cfg.cargarDesdeAST(op.configs[c])) {
+                cerr << "[Lote] No se pudo leer " << op.configs[c] << ", se usan valores por defecto\n";
+            }
+            cfg.cargado = true;
+            TablaFrutas frutas;
+            frutas.compilar(cfg);
+            for (int i = 0; i < frutas.tamanio(); ++i) detalles.push_back(frutas[i].nombre);
+            jugarLoteSnake(cfg, op.base, semilla_base, pool, resultados);
+        }
+        DWORD ms = GetTickCount() - inicio;
+
+        cout << "[Lote] juego=" << juego << " config=" << op.configs[c]
+             << " bot=" << op.base.bot
+             << " partidas=" << op.partidas
+             << " hilos=" << pool.tamanio()
+             << " tiempo_real_ms=" << ms;
+        if (ms > 0) {
+            cout << " partidas_por_segundo=" << static_cast<long long>(op.partidas) * 1000 / ms;
+        }
+        cout << "\n";
+        imprimirResumenLote(juego, resultados, detalles);
+    }
+    return 0;
+}
+
+// ============================================================================
+// FUNCIÓN: ejecutarEntorno
+// ============================================================================
+// Mide el entorno vectorial: reparte los tableros en fragmentos (un
+// EntornoTetrisVectorial por hilo) y avanza cada uno op.pasos pasos con
+// acciones aleatorias. Muestra pasos por segundo, partidas y líneas, que
+// son los mismos para cualquier --hilos con la misma semilla.
+// @param op Opciones leídas de la línea de comandos
+// @return Código de salida del proceso
+// ============================================================================
+struct OpcionesEntorno {
+    int  tableros;  // Tableros en total
+    long pasos;     // Pasos por tablero
+    int  hilos;     // 0 = todos los núcleos
+
+    OpcionesEntorno() : tableros(0), pasos(10000), hilos(0) {}
+};
+
+// Desplazamiento de las semillas de acciones respecto a las de piezas (semilla + b)
+static const uint32_t SEMILLA_ACCIONES_ENTORNO = 0x6A09E667u;
+
+static int ejecutarEntorno(const OpcionesEntorno& op) {
+    compilarJuegoSiPosible("tetris");
+    ConfigTetris cfg;
+    uint32_t     semilla_base = (semillaLineaComandos != 0) ? semillaLineaComandos : 1;
+    PoolTrabajo  pool(op.hilos);
+
+    // Un fragmento por hilo; cada fragmento es un entorno independiente
+    const int fragmentos = min(pool.tamanio(), op.tableros);
+    vector<long> partidas(fragmentos, 0);
+    vector<long> lineas(fragmentos, 0);
+    DWORD inicio = GetTickCount();
+    pool.paraCada(fragmentos, [&](long f, int) {
+        int desde = static_cast<int>(static_cast<long>(op.tableros) * f / fragmentos);
+        int hasta = static_cast<int>(static_cast<long>(op.tableros) * (f + 1) / fragmentos);
+        EntornoTetrisVectorial entorno(cfg, hasta - desde, semilla_base + static_cast<uint32_t>(desde));
+        // Las acciones aleatorias de cada tablero salen de su propio
+        // generador, sembrado por su índice global: el resultado no depende
+        // de cómo se repartan los tableros entre hilos
+        vector<GeneradorAleatorio> acciones_aleatorias;
+        for (int b = desde; b < hasta; ++b) {
+            acciones_aleatorias.push_back(GeneradorAleatorio(semilla_base + SEMILLA_ACCIONES_ENTORNO + static_cast<uint32_t>(b)));
+        }
+        vector<unsigned char> acciones(entorno.tamanio());
+        for (long p = 0; p < op.pasos; ++p) {
+            for (size_t b = 0; b < acciones.size(); ++b) {
+                acciones[b] = static_cast<unsigned char>(acciones_aleatorias[b].rango(NUM_ACCIONES_TETRIS));
+            }
+            entorno.paso(&acciones[0]);
+        }
+        partidas[f] = entorno.partidasTerminadas();
+        for (int b = 0; b < entorno.tamanio(); ++b) lineas[f] += entorno.lineas()[b];
+    });
+    DWORD ms = GetTickCount() - inicio;
+
+    long long pasos_totales = static_cast<long long>(op.tableros) * op.pasos;
+    long partidas_totales = 0, lineas_en_curso = 0;
+    for (int f = 0; f < fragmentos; ++f) {
+        partidas_totales += partidas[f];
+        lineas_en_curso  += lineas[f];
+    }
+    cout << "[Entorno] tableros=" << op.tableros
+         << " pasos=" << op.pasos
+         << " hilos=" << fragmentos
+#ifdef RUNTIME_SSE2
+         << " simd=sse2"
+#else
+         << " simd=no"
+#endif
+         << " partidas_terminadas=" << partidas_totales
+         << " lineas_en_curso=" << lineas_en_curso << "\n";
+    cout << "[Entorno] tiempo_real_ms=" << ms;
+    if (ms > 0) {
+        cout << " pasos_por_segundo=" << pasos_totales * 1000 / ms;
+    }
+    cout << "\n";
+    return 0;
+}
+
+// ============================================================================
+// FUNCIÓN: ejecutarArena
+// ============================================================================
+// Juega la arena de Snake (--arena N) con la configuración compilada y la
+// política de --bot para todas las serpientes. Muestra muertes, frutas y
+// serpiente más larga, decisiones por segundo y la huella del estado final,
+// que debe coincidir para cualquier --hilos con la misma semilla.
+// @param op   Serpientes, ticks e hilos
+// @param base Política (--bot, --guion)
+// @return Código de salida del proceso
+// ============================================================================
+static int ejecutarArena(const OpcionesArena& op, const OpcionesHeadless& base) {
+    compilarJuegoSiPosible("snake");
+    SnakeAST cfg;
+    if (!cfg.cargarDesdeAST("build/arbol.ast")) {
+        cerr << "[Arena] No se pudo leer build/arbol.ast, se usan valores por defecto\n";
+    }
+    cfg.cargado = true;
+    uint32_t   semilla = (semillaLineaComandos != 0) ? semillaLineaComandos : 1;
+    ArenaSnake arena(cfg, base, op.serpientes, semilla);
+
+    DWORD inicio = GetTickCount();
+    ResultadoSimulacion r = arena.simular(op.ticks, op.hilos);
+    DWORD ms = GetTickCount() - inicio;
+
+    cout << "[Arena] serpientes=" << op.serpientes
+         << " tablero=" << arena.anchoTablero() << "x" << arena.altoTablero()
+         << " bot=" << base.bot
+         << " ticks=" << r.ticks
+         << " vivas=" << arena.vivas()
+         << " muertes=" << r.partidas
+         << " frutas=" << arena.frutasComidas()
+         << " mejor_puntaje=" << r.mejor_puntaje
+         << " puntos_en_curso=" << r.puntos_en_curso
+         << " mas_larga=" << arena.masLarga() << "\n";
+    cout << "[Arena] tiempo_real_ms=" << ms;
+    if (ms > 0) {
+        cout << " decisiones_por_segundo=" << static_cast<long long>(r.ticks) * op.serpientes * 1000 / ms;
+    }
+    cout << " huella=" << std::hex << arena.huella() << std::dec << "\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    // Opciones de línea de comandos:
+    //   --semilla N        fija la semilla de la partida
+    //   --headless JUEGO   simula tetris|snake sin render ni teclado
+    //   --ticks N          ticks a simular en modo headless
+    //   --tick-ms N        milisegundos virtuales por tick
+    //   --guion TECLAS     una tecla por tick ('.' = ninguna), se repite
+    //   --bot NOMBRE       política que juega: guion, aleatorio,
+    //                      colocacion / haz (Tetris), voraz / ruta (Snake)
+    //   --lote JUEGO       juega muchas partidas y resume estadísticas
+    //   --partidas N       partidas por configuración en modo lote
+    //   --hilos N          hilos del lote (0 = todos los núcleos)
+    //   --profundidad N    piezas que mira por delante el bot haz
+    //   --config RUTA      archivo AST a evaluar en el lote (repetible)
+    //   --entorno N        avanza N tableros de Tetris a la vez (entorno vectorial)
+    //   --pasos N          pasos por tablero del entorno vectorial
+    //   --arena N          N serpientes en un mismo tablero (prueba de carga)
+    //   --grabar RUTA      graba la partida (consola o headless) en RUTA
+    //   --reproducir RUTA  vuelve a simular una repetición y muestra el final
+    //   --hasta MS         con --reproducir, se detiene en ese instante
+    OpcionesHeadless headless;
+    OpcionesLote     lote;
+    OpcionesEntorno  entorno;
+    OpcionesArena    arena;
+    bool             modo_lote = false;
+    string           ruta_repeticion;
+    DWORD            hasta_ms = 0xFFFFFFFFu;
+    for (int i = 1; i < argc; ++i) {
+        string arg(argv[i]);
+        bool hay_valor = (i + 1 < argc);
+        if (arg == "--semilla" && hay_valor) {
+            semillaLineaComandos = static_cast<unsigned int>(strtoul(argv[++i], NULL, 10));
+        } else if (arg == "--headless" && hay_valor) {
+            headless.juego = argv[++i];
+        } else if (arg == "--ticks" && hay_valor) {
+            headless.ticks = atol(argv[++i]);
+            arena.ticks    = headless.ticks;
+        } else if (arg == "--tick-ms" && hay_valor) {
+            headless.tick_ms = max(1, atoi(argv[++i]));
+        } else if (arg == "--guion" && hay_valor) {
+            headless.guion = argv[++i];
+        } else if (arg == "--bot" && hay_valor) {
+            headless.bot = argv[++i];
+        } else if (arg == "--lote" && hay_valor) {
+            headless.juego = argv[++i];
+            modo_lote = true;
+        } else if (arg == "--partidas" && hay_valor) {
+            lote.partidas = max(1L, atol(argv[++i]));
+        } else if (arg == "--hilos" && hay_valor) {
+            lote.hilos    = atoi(argv[++i]);
+            entorno.hilos = lote.hilos;
+            arena.hilos   = lote.hilos;
+        } else if (arg == "--profundidad" && hay_valor) {
+            headless.profundidad = max(1, atoi(argv[++i]));
+        } else if (arg == "--config" && hay_valor) {
+            lote.configs.push_back(argv[++i]);
+        } else if (arg == "--entorno" && hay_valor) {
+            entorno.tableros = max(1, atoi(argv[++i]));
+        } else if (arg == "--pasos" && hay_valor) {
+            entorno.pasos = max(1L, atol(argv[++i]));
+        } else if (arg == "--arena" && hay_valor) {
+            arena.serpientes = max(1, atoi(argv[++i]));
+        } else if (arg == "--grabar" && hay_valor) {
+            headless.grabar = argv[++i];
+        } else if (arg == "--reproducir" && hay_valor) {
+            ruta_repeticion = argv[++i];
+        } else if (arg == "--hasta" && hay_valor) {
+            hasta_ms = static_cast<DWORD>(strtoul(argv[++i], NULL, 10));
+        }
+    }
+    if (!ruta_repeticion.empty()) {
+        return ejecutarRepeticion(ruta_repeticion, hasta_ms);
+    }
+    if (entorno.tableros > 0) {
+        return ejecutarEntorno(entorno);
+    }
+    if (arena.serpientes > 0) {
+        return ejecutarArena(arena, headless);
+    }
+    if (modo_lote) {
+        lote.base = headless;
+        return ejecutarLote(lote);
+    }
+    if (!headless.juego.empty()) {
+        return ejecutarHeadless(headless);
+    }
+
     cout << "============================================\n";
     cout << "           RUNTIME - SELECCION DE JUEGO\n";
     cout << "============================================\n";
@@ -3005,6 +8700,9 @@ int main(){
         case 1: {
             cout << "Compilando configuracion de Tetris y lanzando juego...\n";
             compilarJuegoSiPosible("tetris");
+            // Las partidas de consola se graban siempre (ver --reproducir)
+            GrabadorRepeticion grabador(headless.grabar.empty() ? "build/repeticion_tetris.rpl" : headless.grabar,
+                                        'T', "build/arbol.ast");
             // Ejecutar la versión gráfica adecuada si se seleccionó MODO_VENTANA
 #ifdef USE_GDI
             if (modoActual == MODO_VENTANA) {
@@ -3030,22 +8728,20 @@ int main(){
                     std::cout << "[Tetris GDI] Window would overflow screen; scaling cell from " << cfg.tamanio_celda << " to " << forced_cell << std::endl;
                 }
                 if (createGDIWindow("Tetris - Motor de Ladrillos (GDI)", desired_w, desired_h)) {
-                    TetrisEngineGDI engine(forced_cell);
-                    std::cout << "[Tetris GDI] Starting with window " << desired_w << "x" << desired_h << ", cell=" << engine.cell << std::endl;
-                    engine.run();
+                    std::cout << "[Tetris GDI] Starting with window " << desired_w << "x" << desired_h << ", cell=" << forced_cell << std::endl;
+                    ejecutarTetrisGDI(cfg, forced_cell, &grabador);
                 } else {
                     // Fallback a consola
-                    TetrisEngine t;
-                    t.ejecutar();
+                    ejecutarTetrisConsola(cfg, &grabador);
                 }
             } else {
-                TetrisEngine t;
-                t.ejecutar();
+                ConfigTetris cfg;
+                ejecutarTetrisConsola(cfg, &grabador);
             }
 #else
             {
-                TetrisEngine t;
-                t.ejecutar();
+                ConfigTetris cfg;
+                ejecutarTetrisConsola(cfg, &grabador);
             }
 #endif
             cout << "\nGracias por jugar Tetris!\n";
@@ -3054,24 +8750,26 @@ int main(){
         case 2: {
             cout << "Compilando configuracion de Snake y lanzando juego...\n";
             compilarJuegoSiPosible("snake");
+            GrabadorRepeticion grabador(headless.grabar.empty() ? "build/repeticion_snake.rpl" : headless.grabar,
+                                        'S', "build/arbol.ast");
             // Ejecutar la versión gráfica adecuada si se seleccionó MODO_VENTANA
 #ifdef USE_GDI
             if (modoActual == MODO_VENTANA) {
                 if (createGDIWindow("Snake - Motor de Ladrillos (GDI)", 900, 700)) {
                     SnakeEngineGDI engine;
-                    engine.run();
+                    engine.run(&grabador);
                 } else {
                     SnakeEngine s;
-                    s.ejecutar();
+                    s.ejecutar(&grabador);
                 }
             } else {
                 SnakeEngine s;
-                s.ejecutar();
+                s.ejecutar(&grabador);
             }
 #else
             {
                 SnakeEngine s;
-                s.ejecutar();
+                s.ejecutar(&grabador);
             }
 #endif
             cout << "\nGracias por jugar Snake!\n";